@@ -0,0 +1,403 @@
+/***********************************************************************
+ * Copyright 2020 by the California Institute of Technology
+ * ALL RIGHTS RESERVED. United States Government Sponsorship acknowledged.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file        demosaic_bench.c
+ * @brief       Throughput benchmark for the demosaic functions
+ *
+ * Sweeps image sizes, the six output types, and the row and whole-image
+ * functions, the latter also with non-temporal output stores. Each case is
+ * run for some warmup iterations, then timed with a monotonic wall clock
+ * for the measured iterations. Results are written one line per case, as
+ * csv (default) or json lines, for tracking regressions.
+ *
+ * usage: demosaic_bench [-i iters] [-w warmup] [-s size] [-f csv|json]
+ *                       [-e engine]
+ *        size is one of vga, 1080p, 4k, 8k, or all (default)
+ *        engine is one of auto (default), scalar, sse2, sse41, avx2, neon
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <demosaic/demosaic_types_pub.h>
+#include <demosaic/demosaic_pub.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    const char * name;
+    I32 n_rows;
+    I32 n_cols;
+} bench_size;
+
+static const bench_size bench_sizes[] = {
+    {"vga", 480, 640},
+    {"1080p", 1080, 1920},
+    {"4k", 2160, 3840},
+    {"8k", 4320, 7680},
+};
+
+#define BENCH_N_SIZES ((I32) (sizeof(bench_sizes) / sizeof(bench_sizes[0])))
+
+typedef enum {
+    BENCH_RGB16,
+    BENCH_RGB8,
+    BENCH_RGB16TO8,
+    BENCH_MONO16,
+    BENCH_MONO8,
+    BENCH_MONO16TO8,
+    BENCH_N_VARIANTS
+} bench_variant;
+
+static const char * const bench_variant_names[BENCH_N_VARIANTS] = {
+    "rgb16", "rgb8", "rgb16to8", "mono16", "mono8", "mono16to8"
+};
+
+// image_nt is the whole-image *_plan functions with DEMOSAIC_STORE_STREAMING
+typedef enum {
+    BENCH_API_IMAGE,
+    BENCH_API_ROW,
+    BENCH_API_IMAGE_NT,
+    BENCH_N_APIS
+} bench_api;
+
+static const char * const bench_api_names[BENCH_N_APIS] = {
+    "image", "row", "image_nt"
+};
+
+// names of the demosaic_engine values, in order
+static const char * const bench_engine_names[] = {
+    "auto", "scalar", "sse2", "sse41", "avx2", "neon"
+};
+
+#define BENCH_N_ENGINES \
+    ((I32) (sizeof(bench_engine_names) / sizeof(bench_engine_names[0])))
+
+// inputs and outputs for one image size, sized for the largest output
+typedef struct {
+    demosaic_args args16;   // 12-bit input, shifted by 4 to 8-bit
+    demosaic_args args8;    // 8-bit input
+    demosaic_plan plan16;   // of args16, with streaming stores
+    demosaic_plan plan8;    // of args8, with streaming stores
+    U16 * bayer16;
+    U8 * bayer8;
+    void * output;
+} bench_bufs;
+
+static F64 bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (F64) ts.tv_sec + (F64) ts.tv_nsec * 1e-9;
+}
+
+static int bench_compare_f64(const void * a, const void * b)
+{
+    const F64 x = *(const F64 *) a;
+    const F64 y = *(const F64 *) b;
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of sorted times
+static F64 bench_percentile(const F64 * sorted, I32 n, I32 pct)
+{
+    I32 rank = (pct * n + 99) / 100;
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[rank - 1];
+}
+
+// fill bayer images with a repeatable pseudo-random pattern
+static void bench_fill(bench_bufs * bufs)
+{
+    const I32 n_pix = bufs->args16.n_rows * bufs->args16.n_cols;
+    uint32_t state = 12345u;
+    for (I32 i = 0; i < n_pix; i++) {
+        state = state * 1103515245u + 12345u;
+        bufs->bayer16[i] = (U16) ((state >> 16) & bufs->args16.max_val);
+        bufs->bayer8[i] = (U8) ((state >> 16) & bufs->args8.max_val);
+    }
+}
+
+static void bench_run_image(const bench_bufs * bufs, bench_variant variant)
+{
+    switch (variant) {
+    case BENCH_RGB16:
+        demosaic_malvar_rgb16(bufs->bayer16, &bufs->args16,
+                (demosaic_pix_rgb16 *) bufs->output);
+        break;
+    case BENCH_RGB8:
+        demosaic_malvar_rgb8(bufs->bayer8, &bufs->args8,
+                (demosaic_pix_rgb8 *) bufs->output);
+        break;
+    case BENCH_RGB16TO8:
+        demosaic_malvar_rgb16to8(bufs->bayer16, &bufs->args16,
+                (demosaic_pix_rgb8 *) bufs->output);
+        break;
+    case BENCH_MONO16:
+        demosaic_malvar_mono16(bufs->bayer16, &bufs->args16,
+                (U16 *) bufs->output);
+        break;
+    case BENCH_MONO8:
+        demosaic_malvar_mono8(bufs->bayer8, &bufs->args8,
+                (U8 *) bufs->output);
+        break;
+    default:
+        demosaic_malvar_mono16to8(bufs->bayer16, &bufs->args16,
+                (U8 *) bufs->output);
+        break;
+    }
+}
+
+static void bench_run_image_nt(const bench_bufs * bufs, bench_variant variant)
+{
+    switch (variant) {
+    case BENCH_RGB16:
+        demosaic_malvar_rgb16_plan(bufs->bayer16, &bufs->plan16,
+                (demosaic_pix_rgb16 *) bufs->output);
+        break;
+    case BENCH_RGB8:
+        demosaic_malvar_rgb8_plan(bufs->bayer8, &bufs->plan8,
+                (demosaic_pix_rgb8 *) bufs->output);
+        break;
+    case BENCH_RGB16TO8:
+        demosaic_malvar_rgb16to8_plan(bufs->bayer16, &bufs->plan16,
+                (demosaic_pix_rgb8 *) bufs->output);
+        break;
+    case BENCH_MONO16:
+        demosaic_malvar_mono16_plan(bufs->bayer16, &bufs->plan16,
+                (U16 *) bufs->output);
+        break;
+    case BENCH_MONO8:
+        demosaic_malvar_mono8_plan(bufs->bayer8, &bufs->plan8,
+                (U8 *) bufs->output);
+        break;
+    default:
+        demosaic_malvar_mono16to8_plan(bufs->bayer16, &bufs->plan16,
+                (U8 *) bufs->output);
+        break;
+    }
+}
+
+static void bench_run_rows(const bench_bufs * bufs, bench_variant variant)
+{
+    const I32 n_rows = bufs->args16.n_rows;
+    const I32 n_cols = bufs->args16.n_cols;
+    for (I32 row = 0; row < n_rows; row++) {
+        const I32 offset = row * n_cols;
+        switch (variant) {
+        case BENCH_RGB16:
+            demosaic_malvar_row_rgb16(bufs->bayer16, &bufs->args16, row,
+                    &((demosaic_pix_rgb16 *) bufs->output)[offset]);
+            break;
+        case BENCH_RGB8:
+            demosaic_malvar_row_rgb8(bufs->bayer8, &bufs->args8, row,
+                    &((demosaic_pix_rgb8 *) bufs->output)[offset]);
+            break;
+        case BENCH_RGB16TO8:
+            demosaic_malvar_row_rgb16to8(bufs->bayer16, &bufs->args16, row,
+                    &((demosaic_pix_rgb8 *) bufs->output)[offset]);
+            break;
+        case BENCH_MONO16:
+            demosaic_malvar_row_mono16(bufs->bayer16, &bufs->args16, row,
+                    &((U16 *) bufs->output)[offset]);
+            break;
+        case BENCH_MONO8:
+            demosaic_malvar_row_mono8(bufs->bayer8, &bufs->args8, row,
+                    &((U8 *) bufs->output)[offset]);
+            break;
+        default:
+            demosaic_malvar_row_mono16to8(bufs->bayer16, &bufs->args16, row,
+                    &((U8 *) bufs->output)[offset]);
+            break;
+        }
+    }
+}
+
+static void bench_report(const char * format, const bench_size * size,
+        bench_variant variant, bench_api api, demosaic_engine engine,
+        F64 * times, I32 iters)
+{
+    const F64 mpix = (F64) size->n_rows * (F64) size->n_cols * 1e-6;
+    qsort(times, (size_t) iters, sizeof(F64), bench_compare_f64);
+    const F64 min_s = times[0];
+    const F64 p50_s = bench_percentile(times, iters, 50);
+    const F64 p90_s = bench_percentile(times, iters, 90);
+    const F64 max_s = times[iters - 1];
+
+    if (strcmp(format, "json") == 0) {
+        printf("{\"size\": \"%s\", \"n_rows\": %d, \"n_cols\": %d, "
+                "\"variant\": \"%s\", \"api\": \"%s\", \"engine\": \"%s\", "
+                "\"iters\": %d, "
+                "\"min_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, "
+                "\"max_ms\": %.4f, \"mpix_s_p50\": %.2f, "
+                "\"mpix_s_max\": %.2f}\n",
+                size->name, (int) size->n_rows, (int) size->n_cols,
+                bench_variant_names[variant], bench_api_names[api],
+                bench_engine_names[engine], (int) iters,
+                min_s * 1e3, p50_s * 1e3, p90_s * 1e3, max_s * 1e3,
+                mpix / p50_s, mpix / min_s);
+    } else {
+        printf("%s,%d,%d,%s,%s,%s,%d,%.4f,%.4f,%.4f,%.4f,%.2f,%.2f\n",
+                size->name, (int) size->n_rows, (int) size->n_cols,
+                bench_variant_names[variant], bench_api_names[api],
+                bench_engine_names[engine], (int) iters,
+                min_s * 1e3, p50_s * 1e3, p90_s * 1e3, max_s * 1e3,
+                mpix / p50_s, mpix / min_s);
+    }
+    fflush(stdout);
+}
+
+static void bench_usage(const char * prog)
+{
+    fprintf(stderr, "usage: %s [-i iters] [-w warmup] [-s size] "
+            "[-f csv|json] [-e engine]\n  size: vga, 1080p, 4k, 8k, or all\n"
+            "  engine: auto, scalar, sse2, sse41, avx2, or neon\n", prog);
+}
+
+int main(int argc, char ** argv)
+{
+    I32 iters = 10;
+    I32 warmup = 2;
+    const char * size_name = "all";
+    const char * format = "csv";
+    const char * engine_name = "auto";
+    I32 engine = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:w:s:f:e:h")) != -1) {
+        switch (opt) {
+        case 'i':
+            iters = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 's':
+            size_name = optarg;
+            break;
+        case 'f':
+            format = optarg;
+            break;
+        case 'e':
+            engine_name = optarg;
+            break;
+        default:
+            bench_usage(argv[0]);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+    for (I32 e = 0; e < BENCH_N_ENGINES; e++) {
+        if (strcmp(engine_name, bench_engine_names[e]) == 0) {
+            engine = e;
+        }
+    }
+    if (iters < 1 || warmup < 0 || engine < 0
+            || (strcmp(format, "csv") != 0 && strcmp(format, "json") != 0)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+    if (demosaic_engine_supported((demosaic_engine) engine) == 0) {
+        fprintf(stderr, "engine %s not supported on this host\n",
+                engine_name);
+        return 1;
+    }
+    const demosaic_engine active =
+            demosaic_engine_init((demosaic_engine) engine);
+
+    F64 * times = (F64 *) malloc((size_t) iters * sizeof(F64));
+    if (times == NULL) {
+        fprintf(stderr, "allocation failed\n");
+        return 1;
+    }
+
+    if (strcmp(format, "csv") == 0) {
+        printf("size,n_rows,n_cols,variant,api,engine,iters,"
+                "min_ms,p50_ms,p90_ms,max_ms,mpix_s_p50,mpix_s_max\n");
+    }
+
+    I32 n_run = 0;
+    for (I32 s = 0; s < BENCH_N_SIZES; s++) {
+        const bench_size * size = &bench_sizes[s];
+        if (strcmp(size_name, "all") != 0
+                && strcmp(size_name, size->name) != 0) {
+            continue;
+        }
+
+        bench_bufs bufs;
+        const size_t n_pix = (size_t) size->n_rows * (size_t) size->n_cols;
+        // rshift 4, ccir 601 weights, rggb, no calibration, ccm or lut
+        demosaic_args_init(&bufs.args16, size->n_rows, size->n_cols, 0x0FFF);
+        bufs.args8 = bufs.args16;
+        bufs.args8.max_val = 0xFF;
+        bufs.args8.rshift = 0;
+        demosaic_plan_init(&bufs.plan16, &bufs.args16);
+        bufs.plan16.store = DEMOSAIC_STORE_STREAMING;
+        demosaic_plan_init(&bufs.plan8, &bufs.args8);
+        bufs.plan8.store = DEMOSAIC_STORE_STREAMING;
+        bufs.bayer16 = (U16 *) malloc(n_pix * sizeof(U16));
+        bufs.bayer8 = (U8 *) malloc(n_pix * sizeof(U8));
+        bufs.output = malloc(n_pix * sizeof(demosaic_pix_rgb16));
+        if (bufs.bayer16 == NULL || bufs.bayer8 == NULL
+                || bufs.output == NULL) {
+            fprintf(stderr, "allocation failed for %s\n", size->name);
+            free(bufs.bayer16);
+            free(bufs.bayer8);
+            free(bufs.output);
+            free(times);
+            return 1;
+        }
+        bench_fill(&bufs);
+
+        for (I32 v = 0; v < BENCH_N_VARIANTS; v++) {
+            for (I32 a = 0; a < BENCH_N_APIS; a++) {
+                for (I32 i = -warmup; i < iters; i++) {
+                    const F64 start = bench_now();
+                    if (a == BENCH_API_ROW) {
+                        bench_run_rows(&bufs, (bench_variant) v);
+                    } else if (a == BENCH_API_IMAGE_NT) {
+                        bench_run_image_nt(&bufs, (bench_variant) v);
+                    } else {
+                        bench_run_image(&bufs, (bench_variant) v);
+                    }
+                    if (i >= 0) {
+                        times[i] = bench_now() - start;
+                    }
+                }
+                bench_report(format, size, (bench_variant) v,
+                        (bench_api) a, active, times, iters);
+            }
+        }
+        ++n_run;
+
+        free(bufs.bayer16);
+        free(bufs.bayer8);
+        free(bufs.output);
+    }
+    free(times);
+
+    if (n_run == 0) {
+        fprintf(stderr, "unknown size %s\n", size_name);
+        bench_usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
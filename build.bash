@@ -34,6 +34,11 @@ else
     cmake -DCMAKE_BUILD_TYPE=Test ..
     make
     make test ARGS="-V"
+  elif [[ "$1" = "bench" ]] ; then
+    echo "Building and running demosaic benchmark"
+    cmake -DCMAKE_BUILD_TYPE=Bench ..
+    make
+    ./demosaic_bench
   elif [[ "$1" = "cobra" ]] ; then
     echo "Running cobra tests (assumes cobra is configured)"
   	cobra -f basic -I$source_path/include $source_path/src/*.c
@@ -67,6 +67,69 @@ extern "C" {
     "ASSERT in file %s, line %d, arg1 = %f.", \
     __FILE__, __LINE__, (double)(arg1))
 
+/* Vectorized kernels for the image interior.
+   If DEMOSAIC_SIMD is nonzero, the interior of each row is demosaiced
+   several pixels at a time by a vector engine, with output identical to the
+   scalar kernels. On x86-64, the SSE2, SSE4.1 and AVX2 engines are compiled
+   with target attributes, so no -m flags are needed, and
+   demosaic_engine_init() selects one at run time from the CPU's features.
+   On ARM, the NEON engine is compiled only if the compiler targets NEON
+   (e.g. with -mfpu=neon).
+   Define as 0 to always use the scalar kernels, which are the reference.
+ */
+#define DEMOSAIC_SIMD 1
+
+/* Running sums for the scalar interior.
+   If DEMOSAIC_RUNNING_SUMS is nonzero, the scalar kernels for the interior
+   of each row slide a window of center line pixels and vertical sums
+   along it, so each loaded pixel and sum serves adjacent pixels, rather
+   than loading all 11 taps of every pixel. Output is identical. This suits
+   processors without SIMD, where it loads less than half as many pixels.
+   Compilers that vectorize the per-pixel loads, such as GCC for x86-64
+   at -O2, run the scalar 16-bit rgb kernel faster without it, so this
+   configuration loads the taps of each pixel. Define as nonzero for
+   processors without SIMD or compilers that do not vectorize.
+ */
+#define DEMOSAIC_RUNNING_SUMS 0
+
+/* Fixed-point luma for the mono functions.
+   If DEMOSAIC_FIXED_POINT_LUMA is nonzero, luma coefficients are converted
+   once per call to integer weights, and each pixel's luma is computed with
+   integer multiplies, adds and shifts, for processors without an FPU.
+   Luma is within 1 + 2.5 * max_val / 32768 of the F64 result.
+   Define as 0 to compute luma in F64.
+ */
+#define DEMOSAIC_FIXED_POINT_LUMA 0
+
+/* Reference functions.
+   If DEMOSAIC_REFERENCE is nonzero, demosaic.c also compiles the per-pixel
+   functions demosaic_malvar_row_*_unoptimized, which mirror every tap with
+   bounds checks. The unit tests compare all other functions against them.
+   Define as 0 in production, where they would be unused.
+ */
+#define DEMOSAIC_REFERENCE 0
+
+/* Instrumentation hooks.
+   If DEMOSAIC_INSTRUMENT is nonzero, demosaic.c calls these hooks for each
+   stage of a demosaic_stage: the whole-image functions, the top and bottom
+   two rows, the left and right two columns, and the interior.
+        DEMOSAIC_STAGE_BEGIN(stage) when a stage starts
+        DEMOSAIC_STAGE_END(stage, n_pixels) when it ends, with the number
+            of pixels it demosaiced
+        DEMOSAIC_STAGE_CLAMPS(stage, n_clamped) after each stage but the
+            image, with the number of interpolated values clamped
+            to [0, max_val].
+   The image stage encloses the others, which do not overlap, so a per-stage
+   start time is enough to time them. Hooks are called once per row and
+   side, not per pixel, and must be thread safe if rows are demosaiced
+   in parallel.
+   For instance, they might record ros::WallTime::now() at each begin, and
+   accumulate durations and counts per stage for a diagnostics publisher.
+   Define as 0 to compile the hooks to nothing, in which case they need not
+   be defined.
+ */
+#define DEMOSAIC_INSTRUMENT 0
+
 #ifdef __cplusplus
 }
 #endif
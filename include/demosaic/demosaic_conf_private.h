@@ -0,0 +1,162 @@
+/***********************************************************************
+ * Copyright 2020 by the California Institute of Technology
+ * ALL RIGHTS RESERVED. United States Government Sponsorship acknowledged.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file        demosaic_test_private.h
+ * @date        2020-06-05
+ * @author      Neil Abcouwer
+ * @brief       Definition private macros for demosaic functions
+ *
+ * A user must provide a demosaic_conf_private.h to define the following macros.
+ * This file is copied for unit testing.
+ */
+
+#ifndef DEMOSAIC_CONF_PRIVATE_H
+#define DEMOSAIC_CONF_PRIVATE_H
+
+#include <assert.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// private demosacic functions are preceded by DEMOSAIC_PRIVATE
+// this can be defined as 0 when compiling unit tests to allow access
+// if your infrastructure does something similar, replace it here
+#ifndef DEMOSAIC_PRIVATE
+#define DEMOSAIC_PRIVATE static
+#endif
+
+/* This library was written with the philosophy that assertions be used to
+   check anomalous conditions. Demosaic functions assert if inputs
+   indicate there is a logic error.
+   See http://spinroot.com/p10/rule5.html.
+
+   This file defines the DEMOSAIC_ASSERT macros used in demosaic.c as simple
+   c asserts, for testing. THe google test suite for the repo uses
+   "death tests" to test that they are called appropriately.
+
+   It is the intent that user of the demosaic library will copy an
+   appropriate demosaic_conf.h to include/demosaic, such that asserts
+   are defined appropriately for the application.
+
+   Possible asserts:
+        cstd assers
+        ROS_ASSERT
+        BOOST_ASSERT
+        (test) ? (void)(0)
+               : send_asynchronous_safing_alert_to_other_process(), assert(0):
+
+   Asserts could also be disabled, but this is is discouraged.
+ */
+#define DEMOSAIC_ASSERT(test) assert(test)
+#define DEMOSAIC_ASSERT_1(test, arg1) assert(test)
+#define DEMOSAIC_ASSERT_2(test, arg1, arg2) assert(test)
+#define DEMOSAIC_ASSERT_DBL_1(test, arg1) assert(test)
+
+/* Vectorized kernels for the image interior.
+   If DEMOSAIC_SIMD is nonzero, the interior of each row is demosaiced
+   several pixels at a time by a vector engine, with output identical to the
+   scalar kernels. On x86-64, the SSE2, SSE4.1 and AVX2 engines are compiled
+   with target attributes, so no -m flags are needed, and
+   demosaic_engine_init() selects one at run time from the CPU's features.
+   On ARM, the NEON engine is compiled only if the compiler targets NEON
+   (e.g. with -mfpu=neon).
+   Define as 0 to always use the scalar kernels, which are the reference.
+   The demosaic_gtest_scalar test defines it and DEMOSAIC_RUNNING_SUMS
+   as 0 when compiling.
+ */
+#ifndef DEMOSAIC_SIMD
+#define DEMOSAIC_SIMD 1
+#endif
+
+/* Running sums for the scalar interior.
+   If DEMOSAIC_RUNNING_SUMS is nonzero, the scalar kernels for the interior
+   of each row slide a window of center line pixels and vertical sums
+   along it, so each loaded pixel and sum serves adjacent pixels, rather
+   than loading all 11 taps of every pixel. Output is identical. This suits
+   processors without SIMD, where it loads less than half as many pixels.
+   Compilers that vectorize the per-pixel loads, such as GCC for x86-64
+   at -O2, may run the scalar 16-bit rgb kernel faster without it.
+   Define as 0 to load the taps of each pixel.
+ */
+#ifndef DEMOSAIC_RUNNING_SUMS
+#define DEMOSAIC_RUNNING_SUMS 1
+#endif
+
+/* Fixed-point luma for the mono functions.
+   If DEMOSAIC_FIXED_POINT_LUMA is nonzero, luma coefficients are converted
+   once per call to integer weights, and each pixel's luma is computed with
+   integer multiplies, adds and shifts, for processors without an FPU.
+   Luma is within 1 + 2.5 * max_val / 32768 of the F64 result.
+   Define as 0 to compute luma in F64. The demosaic_gtest_f64 test
+   defines it as 0 when compiling.
+ */
+#ifndef DEMOSAIC_FIXED_POINT_LUMA
+#define DEMOSAIC_FIXED_POINT_LUMA 1
+#endif
+
+/* Reference functions.
+   If DEMOSAIC_REFERENCE is nonzero, demosaic.c also compiles the per-pixel
+   functions demosaic_malvar_row_*_unoptimized, which mirror every tap with
+   bounds checks. The unit tests compare all other functions against them.
+   Define as 0 in production, where they would be unused. The benchmark
+   uses this configuration with DEMOSAIC_PRIVATE static, and defines it as
+   0 when compiling.
+ */
+#ifndef DEMOSAIC_REFERENCE
+#define DEMOSAIC_REFERENCE 1
+#endif
+
+/* Instrumentation hooks.
+   If DEMOSAIC_INSTRUMENT is nonzero, demosaic.c calls these hooks for each
+   stage of a demosaic_stage: the whole-image functions, the top and bottom
+   two rows, the left and right two columns, and the interior.
+        DEMOSAIC_STAGE_BEGIN(stage) when a stage starts
+        DEMOSAIC_STAGE_END(stage, n_pixels) when it ends, with the number
+            of pixels it demosaiced
+        DEMOSAIC_STAGE_CLAMPS(stage, n_clamped) after each stage but the
+            image, with the number of interpolated values clamped
+            to [0, max_val].
+   The image stage encloses the others, which do not overlap, so a per-stage
+   start time is enough to time them. Hooks are called once per row and
+   side, not per pixel, and must be thread safe if rows are demosaiced
+   in parallel.
+   The unit tests define DEMOSAIC_INSTRUMENT as 1 when compiling, and
+   tally stages in functions defined by the test. Otherwise, such as for the
+   benchmark, it defaults to 0.
+   Define as 0 to compile the hooks to nothing, in which case they need not
+   be defined.
+ */
+#ifndef DEMOSAIC_INSTRUMENT
+#define DEMOSAIC_INSTRUMENT 0
+#endif
+
+#if DEMOSAIC_INSTRUMENT != 0
+void demosaic_test_stage_begin(int stage);
+void demosaic_test_stage_end(int stage, int n_pixels);
+void demosaic_test_stage_clamps(int stage, int n_clamped);
+#define DEMOSAIC_STAGE_BEGIN(stage) demosaic_test_stage_begin((int) (stage))
+#define DEMOSAIC_STAGE_END(stage, n_pixels) \
+    demosaic_test_stage_end((int) (stage), (int) (n_pixels))
+#define DEMOSAIC_STAGE_CLAMPS(stage, n_clamped) \
+    demosaic_test_stage_clamps((int) (stage), (int) (n_clamped))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEMOSAIC_CONF_PRIVATE_H */
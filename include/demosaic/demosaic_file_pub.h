@@ -0,0 +1,191 @@
+/***********************************************************************
+ * Copyright 2020 by the California Institute of Technology
+ * ALL RIGHTS RESERVED. United States Government Sponsorship acknowledged.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file        demosaic_file_pub.h
+ * @date        2026-10-14
+ * @brief       Memory-mapped raw bayer files and demosaiced output files
+ *
+ * Optional, for POSIX hosts: compile src/demosaic_file.c only if needed.
+ * Frames of a mapped file are returned as pointers into the mapping, to
+ * pass as the bayer or output arguments of the demosaic functions without
+ * copying.
+ */
+
+#ifndef DEMOSAIC_FILE_PUB_H
+#define DEMOSAIC_FILE_PUB_H
+
+#include <demosaic/demosaic_types_pub.h>
+
+// byte counts of multi-GB archives
+#include <stddef.h>
+
+// ensure symbols are not mangled by C++
+#ifdef __cplusplus
+   extern "C" {
+#endif
+
+/// layouts of bayer pixels in raw files
+typedef enum {
+    DEMOSAIC_FILE_U16 = 0,   /// one U16 per pixel, in host byte order
+    DEMOSAIC_FILE_U8 = 1,    /// one U8 per pixel
+    DEMOSAIC_FILE_RAW10 = 2, /// MIPI CSI-2 RAW10, 5 bytes per 4 pixels
+    DEMOSAIC_FILE_RAW12 = 3  /// MIPI CSI-2 RAW12, 3 bytes per 2 pixels
+} demosaic_file_format;
+
+/// results of opening, mapping, syncing and unmapping files
+typedef enum {
+    DEMOSAIC_FILE_OK = 0,        /// success
+    DEMOSAIC_FILE_ERR_OPEN = 1,  /// open or fstat failed, see errno
+    DEMOSAIC_FILE_ERR_SIZE = 2,  /// file too small for one frame
+    DEMOSAIC_FILE_ERR_MAP = 3,   /// mmap failed, see errno
+    DEMOSAIC_FILE_ERR_SYNC = 4,  /// msync or munmap failed, see errno
+    DEMOSAIC_FILE_ERR_TRUNCATE = 5 /// output file could not be sized, e.g.
+                                 /// no space or too large, see errno
+} demosaic_file_status;
+
+/// layout of the frames of a raw bayer file
+typedef struct {
+    I32 n_rows;                 /// rows per frame, positive, even
+    I32 n_cols;                 /// columns per frame, positive, even,
+                                /// a multiple of 4 for RAW10
+    demosaic_file_format format; /// pixel layout
+    size_t header_bytes;        /// bytes before the first frame
+    I32 row_pitch;              /// bytes from one row to the next,
+                                /// or 0 for unpadded rows
+    size_t frame_pitch;         /// bytes from one frame to the next,
+                                /// or 0 for adjacent frames
+} demosaic_file_layout;
+
+/// a mapped file. Fields are set by demosaic_file_map() or
+/// demosaic_file_create(), and should not be changed.
+typedef struct {
+    U8 * data;                  /// start of the mapping
+    size_t n_bytes;             /// length of the mapping
+    demosaic_file_layout layout; /// of a bayer file, with pitches resolved,
+                                /// or of an output file, header_bytes and
+                                /// frame_pitch only
+    I32 n_frames;               /// whole frames in the file
+    I32 writable;               /// 1 for output files, 0 for bayer files
+} demosaic_file;
+
+/** @brief Map a raw bayer file read-only
+ *
+ *         Frames are at layout->header_bytes + frame * frame_pitch, and
+ *         the file holds as many whole frames as fit. Pages are read
+ *         on first access, so mapping a multi-GB archive reads nothing.
+ *
+ * @param path          File to map
+ * @param layout        Layout of the frames in the file. Pitches must be
+ *                      at least one unpadded row or frame; for U16 files,
+ *                      header_bytes and pitches must be even
+ * @param file          Mapped file, zeroed unless DEMOSAIC_FILE_OK
+ * @return              DEMOSAIC_FILE_OK, or the step that failed
+ */
+demosaic_file_status demosaic_file_map(
+        const char * const path,
+        const demosaic_file_layout * const layout,
+        demosaic_file * const file);
+
+/** @brief Create, or truncate, an output file of n_frames frames, and map
+ *         it for writing
+ *
+ *         Demosaic directly into demosaic_file_output(). Data reaches the
+ *         file by demosaic_file_unmap().
+ *
+ * @param path          File to create
+ * @param header_bytes  Bytes before the first frame, e.g. for a caller's
+ *                      header, written through file->data
+ * @param frame_bytes   Bytes per frame, positive, e.g.
+ *                      n_rows * n_cols * sizeof(demosaic_pix_rgb8)
+ * @param n_frames      Frames in the file, positive, with
+ *                      header_bytes + frame_bytes * n_frames within size_t
+ * @param file          Mapped file, zeroed unless DEMOSAIC_FILE_OK
+ * @return              DEMOSAIC_FILE_OK, or the step that failed:
+ *                      DEMOSAIC_FILE_ERR_OPEN, DEMOSAIC_FILE_ERR_TRUNCATE
+ *                      if ftruncate failed or the size exceeds off_t,
+ *                      or DEMOSAIC_FILE_ERR_MAP
+ */
+demosaic_file_status demosaic_file_create(
+        const char * const path,
+        size_t header_bytes,
+        size_t frame_bytes,
+        I32 n_frames,
+        demosaic_file * const file);
+
+/** @brief Unmap a file mapped by demosaic_file_map() or
+ *         demosaic_file_create(), writing output files to disk first
+ *
+ * @param file          The file, zeroed on return
+ * @return              DEMOSAIC_FILE_OK, or DEMOSAIC_FILE_ERR_SYNC if the
+ *                      output could not be written
+ */
+demosaic_file_status demosaic_file_unmap(
+        demosaic_file * const file);
+
+/** @brief Frame of a U16 bayer file, as the bayer argument of the 16-bit
+ *         demosaic functions
+ *
+ *         Pass layout.row_pitch as the input pitch of the
+ *         demosaic_malvar_*_pitched() functions if rows are padded.
+ *
+ * @param file          A file mapped with format DEMOSAIC_FILE_U16
+ * @param frame         Frame index, less than n_frames
+ * @return              The first pixel of the frame, in the mapping
+ */
+const U16 * demosaic_file_bayer16(
+        const demosaic_file * const file,
+        I32 frame);
+
+/** @brief Frame of a U8, RAW10 or RAW12 bayer file, as the bayer argument
+ *         of the 8-bit demosaic functions, or the data of a demosaic_packed,
+ *         with layout.row_pitch as its pitch, for the packed functions
+ *
+ * @param file          A file mapped with format other than DEMOSAIC_FILE_U16
+ * @param frame         Frame index, less than n_frames
+ * @return              The first byte of the frame, in the mapping
+ */
+const U8 * demosaic_file_bayer8(
+        const demosaic_file * const file,
+        I32 frame);
+
+/** @brief Frame of an output file, as the output argument of the demosaic
+ *         functions
+ *
+ * @param file          A file mapped by demosaic_file_create()
+ * @param frame         Frame index, less than n_frames
+ * @return              The first byte of the frame, in the mapping,
+ *                      aligned as file->data + header_bytes + frame_bytes
+ *                      * frame
+ */
+void * demosaic_file_output(
+        const demosaic_file * const file,
+        I32 frame);
+
+/** @brief Ask the kernel to start reading a frame of a bayer file,
+ *         e.g. the next frame while demosaicing this one
+ *
+ * @param file          A file mapped by demosaic_file_map()
+ * @param frame         Frame index, less than n_frames
+ */
+void demosaic_file_prefetch(
+        const demosaic_file * const file,
+        I32 frame);
+
+#ifdef __cplusplus
+   }
+#endif
+
+#endif /* DEMOSAIC_FILE_PUB_H */
@@ -17,7 +17,7 @@
  * @file        demosaic_pub.h
  * @date        2020-05-19
  * @author      Neil Abcouwer
- * @brief       Function declarations for Demosaicing RGGB Bayer Images
+ * @brief       Function declarations for Demosaicing Bayer Images
  */
 
 #ifndef DEMOSAIC_PUB_H
@@ -30,6 +30,58 @@
    extern "C" {
 #endif
 
+/** @brief Select the engine of the vectorized image interiors, from
+ *         CPU feature detection or an explicit override
+ *
+ *         Until called, the engine is the widest one the compiler targets,
+ *         e.g. SSE2 for a baseline x86-64 build. Call once at startup,
+ *         before any demosaicing, as the selection is not synchronized
+ *         with running demosaic functions. Every engine's output is
+ *         identical to the scalar kernels'.
+ *
+ * @param engine        DEMOSAIC_ENGINE_AUTO for the widest engine the host
+ *                      supports, or an engine, which must be supported,
+ *                      e.g. DEMOSAIC_ENGINE_SCALAR for the reference kernels
+ * @return              The selected engine
+ */
+demosaic_engine demosaic_engine_init(
+        demosaic_engine engine);
+
+/** @brief Whether an engine is compiled in and the host supports it
+ *
+ * @param engine        Any engine. DEMOSAIC_ENGINE_AUTO and
+ *                      DEMOSAIC_ENGINE_SCALAR are always supported
+ * @return              1 if demosaic_engine_init() accepts engine, else 0
+ */
+I32 demosaic_engine_supported(
+        const demosaic_engine engine);
+
+/** @brief The engine in use, never DEMOSAIC_ENGINE_AUTO
+ *
+ * @return              The engine in use
+ */
+demosaic_engine demosaic_engine_active(void);
+
+/** @brief Initialize demosaicing arguments to their defaults
+ *
+ *         Every optional field is set to off: pattern DEMOSAIC_RGGB, and
+ *         NULL calibration, ccm and lut. rshift is the smallest shift
+ *         bringing max_val to 8 bits, i.e. 4 for 0x0FFF, and coefs are
+ *         the ccir 601 luma coefficients. Set other fields after this call.
+ *         Callers that set every field themselves must also zero the
+ *         struct first, so that fields added later default to off.
+ *
+ * @param args          Arguments to initialize
+ * @param n_rows        Number of rows in the bayer image
+ * @param n_cols        Number of columns in the bayer image
+ * @param max_val       Maximum value of an input pixel
+ */
+void demosaic_args_init(
+        demosaic_args * const args,
+        const I32 n_rows,
+        const I32 n_cols,
+        const U16 max_val);
+
 /** @brief Demosaic a row of a 16-bit bayer image into 16-bit rgb
  *         with malvar linear interpolation
  *
@@ -127,7 +179,8 @@ void demosaic_malvar_rgb8(
  *
  *
  * @param bayer         An input 16-bit Bayer image
- * @param args          Dimensions, maximum value of image, how to shift
+ * @param args          Dimensions, maximum value of image, how to shift,
+ *                      or a tone curve lut
  * @param row           The row to be demosaic
  * @param output_row    Output row of 8-bit RGB pixels,
  *                      length must be equal to the width of the Bayer image.
@@ -249,6 +302,7 @@ void demosaic_malvar_mono8(
  *
  * @param bayer         An input Bayer image
  * @param args          Dimensions, maximum value of image, luma coefs, shift
+ *                      or a tone curve lut
  * @param row           The row to be demosaic
  * @param output_row    Output row of mono pixels,
  *                      length must be equal to the width of the Bayer image.
@@ -274,6 +328,1757 @@ void demosaic_malvar_mono16to8(
         const demosaic_args * const args,
         U8 * output);
 
+/** @brief Demosaic a 16-bit bayer image, or a region of it, into 16-bit rgb
+ *         with malvar linear interpolation, one tile at a time
+ *
+ *         Image dimensions must be positive, even. The region must be
+ *         within the image, and may have any position and size.
+ *
+ *         Each tile reads only its own pixels and a 2 pixel apron around
+ *         them, so the working set is 5 lines of tile_cols, rather than
+ *         5 lines of the image width. The apron is read from the
+ *         neighboring bayer pixels, and mirrored only at the image edges,
+ *         so output is identical to demosaic_malvar_rgb16(), cropped to
+ *         the region.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param region        The rectangle to demosaic, or NULL for the whole image
+ * @param tile_rows     Number of rows per tile, at least 1
+ * @param tile_cols     Number of columns per tile, at least 1
+ * @param output        Output image of 16-bit RGB pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_rgb16_tiled(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        demosaic_pix_rgb16 * output);
+
+/** @brief Demosaic an 8-bit bayer image, or a region of it, into 8-bit rgb
+ *         with malvar linear interpolation, one tile at a time
+ *
+ *         As demosaic_malvar_rgb16_tiled(), so output is identical to
+ *         demosaic_malvar_rgb8(), cropped to the region.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions and maximum value of image, at most 255
+ * @param region        The rectangle to demosaic, or NULL for the whole image
+ * @param tile_rows     Number of rows per tile, at least 1
+ * @param tile_cols     Number of columns per tile, at least 1
+ * @param output        Output image of 8-bit RGB pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_rgb8_tiled(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a 16-bit bayer image, or a region of it, into 8-bit rgb
+ *         with malvar linear interpolation, one tile at a time
+ *
+ *         As demosaic_malvar_rgb16_tiled(), so output is identical to
+ *         demosaic_malvar_rgb16to8(), cropped to the region.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift to 8 bits
+ * @param region        The rectangle to demosaic, or NULL for the whole image
+ * @param tile_rows     Number of rows per tile, at least 1
+ * @param tile_cols     Number of columns per tile, at least 1
+ * @param output        Output image of 8-bit RGB pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_rgb16to8_tiled(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a 16-bit bayer image, or a region of it, into 16-bit mono
+ *         with malvar linear interpolation, one tile at a time
+ *
+ *         As demosaic_malvar_rgb16_tiled(), so output is identical to
+ *         demosaic_malvar_mono16(), cropped to the region.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param region        The rectangle to demosaic, or NULL for the whole image
+ * @param tile_rows     Number of rows per tile, at least 1
+ * @param tile_cols     Number of columns per tile, at least 1
+ * @param output        Output image of 16-bit mono pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_mono16_tiled(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        U16 * output);
+
+/** @brief Demosaic an 8-bit bayer image, or a region of it, into 8-bit mono
+ *         with malvar linear interpolation, one tile at a time
+ *
+ *         As demosaic_malvar_rgb16_tiled(), so output is identical to
+ *         demosaic_malvar_mono8(), cropped to the region.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions, maximum value of image, at most 255, luma
+ *                      coefficients
+ * @param region        The rectangle to demosaic, or NULL for the whole image
+ * @param tile_rows     Number of rows per tile, at least 1
+ * @param tile_cols     Number of columns per tile, at least 1
+ * @param output        Output image of 8-bit mono pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_mono8_tiled(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        U8 * output);
+
+/** @brief Demosaic a 16-bit bayer image, or a region of it, into 8-bit mono
+ *         with malvar linear interpolation, one tile at a time
+ *
+ *         As demosaic_malvar_rgb16_tiled(), so output is identical to
+ *         demosaic_malvar_mono16to8(), cropped to the region.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients,
+ *                      shift to 8 bits
+ * @param region        The rectangle to demosaic, or NULL for the whole image
+ * @param tile_rows     Number of rows per tile, at least 1
+ * @param tile_cols     Number of columns per tile, at least 1
+ * @param output        Output image of 8-bit mono pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_mono16to8_tiled(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        U8 * output);
+
+/** @brief Demosaic a region of a 16-bit bayer image into 16-bit rgb
+ *         with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even. The region must be
+ *         within the image, and may have any position and size.
+ *
+ *         Pixels at the region's boundary sample the surrounding bayer
+ *         pixels, mirroring only at the image edges, so output is identical
+ *         to demosaic_malvar_rgb16(), cropped to the region.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param region        The rectangle to demosaic
+ * @param output        Output image of 16-bit RGB pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_region_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        demosaic_pix_rgb16 * output);
+
+/** @brief Demosaic a region of a 8-bit bayer image into 8-bit rgb
+ *         with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even. The region must be
+ *         within the image, and may have any position and size.
+ *
+ *         Pixels at the region's boundary sample the surrounding bayer
+ *         pixels, mirroring only at the image edges, so output is identical
+ *         to demosaic_malvar_rgb8(), cropped to the region.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param region        The rectangle to demosaic
+ * @param output        Output image of 8-bit RGB pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_region_rgb8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a region of a 16-bit bayer image into 8-bit rgb
+ *         with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even. The region must be
+ *         within the image, and may have any position and size.
+ *
+ *         Pixels at the region's boundary sample the surrounding bayer
+ *         pixels, mirroring only at the image edges, so output is identical
+ *         to demosaic_malvar_rgb16to8(), cropped to the region.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift
+ * @param region        The rectangle to demosaic
+ * @param output        Output image of 8-bit RGB pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_region_rgb16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a region of a 16-bit bayer image into 16-bit mono
+ *         with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even. The region must be
+ *         within the image, and may have any position and size.
+ *
+ *         Pixels at the region's boundary sample the surrounding bayer
+ *         pixels, mirroring only at the image edges, so output is identical
+ *         to demosaic_malvar_mono16(), cropped to the region.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param region        The rectangle to demosaic
+ * @param output        Output image of 16-bit mono pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_region_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        U16 * output);
+
+/** @brief Demosaic a region of a 8-bit bayer image into 8-bit mono
+ *         with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even. The region must be
+ *         within the image, and may have any position and size.
+ *
+ *         Pixels at the region's boundary sample the surrounding bayer
+ *         pixels, mirroring only at the image edges, so output is identical
+ *         to demosaic_malvar_mono8(), cropped to the region.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param region        The rectangle to demosaic
+ * @param output        Output image of 8-bit mono pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_region_mono8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        U8 * output);
+
+/** @brief Demosaic a region of a 16-bit bayer image into 8-bit mono
+ *         with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even. The region must be
+ *         within the image, and may have any position and size.
+ *
+ *         Pixels at the region's boundary sample the surrounding bayer
+ *         pixels, mirroring only at the image edges, so output is identical
+ *         to demosaic_malvar_mono16to8(), cropped to the region.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value, shift, luma coefficients
+ * @param region        The rectangle to demosaic
+ * @param output        Output image of 8-bit mono pixels, with the
+ *                      dimensions of the region, rows packed together.
+ */
+void demosaic_malvar_region_mono16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        U8 * output);
+
+/** @brief The output pixels changed by changing a rectangle of bayer
+ *         pixels: the rectangle grown by DEMOSAIC_KERNEL_RADIUS on each
+ *         side, and clipped to the image
+ *
+ * @param args          Dimensions of image
+ * @param dirty         Changed bayer pixels, within the image
+ * @param affected      The output pixels to demosaic again
+ */
+void demosaic_dirty_affected(
+        const demosaic_args * const args,
+        const demosaic_rect * const dirty,
+        demosaic_rect * const affected);
+
+/** @brief Demosaic again, in place, the 16-bit RGB pixels of a whole 16-bit RGB
+ *         image changed by changing rectangles of its bayer image
+ *
+ *         Image dimensions must be positive, even. Rectangles must be within
+ *         the image, and may have any position and size, and overlap.
+ *         Only the demosaic_dirty_affected() pixels of each rectangle are
+ *         written, so output is identical to demosaic_malvar_rgb16() of the
+ *         changed image if it was before. Pixels affected by several
+ *         rectangles are demosaiced once for each.
+ *
+ * @param bayer         The changed 16-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param dirty         The rectangles of changed bayer pixels
+ * @param n_dirty       Number of rectangles, not negative
+ * @param output        Output image of 16-bit RGB pixels, the size of the
+ *                      Bayer image, updated in place
+ */
+void demosaic_malvar_rgb16_dirty(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        demosaic_pix_rgb16 * output);
+
+/** @brief Demosaic again, in place, the 8-bit RGB pixels of a whole 8-bit RGB
+ *         image changed by changing rectangles of its bayer image
+ *
+ *         Image dimensions must be positive, even. Rectangles must be within
+ *         the image, and may have any position and size, and overlap.
+ *         Only the demosaic_dirty_affected() pixels of each rectangle are
+ *         written, so output is identical to demosaic_malvar_rgb8() of the
+ *         changed image if it was before. Pixels affected by several
+ *         rectangles are demosaiced once for each.
+ *
+ * @param bayer         The changed 8-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param dirty         The rectangles of changed bayer pixels
+ * @param n_dirty       Number of rectangles, not negative
+ * @param output        Output image of 8-bit RGB pixels, the size of the
+ *                      Bayer image, updated in place
+ */
+void demosaic_malvar_rgb8_dirty(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic again, in place, the 8-bit RGB pixels of a whole 8-bit RGB
+ *         image changed by changing rectangles of its bayer image
+ *
+ *         Image dimensions must be positive, even. Rectangles must be within
+ *         the image, and may have any position and size, and overlap.
+ *         Only the demosaic_dirty_affected() pixels of each rectangle are
+ *         written, so output is identical to demosaic_malvar_rgb16to8() of the
+ *         changed image if it was before. Pixels affected by several
+ *         rectangles are demosaiced once for each.
+ *
+ * @param bayer         The changed 16-bit Bayer image
+ * @param args          Dimensions, maximum value, shift
+ * @param dirty         The rectangles of changed bayer pixels
+ * @param n_dirty       Number of rectangles, not negative
+ * @param output        Output image of 8-bit RGB pixels, the size of the
+ *                      Bayer image, updated in place
+ */
+void demosaic_malvar_rgb16to8_dirty(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic again, in place, the 16-bit mono pixels of a whole 16-bit mono
+ *         image changed by changing rectangles of its bayer image
+ *
+ *         Image dimensions must be positive, even. Rectangles must be within
+ *         the image, and may have any position and size, and overlap.
+ *         Only the demosaic_dirty_affected() pixels of each rectangle are
+ *         written, so output is identical to demosaic_malvar_mono16() of the
+ *         changed image if it was before. Pixels affected by several
+ *         rectangles are demosaiced once for each.
+ *
+ * @param bayer         The changed 16-bit Bayer image
+ * @param args          Dimensions, maximum value, luma coefficients
+ * @param dirty         The rectangles of changed bayer pixels
+ * @param n_dirty       Number of rectangles, not negative
+ * @param output        Output image of 16-bit mono pixels, the size of the
+ *                      Bayer image, updated in place
+ */
+void demosaic_malvar_mono16_dirty(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        U16 * output);
+
+/** @brief Demosaic again, in place, the 8-bit mono pixels of a whole 8-bit mono
+ *         image changed by changing rectangles of its bayer image
+ *
+ *         Image dimensions must be positive, even. Rectangles must be within
+ *         the image, and may have any position and size, and overlap.
+ *         Only the demosaic_dirty_affected() pixels of each rectangle are
+ *         written, so output is identical to demosaic_malvar_mono8() of the
+ *         changed image if it was before. Pixels affected by several
+ *         rectangles are demosaiced once for each.
+ *
+ * @param bayer         The changed 8-bit Bayer image
+ * @param args          Dimensions, maximum value, luma coefficients
+ * @param dirty         The rectangles of changed bayer pixels
+ * @param n_dirty       Number of rectangles, not negative
+ * @param output        Output image of 8-bit mono pixels, the size of the
+ *                      Bayer image, updated in place
+ */
+void demosaic_malvar_mono8_dirty(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        U8 * output);
+
+/** @brief Demosaic again, in place, the 8-bit mono pixels of a whole 8-bit mono
+ *         image changed by changing rectangles of its bayer image
+ *
+ *         Image dimensions must be positive, even. Rectangles must be within
+ *         the image, and may have any position and size, and overlap.
+ *         Only the demosaic_dirty_affected() pixels of each rectangle are
+ *         written, so output is identical to demosaic_malvar_mono16to8() of the
+ *         changed image if it was before. Pixels affected by several
+ *         rectangles are demosaiced once for each.
+ *
+ * @param bayer         The changed 16-bit Bayer image
+ * @param args          Dimensions, maximum value, shift, luma coefficients
+ * @param dirty         The rectangles of changed bayer pixels
+ * @param n_dirty       Number of rectangles, not negative
+ * @param output        Output image of 8-bit mono pixels, the size of the
+ *                      Bayer image, updated in place
+ */
+void demosaic_malvar_mono16to8_dirty(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        U8 * output);
+
+/** @brief Demosaic a 16-bit bayer image with padded rows to 16-bit
+ *         RGB pixels with padded rows, using malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_rgb16(), row by row.
+ *
+ * @param bayer         An input 16-bit Bayer image, with rows
+ *                      pitch->input bytes apart
+ * @param args          Dimensions, maximum value of image
+ * @param pitch         Input and output row pitches in bytes
+ * @param output        Output 16-bit RGB image, with rows
+ *                      pitch->output bytes apart
+ */
+void demosaic_malvar_rgb16_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        demosaic_pix_rgb16 * output);
+
+/** @brief Demosaic a 8-bit bayer image with padded rows to 8-bit
+ *         RGB pixels with padded rows, using malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_rgb8(), row by row.
+ *
+ * @param bayer         An input 8-bit Bayer image, with rows
+ *                      pitch->input bytes apart
+ * @param args          Dimensions, maximum value of image
+ * @param pitch         Input and output row pitches in bytes
+ * @param output        Output 8-bit RGB image, with rows
+ *                      pitch->output bytes apart
+ */
+void demosaic_malvar_rgb8_pitched(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a 16-bit bayer image with padded rows to 8-bit
+ *         RGB pixels with padded rows, using malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_rgb16to8(), row by row.
+ *
+ * @param bayer         An input 16-bit Bayer image, with rows
+ *                      pitch->input bytes apart
+ * @param args          Dimensions, maximum value of image, shift
+ * @param pitch         Input and output row pitches in bytes
+ * @param output        Output 8-bit RGB image, with rows
+ *                      pitch->output bytes apart
+ */
+void demosaic_malvar_rgb16to8_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a 16-bit bayer image with padded rows to 16-bit
+ *         mono pixels with padded rows, using malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_mono16(), row by row.
+ *
+ * @param bayer         An input 16-bit Bayer image, with rows
+ *                      pitch->input bytes apart
+ * @param args          Dimensions, maximum value of image, coefficients
+ * @param pitch         Input and output row pitches in bytes
+ * @param output        Output 16-bit mono image, with rows
+ *                      pitch->output bytes apart
+ */
+void demosaic_malvar_mono16_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        U16 * output);
+
+/** @brief Demosaic a 8-bit bayer image with padded rows to 8-bit
+ *         mono pixels with padded rows, using malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_mono8(), row by row.
+ *
+ * @param bayer         An input 8-bit Bayer image, with rows
+ *                      pitch->input bytes apart
+ * @param args          Dimensions, maximum value of image, coefficients
+ * @param pitch         Input and output row pitches in bytes
+ * @param output        Output 8-bit mono image, with rows
+ *                      pitch->output bytes apart
+ */
+void demosaic_malvar_mono8_pitched(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        U8 * output);
+
+/** @brief Demosaic a 16-bit bayer image with padded rows to 8-bit
+ *         mono pixels with padded rows, using malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_mono16to8(), row by row.
+ *
+ * @param bayer         An input 16-bit Bayer image, with rows
+ *                      pitch->input bytes apart
+ * @param args          Dimensions, maximum value of image, shift, coefficients
+ * @param pitch         Input and output row pitches in bytes
+ * @param output        Output 8-bit mono image, with rows
+ *                      pitch->output bytes apart
+ */
+void demosaic_malvar_mono16to8_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        U8 * output);
+
+/** @brief Demosaic a row of a 16-bit bayer image into separate
+ *         16-bit red, green and blue rows with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, row must be within image.
+ *         Output is identical to demosaic_malvar_row_rgb16(), by channel.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param row           The row to be demosaiced
+ * @param red_row       Output row of 16-bit red pixels,
+ *                      length must be equal to the width of the Bayer image.
+ * @param green_row     Output row of 16-bit green pixels
+ * @param blue_row      Output row of 16-bit blue pixels
+ */
+void demosaic_malvar_row_rgb16_planar(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 red_row[],
+        U16 green_row[],
+        U16 blue_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into separate 16-bit red,
+ *         green and blue planes with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_rgb16(), by channel.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param planes        Output planes, each with the dimensions of the
+ *                      Bayer image, and a stride of at least its width.
+ */
+void demosaic_malvar_rgb16_planar(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_planes16 * const planes);
+
+/** @brief Demosaic a row of a 8-bit bayer image into separate
+ *         8-bit red, green and blue rows with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, row must be within image.
+ *         Output is identical to demosaic_malvar_row_rgb8(), by channel.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param row           The row to be demosaiced
+ * @param red_row       Output row of 8-bit red pixels,
+ *                      length must be equal to the width of the Bayer image.
+ * @param green_row     Output row of 8-bit green pixels
+ * @param blue_row      Output row of 8-bit blue pixels
+ */
+void demosaic_malvar_row_rgb8_planar(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 red_row[],
+        U8 green_row[],
+        U8 blue_row[]);
+
+/** @brief Demosaic a 8-bit bayer image into separate 8-bit red,
+ *         green and blue planes with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_rgb8(), by channel.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param planes        Output planes, each with the dimensions of the
+ *                      Bayer image, and a stride of at least its width.
+ */
+void demosaic_malvar_rgb8_planar(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_planes8 * const planes);
+
+/** @brief Demosaic a row of a 16-bit bayer image into separate
+ *         8-bit red, green and blue rows with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, row must be within image.
+ *         Output is identical to demosaic_malvar_row_rgb16to8(), by channel.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift
+ * @param row           The row to be demosaiced
+ * @param red_row       Output row of 8-bit red pixels,
+ *                      length must be equal to the width of the Bayer image.
+ * @param green_row     Output row of 8-bit green pixels
+ * @param blue_row      Output row of 8-bit blue pixels
+ */
+void demosaic_malvar_row_rgb16to8_planar(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 red_row[],
+        U8 green_row[],
+        U8 blue_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into separate 8-bit red,
+ *         green and blue planes with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even.
+ *         Output is identical to demosaic_malvar_rgb16to8(), by channel.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift
+ * @param planes        Output planes, each with the dimensions of the
+ *                      Bayer image, and a stride of at least its width.
+ */
+void demosaic_malvar_rgb16to8_planar(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_planes8 * const planes);
+
+/** @brief Demosaic a 8-bit bayer image into full range YCbCr planes,
+ *         with 4:2:0 or 4:2:2 chroma, with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even. Luma is identical to
+ *         demosaic_malvar_mono8(). Chroma is cb = (blue - luma) /
+ *         (2 * (1 - blue coef)) + 128 and cr = (red - luma) /
+ *         (2 * (1 - red coef)) + 128, of the mean rgb of each 2x2 or 2x1
+ *         block, with the normalized luma coefficients, i.e. JPEG for
+ *         ccir 601 coefficients. No rgb image is written.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param format        DEMOSAIC_YUV420 or DEMOSAIC_YUV422
+ * @param planes        Output planes, luma with the dimensions of the Bayer
+ *                      image and a stride of at least its width, chroma
+ *                      half as wide, and half as high for 4:2:0
+ */
+void demosaic_malvar_yuv8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_yuv_format format,
+        const demosaic_planes_yuv8 * const planes);
+
+/** @brief Demosaic a 16-bit bayer image into full range YCbCr planes,
+ *         with 4:2:0 or 4:2:2 chroma, with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even. Luma is identical to
+ *         demosaic_malvar_mono16to8(), and chroma is as
+ *         demosaic_malvar_yuv8(), of the shifted or tone mapped rgb.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift or tone
+ *                      curve lut, luma coefficients
+ * @param format        DEMOSAIC_YUV420 or DEMOSAIC_YUV422
+ * @param planes        Output planes, as demosaic_malvar_yuv8()
+ */
+void demosaic_malvar_yuv16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_yuv_format format,
+        const demosaic_planes_yuv8 * const planes);
+
+/** @brief Validate demosaicing arguments and precompute what the
+ *         *_plan functions need, once for any number of rows and frames
+ *
+ *         Image dimensions must be positive, even. Luma coefficients must be
+ *         in [0,1], and rshift not negative, even if unused.
+ *         The 8-bit functions check max_val when called.
+ *
+ *         plan->store is set to DEMOSAIC_STORE_CACHED. Set it to
+ *         DEMOSAIC_STORE_STREAMING after this call for the whole-image
+ *         *_plan and *_batch functions using the plan to demosaic each row
+ *         in chunks on the stack, and copy them to the output with
+ *         non-temporal stores, which bypass the cache, on x86, while
+ *         prefetching the bayer rows the next rows read. For frames much
+ *         larger than the cache that are written once and handed on, it
+ *         keeps the output from evicting the bayer rows still needed.
+ *         Stores are fenced before each function, or band of a batch,
+ *         returns. Other targets use ordinary stores. Output is identical.
+ *         The row functions, and functions taking demosaic_args, always
+ *         use ordinary stores.
+ *
+ * @param plan          The plan to initialize
+ * @param args          Dimensions, maximum value, shift, luma coefficients
+ */
+void demosaic_plan_init(
+        demosaic_plan * const plan,
+        const demosaic_args * const args);
+
+/** @brief Demosaic a row of a 16-bit bayer image into 16-bit rgb
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_row_rgb16(), without re-validating arguments.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param row           The row to be demosaiced
+ * @param output_row    Output row of 16-bit RGB pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_rgb16_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb16 output_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into 16-bit rgb
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_rgb16(), checking arguments once.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param output        Output image of 16-bit RGB pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_rgb16_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        demosaic_pix_rgb16 * output);
+
+/** @brief Demosaic a row of a 8-bit bayer image into 8-bit rgb
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_row_rgb8(), without re-validating arguments.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param row           The row to be demosaiced
+ * @param output_row    Output row of 8-bit RGB pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_rgb8_plan(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[]);
+
+/** @brief Demosaic a 8-bit bayer image into 8-bit rgb
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_rgb8(), checking arguments once.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param output        Output image of 8-bit RGB pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_rgb8_plan(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a row of a 16-bit bayer image into 8-bit rgb
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_row_rgb16to8(), without re-validating arguments.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param row           The row to be demosaiced
+ * @param output_row    Output row of 8-bit RGB pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_rgb16to8_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into 8-bit rgb
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_rgb16to8(), checking arguments once.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param output        Output image of 8-bit RGB pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_rgb16to8_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a row of a 16-bit bayer image into 16-bit mono
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_row_mono16(), without re-validating arguments.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param row           The row to be demosaiced
+ * @param output_row    Output row of 16-bit mono pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_mono16_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U16 output_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into 16-bit mono
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_mono16(), checking arguments once.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param output        Output image of 16-bit mono pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_mono16_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        U16 * output);
+
+/** @brief Demosaic a row of a 8-bit bayer image into 8-bit mono
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_row_mono8(), without re-validating arguments.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param row           The row to be demosaiced
+ * @param output_row    Output row of 8-bit mono pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_mono8_plan(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U8 output_row[]);
+
+/** @brief Demosaic a 8-bit bayer image into 8-bit mono
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_mono8(), checking arguments once.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param output        Output image of 8-bit mono pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_mono8_plan(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        U8 * output);
+
+/** @brief Demosaic a row of a 16-bit bayer image into 8-bit mono
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_row_mono16to8(), without re-validating arguments.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param row           The row to be demosaiced
+ * @param output_row    Output row of 8-bit mono pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_mono16to8_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U8 output_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into 8-bit mono
+ *         with malvar linear interpolation, using a plan
+ *
+ *         Identical to demosaic_malvar_mono16to8(), checking arguments once.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param plan          A plan from demosaic_plan_init()
+ * @param output        Output image of 8-bit mono pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_mono16to8_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        U8 * output);
+
+/** @brief Demosaic a row of a 16-bit bayer image into both 16-bit rgb
+ *         and 16-bit mono with malvar linear interpolation, in one pass
+ *
+ *         Image dimensions must be positive, even, row must be within image.
+ *
+ *         Each pixel's kernels are computed once for both outputs.
+ *         Outputs are identical to demosaic_malvar_row_rgb16() and
+ *         demosaic_malvar_row_mono16().
+ *
+ * @param bayer             An input 16-bit Bayer image
+ * @param args              Dimensions, maximum value of image,
+ *                          luma coefficients
+ * @param row               The row to be demosaiced
+ * @param output_rgb_row    Output row of 16-bit RGB pixels,
+ *                          length must be equal to the width of the image.
+ * @param output_mono_row   Output row of 16-bit mono pixels,
+ *                          length must be equal to the width of the image.
+ */
+void demosaic_malvar_row_rgb16_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb16 output_rgb_row[],
+        U16 output_mono_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into both 16-bit rgb
+ *         and 16-bit mono with malvar linear interpolation, in one pass
+ *
+ *         Image dimensions must be positive, even.
+ *
+ *         Reads the bayer image once. Outputs are identical to
+ *         demosaic_malvar_rgb16() and demosaic_malvar_mono16().
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param output_rgb    Output image of 16-bit RGB pixels,
+ *                      dimensions must be equal to the Bayer image.
+ * @param output_mono   Output image of 16-bit mono pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_rgb16_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb16 * output_rgb,
+        U16 * output_mono);
+
+/** @brief Demosaic a 16-bit bayer image into 16-bit rgb
+ *         with malvar linear interpolation, in parallel row bands
+ *
+ *         Image dimensions must be positive, even. Arguments are checked
+ *         once, as by demosaic_plan_init(), so luma coefficients must be
+ *         in [0,1], and rshift not negative, even if unused.
+ *
+ *         Splits the image into dispatcher->n_bands bands of rows,
+ *         and has the dispatcher run one job per band, as
+ *         demosaic_malvar_rgb16_batch() of one frame. Jobs only read
+ *         bayer and args, and write disjoint rows of output,
+ *         so may run concurrently. Output is identical to the serial
+ *         demosaic_malvar_rgb16().
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param dispatcher    Number of bands, and the function that runs jobs
+ * @param output        Output image of 16-bit RGB pixels,
+ *                      Dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_rgb16_parallel(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        demosaic_pix_rgb16 * output);
+
+/** @brief Demosaic an 8-bit bayer image into 8-bit rgb
+ *         with malvar linear interpolation, in parallel row bands
+ *
+ *         See demosaic_malvar_rgb16_parallel().
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions and maximum value of image
+ * @param dispatcher    Number of bands, and the function that runs jobs
+ * @param output        Output image of 8-bit RGB pixels,
+ *                      Dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_rgb8_parallel(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a 16-bit bayer image into 8-bit rgb
+ *         with malvar linear interpolation, in parallel row bands
+ *
+ *         See demosaic_malvar_rgb16_parallel().
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, how to shift
+ * @param dispatcher    Number of bands, and the function that runs jobs
+ * @param output        Output image of 8-bit RGB pixels,
+ *                      Dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_rgb16to8_parallel(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a 16-bit bayer image into 16-bit mono
+ *         with malvar linear interpolation, in parallel row bands
+ *
+ *         See demosaic_malvar_rgb16_parallel().
+ *
+ * @param bayer         An input Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param dispatcher    Number of bands, and the function that runs jobs
+ * @param output        Output image of mono pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_mono16_parallel(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        U16 * output);
+
+/** @brief Demosaic an 8-bit bayer image into 8-bit mono
+ *         with malvar linear interpolation, in parallel row bands
+ *
+ *         See demosaic_malvar_rgb16_parallel().
+ *
+ * @param bayer         An input Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param dispatcher    Number of bands, and the function that runs jobs
+ * @param output        Output image of mono pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_mono8_parallel(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        U8 * output);
+
+/** @brief Demosaic a 16-bit bayer image into 8-bit mono
+ *         with malvar linear interpolation, in parallel row bands
+ *
+ *         See demosaic_malvar_rgb16_parallel().
+ *
+ * @param bayer         An input Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefs, shift
+ * @param dispatcher    Number of bands, and the function that runs jobs
+ * @param output        Output image of mono pixels,
+ *                      dimensions must be equal to the Bayer image.
+ */
+void demosaic_malvar_mono16to8_parallel(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        U8 * output);
+
+/** @brief Demosaic a batch of 16-bit bayer frames into 16-bit rgb
+ *         with malvar linear interpolation, sharing one plan
+ *
+ *         Frames have the dimensions and arguments of the plan, so they
+ *         are checked and set up once for the batch. With a NULL
+ *         dispatcher, frames are demosaiced in order on the calling thread,
+ *         prefetching the first bayer rows of each next frame during the
+ *         last rows of the current one. Otherwise the dispatcher runs
+ *         n_frames * dispatcher->n_bands jobs, one per band of rows of
+ *         a frame, which may run concurrently, and returns when all have
+ *         finished. Output is identical to demosaic_malvar_rgb16_plan()
+ *         of each frame.
+ *
+ * @param bayer         n_frames input 16-bit Bayer images
+ * @param plan          Plan initialized with the arguments of all frames
+ * @param dispatcher    Number of bands per frame, and the function that
+ *                      runs jobs, or NULL to demosaic serially
+ * @param n_frames      Number of frames, zero or more
+ * @param output        n_frames output images of 16-bit RGB pixels,
+ *                      dimensions must be equal to the Bayer images.
+ */
+void demosaic_malvar_rgb16_batch(
+        const U16 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        demosaic_pix_rgb16 * const output[]);
+
+/** @brief Demosaic a batch of 8-bit bayer frames into 8-bit rgb
+ *         with malvar linear interpolation, sharing one plan
+ *
+ *         See demosaic_malvar_rgb16_batch().
+ *
+ * @param bayer         n_frames input 8-bit Bayer images
+ * @param plan          Plan initialized with the arguments of all frames
+ * @param dispatcher    Number of bands per frame, and the function that
+ *                      runs jobs, or NULL to demosaic serially
+ * @param n_frames      Number of frames, zero or more
+ * @param output        n_frames output images of 8-bit RGB pixels,
+ *                      dimensions must be equal to the Bayer images.
+ */
+void demosaic_malvar_rgb8_batch(
+        const U8 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        demosaic_pix_rgb8 * const output[]);
+
+/** @brief Demosaic a batch of 16-bit bayer frames into 8-bit rgb
+ *         with malvar linear interpolation, sharing one plan
+ *
+ *         See demosaic_malvar_rgb16_batch().
+ *
+ * @param bayer         n_frames input 16-bit Bayer images
+ * @param plan          Plan initialized with the arguments of all frames
+ * @param dispatcher    Number of bands per frame, and the function that
+ *                      runs jobs, or NULL to demosaic serially
+ * @param n_frames      Number of frames, zero or more
+ * @param output        n_frames output images of 8-bit RGB pixels,
+ *                      dimensions must be equal to the Bayer images.
+ */
+void demosaic_malvar_rgb16to8_batch(
+        const U16 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        demosaic_pix_rgb8 * const output[]);
+
+/** @brief Demosaic a batch of 16-bit bayer frames into 16-bit mono
+ *         with malvar linear interpolation, sharing one plan
+ *
+ *         See demosaic_malvar_rgb16_batch().
+ *
+ * @param bayer         n_frames input 16-bit Bayer images
+ * @param plan          Plan initialized with the arguments of all frames
+ * @param dispatcher    Number of bands per frame, and the function that
+ *                      runs jobs, or NULL to demosaic serially
+ * @param n_frames      Number of frames, zero or more
+ * @param output        n_frames output images of mono pixels,
+ *                      dimensions must be equal to the Bayer images.
+ */
+void demosaic_malvar_mono16_batch(
+        const U16 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        U16 * const output[]);
+
+/** @brief Demosaic a batch of 8-bit bayer frames into 8-bit mono
+ *         with malvar linear interpolation, sharing one plan
+ *
+ *         See demosaic_malvar_rgb16_batch().
+ *
+ * @param bayer         n_frames input 8-bit Bayer images
+ * @param plan          Plan initialized with the arguments of all frames
+ * @param dispatcher    Number of bands per frame, and the function that
+ *                      runs jobs, or NULL to demosaic serially
+ * @param n_frames      Number of frames, zero or more
+ * @param output        n_frames output images of mono pixels,
+ *                      dimensions must be equal to the Bayer images.
+ */
+void demosaic_malvar_mono8_batch(
+        const U8 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        U8 * const output[]);
+
+/** @brief Demosaic a batch of 16-bit bayer frames into 8-bit mono
+ *         with malvar linear interpolation, sharing one plan
+ *
+ *         See demosaic_malvar_rgb16_batch().
+ *
+ * @param bayer         n_frames input 16-bit Bayer images
+ * @param plan          Plan initialized with the arguments of all frames
+ * @param dispatcher    Number of bands per frame, and the function that
+ *                      runs jobs, or NULL to demosaic serially
+ * @param n_frames      Number of frames, zero or more
+ * @param output        n_frames output images of mono pixels,
+ *                      dimensions must be equal to the Bayer images.
+ */
+void demosaic_malvar_mono16to8_batch(
+        const U16 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        U8 * const output[]);
+
+/** @brief Initialize an arena over caller-owned memory
+ *
+ *         The demosaic functions never allocate. Size the arena with
+ *         demosaic_scratch_size() for each use of it, e.g. a static pool,
+ *         and take each buffer from it once, at init.
+ *
+ * @param scratch       The arena to initialize, empty
+ * @param base          First byte of the memory, aligned to
+ *                      DEMOSAIC_SCRATCH_ALIGN
+ * @param n_bytes       Bytes of memory, not negative
+ */
+void demosaic_scratch_init(
+        demosaic_scratch * const scratch,
+        void * const base,
+        const I32 n_bytes);
+
+/** @brief Take a buffer from an arena
+ *
+ *         Asserts the arena holds n_bytes, rounded up to a multiple of
+ *         DEMOSAIC_SCRATCH_ALIGN, more.
+ *
+ * @param scratch       An initialized arena
+ * @param n_bytes       Bytes of the buffer, positive, e.g. from
+ *                      demosaic_scratch_size()
+ * @return              The buffer, aligned to DEMOSAIC_SCRATCH_ALIGN
+ */
+void * demosaic_scratch_take(
+        demosaic_scratch * const scratch,
+        const I32 n_bytes);
+
+/** @brief Return every buffer taken from an arena to it, e.g. to take
+ *         buffers for other dimensions
+ *
+ * @param scratch       An initialized arena, empty on return
+ */
+void demosaic_scratch_reset(
+        demosaic_scratch * const scratch);
+
+/** @brief Scratch bytes a mode needs for images of the dimensions of args
+ *
+ *         DEMOSAIC_MODE_STREAM and DEMOSAIC_MODE_PACKED need a line_buffer of
+ *         DEMOSAIC_STREAM_LINES * n_cols pixels; the other modes need none.
+ *         Rounded up to a multiple of DEMOSAIC_SCRATCH_ALIGN, so the sum of
+ *         the sizes of the buffers taken is the size of the arena.
+ *
+ * @param args          Dimensions of the image
+ * @param mode          How the image is demosaiced
+ * @return              Bytes to take from a demosaic_scratch, or 0
+ */
+I32 demosaic_scratch_size(
+        const demosaic_args * const args,
+        const demosaic_mode mode);
+
+/** @brief Peak bytes a mode touches while demosaicing a row, for budgeting
+ *         SRAM
+ *
+ *         The scratch of demosaic_scratch_size(), the bayer lines read and
+ *         output rows written at once, and the library's fixed buffers on
+ *         the stack, for the widest input and output of the mode's
+ *         functions. Excludes the rest of the call stack, e.g. measured
+ *         with -fstack-usage. Bands of the parallel functions each touch
+ *         the DEMOSAIC_MODE_ROWS working set.
+ *
+ * @param args          Dimensions of the image
+ * @param mode          How the image is demosaiced
+ * @return              Bytes, an upper bound
+ */
+I32 demosaic_working_set_size(
+        const demosaic_args * const args,
+        const demosaic_mode mode);
+
+/** @brief Start streaming a bayer frame one line at a time
+ *
+ *         Image dimensions must be positive, even.
+ *
+ *         The stream keeps only the last DEMOSAIC_STREAM_LINES bayer lines,
+ *         in line_buffer, so the whole frame need not be in memory.
+ *         Call again to start the next frame.
+ *
+ * @param stream        The stream to initialize
+ * @param args          Dimensions and maximum value of image
+ * @param line_buffer   Ring buffer owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ */
+void demosaic_stream_init(
+        demosaic_stream * const stream,
+        const demosaic_args * const args,
+        U16 line_buffer[]);
+
+/** @brief Push the next line of a 16-bit bayer frame to a stream,
+ *         and demosaic a row into 16-bit rgb if one is ready
+ *
+ *         Lines must be pushed in order, top to bottom, no more than
+ *         n_rows per frame. Rows are demosaiced with a latency of two lines:
+ *         pushing line k outputs row k - 2. The last two rows are output
+ *         by demosaic_malvar_stream_flush_rgb16().
+ *         Output is identical to demosaic_malvar_rgb16().
+ *
+ * @param stream        An initialized stream
+ * @param line          The next bayer line, n_cols pixels, copied to the stream
+ * @param output_row    Output row of 16-bit RGB pixels, n_cols long,
+ *                      written only if a row is ready.
+ * @return              The index of the row written to output_row,
+ *                      or -1 if no row is ready yet.
+ */
+I32 demosaic_malvar_stream_push_rgb16(
+        demosaic_stream * const stream,
+        const U16 line[],
+        demosaic_pix_rgb16 output_row[]);
+
+/** @brief Demosaic one of the remaining rows of a stream into 16-bit rgb,
+ *         after all lines of the frame have been pushed
+ *
+ *         Call until it returns -1, i.e. twice per frame.
+ *
+ * @param stream        A stream to which all n_rows lines have been pushed
+ * @param output_row    Output row of 16-bit RGB pixels, n_cols long,
+ *                      written only if a row remains.
+ * @return              The index of the row written to output_row,
+ *                      or -1 if all rows have been output.
+ */
+I32 demosaic_malvar_stream_flush_rgb16(
+        demosaic_stream * const stream,
+        demosaic_pix_rgb16 output_row[]);
+
+/** @brief Demosaic a row of a packed 10 or 12-bit bayer image into
+ *         16-bit rgb with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, and a multiple of 4
+ *         columns for RAW10, row must be within image.
+ *         Unpacks the 5 bayer lines around the row into line_buffer; to
+ *         demosaic a whole image, demosaic_malvar_rgb16_packed() unpacks
+ *         each line once.
+ *         Output is identical to demosaic_malvar_rgb16() of the unpacked image.
+ *
+ * @param bayer         An input packed Bayer image
+ * @param args          Dimensions, maximum value of image
+ * @param row           The row to be demosaiced
+ * @param line_buffer   Scratch owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ * @param output_row    Output row of 16-bit RGB pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_rgb16_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        demosaic_pix_rgb16 output_row[]);
+
+/** @brief Demosaic a packed 10 or 12-bit bayer image into
+ *         16-bit rgb with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, and a multiple of 4
+ *         columns for RAW10.
+ *         Lines are unpacked as they are needed, into a ring of
+ *         DEMOSAIC_STREAM_LINES lines, so no unpacked 16-bit image exists.
+ *         Output is identical to demosaic_malvar_rgb16() of the unpacked image.
+ *
+ * @param bayer         An input packed Bayer image
+ * @param args          Dimensions, maximum value of image
+ * @param line_buffer   Scratch owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ * @param output        Output image of 16-bit RGB pixels
+ */
+void demosaic_malvar_rgb16_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        demosaic_pix_rgb16 * output);
+
+/** @brief Demosaic a row of a packed 10 or 12-bit bayer image into
+ *         8-bit rgb with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, and a multiple of 4
+ *         columns for RAW10, row must be within image.
+ *         Unpacks the 5 bayer lines around the row into line_buffer; to
+ *         demosaic a whole image, demosaic_malvar_rgb16to8_packed() unpacks
+ *         each line once.
+ *         Output is identical to demosaic_malvar_rgb16to8() of the unpacked image.
+ *
+ * @param bayer         An input packed Bayer image
+ * @param args          Dimensions, maximum value of image
+ * @param row           The row to be demosaiced
+ * @param line_buffer   Scratch owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ * @param output_row    Output row of 8-bit RGB pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_rgb16to8_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        demosaic_pix_rgb8 output_row[]);
+
+/** @brief Demosaic a packed 10 or 12-bit bayer image into
+ *         8-bit rgb with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, and a multiple of 4
+ *         columns for RAW10.
+ *         Lines are unpacked as they are needed, into a ring of
+ *         DEMOSAIC_STREAM_LINES lines, so no unpacked 16-bit image exists.
+ *         Output is identical to demosaic_malvar_rgb16to8() of the unpacked image.
+ *
+ * @param bayer         An input packed Bayer image
+ * @param args          Dimensions, maximum value of image
+ * @param line_buffer   Scratch owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ * @param output        Output image of 8-bit RGB pixels
+ */
+void demosaic_malvar_rgb16to8_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a row of a packed 10 or 12-bit bayer image into
+ *         16-bit monochrome with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, and a multiple of 4
+ *         columns for RAW10, row must be within image.
+ *         Unpacks the 5 bayer lines around the row into line_buffer; to
+ *         demosaic a whole image, demosaic_malvar_mono16_packed() unpacks
+ *         each line once.
+ *         Output is identical to demosaic_malvar_mono16() of the unpacked image.
+ *
+ * @param bayer         An input packed Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param row           The row to be demosaiced
+ * @param line_buffer   Scratch owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ * @param output_row    Output row of 16-bit monochrome/panchromatic pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_mono16_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        U16 output_row[]);
+
+/** @brief Demosaic a packed 10 or 12-bit bayer image into
+ *         16-bit monochrome with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, and a multiple of 4
+ *         columns for RAW10.
+ *         Lines are unpacked as they are needed, into a ring of
+ *         DEMOSAIC_STREAM_LINES lines, so no unpacked 16-bit image exists.
+ *         Output is identical to demosaic_malvar_mono16() of the unpacked image.
+ *
+ * @param bayer         An input packed Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param line_buffer   Scratch owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ * @param output        Output image of 16-bit monochrome/panchromatic pixels
+ */
+void demosaic_malvar_mono16_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        U16 * output);
+
+/** @brief Demosaic a row of a packed 10 or 12-bit bayer image into
+ *         8-bit monochrome with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, and a multiple of 4
+ *         columns for RAW10, row must be within image.
+ *         Unpacks the 5 bayer lines around the row into line_buffer; to
+ *         demosaic a whole image, demosaic_malvar_mono16to8_packed() unpacks
+ *         each line once.
+ *         Output is identical to demosaic_malvar_mono16to8() of the unpacked image.
+ *
+ * @param bayer         An input packed Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param row           The row to be demosaiced
+ * @param line_buffer   Scratch owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ * @param output_row    Output row of 8-bit monochrome/panchromatic pixels,
+ *                      length must be equal to the width of the Bayer image.
+ */
+void demosaic_malvar_row_mono16to8_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        U8 output_row[]);
+
+/** @brief Demosaic a packed 10 or 12-bit bayer image into
+ *         8-bit monochrome with malvar linear interpolation
+ *
+ *         Image dimensions must be positive, even, and a multiple of 4
+ *         columns for RAW10.
+ *         Lines are unpacked as they are needed, into a ring of
+ *         DEMOSAIC_STREAM_LINES lines, so no unpacked 16-bit image exists.
+ *         Output is identical to demosaic_malvar_mono16to8() of the unpacked image.
+ *
+ * @param bayer         An input packed Bayer image
+ * @param args          Dimensions, maximum value of image, luma coefficients
+ * @param line_buffer   Scratch owned by the caller,
+ *                      DEMOSAIC_STREAM_LINES * args->n_cols pixels long.
+ * @param output        Output image of 8-bit monochrome/panchromatic pixels
+ */
+void demosaic_malvar_mono16to8_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        U8 * output);
+
+/** @brief Push the next line of a packed 10 or 12-bit bayer frame to a
+ *         stream, and demosaic a row into 16-bit rgb if one is ready
+ *
+ *         Like demosaic_malvar_stream_push_rgb16(), but unpacks the line
+ *         straight into the stream's ring buffer. Columns must be a
+ *         multiple of 4 for RAW10. Lines of one frame may mix packed and
+ *         unpacked pushes; flush with demosaic_malvar_stream_flush_rgb16().
+ *
+ * @param stream        An initialized stream
+ * @param packing       How the pixels of line are packed
+ * @param line          The next packed bayer line, n_cols pixels
+ * @param output_row    Output row of 16-bit RGB pixels, n_cols long,
+ *                      written only if a row is ready.
+ * @return              The index of the row written to output_row,
+ *                      or -1 if no row is ready yet.
+ */
+I32 demosaic_malvar_stream_push_packed_rgb16(
+        demosaic_stream * const stream,
+        const demosaic_packing packing,
+        const U8 line[],
+        demosaic_pix_rgb16 output_row[]);
+
+/** @brief Demosaic a pair of rows of a 16-bit bayer image into a row of
+ *         half-resolution 16-bit RGB pixels by subsampling
+ *
+ *         Each 2x2 bayer quad becomes one pixel, with its red, the rounded
+ *         average of its greens, and its blue.
+ *         Image dimensions must be positive, even, row must be within the
+ *         half-resolution image, i.e. less than half the Bayer rows.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image
+ * @param row           The half-resolution row, from Bayer rows 2*row, 2*row+1
+ * @param output_row    Output row of 16-bit RGB pixels,
+ *                      length must be half the width of the Bayer image.
+ */
+void demosaic_subsample_row_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb16 output_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into a half-resolution
+ *         16-bit RGB image by subsampling, see
+ *         demosaic_subsample_row_rgb16()
+ *
+ *         Image dimensions must be positive, even.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image
+ * @param output        Output 16-bit RGB image, with half the rows
+ *                      and half the columns of the Bayer image.
+ */
+void demosaic_subsample_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb16 * output);
+
+/** @brief Demosaic a pair of rows of a 8-bit bayer image into a row of
+ *         half-resolution 8-bit RGB pixels by subsampling
+ *
+ *         Each 2x2 bayer quad becomes one pixel, with its red, the rounded
+ *         average of its greens, and its blue.
+ *         Image dimensions must be positive, even, row must be within the
+ *         half-resolution image, i.e. less than half the Bayer rows.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions, maximum value of image
+ * @param row           The half-resolution row, from Bayer rows 2*row, 2*row+1
+ * @param output_row    Output row of 8-bit RGB pixels,
+ *                      length must be half the width of the Bayer image.
+ */
+void demosaic_subsample_row_rgb8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[]);
+
+/** @brief Demosaic a 8-bit bayer image into a half-resolution
+ *         8-bit RGB image by subsampling, see
+ *         demosaic_subsample_row_rgb8()
+ *
+ *         Image dimensions must be positive, even.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions, maximum value of image
+ * @param output        Output 8-bit RGB image, with half the rows
+ *                      and half the columns of the Bayer image.
+ */
+void demosaic_subsample_rgb8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a pair of rows of a 16-bit bayer image into a row of
+ *         half-resolution 8-bit RGB pixels by subsampling
+ *
+ *         Each 2x2 bayer quad becomes one pixel, with its red, the rounded
+ *         average of its greens, and its blue.
+ *         Image dimensions must be positive, even, row must be within the
+ *         half-resolution image, i.e. less than half the Bayer rows.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift
+ * @param row           The half-resolution row, from Bayer rows 2*row, 2*row+1
+ * @param output_row    Output row of 8-bit RGB pixels,
+ *                      length must be half the width of the Bayer image.
+ */
+void demosaic_subsample_row_rgb16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into a half-resolution
+ *         8-bit RGB image by subsampling, see
+ *         demosaic_subsample_row_rgb16to8()
+ *
+ *         Image dimensions must be positive, even.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift
+ * @param output        Output 8-bit RGB image, with half the rows
+ *                      and half the columns of the Bayer image.
+ */
+void demosaic_subsample_rgb16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb8 * output);
+
+/** @brief Demosaic a pair of rows of a 16-bit bayer image into a row of
+ *         half-resolution 16-bit mono pixels by subsampling
+ *
+ *         Each 2x2 bayer quad becomes one pixel, with its red, the rounded
+ *         average of its greens, and its blue.
+ *         Image dimensions must be positive, even, row must be within the
+ *         half-resolution image, i.e. less than half the Bayer rows.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, coefficients
+ * @param row           The half-resolution row, from Bayer rows 2*row, 2*row+1
+ * @param output_row    Output row of 16-bit mono pixels,
+ *                      length must be half the width of the Bayer image.
+ */
+void demosaic_subsample_row_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 output_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into a half-resolution
+ *         16-bit mono image by subsampling, see
+ *         demosaic_subsample_row_mono16()
+ *
+ *         Image dimensions must be positive, even.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, coefficients
+ * @param output        Output 16-bit mono image, with half the rows
+ *                      and half the columns of the Bayer image.
+ */
+void demosaic_subsample_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        U16 * output);
+
+/** @brief Demosaic a pair of rows of a 8-bit bayer image into a row of
+ *         half-resolution 8-bit mono pixels by subsampling
+ *
+ *         Each 2x2 bayer quad becomes one pixel, with its red, the rounded
+ *         average of its greens, and its blue.
+ *         Image dimensions must be positive, even, row must be within the
+ *         half-resolution image, i.e. less than half the Bayer rows.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions, maximum value of image, coefficients
+ * @param row           The half-resolution row, from Bayer rows 2*row, 2*row+1
+ * @param output_row    Output row of 8-bit mono pixels,
+ *                      length must be half the width of the Bayer image.
+ */
+void demosaic_subsample_row_mono8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 output_row[]);
+
+/** @brief Demosaic a 8-bit bayer image into a half-resolution
+ *         8-bit mono image by subsampling, see
+ *         demosaic_subsample_row_mono8()
+ *
+ *         Image dimensions must be positive, even.
+ *
+ * @param bayer         An input 8-bit Bayer image
+ * @param args          Dimensions, maximum value of image, coefficients
+ * @param output        Output 8-bit mono image, with half the rows
+ *                      and half the columns of the Bayer image.
+ */
+void demosaic_subsample_mono8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        U8 * output);
+
+/** @brief Demosaic a pair of rows of a 16-bit bayer image into a row of
+ *         half-resolution 8-bit mono pixels by subsampling
+ *
+ *         Each 2x2 bayer quad becomes one pixel, with its red, the rounded
+ *         average of its greens, and its blue.
+ *         Image dimensions must be positive, even, row must be within the
+ *         half-resolution image, i.e. less than half the Bayer rows.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift, coefficients
+ * @param row           The half-resolution row, from Bayer rows 2*row, 2*row+1
+ * @param output_row    Output row of 8-bit mono pixels,
+ *                      length must be half the width of the Bayer image.
+ */
+void demosaic_subsample_row_mono16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 output_row[]);
+
+/** @brief Demosaic a 16-bit bayer image into a half-resolution
+ *         8-bit mono image by subsampling, see
+ *         demosaic_subsample_row_mono16to8()
+ *
+ *         Image dimensions must be positive, even.
+ *
+ * @param bayer         An input 16-bit Bayer image
+ * @param args          Dimensions, maximum value of image, shift, coefficients
+ * @param output        Output 8-bit mono image, with half the rows
+ *                      and half the columns of the Bayer image.
+ */
+void demosaic_subsample_mono16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        U8 * output);
+
 #ifdef __cplusplus
    }
 #endif
@@ -34,7 +34,64 @@ typedef struct {
     F64 blue;
 } demosaic_luma_coefs;
 
-/// arguments for the demosaicing operation
+/// bayer patterns, named by the colors of the top left 2x2 pixels
+typedef enum {
+    DEMOSAIC_RGGB = 0, /// red at (0, 0), blue at (1, 1)
+    DEMOSAIC_GRBG = 1, /// red at (0, 1), blue at (1, 0)
+    DEMOSAIC_GBRG = 2, /// red at (1, 0), blue at (0, 1)
+    DEMOSAIC_BGGR = 3  /// red at (1, 1), blue at (0, 0)
+} demosaic_pattern;
+
+/// channels of the bayer pattern, by position in pattern coordinates
+typedef enum {
+    DEMOSAIC_CFA_RED = 0,        /// red, at (0, 0)
+    DEMOSAIC_CFA_GREEN_RED = 1,  /// green in red rows, at (0, 1)
+    DEMOSAIC_CFA_GREEN_BLUE = 2, /// green in blue rows, at (1, 0)
+    DEMOSAIC_CFA_BLUE = 3        /// blue, at (1, 1)
+} demosaic_cfa_channel;
+
+/// number of fractional bits of white balance gains,
+/// i.e. a gain of 1 << DEMOSAIC_GAIN_BITS is unity
+#define DEMOSAIC_GAIN_BITS 8
+
+/// largest gain * max_val, so kernel sums of calibrated pixels fit in I32.
+/// i.e. gains up to 12.8 for 12-bit input, or 3.2 for 16-bit input
+#define DEMOSAIC_GAIN_MAX_PRODUCT 0x03333333
+
+/** black level and white balance gain of each bayer channel, by
+    demosaic_cfa_channel, applied to bayer pixels within the kernels.
+    Each pixel is calibrated to (pixel - black) * gain, in full precision and
+    without clamping, before interpolation. Outputs, including each
+    pixel's own channel, are then divided by 1 << DEMOSAIC_GAIN_BITS and
+    clamped to [0, max_val] */
+typedef struct {
+    U16 black[4]; /// at most max_val
+    U16 gain[4];  /// at most DEMOSAIC_GAIN_MAX_PRODUCT / max_val
+} demosaic_calibration;
+
+/// number of fractional bits of color correction matrix coefficients,
+/// i.e. a coefficient of 1 << DEMOSAIC_CCM_BITS is unity
+#define DEMOSAIC_CCM_BITS 10
+
+/** largest sum of the absolute coefficients of a matrix row, times max_val,
+    and times the largest gain over 1 << DEMOSAIC_GAIN_BITS if calibrated,
+    so corrected sums fit in I32. i.e. rows summing to 8.0 for 16-bit input */
+#define DEMOSAIC_CCM_MAX_PRODUCT 0x20000000
+
+/** 3x3 color correction matrix, i.e. sensor to sRGB, applied to the
+    interpolated red, green and blue of each pixel within the kernels.
+    Output channel i is the sum over j of coef[i][j] times input channel j,
+    red, green and blue, divided by 1 << DEMOSAIC_CCM_BITS and rounded.
+    Inputs are unclamped, and outputs are then clamped to [0, max_val] */
+typedef struct {
+    I32 coef[3][3];
+} demosaic_ccm;
+
+/** arguments for the demosaicing operation
+    Set the defaults with demosaic_args_init(), or zero-initialize before
+    setting fields, i.e. demosaic_args args = {0}, so that pattern is
+    DEMOSAIC_RGGB and calibration, ccm and lut are NULL unless set.
+    Fields added to this struct default to off when zero. */
 typedef struct {
     I32 n_rows; /// number of rows in the bayer image
     I32 n_cols; /// number of columns in the bayer image
@@ -49,8 +106,60 @@ typedef struct {
     I32 rshift;
     /// if demosacing to mono, the coefficients to use
     demosaic_luma_coefs coefs;
+    /// the bayer pattern of the image, DEMOSAIC_RGGB if top left is red
+    demosaic_pattern pattern;
+    /// black levels and white balance gains, or NULL for raw bayer pixels
+    const demosaic_calibration * calibration;
+    /// color correction matrix, or NULL for sensor colors
+    const demosaic_ccm * ccm;
+    /** tone curve, i.e. gamma, of max_val + 1 entries, mapping 16-bit values
+        to the outputs of the 16to8 functions in place of rshift,
+        or NULL to shift */
+    const U8 * lut;
 } demosaic_args;
 
+/// number of fractional bits of fixed-point luma weights
+#define DEMOSAIC_LUMA_FIXED_BITS 15
+
+/// luma coefficients as fixed-point integer weights,
+/// scaled by 1 << DEMOSAIC_LUMA_FIXED_BITS
+typedef struct {
+    I32 red;
+    I32 green;
+    I32 blue;
+} demosaic_luma_fixed;
+
+/// how the functions taking a demosaic_plan store whole-image output
+typedef enum {
+    DEMOSAIC_STORE_CACHED = 0,   /// ordinary stores, through the cache
+    DEMOSAIC_STORE_STREAMING = 1 /// non-temporal stores, around the cache,
+                                 /// and prefetch of the next bayer rows
+} demosaic_store;
+
+/** arguments for the demosaicing operation, validated and precomputed once
+    by demosaic_plan_init(), so the *_plan functions can skip per-row setup */
+typedef struct {
+    demosaic_args args;               /// copy of the validated arguments
+    demosaic_luma_coefs coefs_normed; /// luma coefficients, normalized
+    demosaic_luma_fixed luma_fixed;   /// coefs_normed as fixed-point weights
+    I32 max_val_shifted;              /// args.max_val >> args.rshift
+    /// how the whole-image *_plan and *_batch functions store output,
+    /// DEMOSAIC_STORE_CACHED from demosaic_plan_init(), may be set after
+    demosaic_store store;
+} demosaic_plan;
+
+/// a rectangle of pixels within an image
+typedef struct {
+    I32 row;    /// first row
+    I32 col;    /// first column
+    I32 n_rows; /// number of rows
+    I32 n_cols; /// number of columns
+} demosaic_rect;
+
+/// bayer pixels read on each side of an output pixel by the malvar kernel,
+/// so a changed bayer pixel changes output this far away
+#define DEMOSAIC_KERNEL_RADIUS 2
+
 /// a 3x16bit rgb pixel
 typedef struct {
     U16 red;
@@ -65,4 +174,136 @@ typedef struct {
     U8 blue;
 } demosaic_pix_rgb8;
 
+/** row pitches, in bytes from the start of one row to the next,
+    for bayer images and output held in padded or aligned buffers */
+typedef struct {
+    I32 input;  /// bayer pitch, at least n_cols pixels, a multiple of one
+    I32 output; /// output pitch, at least n_cols output pixels, and a
+                /// multiple of the output channel size
+} demosaic_pitch;
+
+/// separate red, green and blue planes of 16-bit pixels
+typedef struct {
+    U16 * red;   /// red plane
+    U16 * green; /// green plane
+    U16 * blue;  /// blue plane
+    I32 stride;  /// pixels from the start of one plane row to the next
+} demosaic_planes16;
+
+/// separate red, green and blue planes of 8-bit pixels
+typedef struct {
+    U8 * red;    /// red plane
+    U8 * green;  /// green plane
+    U8 * blue;   /// blue plane
+    I32 stride;  /// pixels from the start of one plane row to the next
+} demosaic_planes8;
+
+/// chroma subsampling of YCbCr outputs
+typedef enum {
+    DEMOSAIC_YUV420 = 0, /// one cb and cr sample per 2x2 pixels
+    DEMOSAIC_YUV422 = 1  /// one cb and cr sample per 2 pixels of a row
+} demosaic_yuv_format;
+
+/** separate planes of 8-bit full range YCbCr pixels, i.e. for JPEG or a
+    video encoder. Luma is at full resolution, chroma at half width, and
+    for DEMOSAIC_YUV420 at half height. */
+typedef struct {
+    U8 * y;               /// luma plane
+    U8 * cb;              /// blue difference chroma plane
+    U8 * cr;              /// red difference chroma plane
+    I32 y_stride;         /// pixels from the start of one luma row to the next
+    I32 chroma_stride;    /// pixels from the start of one chroma row to the
+                          /// next, for both chroma planes
+} demosaic_planes_yuv8;
+
+/// a job run by a demosaic_dispatcher, index is in [0, n_jobs)
+typedef void (*demosaic_job_fn)(void * job_context, I32 index);
+
+/** runs job(job_context, index) once for every index in [0, n_jobs),
+    possibly concurrently, and returns only after all jobs have finished.
+    pool_context is the demosaic_dispatcher's, i.e. a worker pool. */
+typedef void (*demosaic_dispatch_fn)(
+        void * pool_context,
+        demosaic_job_fn job,
+        void * job_context,
+        I32 n_jobs);
+
+/// how to split whole-image demosaicing into jobs,
+/// and who runs them, i.e. a framework's thread pool
+typedef struct {
+    demosaic_dispatch_fn dispatch; /// runs the jobs
+    void * pool_context;           /// passed to dispatch
+    I32 n_bands;                   /// number of row bands (jobs), >= 1
+} demosaic_dispatcher;
+
+/// number of bayer lines held by a demosaic_stream
+#define DEMOSAIC_STREAM_LINES 5
+
+/// state for demosaicing a frame fed one bayer line at a time
+typedef struct {
+    demosaic_args args; /// dimensions and maximum value of the frame
+    U16 * lines;        /// ring of DEMOSAIC_STREAM_LINES lines, caller-owned
+    I32 n_lines_in;     /// number of lines pushed this frame
+    I32 n_rows_out;     /// number of rows demosaiced this frame
+} demosaic_stream;
+
+/// MIPI CSI-2 packings of bayer pixels. Each group of pixels holds their
+/// high 8 bits in a byte each, then their low bits in one byte,
+/// the first pixel in the least significant bits.
+typedef enum {
+    DEMOSAIC_PACKED_RAW10 = 0, /// 10-bit pixels, 4 in 5 bytes
+    DEMOSAIC_PACKED_RAW12 = 1  /// 12-bit pixels, 2 in 3 bytes
+} demosaic_packing;
+
+/// a packed bayer image, e.g. as received from a MIPI CSI-2 sensor
+typedef struct {
+    const U8 * data;          /// first byte of the top row
+    demosaic_packing packing; /// how pixels are packed
+    I32 pitch;                /// bytes from the start of one row to the
+                              /// next, at least one packed row
+} demosaic_packed;
+
+/// alignment in bytes of every buffer taken from a demosaic_scratch,
+/// one cache line
+#define DEMOSAIC_SCRATCH_ALIGN 64
+
+/// ways of demosaicing, for sizing scratch and working sets, see
+/// demosaic_scratch_size() and demosaic_working_set_size()
+typedef enum {
+    DEMOSAIC_MODE_ROWS = 0,   /// the row, image, region, tiled, dirty,
+                              /// pitched, planar, plan, fused, batch and
+                              /// subsample functions, and each band of the
+                              /// parallel ones
+    DEMOSAIC_MODE_STREAM = 1, /// a demosaic_stream, its ring in scratch
+    DEMOSAIC_MODE_PACKED = 2, /// the packed functions, their lines in scratch
+    DEMOSAIC_MODE_YUV = 3     /// the yuv functions
+} demosaic_mode;
+
+/// a caller-owned arena, e.g. a static pool, from which the buffers of the
+/// demosaic functions are taken once, so nothing is allocated after init
+typedef struct {
+    U8 * base;   /// first byte, aligned to DEMOSAIC_SCRATCH_ALIGN
+    I32 n_bytes; /// bytes in the arena
+    I32 n_used;  /// bytes taken, a multiple of DEMOSAIC_SCRATCH_ALIGN
+} demosaic_scratch;
+
+/// engines of the vectorized image interiors, see demosaic_engine_init().
+/// Within each architecture, from narrowest to widest.
+typedef enum {
+    DEMOSAIC_ENGINE_AUTO = 0,   /// the widest engine the host supports
+    DEMOSAIC_ENGINE_SCALAR = 1, /// the scalar kernels only, on any host
+    DEMOSAIC_ENGINE_SSE2 = 2,   /// x86, 4 lanes, the x86-64 baseline
+    DEMOSAIC_ENGINE_SSE41 = 3,  /// x86, 4 lanes, SSE4.1
+    DEMOSAIC_ENGINE_AVX2 = 4,   /// x86, 8 lanes, AVX2
+    DEMOSAIC_ENGINE_NEON = 5    /// ARM, 4 lanes
+} demosaic_engine;
+
+/// stages reported to the instrumentation hooks of demosaic_conf_private.h
+typedef enum {
+    DEMOSAIC_STAGE_IMAGE = 0,     /// a whole-image call, enclosing the others
+    DEMOSAIC_STAGE_EDGE_ROWS = 1, /// top and bottom two rows, mirrored
+    DEMOSAIC_STAGE_EDGE_COLS = 2, /// left and right two columns of other rows
+    DEMOSAIC_STAGE_INTERIOR = 3   /// everything else, vectorized if enabled
+} demosaic_stage;
+
 #endif // DEMOSAIC_TYPES_PUB_H
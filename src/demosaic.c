@@ -17,9 +17,9 @@
  * @file        demosaic.c
  * @date        2020-05-19
  * @author      Neil Abcouwer
- * @brief       Functions for Malvar Demosaicing RGGB Bayer Images
+ * @brief       Functions for Malvar Demosaicing Bayer Images
  *
- * These functions support linear demosaicing from RGGB format images
+ * These functions support linear demosaicing from RGGB, GRBG, GBRG or BGGR format images
  * stored in 16-bit or 8-bit unsigned integer arrays
  * to 16-bit or 8-bit RGB or monochrmome/panchromatic pixels.
  *
@@ -40,18 +40,128 @@
 #include <demosaic/demosaic_pub.h>
 #include <demosaic/demosaic_conf_private.h>
 
-// macros for faster access
+#include <string.h>
 
-// get pixel value in image buffer with NO safety checking
-#define GET_PIX(bayer, n_cols, row, col) \
-    ((bayer)[(n_cols)*(row)+(col)])
+// macros for faster access
 
 // constrain between limits, inclusive
 #define DM_LIMIT(x, min, max) \
     ( ( (x) >= (max) ) ? (max) : ( ( (x) <= (min) ) ? (min) : (x) ) )
 
+// 1 if x is outside [0, max], so would be clamped
+#define DM_CLAMPED(x, max) ((((x) < 0) || ((x) > (max))) ? 1 : 0)
+
+// offsets from image to pattern coordinates, in which red is at (0, 0),
+// for the bayer pattern of args. Mirroring at the edges keeps parity,
+// so the offsets apply unchanged to mirrored rows and columns.
+#define DM_ROW_OFFSET(args) (((I32) (args)->pattern >> 1) & 1)
+#define DM_COL_OFFSET(args) ((I32) (args)->pattern & 1)
+
+// entry of a tone curve lut for 16-bit value v, limited to max_val
+// so out of range bayer pixels, passed through raw, stay in the table
+#define DM_LUT(lut, v, max_val) ((lut)[((v) > (max_val)) ? (max_val) : (v)])
+
+// 8-bit output of 16-bit value v, by the lut of args, or shifted if none
+#define DM_TO8(args, v) (((args)->lut != NULL) \
+    ? DM_LUT((args)->lut, (v), (I32) (args)->max_val) : ((v) >> (args)->rshift))
+
+// 1 if args calibrates or color corrects pixels, so needs the corrected
+// kernels, which apply both before clamping
+#define DM_CORRECTED(args) \
+    (((args)->calibration != NULL) || ((args)->ccm != NULL))
+
+// apply the color correction matrix to unclamped red, green and blue,
+// rounding. Negative sums round differently from an arithmetic shift,
+// but clamp to 0 either way.
+static inline void demosaic_correct_rgb(const demosaic_ccm * const ccm,
+        I32 * const red, I32 * const green, I32 * const blue)
+{
+    const I32 in[3] = {*red, *green, *blue};
+    I32 out[3];
+    for (I32 i = 0; i < 3; i++) {
+        out[i] = (ccm->coef[i][0] * in[0] + ccm->coef[i][1] * in[1]
+                  + ccm->coef[i][2] * in[2] + (1 << (DEMOSAIC_CCM_BITS - 1)))
+               / (1 << DEMOSAIC_CCM_BITS);
+    }
+    *red = out[0];
+    *green = out[1];
+    *blue = out[2];
+}
+
+// luma weights applied to rgb by the mono functions, and how they are applied.
+// With DEMOSAIC_FIXED_POINT_LUMA, weights are integers scaled by
+// 1 << DM_LUMA_BITS, so luma needs no floating point. Weights sum to at
+// most 1 << DM_LUMA_BITS, so 16-bit rgb cannot overflow I32.
+#define DM_LUMA_BITS DEMOSAIC_LUMA_FIXED_BITS
+#if defined(DEMOSAIC_FIXED_POINT_LUMA) && (DEMOSAIC_FIXED_POINT_LUMA != 0)
+#define DM_FIXED_LUMA
+typedef demosaic_luma_fixed demosaic_luma_weights;
+#define DM_LUMA(w, r, g, b) \
+    (((w).red * (r) + (w).green * (g) + (w).blue * (b) \
+      + (1 << (DM_LUMA_BITS - 1))) >> DM_LUMA_BITS)
+#else
+typedef demosaic_luma_coefs demosaic_luma_weights;
+#define DM_LUMA(w, r, g, b) \
+    ((w).red * (r) + (w).green * (g) + (w).blue * (b) + 0.5)
+#endif
+
+// the per-pixel reference functions, demosaic_malvar_row_*_unoptimized,
+// and their get_* helpers are compiled only if the configuration asks for
+// them, i.e. for unit tests, as all rows now use the span kernels
+#if defined(DEMOSAIC_REFERENCE) && (DEMOSAIC_REFERENCE != 0)
+#define DM_REFERENCE
+#endif
+
+// the scalar interior kernels slide a window of taps along each row,
+// rather than loading all taps of each pixel, if the configuration asks
+// for it. Output is identical.
+#if defined(DEMOSAIC_RUNNING_SUMS) && (DEMOSAIC_RUNNING_SUMS != 0)
+#define DM_RUNNING_SUMS
+#endif
+
+// instrumentation hooks, mapped to those of demosaic_conf_private.h
+// if the configuration enables them, otherwise compiled to nothing.
+// DM_COUNT adds n to count only when instrumenting, else just evaluates n.
+#if defined(DEMOSAIC_INSTRUMENT) && (DEMOSAIC_INSTRUMENT != 0)
+#define DM_INSTRUMENT
+#define DM_STAGE_BEGIN(stage) DEMOSAIC_STAGE_BEGIN(stage)
+#define DM_STAGE_END(stage, n_pixels) DEMOSAIC_STAGE_END(stage, n_pixels)
+#define DM_STAGE_CLAMPS(stage, n_clamped) \
+    DEMOSAIC_STAGE_CLAMPS(stage, n_clamped)
+#define DM_COUNT(count, n) ((count) += (n))
+#else
+#define DM_STAGE_BEGIN(stage) ((void) 0)
+#define DM_STAGE_END(stage, n_pixels) ((void) (n_pixels))
+#define DM_STAGE_CLAMPS(stage, n_clamped) ((void) 0)
+#define DM_COUNT(count, n) ((void) (n))
+#endif
+
+// vector helpers of the kernels are always inlined, as the rest of this
+// file otherwise exhausts the compiler's inlining budget before them,
+// and are compiled for the instruction set of their engine
+#if defined(__GNUC__)
+#define DM_V_INLINE static inline __attribute__((always_inline)) DM_V_TARGET
+#else
+#define DM_V_INLINE static inline DM_V_TARGET
+#endif
+
+// DM_SIMD is defined if the configuration allows vectorized kernels and
+// the compiler targets x86 with SSE2, or NEON; see "vector engines".
+#if defined(DEMOSAIC_SIMD) && (DEMOSAIC_SIMD != 0)
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define DM_SIMD
+#define DM_ENGINE_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DM_SIMD
+#define DM_ENGINE_NEON
+#endif
+#endif
+
 // private helper functions
 
+#ifdef DM_REFERENCE
 // get pixel. if out of bounds, get closest pixel of same bayer color
 DEMOSAIC_PRIVATE U16 get_pixel16_safe(const U16 * const bayer,
         const I32 n_rows, const I32 n_cols, I32 row, I32 col)
@@ -95,6 +205,68 @@ DEMOSAIC_PRIVATE U8 get_pixel8_safe(const U8 * const bayer,
     return bayer[n_cols*row + col];
 }
 
+// scale of calibrated pixels, relative to raw pixels
+#define DM_CAL_SCALE(args) \
+    (((args)->calibration != NULL) ? (1 << DEMOSAIC_GAIN_BITS) : 1)
+
+// calibration channel of (row, col), which may be up to 2 out of bounds
+#define DM_CAL_CHANNEL(args, row, col) \
+    (2 * (((row) + 2 + DM_ROW_OFFSET(args)) % 2) \
+     + (((col) + 2 + DM_COL_OFFSET(args)) % 2))
+
+// get pixel as get_pixel16_safe(). if args has a calibration,
+// get gain * (pixel - black), DM_CAL_SCALE() times the calibrated pixel
+DEMOSAIC_PRIVATE I32 get_cal_pixel16(const U16 * const bayer,
+        const demosaic_args * const args, const I32 row, const I32 col)
+{
+    const I32 val = get_pixel16_safe(bayer, args->n_rows, args->n_cols,
+            row, col);
+    const demosaic_calibration * const cal = args->calibration;
+
+    if (cal == NULL) {
+        return val;
+    }
+    const I32 ch = DM_CAL_CHANNEL(args, row, col);
+    return (I32)cal->gain[ch] * (val - (I32)cal->black[ch]);
+}
+
+DEMOSAIC_PRIVATE I32 get_cal_pixel8(const U8 * const bayer,
+        const demosaic_args * const args, const I32 row, const I32 col)
+{
+    const I32 val = get_pixel8_safe(bayer, args->n_rows, args->n_cols,
+            row, col);
+    const demosaic_calibration * const cal = args->calibration;
+
+    if (cal == NULL) {
+        return val;
+    }
+    const I32 ch = DM_CAL_CHANNEL(args, row, col);
+    return (I32)cal->gain[ch] * (val - (I32)cal->black[ch]);
+}
+
+// limit a kernel output to [0, max_val], unless args has a color
+// correction matrix, which is applied to unclamped outputs
+#define DM_REF_LIMIT(args, val, max_val) \
+    (((args)->ccm != NULL) ? (val) : DM_LIMIT(val, 0, max_val))
+
+// get the output value of the bayer pixel at (row, col),
+// calibrated if args has a calibration, and limited as DM_REF_LIMIT()
+DEMOSAIC_PRIVATE I32 get_center16(const U16 * const bayer,
+        const demosaic_args * const args, const I32 row, const I32 col)
+{
+    const I32 val = get_cal_pixel16(bayer, args, row, col)
+            / DM_CAL_SCALE(args);
+    return DM_REF_LIMIT(args, val, (I32)args->max_val);
+}
+
+DEMOSAIC_PRIVATE I32 get_center8(const U8 * const bayer,
+        const demosaic_args * const args, const I32 row, const I32 col)
+{
+    const I32 val = get_cal_pixel8(bayer, args, row, col)
+            / DM_CAL_SCALE(args);
+    return DM_REF_LIMIT(args, val, (I32)args->max_val);
+}
+
 // get rgb values from linear interpolation of bayer pixels
 
 // interpolate green value from a bayer pixel that is not green
@@ -104,56 +276,52 @@ DEMOSAIC_PRIVATE U8 get_pixel8_safe(const U8 * const bayer,
 // -1 +2 +4 +2 -1
 //       +2
 //       -1
-DEMOSAIC_PRIVATE U16 get_green16(
+DEMOSAIC_PRIVATE I32 get_green16(
         const U16 * const bayer,
         const demosaic_args * const args,
         const I32 row, const I32 col)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
-    I32 n_rows = args->n_rows;
-    I32 n_cols = args->n_cols;
     I32 max_val = (I32)args->max_val;
     I32 val = 0;
 
-    val =   ( get_pixel16_safe(bayer, n_rows, n_cols, row - 2, col + 0) * -1
-            + get_pixel16_safe(bayer, n_rows, n_cols, row - 1, col + 0) * +2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col - 2) * -1
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col - 1) * +2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 0) * +4
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 1) * +2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 2) * -1
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 1, col + 0) * +2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 2, col + 0) * -1)
-          / 8;
-
-    return (U16) DM_LIMIT(val, 0, max_val);
+    val =   ( get_cal_pixel16(bayer, args, row - 2, col + 0) * -1
+            + get_cal_pixel16(bayer, args, row - 1, col + 0) * +2
+            + get_cal_pixel16(bayer, args, row + 0, col - 2) * -1
+            + get_cal_pixel16(bayer, args, row + 0, col - 1) * +2
+            + get_cal_pixel16(bayer, args, row + 0, col + 0) * +4
+            + get_cal_pixel16(bayer, args, row + 0, col + 1) * +2
+            + get_cal_pixel16(bayer, args, row + 0, col + 2) * -1
+            + get_cal_pixel16(bayer, args, row + 1, col + 0) * +2
+            + get_cal_pixel16(bayer, args, row + 2, col + 0) * -1)
+          / (8 * DM_CAL_SCALE(args));
+
+    return DM_REF_LIMIT(args, val, max_val);
 }
 
-DEMOSAIC_PRIVATE U8 get_green8(
+DEMOSAIC_PRIVATE I32 get_green8(
         const U8 * const bayer,
         const demosaic_args * const args,
         const I32 row, const I32 col)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
-    I32 n_rows = args->n_rows;
-    I32 n_cols = args->n_cols;
     I32 max_val = (I32)args->max_val;
     I32 val = 0;
 
-    val =   ( get_pixel8_safe(bayer, n_rows, n_cols, row - 2, col + 0) * -1
-            + get_pixel8_safe(bayer, n_rows, n_cols, row - 1, col + 0) * +2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col - 2) * -1
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col - 1) * +2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 0) * +4
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 1) * +2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 2) * -1
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 1, col + 0) * +2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 2, col + 0) * -1)
-          / 8;
-
-    return (U8) DM_LIMIT(val, 0, max_val);
+    val =   ( get_cal_pixel8(bayer, args, row - 2, col + 0) * -1
+            + get_cal_pixel8(bayer, args, row - 1, col + 0) * +2
+            + get_cal_pixel8(bayer, args, row + 0, col - 2) * -1
+            + get_cal_pixel8(bayer, args, row + 0, col - 1) * +2
+            + get_cal_pixel8(bayer, args, row + 0, col + 0) * +4
+            + get_cal_pixel8(bayer, args, row + 0, col + 1) * +2
+            + get_cal_pixel8(bayer, args, row + 0, col + 2) * -1
+            + get_cal_pixel8(bayer, args, row + 1, col + 0) * +2
+            + get_cal_pixel8(bayer, args, row + 2, col + 0) * -1)
+          / (8 * DM_CAL_SCALE(args));
+
+    return DM_REF_LIMIT(args, val, max_val);
 }
 
 // interpolate red or blue value from a green bayer pixel value,
@@ -167,60 +335,56 @@ DEMOSAIC_PRIVATE U8 get_green8(
 // -2 +8 +10 +8 -2
 //    -2     -2
 //       +1
-DEMOSAIC_PRIVATE U16 get_red_blue_from_row16(
+DEMOSAIC_PRIVATE I32 get_red_blue_from_row16(
         const U16 * const bayer,
         const demosaic_args * const args,
         const I32 row, const I32 col)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
-    I32 n_rows = args->n_rows;
-    I32 n_cols = args->n_cols;
     I32 max_val = (I32)args->max_val;
     I32 val = 0;
 
-    val =   ( get_pixel16_safe(bayer, n_rows, n_cols, row - 2, col + 0) * +1
-            + get_pixel16_safe(bayer, n_rows, n_cols, row - 1, col - 1) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row - 1, col + 1) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col - 2) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col - 1) * +8
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 0) * +10
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 1) * +8
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 2) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 1, col - 1) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 1, col + 1) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 2, col + 0) * +1)
-          / 16;
-
-    return (U16) DM_LIMIT(val, 0, max_val);
+    val =   ( get_cal_pixel16(bayer, args, row - 2, col + 0) * +1
+            + get_cal_pixel16(bayer, args, row - 1, col - 1) * -2
+            + get_cal_pixel16(bayer, args, row - 1, col + 1) * -2
+            + get_cal_pixel16(bayer, args, row + 0, col - 2) * -2
+            + get_cal_pixel16(bayer, args, row + 0, col - 1) * +8
+            + get_cal_pixel16(bayer, args, row + 0, col + 0) * +10
+            + get_cal_pixel16(bayer, args, row + 0, col + 1) * +8
+            + get_cal_pixel16(bayer, args, row + 0, col + 2) * -2
+            + get_cal_pixel16(bayer, args, row + 1, col - 1) * -2
+            + get_cal_pixel16(bayer, args, row + 1, col + 1) * -2
+            + get_cal_pixel16(bayer, args, row + 2, col + 0) * +1)
+          / (16 * DM_CAL_SCALE(args));
+
+    return DM_REF_LIMIT(args, val, max_val);
 }
 
-DEMOSAIC_PRIVATE U8 get_red_blue_from_row8(
+DEMOSAIC_PRIVATE I32 get_red_blue_from_row8(
         const U8 * const bayer,
         const demosaic_args * const args,
         const I32 row, const I32 col)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
-    I32 n_rows = args->n_rows;
-    I32 n_cols = args->n_cols;
     I32 max_val = (I32)args->max_val;
     I32 val = 0;
 
-    val =   ( get_pixel8_safe(bayer, n_rows, n_cols, row - 2, col + 0) * +1
-            + get_pixel8_safe(bayer, n_rows, n_cols, row - 1, col - 1) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row - 1, col + 1) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col - 2) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col - 1) * +8
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 0) * +10
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 1) * +8
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 2) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 1, col - 1) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 1, col + 1) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 2, col + 0) * +1)
-          / 16;
-
-    return (U16) DM_LIMIT(val, 0, max_val);
+    val =   ( get_cal_pixel8(bayer, args, row - 2, col + 0) * +1
+            + get_cal_pixel8(bayer, args, row - 1, col - 1) * -2
+            + get_cal_pixel8(bayer, args, row - 1, col + 1) * -2
+            + get_cal_pixel8(bayer, args, row + 0, col - 2) * -2
+            + get_cal_pixel8(bayer, args, row + 0, col - 1) * +8
+            + get_cal_pixel8(bayer, args, row + 0, col + 0) * +10
+            + get_cal_pixel8(bayer, args, row + 0, col + 1) * +8
+            + get_cal_pixel8(bayer, args, row + 0, col + 2) * -2
+            + get_cal_pixel8(bayer, args, row + 1, col - 1) * -2
+            + get_cal_pixel8(bayer, args, row + 1, col + 1) * -2
+            + get_cal_pixel8(bayer, args, row + 2, col + 0) * +1)
+          / (16 * DM_CAL_SCALE(args));
+
+    return DM_REF_LIMIT(args, val, max_val);
 }
 
 // interpolate red or blue value from a green bayer pixel,
@@ -233,60 +397,56 @@ DEMOSAIC_PRIVATE U8 get_red_blue_from_row8(
 // +1   +10    +1
 //    -2 +8 -2
 //       -2
-DEMOSAIC_PRIVATE U16 get_red_blue_from_column16(
+DEMOSAIC_PRIVATE I32 get_red_blue_from_column16(
         const U16 * const bayer,
         const demosaic_args * const args,
         const I32 row, const I32 col)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
-    I32 n_rows = args->n_rows;
-    I32 n_cols = args->n_cols;
     I32 max_val = (I32)args->max_val;
     I32 val = 0;
 
-    val =   ( get_pixel16_safe(bayer, n_rows, n_cols, row - 2, col + 0) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row - 1, col - 1) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row - 1, col + 0) * +8
-            + get_pixel16_safe(bayer, n_rows, n_cols, row - 1, col + 1) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col - 2) * +1
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 0) * +10
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 2) * +1
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 1, col - 1) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 1, col + 0) * +8
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 1, col + 1) * -2
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 2, col + 0) * -2)
-          / 16;
-
-    return (U16) DM_LIMIT(val, 0, max_val);
+    val =   ( get_cal_pixel16(bayer, args, row - 2, col + 0) * -2
+            + get_cal_pixel16(bayer, args, row - 1, col - 1) * -2
+            + get_cal_pixel16(bayer, args, row - 1, col + 0) * +8
+            + get_cal_pixel16(bayer, args, row - 1, col + 1) * -2
+            + get_cal_pixel16(bayer, args, row + 0, col - 2) * +1
+            + get_cal_pixel16(bayer, args, row + 0, col + 0) * +10
+            + get_cal_pixel16(bayer, args, row + 0, col + 2) * +1
+            + get_cal_pixel16(bayer, args, row + 1, col - 1) * -2
+            + get_cal_pixel16(bayer, args, row + 1, col + 0) * +8
+            + get_cal_pixel16(bayer, args, row + 1, col + 1) * -2
+            + get_cal_pixel16(bayer, args, row + 2, col + 0) * -2)
+          / (16 * DM_CAL_SCALE(args));
+
+    return DM_REF_LIMIT(args, val, max_val);
 }
 
-DEMOSAIC_PRIVATE U8 get_red_blue_from_column8(
+DEMOSAIC_PRIVATE I32 get_red_blue_from_column8(
         const U8 * const bayer,
         const demosaic_args * const args,
         const I32 row, const I32 col)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
-    I32 n_rows = args->n_rows;
-    I32 n_cols = args->n_cols;
     I32 max_val = (I32)args->max_val;
     I32 val = 0;
 
-    val =   ( get_pixel8_safe(bayer, n_rows, n_cols, row - 2, col + 0) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row - 1, col - 1) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row - 1, col + 0) * +8
-            + get_pixel8_safe(bayer, n_rows, n_cols, row - 1, col + 1) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col - 2) * +1
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 0) * +10
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 2) * +1
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 1, col - 1) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 1, col + 0) * +8
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 1, col + 1) * -2
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 2, col + 0) * -2)
-          / 16;
-
-    return (U16) DM_LIMIT(val, 0, max_val);
+    val =   ( get_cal_pixel8(bayer, args, row - 2, col + 0) * -2
+            + get_cal_pixel8(bayer, args, row - 1, col - 1) * -2
+            + get_cal_pixel8(bayer, args, row - 1, col + 0) * +8
+            + get_cal_pixel8(bayer, args, row - 1, col + 1) * -2
+            + get_cal_pixel8(bayer, args, row + 0, col - 2) * +1
+            + get_cal_pixel8(bayer, args, row + 0, col + 0) * +10
+            + get_cal_pixel8(bayer, args, row + 0, col + 2) * +1
+            + get_cal_pixel8(bayer, args, row + 1, col - 1) * -2
+            + get_cal_pixel8(bayer, args, row + 1, col + 0) * +8
+            + get_cal_pixel8(bayer, args, row + 1, col + 1) * -2
+            + get_cal_pixel8(bayer, args, row + 2, col + 0) * -2)
+          / (16 * DM_CAL_SCALE(args));
+
+    return DM_REF_LIMIT(args, val, max_val);
 }
 
 // get red or blue value from a blue or red bayer pixel, respectively
@@ -299,56 +459,52 @@ DEMOSAIC_PRIVATE U8 get_red_blue_from_column8(
 // -3   +12    -3
 //    +4    +4
 //       -3
-DEMOSAIC_PRIVATE U16 get_red_blue_from_opposite16(
+DEMOSAIC_PRIVATE I32 get_red_blue_from_opposite16(
         const U16 * const bayer,
         const demosaic_args * const args,
         const I32 row, const I32 col)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
-    I32 n_rows = args->n_rows;
-    I32 n_cols = args->n_cols;
     I32 max_val = (I32)args->max_val;
     I32 val = 0;
 
-    val =   ( get_pixel16_safe(bayer, n_rows, n_cols, row - 2, col + 0) * -3
-            + get_pixel16_safe(bayer, n_rows, n_cols, row - 1, col - 1) * +4
-            + get_pixel16_safe(bayer, n_rows, n_cols, row - 1, col + 1) * +4
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col - 2) * -3
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 0) * +12
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 0, col + 2) * -3
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 1, col - 1) * +4
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 1, col + 1) * +4
-            + get_pixel16_safe(bayer, n_rows, n_cols, row + 2, col + 0) * -3)
-          / 16;
-
-    return (U16) DM_LIMIT(val, 0, max_val);
+    val =   ( get_cal_pixel16(bayer, args, row - 2, col + 0) * -3
+            + get_cal_pixel16(bayer, args, row - 1, col - 1) * +4
+            + get_cal_pixel16(bayer, args, row - 1, col + 1) * +4
+            + get_cal_pixel16(bayer, args, row + 0, col - 2) * -3
+            + get_cal_pixel16(bayer, args, row + 0, col + 0) * +12
+            + get_cal_pixel16(bayer, args, row + 0, col + 2) * -3
+            + get_cal_pixel16(bayer, args, row + 1, col - 1) * +4
+            + get_cal_pixel16(bayer, args, row + 1, col + 1) * +4
+            + get_cal_pixel16(bayer, args, row + 2, col + 0) * -3)
+          / (16 * DM_CAL_SCALE(args));
+
+    return DM_REF_LIMIT(args, val, max_val);
 }
 
-DEMOSAIC_PRIVATE U8 get_red_blue_from_opposite8(
+DEMOSAIC_PRIVATE I32 get_red_blue_from_opposite8(
         const U8 * const bayer,
         const demosaic_args * const args,
         const I32 row, const I32 col)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
-    I32 n_rows = args->n_rows;
-    I32 n_cols = args->n_cols;
     I32 max_val = (I32)args->max_val;
     I32 val = 0;
 
-    val =   ( get_pixel8_safe(bayer, n_rows, n_cols, row - 2, col + 0) * -3
-            + get_pixel8_safe(bayer, n_rows, n_cols, row - 1, col - 1) * +4
-            + get_pixel8_safe(bayer, n_rows, n_cols, row - 1, col + 1) * +4
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col - 2) * -3
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 0) * +12
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 0, col + 2) * -3
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 1, col - 1) * +4
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 1, col + 1) * +4
-            + get_pixel8_safe(bayer, n_rows, n_cols, row + 2, col + 0) * -3)
-          / 16;
-
-    return (U16) DM_LIMIT(val, 0, max_val);
+    val =   ( get_cal_pixel8(bayer, args, row - 2, col + 0) * -3
+            + get_cal_pixel8(bayer, args, row - 1, col - 1) * +4
+            + get_cal_pixel8(bayer, args, row - 1, col + 1) * +4
+            + get_cal_pixel8(bayer, args, row + 0, col - 2) * -3
+            + get_cal_pixel8(bayer, args, row + 0, col + 0) * +12
+            + get_cal_pixel8(bayer, args, row + 0, col + 2) * -3
+            + get_cal_pixel8(bayer, args, row + 1, col - 1) * +4
+            + get_cal_pixel8(bayer, args, row + 1, col + 1) * +4
+            + get_cal_pixel8(bayer, args, row + 2, col + 0) * -3)
+          / (16 * DM_CAL_SCALE(args));
+
+    return DM_REF_LIMIT(args, val, max_val);
 }
 
 // get rgb pixels
@@ -364,7 +520,7 @@ DEMOSAIC_PRIVATE void get_rgb16_at_red16(
     DEMOSAIC_ASSERT(args != NULL);
 
     output_pixel->red =
-            get_pixel16_safe(bayer, args->n_rows, args->n_cols, row, col);
+            get_center16(bayer, args, row, col);
     output_pixel->green = get_green16(bayer, args, row, col);
     // estimate blue at red pixel
     output_pixel->blue = get_red_blue_from_opposite16(bayer, args, row, col);
@@ -381,7 +537,7 @@ DEMOSAIC_PRIVATE void get_rgb8_at_red8(
     DEMOSAIC_ASSERT(args != NULL);
 
     output_pixel->red =
-            get_pixel8_safe(bayer, args->n_rows, args->n_cols, row, col);
+            get_center8(bayer, args, row, col);
     output_pixel->green = get_green8(bayer, args, row, col);
     // estimate blue at red pixel
     output_pixel->blue = get_red_blue_from_opposite8(bayer, args, row, col);
@@ -398,15 +554,12 @@ DEMOSAIC_PRIVATE void get_rgb8_at_red16(
     DEMOSAIC_ASSERT(args != NULL);
 
     output_pixel->red =
-            get_pixel16_safe(bayer, args->n_rows, args->n_cols, row, col)
-            >> args->rshift;
+            DM_TO8(args, get_center16(bayer, args, row, col));
     output_pixel->green =
-            get_green16(bayer, args, row, col)
-            >> args->rshift;
+            DM_TO8(args, get_green16(bayer, args, row, col));
     // estimate blue at red pixel
     output_pixel->blue =
-            get_red_blue_from_opposite16(bayer, args, row, col)
-            >> args->rshift;
+            DM_TO8(args, get_red_blue_from_opposite16(bayer, args, row, col));
 }
 
 // get 16-bit rgb pixel from 16-bit bayer at green in red-green row
@@ -422,7 +575,7 @@ DEMOSAIC_PRIVATE void get_rgb16_at_green_rg16(
     // estimate red at green pixel in a red row
     output_pixel->red = get_red_blue_from_row16(bayer, args, row, col);
     output_pixel->green =
-            get_pixel16_safe(bayer, args->n_rows, args->n_cols, row, col);
+            get_center16(bayer, args, row, col);
     // estimate blue at green pixel in a blue column
     output_pixel->blue = get_red_blue_from_column16(bayer, args, row, col);
 }
@@ -440,7 +593,7 @@ DEMOSAIC_PRIVATE void get_rgb8_at_green_rg8(
     // estimate red at green pixel in a red row
     output_pixel->red = get_red_blue_from_row8(bayer, args, row, col);
     output_pixel->green =
-            get_pixel8_safe(bayer, args->n_rows, args->n_cols, row, col);
+            get_center8(bayer, args, row, col);
     // estimate blue at green pixel in a blue column
     output_pixel->blue = get_red_blue_from_column8(bayer, args, row, col);
 }
@@ -456,14 +609,13 @@ DEMOSAIC_PRIVATE void get_rgb8_at_green_rg16(
     DEMOSAIC_ASSERT(args != NULL);
 
     // estimate red at green pixel in a red row
-    output_pixel->red = get_red_blue_from_row16(bayer, args, row, col)
-            >> args->rshift;
+    output_pixel->red =
+            DM_TO8(args, get_red_blue_from_row16(bayer, args, row, col));
     output_pixel->green =
-            get_pixel16_safe(bayer, args->n_rows, args->n_cols, row, col)
-            >> args->rshift;
+            DM_TO8(args, get_center16(bayer, args, row, col));
     // estimate blue at green pixel in a blue column
-    output_pixel->blue = get_red_blue_from_column16(bayer, args, row, col)
-            >> args->rshift;
+    output_pixel->blue =
+            DM_TO8(args, get_red_blue_from_column16(bayer, args, row, col));
 }
 
 // get 16-bit rgb pixel from 16-bit bayer at green in green-blue row
@@ -479,7 +631,7 @@ DEMOSAIC_PRIVATE void get_rgb16_at_green_gb16(
     // estimate red at green pixel in red column
     output_pixel->red = get_red_blue_from_column16(bayer, args, row, col);
     output_pixel->green =
-            get_pixel16_safe(bayer, args->n_rows, args->n_cols, row, col);
+            get_center16(bayer, args, row, col);
     // estimate blue at green pixel in blue row
     output_pixel->blue = get_red_blue_from_row16(bayer, args, row, col);
 }
@@ -496,7 +648,7 @@ DEMOSAIC_PRIVATE void get_rgb8_at_green_gb8(
 
     output_pixel->red = get_red_blue_from_column8(bayer, args, row, col);
     output_pixel->green =
-            get_pixel8_safe(bayer, args->n_rows, args->n_cols, row, col);
+            get_center8(bayer, args, row, col);
     output_pixel->blue = get_red_blue_from_row8(bayer, args, row, col);
 }
 
@@ -510,13 +662,12 @@ DEMOSAIC_PRIVATE void get_rgb8_at_green_gb16(
     DEMOSAIC_ASSERT(output_pixel != NULL);
     DEMOSAIC_ASSERT(args != NULL);
 
-    output_pixel->red = get_red_blue_from_column16(bayer, args, row, col)
-            >> args->rshift;
+    output_pixel->red =
+            DM_TO8(args, get_red_blue_from_column16(bayer, args, row, col));
     output_pixel->green =
-            get_pixel16_safe(bayer, args->n_rows, args->n_cols, row, col)
-            >> args->rshift;
-    output_pixel->blue = get_red_blue_from_row16(bayer, args, row, col)
-            >> args->rshift;
+            DM_TO8(args, get_center16(bayer, args, row, col));
+    output_pixel->blue =
+            DM_TO8(args, get_red_blue_from_row16(bayer, args, row, col));
 }
 
 
@@ -533,7 +684,7 @@ DEMOSAIC_PRIVATE void get_rgb16_at_blue16(
     output_pixel->red = get_red_blue_from_opposite16(bayer, args, row, col);
     output_pixel->green = get_green16(bayer, args, row, col);
     output_pixel->blue =
-            get_pixel16_safe(bayer, args->n_rows, args->n_cols, row, col);
+            get_center16(bayer, args, row, col);
 }
 
 // get 8-bit rgb pixel from 8-bit bayer at blue
@@ -549,7 +700,7 @@ DEMOSAIC_PRIVATE void get_rgb8_at_blue8(
     output_pixel->red = get_red_blue_from_opposite8(bayer, args, row, col);
     output_pixel->green = get_green8(bayer, args, row, col);
     output_pixel->blue =
-            get_pixel8_safe(bayer, args->n_rows, args->n_cols, row, col);
+            get_center8(bayer, args, row, col);
 }
 
 // get 8-bit rgb pixel from 16-bit bayer at blue
@@ -562,577 +713,1558 @@ DEMOSAIC_PRIVATE void get_rgb8_at_blue16(
     DEMOSAIC_ASSERT(output_pixel != NULL);
     DEMOSAIC_ASSERT(args != NULL);
 
-    output_pixel->red = get_red_blue_from_opposite16(bayer, args, row, col)
-            >> args->rshift;
-    output_pixel->green = get_green16(bayer, args, row, col) >> args->rshift;
+    output_pixel->red =
+            DM_TO8(args, get_red_blue_from_opposite16(bayer, args, row, col));
+    output_pixel->green = DM_TO8(args, get_green16(bayer, args, row, col));
     output_pixel->blue =
-            get_pixel16_safe(bayer, args->n_rows, args->n_cols, row, col)
-            >> args->rshift;
+            DM_TO8(args, get_center16(bayer, args, row, col));
 }
 
-// assert dimensions are properly sized
-DEMOSAIC_PRIVATE void demosaic_malvar_assert_proper_dimensions(
-        const demosaic_args * const args)
+// get the color corrected rgb values of the pixel at (row, col),
+// from unclamped kernel outputs, limited to [0, max_val]
+DEMOSAIC_PRIVATE void get_corrected_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row, const I32 col,
+        I32 rgb[3])
 {
-    // assert at least 2x2 image
-    DEMOSAIC_ASSERT_1(args->n_cols >= 2, args->n_cols);
-    DEMOSAIC_ASSERT_1(args->n_rows >= 2, args->n_rows);
+    DEMOSAIC_ASSERT(args->ccm != NULL);
+
+    const I32 max_val = (I32)args->max_val;
+    I32 red;
+    I32 green;
+    I32 blue;
+    if (((row + DM_ROW_OFFSET(args)) % 2) == 0) { // red-green row
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            red = get_center16(bayer, args, row, col);
+            green = get_green16(bayer, args, row, col);
+            blue = get_red_blue_from_opposite16(bayer, args, row, col);
+        } else {
+            red = get_red_blue_from_row16(bayer, args, row, col);
+            green = get_center16(bayer, args, row, col);
+            blue = get_red_blue_from_column16(bayer, args, row, col);
+        }
+    } else { // green-blue row
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            red = get_red_blue_from_column16(bayer, args, row, col);
+            green = get_center16(bayer, args, row, col);
+            blue = get_red_blue_from_row16(bayer, args, row, col);
+        } else {
+            red = get_red_blue_from_opposite16(bayer, args, row, col);
+            green = get_green16(bayer, args, row, col);
+            blue = get_center16(bayer, args, row, col);
+        }
+    }
+    demosaic_correct_rgb(args->ccm, &red, &green, &blue);
+    rgb[0] = DM_LIMIT(red, 0, max_val);
+    rgb[1] = DM_LIMIT(green, 0, max_val);
+    rgb[2] = DM_LIMIT(blue, 0, max_val);
+}
 
-    // assert even number of rows and columns
-    DEMOSAIC_ASSERT_1(args->n_cols % 2 == 0, args->n_cols);
-    DEMOSAIC_ASSERT_1(args->n_rows % 2 == 0, args->n_rows);
+DEMOSAIC_PRIVATE void get_corrected_rgb8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row, const I32 col,
+        I32 rgb[3])
+{
+    DEMOSAIC_ASSERT(args->ccm != NULL);
+
+    const I32 max_val = (I32)args->max_val;
+    I32 red;
+    I32 green;
+    I32 blue;
+    if (((row + DM_ROW_OFFSET(args)) % 2) == 0) { // red-green row
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            red = get_center8(bayer, args, row, col);
+            green = get_green8(bayer, args, row, col);
+            blue = get_red_blue_from_opposite8(bayer, args, row, col);
+        } else {
+            red = get_red_blue_from_row8(bayer, args, row, col);
+            green = get_center8(bayer, args, row, col);
+            blue = get_red_blue_from_column8(bayer, args, row, col);
+        }
+    } else { // green-blue row
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            red = get_red_blue_from_column8(bayer, args, row, col);
+            green = get_center8(bayer, args, row, col);
+            blue = get_red_blue_from_row8(bayer, args, row, col);
+        } else {
+            red = get_red_blue_from_opposite8(bayer, args, row, col);
+            green = get_green8(bayer, args, row, col);
+            blue = get_center8(bayer, args, row, col);
+        }
+    }
+    demosaic_correct_rgb(args->ccm, &red, &green, &blue);
+    rgb[0] = DM_LIMIT(red, 0, max_val);
+    rgb[1] = DM_LIMIT(green, 0, max_val);
+    rgb[2] = DM_LIMIT(blue, 0, max_val);
 }
 
-// demosaic 16 bit bayer to 16 bit rgb, without optimizations
-DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb16_unoptimized(
+// demosaic the pixel at (row, col), by its color in the bayer pattern
+DEMOSAIC_PRIVATE void get_rgb16_at16(
         const U16 * const bayer,
         const demosaic_args * const args,
-        const I32 row,
-        demosaic_pix_rgb16 output_row[])
+        const I32 row, const I32 col,
+        demosaic_pix_rgb16 * output_pixel)
 {
-    // assert pointers not null
-    DEMOSAIC_ASSERT(bayer != NULL);
-    DEMOSAIC_ASSERT(args != NULL);
-    DEMOSAIC_ASSERT(output_row != NULL);
-
-    // assert even rows and columns, at least 2x2
-    demosaic_malvar_assert_proper_dimensions(args);
-
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
-
-    const I32 n_cols = args->n_cols;
-    I32 col = 0;
-
-    if ((row % 2) == 0) { // red-green row
-        while (col < n_cols) {
-            get_rgb16_at_red16(bayer, args, row, col, &(output_row[col]));
-            ++col;
-            get_rgb16_at_green_rg16(bayer, args, row, col, &(output_row[col]));
-            ++col;
+    if (args->ccm != NULL) {
+        I32 rgb[3];
+        get_corrected_rgb16(bayer, args, row, col, rgb);
+        output_pixel->red = rgb[0];
+        output_pixel->green = rgb[1];
+        output_pixel->blue = rgb[2];
+        return;
+    }
+    if (((row + DM_ROW_OFFSET(args)) % 2) == 0) { // red-green row
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            get_rgb16_at_red16(bayer, args, row, col, output_pixel);
+        } else {
+            get_rgb16_at_green_rg16(bayer, args, row, col, output_pixel);
         }
     } else { // green-blue row
-        while (col < n_cols) {
-            get_rgb16_at_green_gb16(bayer, args, row, col, &(output_row[col]));
-            ++col;
-            get_rgb16_at_blue16(bayer, args, row, col, &(output_row[col]));
-            ++col;
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            get_rgb16_at_green_gb16(bayer, args, row, col, output_pixel);
+        } else {
+            get_rgb16_at_blue16(bayer, args, row, col, output_pixel);
         }
     }
 }
 
-// demosaic 8 bit bayer to 8 bit rgb, without optimizations
-DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb8_unoptimized(
+DEMOSAIC_PRIVATE void get_rgb8_at8(
         const U8 * const bayer,
         const demosaic_args * const args,
-        const I32 row,
-        demosaic_pix_rgb8 output_row[])
+        const I32 row, const I32 col,
+        demosaic_pix_rgb8 * output_pixel)
 {
-    // assert pointers not null
-    DEMOSAIC_ASSERT(bayer != NULL);
-    DEMOSAIC_ASSERT(args != NULL);
-    DEMOSAIC_ASSERT(output_row != NULL);
-
-    // assert even rows and columns, at least 2x2
-    demosaic_malvar_assert_proper_dimensions(args);
-
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
-
-    // assert max val is 255 or less
-    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
-
-    const I32 n_cols = args->n_cols;
-    I32 col = 0;
-
-    if ((row % 2) == 0) { // red-green row
-        while (col < n_cols) {
-            get_rgb8_at_red8(bayer, args, row, col, &(output_row[col]));
-            ++col;
-            get_rgb8_at_green_rg8(bayer, args, row, col, &(output_row[col]));
-            ++col;
+    if (args->ccm != NULL) {
+        I32 rgb[3];
+        get_corrected_rgb8(bayer, args, row, col, rgb);
+        output_pixel->red = rgb[0];
+        output_pixel->green = rgb[1];
+        output_pixel->blue = rgb[2];
+        return;
+    }
+    if (((row + DM_ROW_OFFSET(args)) % 2) == 0) { // red-green row
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            get_rgb8_at_red8(bayer, args, row, col, output_pixel);
+        } else {
+            get_rgb8_at_green_rg8(bayer, args, row, col, output_pixel);
         }
     } else { // green-blue row
-        while (col < n_cols) {
-            get_rgb8_at_green_gb8(bayer, args, row, col, &(output_row[col]));
-            ++col;
-            get_rgb8_at_blue8(bayer, args, row, col, &(output_row[col]));
-            ++col;
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            get_rgb8_at_green_gb8(bayer, args, row, col, output_pixel);
+        } else {
+            get_rgb8_at_blue8(bayer, args, row, col, output_pixel);
         }
     }
 }
 
-// demosaic 8 bit bayer to 8 bit rgb, without optimizations
-DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb16to8_unoptimized(
+DEMOSAIC_PRIVATE void get_rgb8_at16(
         const U16 * const bayer,
         const demosaic_args * const args,
-        const I32 row,
-        demosaic_pix_rgb8 output_row[])
+        const I32 row, const I32 col,
+        demosaic_pix_rgb8 * output_pixel)
 {
-    // assert pointers not null
-    DEMOSAIC_ASSERT(bayer != NULL);
-    DEMOSAIC_ASSERT(args != NULL);
-    DEMOSAIC_ASSERT(output_row != NULL);
-
-    // assert even rows and columns, at least 2x2
-    demosaic_malvar_assert_proper_dimensions(args);
-
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+    if (args->ccm != NULL) {
+        I32 rgb[3];
+        get_corrected_rgb16(bayer, args, row, col, rgb);
+        output_pixel->red = DM_TO8(args, rgb[0]);
+        output_pixel->green = DM_TO8(args, rgb[1]);
+        output_pixel->blue = DM_TO8(args, rgb[2]);
+        return;
+    }
+    if (((row + DM_ROW_OFFSET(args)) % 2) == 0) { // red-green row
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            get_rgb8_at_red16(bayer, args, row, col, output_pixel);
+        } else {
+            get_rgb8_at_green_rg16(bayer, args, row, col, output_pixel);
+        }
+    } else { // green-blue row
+        if (((col + DM_COL_OFFSET(args)) % 2) == 0) {
+            get_rgb8_at_green_gb16(bayer, args, row, col, output_pixel);
+        } else {
+            get_rgb8_at_blue16(bayer, args, row, col, output_pixel);
+        }
+    }
+}
+#endif // DM_REFERENCE
 
-    // assert shift is not negative
-    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+// assert dimensions are properly sized
+DEMOSAIC_PRIVATE void demosaic_malvar_assert_proper_dimensions(
+        const demosaic_args * const args)
+{
+    // assert at least 2x2 image
+    DEMOSAIC_ASSERT_1(args->n_cols >= 2, args->n_cols);
+    DEMOSAIC_ASSERT_1(args->n_rows >= 2, args->n_rows);
 
-    // assert max val can be shifted to 8 bits
-    DEMOSAIC_ASSERT_2((args->max_val >> args->rshift) <= U8_MAX,
-            args->max_val, args->rshift);
+    // assert even number of rows and columns
+    DEMOSAIC_ASSERT_1(args->n_cols % 2 == 0, args->n_cols);
+    DEMOSAIC_ASSERT_1(args->n_rows % 2 == 0, args->n_rows);
 
-    const I32 n_cols = args->n_cols;
-    I32 col = 0;
+    // assert a supported bayer pattern
+    DEMOSAIC_ASSERT_1(args->pattern >= DEMOSAIC_RGGB
+            && args->pattern <= DEMOSAIC_BGGR, args->pattern);
+
+    // assert black levels are in range, and gains keep kernel sums in I32
+    if (args->calibration != NULL) {
+        for (I32 ch = 0; ch < 4; ch++) {
+            DEMOSAIC_ASSERT_2(args->calibration->black[ch] <= args->max_val,
+                    args->calibration->black[ch], args->max_val);
+            DEMOSAIC_ASSERT_2((F64) args->calibration->gain[ch]
+                    * (F64) args->max_val <= (F64) DEMOSAIC_GAIN_MAX_PRODUCT,
+                    args->calibration->gain[ch], args->max_val);
+        }
+    }
 
-    if ((row % 2) == 0) { // red-green row
-        while (col < n_cols) {
-            get_rgb8_at_red16(bayer, args, row, col, &(output_row[col]));
-            ++col;
-            get_rgb8_at_green_rg16(bayer, args, row, col, &(output_row[col]));
-            ++col;
+    // assert corrected sums of the largest calibrated pixels fit in I32
+    if (args->ccm != NULL) {
+        F64 largest = (F64) args->max_val;
+        if (args->calibration != NULL) {
+            I32 max_gain = 0;
+            for (I32 ch = 0; ch < 4; ch++) {
+                if (args->calibration->gain[ch] > max_gain) {
+                    max_gain = args->calibration->gain[ch];
+                }
+            }
+            largest = largest * (F64) max_gain / (1 << DEMOSAIC_GAIN_BITS);
         }
-    } else { // green-blue row
-        while (col < n_cols) {
-            get_rgb8_at_green_gb16(bayer, args, row, col, &(output_row[col]));
-            ++col;
-            get_rgb8_at_blue16(bayer, args, row, col, &(output_row[col]));
-            ++col;
+        for (I32 i = 0; i < 3; i++) {
+            F64 row_sum = 0.0;
+            for (I32 j = 0; j < 3; j++) {
+                const I32 coef = args->ccm->coef[i][j];
+                row_sum += (coef < 0) ? -(F64) coef : (F64) coef;
+            }
+            DEMOSAIC_ASSERT_DBL_1(row_sum * largest
+                    <= (F64) DEMOSAIC_CCM_MAX_PRODUCT, row_sum);
         }
     }
 }
 
-// Demosaic 16 bit bayer row to 16 bit rgb row
-// If the row is at the top or bottom, use the unoptimized function,
-// which ensures that sampling past the image edges does not occur.
-// Otherwise, use safe functions at left and right edges, and unsafe macros
-// in image interior, where edge testing is known to be unnecessary.
-// This vastly improves performance.
-void demosaic_malvar_row_rgb16(
-        const U16 * const bayer,
+// gains and offsets (gain * black) of a calibration, by demosaic_cfa_channel
+typedef struct {
+    I32 gain[4];
+    I32 offset[4];
+} demosaic_cal_weights;
+
+// fill weights from the calibration of args.
+// returns weights, or NULL if args has no calibration.
+static inline const demosaic_cal_weights * demosaic_cal_weights_init(
         const demosaic_args * const args,
-        const I32 row,
-        demosaic_pix_rgb16 output_row[])
+        demosaic_cal_weights * const weights)
 {
-    DEMOSAIC_ASSERT(args != NULL);
+    const demosaic_calibration * const cal = args->calibration;
+    if (cal != NULL) {
+        for (I32 ch = 0; ch < 4; ch++) {
+            weights->gain[ch] = (I32) cal->gain[ch];
+            weights->offset[ch] = (I32) cal->gain[ch] * (I32) cal->black[ch];
+        }
+    }
+    return (cal != NULL) ? weights : NULL;
+}
 
-    // if this row is one of the two top or bottom rows, use safe functions
-    if (row < 2 || row >= args->n_rows - 2 ) {
-        demosaic_malvar_row_rgb16_unoptimized(bayer, args, row, output_row);
-        return;
+// fill weights as demosaic_cal_weights_init(), with unity gains if args
+// has no calibration, for the corrected kernels. returns weights.
+static inline const demosaic_cal_weights * demosaic_corrected_weights_init(
+        const demosaic_args * const args,
+        demosaic_cal_weights * const weights)
+{
+    if (demosaic_cal_weights_init(args, weights) == NULL) {
+        for (I32 ch = 0; ch < 4; ch++) {
+            weights->gain[ch] = 1 << DEMOSAIC_GAIN_BITS;
+            weights->offset[ch] = 0;
+        }
     }
-    // else middle row, can be optimized
+    return weights;
+}
 
-    // assert pointers not null
-    DEMOSAIC_ASSERT(output_row != NULL);
-    DEMOSAIC_ASSERT(bayer != NULL);
+#ifdef DM_SIMD
+// vector engines, the vectorized interiors of the span kernels for one
+// instruction set, generated by demosaic_simd_template.h, and selected at
+// run time by demosaic_engine_init(). Engines beyond the compiler's target
+// are compiled with target attributes, so one build runs on every host of
+// its architecture, with the best engine each host supports.
+//
+// The lines functions vectorize columns [col, col_end) of a row from the
+// five bayer lines from row-2 to row+2, output starting at col, and return
+// the column at which the scalar loops should resume.
+typedef struct {
+    demosaic_engine engine;
+    I32 (*lines_rgb16)(const U16 * const lines[5],
+            const demosaic_args * const args, const I32 row, I32 col,
+            const I32 col_end, demosaic_pix_rgb16 output[]);
+    // from col to the interior's end, see demosaic_rgb16_mono16_span()
+    I32 (*lines_rgb16_mono16)(const U16 * const lines[5],
+            const demosaic_args * const args,
+            const demosaic_luma_weights * const coefs_normed, const I32 row,
+            I32 col, demosaic_pix_rgb16 output_rgb_row[],
+            U16 output_mono_row[]);
+    I32 (*lines_rgb8)(const U8 * const lines[5],
+            const demosaic_args * const args, const I32 row, I32 col,
+            const I32 col_end, demosaic_pix_rgb8 output[]);
+    I32 (*lines_rgb16to8)(const U16 * const lines[5],
+            const demosaic_args * const args, const I32 row, I32 col,
+            const I32 col_end, demosaic_pix_rgb8 output[]);
+    I32 (*lines_mono16)(const U16 * const lines[5],
+            const demosaic_args * const args,
+            const demosaic_luma_weights * const coefs_normed, const I32 row,
+            I32 col, const I32 col_end, U16 output[]);
+    I32 (*lines_mono8)(const U8 * const lines[5],
+            const demosaic_args * const args,
+            const demosaic_luma_weights * const coefs_normed, const I32 row,
+            I32 col, const I32 col_end, U8 output[]);
+    I32 (*lines_mono16to8)(const U16 * const lines[5],
+            const demosaic_args * const args,
+            const demosaic_luma_weights * const coefs_normed, const I32 row,
+            I32 col, const I32 col_end, U8 output[]);
+    I32 (*lines_planar16)(const U16 * const lines[5],
+            const demosaic_args * const args, const I32 row, I32 col,
+            const I32 col_end, U16 red_out[], U16 green_out[],
+            U16 blue_out[]);
+    I32 (*lines_planar8)(const U8 * const lines[5],
+            const demosaic_args * const args, const I32 row, I32 col,
+            const I32 col_end, U8 red_out[], U8 green_out[], U8 blue_out[]);
+    I32 (*lines_planar16to8)(const U16 * const lines[5],
+            const demosaic_args * const args, const I32 row, I32 col,
+            const I32 col_end, U8 red_out[], U8 green_out[], U8 blue_out[]);
+    // calibrated or color corrected pixels, always output as rgb16
+    I32 (*cal_lines16)(const U16 * const lines[5],
+            const demosaic_args * const args, const I32 row, I32 col,
+            const I32 col_end, demosaic_pix_rgb16 output[]);
+    I32 (*cal_lines8)(const U8 * const lines[5],
+            const demosaic_args * const args, const I32 row, I32 col,
+            const I32 col_end, demosaic_pix_rgb16 output[]);
+    // unpacks the start of a packed line, returning the first column not
+    // unpacked, or NULL to unpack with the scalar loops
+    I32 (*unpack_line)(const U8 * const packed,
+            const demosaic_packing packing, const I32 n_cols, U16 line[]);
+} demosaic_engine_fns;
+
+// Each engine defines, for the template, vector operations on DM_V_WIDTH
+// 32-bit signed lanes, for the image interior, and on DM_V16_WIDTH 16-bit
+// signed lanes, twice as many, for the interior of 8-bit images, whose
+// malvar sums fit in 16 bits, as shown at demosaic_simd16_kernel_sums().
+// Arguments may be evaluated more than once, so must not have side effects.
+
+#ifdef DM_ENGINE_X86
+// SSE4.1 and AVX2 are compiled with target attributes where the compiler
+// supports them, or if it already targets them
+#if defined(__SSE4_1__) || defined(__GNUC__)
+#define DM_ENGINE_SSE41
+#endif
+#if defined(__AVX2__) || defined(__GNUC__)
+#define DM_ENGINE_AVX2
+#endif
+
+// load 4 8-bit pixels, without reading past them
+static inline __m128i dm_v_load8_sse2(const U8 * const p)
+{
+    I32 packed = 0;
+    memcpy(&packed, p, sizeof(packed));
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+}
 
-    // assert even rows and columns, at least 2x2
-    demosaic_malvar_assert_proper_dimensions(args);
+// low 32 bits of lane products, from the even and odd 64-bit products,
+// as SSE2 has no 32-bit multiply
+static inline __m128i dm_v_mul_sse2(const __m128i a, const __m128i b)
+{
+    const __m128i even = _mm_mul_epu32(a, b);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4),
+                                      _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
 
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+// unpacking 8 pixels at a time needs a byte shuffle, i.e. SSSE3, which
+// SSE4.1 and AVX2 imply, so those engines unpack with it, as does SSE2
+// if the compiler targets SSSE3. Others unpack one group at a time.
+#if defined(__SSSE3__) || defined(__GNUC__)
+#define DM_UNPACK_SIMD
+#ifdef __SSSE3__
+#define DM_UNPACK_TARGET
+#else
+#define DM_UNPACK_TARGET __attribute__((target("ssse3")))
+#endif
+
+// unpack 8 pixels at a time from the start of a packed line, while the
+// 16 byte loads stay within it, returning the first column not unpacked.
+// A shuffle spreads each pixel's high byte and low bits byte to a 16-bit
+// lane, as hi << 8 | lo, then shifts and masks keep the bits of the pixel.
+DEMOSAIC_PRIVATE DM_UNPACK_TARGET I32 demosaic_simd_unpack_line(
+        const U8 * const packed,
+        const demosaic_packing packing,
+        const I32 n_cols,
+        U16 line[])
+{
+    I32 col = 0;
+    if (packing == DEMOSAIC_PACKED_RAW10) {
+        // two groups of 4 in 10 bytes, hi << 2 | ((lo >> (2 * k)) & 0x3)
+        // for pixel k of a group, the low bits shifted by multiplication
+        const __m128i spread = _mm_setr_epi8(
+                4, 0, 4, 1, 4, 2, 4, 3, 9, 5, 9, 6, 9, 7, 9, 8);
+        const __m128i lo_shift = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+        const __m128i hi_mask = _mm_set1_epi16(0x03FC);
+        const __m128i lo_mask = _mm_set1_epi16(0x0003);
+        const __m128i byte_mask = _mm_set1_epi16(0x00FF);
+        for (; col + 16 <= n_cols; col += 8) {
+            const __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(
+                    (const __m128i *) &packed[(col / 4) * 5]), spread);
+            const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 6), hi_mask);
+            const __m128i lo = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(
+                    _mm_and_si128(v, byte_mask), lo_shift), 6), lo_mask);
+            _mm_storeu_si128((__m128i *) &line[col], _mm_or_si128(hi, lo));
+        }
+    } else {
+        // four groups of 2 in 12 bytes, hi << 4 | (lo & 0xF) for even
+        // pixels, which is v >> 4 for odd pixels
+        const __m128i spread = _mm_setr_epi8(
+                2, 0, 2, 1, 5, 3, 5, 4, 8, 6, 8, 7, 11, 9, 11, 10);
+        const __m128i shifted_mask = _mm_setr_epi16(
+                0x0FF0, -1, 0x0FF0, -1, 0x0FF0, -1, 0x0FF0, -1);
+        const __m128i low_mask = _mm_setr_epi16(
+                0x000F, 0, 0x000F, 0, 0x000F, 0, 0x000F, 0);
+        for (; col + 12 <= n_cols; col += 8) {
+            const __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(
+                    (const __m128i *) &packed[(col / 2) * 3]), spread);
+            _mm_storeu_si128((__m128i *) &line[col], _mm_or_si128(
+                    _mm_and_si128(_mm_srli_epi16(v, 4), shifted_mask),
+                    _mm_and_si128(v, low_mask)));
+        }
+    }
+    return col;
+}
+#endif // DM_UNPACK_SIMD
+
+// SSE2, 4 32-bit lanes, the x86-64 baseline
+#define DM_V_NAME sse2
+#define DM_V_ENGINE DEMOSAIC_ENGINE_SSE2
+#define DM_V_TARGET
+#if defined(DM_UNPACK_SIMD) && defined(__SSSE3__)
+#define DM_V_UNPACK demosaic_simd_unpack_line
+#else
+#define DM_V_UNPACK NULL
+#endif
+#define dm_vec __m128i
+#define DM_V_WIDTH 4
+#define DM_V_LOAD16(p) _mm_unpacklo_epi16( \
+    _mm_loadl_epi64((const __m128i *)(p)), _mm_setzero_si128())
+#define DM_V_LOAD8(p) dm_v_load8_sse2(p)
+#define DM_V_LOAD32(p) _mm_loadu_si128((const __m128i *)(p))
+#define DM_V_STORE(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define DM_V_SET1(x) _mm_set1_epi32(x)
+#define DM_V_EVEN_LANES() _mm_set_epi32(0, -1, 0, -1)
+#define DM_V_ODD_LANES() _mm_set_epi32(-1, 0, -1, 0)
+#define DM_V_ADD(a, b) _mm_add_epi32((a), (b))
+#define DM_V_SUB(a, b) _mm_sub_epi32((a), (b))
+#define DM_V_MUL(a, b) dm_v_mul_sse2((a), (b))
+#define DM_V_SLL(a, n) _mm_slli_epi32((a), (n))
+#define DM_V_SRA(a, n) _mm_srai_epi32((a), (n))
+#define DM_V_SRL_VAR(a, n) _mm_srl_epi32((a), _mm_cvtsi32_si128(n))
+// a where mask is set, else b
+#define DM_V_SELECT(mask, a, b) \
+    _mm_or_si128(_mm_and_si128((mask), (a)), _mm_andnot_si128((mask), (b)))
+// SSE2 has no 32-bit min and max
+#define DM_V_MIN(a, b) DM_V_SELECT(_mm_cmpgt_epi32((a), (b)), (b), (a))
+#define DM_V_MAX(a, b) DM_V_SELECT(_mm_cmpgt_epi32((a), (b)), (a), (b))
+#define dm_vec16 __m128i
+#define DM_V16_WIDTH 8
+#define DM_V16_LOAD8(p) _mm_unpacklo_epi8( \
+    _mm_loadl_epi64((const __m128i *)(p)), _mm_setzero_si128())
+// store lanes in [0, U8_MAX] as 8-bit pixels
+#define DM_V16_STORE8(p, v) \
+    _mm_storel_epi64((__m128i *)(p), _mm_packus_epi16((v), (v)))
+#define DM_V16_SET1(x) _mm_set1_epi16(x)
+#define DM_V16_EVEN_LANES() _mm_set1_epi32(0x0000FFFF)
+#define DM_V16_ODD_LANES() _mm_set1_epi32(-0x10000)
+#define DM_V16_ADD(a, b) _mm_add_epi16((a), (b))
+#define DM_V16_SUB(a, b) _mm_sub_epi16((a), (b))
+#define DM_V16_SLL(a, n) _mm_slli_epi16((a), (n))
+#define DM_V16_SRA(a, n) _mm_srai_epi16((a), (n))
+#define DM_V16_MIN(a, b) _mm_min_epi16((a), (b))
+#define DM_V16_MAX(a, b) _mm_max_epi16((a), (b))
+// a where mask is set, else b
+#define DM_V16_SELECT(mask, a, b) \
+    _mm_or_si128(_mm_and_si128((mask), (a)), _mm_andnot_si128((mask), (b)))
+#include "demosaic_simd_template.h"
+
+#ifdef DM_ENGINE_SSE41
+// SSE4.1, 4 32-bit lanes, with the 32-bit multiply, min, max and blend
+// SSE2 emulates
+#define DM_V_NAME sse41
+#define DM_V_ENGINE DEMOSAIC_ENGINE_SSE41
+#ifdef __SSE4_1__
+#define DM_V_TARGET
+#else
+#define DM_V_TARGET __attribute__((target("sse4.1")))
+#endif
+#define DM_V_UNPACK demosaic_simd_unpack_line
+#define dm_vec __m128i
+#define DM_V_WIDTH 4
+#define DM_V_LOAD16(p) \
+    _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(p)))
+#define DM_V_LOAD8(p) dm_v_load8_sse2(p)
+#define DM_V_LOAD32(p) _mm_loadu_si128((const __m128i *)(p))
+#define DM_V_STORE(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define DM_V_SET1(x) _mm_set1_epi32(x)
+#define DM_V_EVEN_LANES() _mm_set_epi32(0, -1, 0, -1)
+#define DM_V_ODD_LANES() _mm_set_epi32(-1, 0, -1, 0)
+#define DM_V_ADD(a, b) _mm_add_epi32((a), (b))
+#define DM_V_SUB(a, b) _mm_sub_epi32((a), (b))
+#define DM_V_MUL(a, b) _mm_mullo_epi32((a), (b))
+#define DM_V_SLL(a, n) _mm_slli_epi32((a), (n))
+#define DM_V_SRA(a, n) _mm_srai_epi32((a), (n))
+#define DM_V_SRL_VAR(a, n) _mm_srl_epi32((a), _mm_cvtsi32_si128(n))
+#define DM_V_MIN(a, b) _mm_min_epi32((a), (b))
+#define DM_V_MAX(a, b) _mm_max_epi32((a), (b))
+// a where mask is set, else b
+#define DM_V_SELECT(mask, a, b) _mm_blendv_epi8((b), (a), (mask))
+#define dm_vec16 __m128i
+#define DM_V16_WIDTH 8
+#define DM_V16_LOAD8(p) \
+    _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(p)))
+// store lanes in [0, U8_MAX] as 8-bit pixels
+#define DM_V16_STORE8(p, v) \
+    _mm_storel_epi64((__m128i *)(p), _mm_packus_epi16((v), (v)))
+#define DM_V16_SET1(x) _mm_set1_epi16(x)
+#define DM_V16_EVEN_LANES() _mm_set1_epi32(0x0000FFFF)
+#define DM_V16_ODD_LANES() _mm_set1_epi32(-0x10000)
+#define DM_V16_ADD(a, b) _mm_add_epi16((a), (b))
+#define DM_V16_SUB(a, b) _mm_sub_epi16((a), (b))
+#define DM_V16_SLL(a, n) _mm_slli_epi16((a), (n))
+#define DM_V16_SRA(a, n) _mm_srai_epi16((a), (n))
+#define DM_V16_MIN(a, b) _mm_min_epi16((a), (b))
+#define DM_V16_MAX(a, b) _mm_max_epi16((a), (b))
+// a where mask is set, else b
+#define DM_V16_SELECT(mask, a, b) _mm_blendv_epi8((b), (a), (mask))
+#include "demosaic_simd_template.h"
+#endif // DM_ENGINE_SSE41
+
+#ifdef DM_ENGINE_AVX2
+// AVX2, 8 32-bit lanes
+#define DM_V_NAME avx2
+#define DM_V_ENGINE DEMOSAIC_ENGINE_AVX2
+#ifdef __AVX2__
+#define DM_V_TARGET
+#else
+#define DM_V_TARGET __attribute__((target("avx2")))
+#endif
+#define DM_V_UNPACK demosaic_simd_unpack_line
+#define dm_vec __m256i
+#define DM_V_WIDTH 8
+#define DM_V_LOAD16(p) \
+    _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p)))
+#define DM_V_LOAD8(p) \
+    _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p)))
+#define DM_V_LOAD32(p) _mm256_loadu_si256((const __m256i *)(p))
+#define DM_V_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+#define DM_V_SET1(x) _mm256_set1_epi32(x)
+#define DM_V_EVEN_LANES() _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1)
+#define DM_V_ODD_LANES() _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0)
+#define DM_V_ADD(a, b) _mm256_add_epi32((a), (b))
+#define DM_V_SUB(a, b) _mm256_sub_epi32((a), (b))
+#define DM_V_MUL(a, b) _mm256_mullo_epi32((a), (b))
+#define DM_V_SLL(a, n) _mm256_slli_epi32((a), (n))
+#define DM_V_SRA(a, n) _mm256_srai_epi32((a), (n))
+#define DM_V_SRL_VAR(a, n) _mm256_srl_epi32((a), _mm_cvtsi32_si128(n))
+#define DM_V_MIN(a, b) _mm256_min_epi32((a), (b))
+#define DM_V_MAX(a, b) _mm256_max_epi32((a), (b))
+// a where mask is set, else b
+#define DM_V_SELECT(mask, a, b) _mm256_blendv_epi8((b), (a), (mask))
+#define dm_vec16 __m256i
+#define DM_V16_WIDTH 16
+#define DM_V16_LOAD8(p) \
+    _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p)))
+// store lanes in [0, U8_MAX] as 8-bit pixels
+#define DM_V16_STORE8(p, v) _mm_storeu_si128((__m128i *)(p), \
+    _mm256_castsi256_si128(_mm256_permute4x64_epi64( \
+            _mm256_packus_epi16((v), (v)), 0x08)))
+#define DM_V16_SET1(x) _mm256_set1_epi16(x)
+#define DM_V16_EVEN_LANES() _mm256_set1_epi32(0x0000FFFF)
+#define DM_V16_ODD_LANES() _mm256_set1_epi32(-0x10000)
+#define DM_V16_ADD(a, b) _mm256_add_epi16((a), (b))
+#define DM_V16_SUB(a, b) _mm256_sub_epi16((a), (b))
+#define DM_V16_SLL(a, n) _mm256_slli_epi16((a), (n))
+#define DM_V16_SRA(a, n) _mm256_srai_epi16((a), (n))
+#define DM_V16_MIN(a, b) _mm256_min_epi16((a), (b))
+#define DM_V16_MAX(a, b) _mm256_max_epi16((a), (b))
+// a where mask is set, else b
+#define DM_V16_SELECT(mask, a, b) _mm256_blendv_epi8((b), (a), (mask))
+#include "demosaic_simd_template.h"
+#endif // DM_ENGINE_AVX2
+
+// the engine of the compiler's target, until demosaic_engine_init()
+#if defined(__AVX2__)
+#define DM_ENGINE_DEFAULT demosaic_engine_avx2
+#elif defined(__SSE4_1__)
+#define DM_ENGINE_DEFAULT demosaic_engine_sse41
+#else
+#define DM_ENGINE_DEFAULT demosaic_engine_sse2
+#endif
+#endif // DM_ENGINE_X86
+
+#ifdef DM_ENGINE_NEON
+// load 4 8-bit pixels, without reading past them
+static inline int32x4_t dm_v_load8_neon(const U8 * const p)
+{
+    uint32_t packed = 0;
+    memcpy(&packed, p, sizeof(packed));
+    return vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(
+            vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(packed))))));
+}
 
-    const I32 ncol = args->n_cols;
-    I32 red = 0;
-    I32 green = 0;
-    I32 blue = 0;
-    const U16 max_val = args->max_val;
-
-    if ((row % 2) == 0) { // red-green row
-        // at left edge, use safe helpers
-        get_rgb16_at_red16(bayer, args, row, 0, &(output_row[0]));
-        get_rgb16_at_green_rg16(bayer, args, row, 1, &(output_row[1]));
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // comments on the right indicate sampling kernels. See Malvar paper.
-
-            // red pixel
-            output_row[col].red = GET_PIX(bayer,ncol,row,col);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            output_row[col].green = DM_LIMIT(green, 0, max_val);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            output_row[col].blue = DM_LIMIT(blue, 0, max_val);
+// NEON, 4 32-bit lanes
+#define DM_V_NAME neon
+#define DM_V_ENGINE DEMOSAIC_ENGINE_NEON
+#define DM_V_TARGET
+#define DM_V_UNPACK NULL
+#define dm_vec int32x4_t
+#define DM_V_WIDTH 4
+#define DM_V_LOAD16(p) vreinterpretq_s32_u32(vmovl_u16(vld1_u16(p)))
+#define DM_V_LOAD8(p) dm_v_load8_neon(p)
+#define DM_V_LOAD32(p) vld1q_s32(p)
+#define DM_V_STORE(p, v) vst1q_s32((p), (v))
+#define DM_V_SET1(x) vdupq_n_s32(x)
+#define DM_V_EVEN_LANES() vcombine_s32(vcreate_s32(0x00000000FFFFFFFFULL), \
+                                       vcreate_s32(0x00000000FFFFFFFFULL))
+#define DM_V_ODD_LANES() vcombine_s32(vcreate_s32(0xFFFFFFFF00000000ULL), \
+                                      vcreate_s32(0xFFFFFFFF00000000ULL))
+#define DM_V_ADD(a, b) vaddq_s32((a), (b))
+#define DM_V_SUB(a, b) vsubq_s32((a), (b))
+#define DM_V_MUL(a, b) vmulq_s32((a), (b))
+#define DM_V_SLL(a, n) vshlq_n_s32((a), (n))
+#define DM_V_SRA(a, n) vshrq_n_s32((a), (n))
+#define DM_V_SRL_VAR(a, n) vshlq_s32((a), vdupq_n_s32(-(n)))
+#define DM_V_MIN(a, b) vminq_s32((a), (b))
+#define DM_V_MAX(a, b) vmaxq_s32((a), (b))
+// a where mask is set, else b
+#define DM_V_SELECT(mask, a, b) \
+    vbslq_s32(vreinterpretq_u32_s32(mask), (a), (b))
+#define dm_vec16 int16x8_t
+#define DM_V16_WIDTH 8
+#define DM_V16_LOAD8(p) vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p)))
+// store lanes in [0, U8_MAX] as 8-bit pixels
+#define DM_V16_STORE8(p, v) vst1_u8((p), vqmovun_s16(v))
+#define DM_V16_SET1(x) vdupq_n_s16(x)
+#define DM_V16_EVEN_LANES() vreinterpretq_s16_u32(vdupq_n_u32(0x0000FFFFU))
+#define DM_V16_ODD_LANES() vreinterpretq_s16_u32(vdupq_n_u32(0xFFFF0000U))
+#define DM_V16_ADD(a, b) vaddq_s16((a), (b))
+#define DM_V16_SUB(a, b) vsubq_s16((a), (b))
+#define DM_V16_SLL(a, n) vshlq_n_s16((a), (n))
+#define DM_V16_SRA(a, n) vshrq_n_s16((a), (n))
+#define DM_V16_MIN(a, b) vminq_s16((a), (b))
+#define DM_V16_MAX(a, b) vmaxq_s16((a), (b))
+// a where mask is set, else b
+#define DM_V16_SELECT(mask, a, b) \
+    vbslq_s16(vreinterpretq_u16_s16(mask), (a), (b))
+#include "demosaic_simd_template.h"
+
+#define DM_ENGINE_DEFAULT demosaic_engine_neon
+#endif // DM_ENGINE_NEON
+
+// the active engine, or NULL for the scalar kernels. Only
+// demosaic_engine_init() changes it, before demosaicing starts, so the
+// span kernels of every thread read it without synchronization.
+static const demosaic_engine_fns * demosaic_vector_engine = &DM_ENGINE_DEFAULT;
+#endif // DM_SIMD
+
+// 1 if engine is compiled in, and the host has its instructions
+DEMOSAIC_PRIVATE I32 demosaic_engine_runs(
+        const demosaic_engine engine)
+{
+    I32 runs = 0;
+    switch (engine) {
+    case DEMOSAIC_ENGINE_SCALAR:
+        runs = 1;
+        break;
+#ifdef DM_ENGINE_X86
+    case DEMOSAIC_ENGINE_SSE2:
+        runs = 1;
+        break;
+#endif
+#ifdef DM_ENGINE_SSE41
+    case DEMOSAIC_ENGINE_SSE41:
+#ifdef __SSE4_1__
+        runs = 1;
+#else
+        __builtin_cpu_init();
+        runs = __builtin_cpu_supports("sse4.1") ? 1 : 0;
+#endif
+        break;
+#endif
+#ifdef DM_ENGINE_AVX2
+    case DEMOSAIC_ENGINE_AVX2:
+#ifdef __AVX2__
+        runs = 1;
+#else
+        // also checks the OS saves the 256-bit registers
+        __builtin_cpu_init();
+        runs = __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+        break;
+#endif
+#ifdef DM_ENGINE_NEON
+    case DEMOSAIC_ENGINE_NEON:
+        runs = 1;
+        break;
+#endif
+    default:
+        // not compiled in
+        break;
+    }
+    return runs;
+}
 
-            ++col;
+I32 demosaic_engine_supported(
+        const demosaic_engine engine)
+{
+    DEMOSAIC_ASSERT_1((engine >= DEMOSAIC_ENGINE_AUTO)
+            && (engine <= DEMOSAIC_ENGINE_NEON), engine);
 
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            output_row[col].red = DM_LIMIT(red, 0, max_val);
-
-            output_row[col].green = GET_PIX(bayer,ncol,row,col);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            output_row[col].blue = DM_LIMIT(blue, 0, max_val);
-            ++col;
+    return (engine == DEMOSAIC_ENGINE_AUTO) ? 1 : demosaic_engine_runs(engine);
+}
+
+demosaic_engine demosaic_engine_init(
+        demosaic_engine engine)
+{
+    DEMOSAIC_ASSERT_1((engine >= DEMOSAIC_ENGINE_AUTO)
+            && (engine <= DEMOSAIC_ENGINE_NEON), engine);
+
+    // the widest engine the host runs, the enum being in order of width
+    // within each architecture
+    if (engine == DEMOSAIC_ENGINE_AUTO) {
+        engine = DEMOSAIC_ENGINE_NEON;
+        while (demosaic_engine_runs(engine) == 0) {
+            engine = (demosaic_engine) (engine - 1);
         }
-        // at right edge, use safe helpers
-        get_rgb16_at_red16(bayer, args, row, ncol-2, &(output_row[ncol-2]));
-        get_rgb16_at_green_rg16(bayer, args, row, ncol-1, &(output_row[ncol-1]));
-    } else { // green-blue row
-        // at left edge, use safe helpers
-        get_rgb16_at_green_gb16(bayer, args, row, 0, &(output_row[0]));
-        get_rgb16_at_blue16(bayer, args, row, 1, &(output_row[1]));
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            output_row[col].red = DM_LIMIT(red, 0, max_val);
-
-            output_row[col].green = GET_PIX(bayer,ncol,row,col);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            output_row[col].blue = DM_LIMIT(blue, 0, max_val);
+    }
+    DEMOSAIC_ASSERT_1(demosaic_engine_runs(engine), engine);
+
+#ifdef DM_SIMD
+    switch (engine) {
+#ifdef DM_ENGINE_X86
+    case DEMOSAIC_ENGINE_SSE2:
+        demosaic_vector_engine = &demosaic_engine_sse2;
+        break;
+#endif
+#ifdef DM_ENGINE_SSE41
+    case DEMOSAIC_ENGINE_SSE41:
+        demosaic_vector_engine = &demosaic_engine_sse41;
+        break;
+#endif
+#ifdef DM_ENGINE_AVX2
+    case DEMOSAIC_ENGINE_AVX2:
+        demosaic_vector_engine = &demosaic_engine_avx2;
+        break;
+#endif
+#ifdef DM_ENGINE_NEON
+    case DEMOSAIC_ENGINE_NEON:
+        demosaic_vector_engine = &demosaic_engine_neon;
+        break;
+#endif
+    default:
+        demosaic_vector_engine = NULL;
+        break;
+    }
+#endif
+    return engine;
+}
 
-            ++col;
+demosaic_engine demosaic_engine_active(void)
+{
+#ifdef DM_SIMD
+    if (demosaic_vector_engine != NULL) {
+        return demosaic_vector_engine->engine;
+    }
+#endif
+    return DEMOSAIC_ENGINE_SCALAR;
+}
 
-            // blue pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4  0 4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4  0 4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            output_row[col].red = DM_LIMIT(red, 0, max_val);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            output_row[col].green = DM_LIMIT(green, 0, max_val);
-
-            output_row[col].blue = GET_PIX(bayer,ncol,row,col);
+// demosaicing from line pointers, for callers that do not hold the whole
+// bayer image, i.e. streaming. lines[i] is bayer row row-2+i, with rows
+// outside the image already replaced by the closest row of the same color.
 
-            ++col;
-        }
-        // at right edge, use safe helpers
-        get_rgb16_at_green_gb16(bayer, args, row, ncol-2, &(output_row[ncol-2]));
-        get_rgb16_at_blue16(bayer, args, row, ncol-1, &(output_row[ncol-1]));
+// index along one image axis. if out of bounds, closest of same bayer color
+DEMOSAIC_PRIVATE I32 demosaic_mirror_index(I32 index, const I32 n)
+{
+    if (index < 0) {
+        index = (-index) % 2;
     }
+    if (index >= n) {
+        index = n - 2 + (index % 2);
+    }
+    return index;
 }
 
-// demosaic 16 bit bayer row to 16 bit rgb row
-void demosaic_malvar_rgb16(
+// point lines at bayer rows row-2 to row+2, mirroring rows beyond the
+// top and bottom edges to the closest row of the same color
+DEMOSAIC_PRIVATE void demosaic_bayer_lines16(
         const U16 * const bayer,
         const demosaic_args * const args,
-        demosaic_pix_rgb16 * output)
+        const I32 row,
+        const U16 * lines[5])
 {
-    DEMOSAIC_ASSERT(args != NULL);
+    for (I32 i = 0; i < 5; i++) {
+        lines[i] = &bayer[args->n_cols
+                * demosaic_mirror_index(row - 2 + i, args->n_rows)];
+    }
+}
 
-    // assert even rows and columns, at least 2x2
-    demosaic_malvar_assert_proper_dimensions(args);
+DEMOSAIC_PRIVATE void demosaic_bayer_lines8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        const U8 * lines[5])
+{
+    for (I32 i = 0; i < 5; i++) {
+        lines[i] = &bayer[args->n_cols
+                * demosaic_mirror_index(row - 2 + i, args->n_rows)];
+    }
+}
 
-    for (I32 row = 0; row < args->n_rows; row++) {
-        demosaic_malvar_row_rgb16(bayer, args, row,
-                &output[row * args->n_cols]);
+// bayer lines for demosaic_bayer_lines16, with rows pitch bytes apart
+DEMOSAIC_PRIVATE void demosaic_bayer_lines16_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 pitch,
+        const I32 row,
+        const U16 * lines[5])
+{
+    const U8 * const base = (const U8 *) bayer;
+    for (I32 i = 0; i < 5; i++) {
+        lines[i] = (const U16 *) &base[pitch
+                * demosaic_mirror_index(row - 2 + i, args->n_rows)];
     }
 }
 
-// demosaic 8 bit bayer to 8 bit rgb
-// If the row is at the top or bottom, use the unoptimized function,
-// which ensures that sampling past the image edges does not occur.
-// Otherwise, use safe functions at left and right edges, and unsafe macros
-// in image interior, where edge testing is known to be unnecessary.
-// This vastly improves performance.
-void demosaic_malvar_row_rgb8(
+// bayer lines for demosaic_bayer_lines8, with rows pitch bytes apart
+DEMOSAIC_PRIVATE void demosaic_bayer_lines8_pitched(
         const U8 * const bayer,
         const demosaic_args * const args,
+        const I32 pitch,
         const I32 row,
-        demosaic_pix_rgb8 output_row[])
+        const U8 * lines[5])
 {
-    DEMOSAIC_ASSERT(args != NULL);
-
-    // if this row is one of the two top or bottom rows, use safe functions
-    if (row < 2 || row >= args->n_rows - 2 ) {
-        demosaic_malvar_row_rgb8_unoptimized(bayer, args, row, output_row);
-        return;
+    const U8 * const base = (const U8 *) bayer;
+    for (I32 i = 0; i < 5; i++) {
+        lines[i] = (const U8 *) &base[pitch
+                * demosaic_mirror_index(row - 2 + i, args->n_rows)];
     }
-    // else middle row, can be optimized
+}
 
-    // assert pointers not null
-    DEMOSAIC_ASSERT(output_row != NULL);
-    DEMOSAIC_ASSERT(bayer != NULL);
+// sums of the bayer pixels sampled by the malvar kernels around (row, col)
+typedef struct {
+    I32 center; // (0, 0)
+    I32 vert1;  // (-1, 0) + (+1, 0)
+    I32 horz1;  // (0, -1) + (0, +1)
+    I32 vert2;  // (-2, 0) + (+2, 0)
+    I32 horz2;  // (0, -2) + (0, +2)
+    I32 diag;   // (-1, -1) + (-1, +1) + (+1, -1) + (+1, +1)
+} demosaic_taps;
+
+// load taps from lines, mirroring columns beyond the left and right edges
+static inline void demosaic_load_taps16_safe(
+        const U16 * const lines[5], const I32 n_cols, const I32 col,
+        demosaic_taps * const taps)
+{
+    const I32 left1 = demosaic_mirror_index(col - 1, n_cols);
+    const I32 right1 = demosaic_mirror_index(col + 1, n_cols);
+    const I32 left2 = demosaic_mirror_index(col - 2, n_cols);
+    const I32 right2 = demosaic_mirror_index(col + 2, n_cols);
+
+    taps->center = lines[2][col];
+    taps->vert1 = lines[1][col] + lines[3][col];
+    taps->horz1 = lines[2][left1] + lines[2][right1];
+    taps->vert2 = lines[0][col] + lines[4][col];
+    taps->horz2 = lines[2][left2] + lines[2][right2];
+    taps->diag = lines[1][left1] + lines[1][right1]
+               + lines[3][left1] + lines[3][right1];
+}
 
-    // assert even rows and columns, at least 2x2
-    demosaic_malvar_assert_proper_dimensions(args);
+// load taps from lines, col must be at least 2 from the left and right edges
+static inline void demosaic_load_taps16(
+        const U16 * const lines[5], const I32 col,
+        demosaic_taps * const taps)
+{
+    taps->center = lines[2][col];
+    taps->vert1 = lines[1][col] + lines[3][col];
+    taps->horz1 = lines[2][col - 1] + lines[2][col + 1];
+    taps->vert2 = lines[0][col] + lines[4][col];
+    taps->horz2 = lines[2][col - 2] + lines[2][col + 2];
+    taps->diag = lines[1][col - 1] + lines[1][col + 1]
+               + lines[3][col - 1] + lines[3][col + 1];
+}
 
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+static inline void demosaic_load_taps8_safe(
+        const U8 * const lines[5], const I32 n_cols, const I32 col,
+        demosaic_taps * const taps)
+{
+    const I32 left1 = demosaic_mirror_index(col - 1, n_cols);
+    const I32 right1 = demosaic_mirror_index(col + 1, n_cols);
+    const I32 left2 = demosaic_mirror_index(col - 2, n_cols);
+    const I32 right2 = demosaic_mirror_index(col + 2, n_cols);
+
+    taps->center = lines[2][col];
+    taps->vert1 = lines[1][col] + lines[3][col];
+    taps->horz1 = lines[2][left1] + lines[2][right1];
+    taps->vert2 = lines[0][col] + lines[4][col];
+    taps->horz2 = lines[2][left2] + lines[2][right2];
+    taps->diag = lines[1][left1] + lines[1][right1]
+               + lines[3][left1] + lines[3][right1];
+}
 
-    // assert max val is 255 or less
-    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+static inline void demosaic_load_taps8(
+        const U8 * const lines[5], const I32 col,
+        demosaic_taps * const taps)
+{
+    taps->center = lines[2][col];
+    taps->vert1 = lines[1][col] + lines[3][col];
+    taps->horz1 = lines[2][col - 1] + lines[2][col + 1];
+    taps->vert2 = lines[0][col] + lines[4][col];
+    taps->horz2 = lines[2][col - 2] + lines[2][col + 2];
+    taps->diag = lines[1][col - 1] + lines[1][col + 1]
+               + lines[3][col - 1] + lines[3][col + 1];
+}
 
-    const I32 ncol = args->n_cols;
-    I32 red = 0;
-    I32 green = 0;
-    I32 blue = 0;
-    const U16 max_val = args->max_val;
-
-    if ((row % 2) == 0) { // red-green row
-        // at left edge, use safe helpers
-        get_rgb8_at_red8(bayer, args, row, 0, &(output_row[0]));
-        get_rgb8_at_green_rg8(bayer, args, row, 1, &(output_row[1]));
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // comments on the right indicate sampling kernels. See Malvar paper.
-
-            // red pixel
-            output_row[col].red = GET_PIX(bayer,ncol,row,col);
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            output_row[col].green = DM_LIMIT(green, 0, max_val);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            output_row[col].blue = DM_LIMIT(blue, 0, max_val);
+// calibrate the taps of a pixel at (row, col), in pattern coordinates.
+// center, vert2 and horz2 are of the pixel's channel, horz1 of the other
+// channel in its row, vert1 of the other channel in its column, and diag
+// of the opposite channel.
+static inline void demosaic_calibrate_taps(
+        const demosaic_cal_weights * const w,
+        const I32 row, const I32 col,
+        demosaic_taps * const t)
+{
+    const I32 same = 2 * (row % 2) + (col % 2);
+    const I32 in_row = same ^ 1;
+    const I32 in_col = same ^ 2;
+    const I32 opposite = same ^ 3;
+
+    t->center = w->gain[same] * t->center - w->offset[same];
+    t->vert2 = w->gain[same] * t->vert2 - 2 * w->offset[same];
+    t->horz2 = w->gain[same] * t->horz2 - 2 * w->offset[same];
+    t->horz1 = w->gain[in_row] * t->horz1 - 2 * w->offset[in_row];
+    t->vert1 = w->gain[in_col] * t->vert1 - 2 * w->offset[in_col];
+    t->diag = w->gain[opposite] * t->diag - 4 * w->offset[opposite];
+}
 
-            ++col;
+// apply the malvar kernels to the calibrated taps of a pixel at (row, col),
+// in pattern coordinates, dividing sums and the pixel's own channel by the
+// gain scale, then the color correction matrix if ccm is not NULL,
+// before clamping them.
+// Return the number of values clamped to [0, max_val].
+DEMOSAIC_PRIVATE I32 demosaic_cal_interpolate_taps(
+        const demosaic_taps * const raw,
+        const demosaic_cal_weights * const cal,
+        const demosaic_ccm * const ccm,
+        const I32 row, const I32 col, const I32 max_val,
+        demosaic_pix_rgb16 * const output_pixel)
+{
+    const I32 scale = 1 << DEMOSAIC_GAIN_BITS;
+    demosaic_taps t = *raw;
+    demosaic_calibrate_taps(cal, row, col, &t);
+
+    const I32 outer = t.vert2 + t.horz2;
+    const I32 center = t.center / scale;
+    const I32 k_green = (4 * t.center + 2 * (t.vert1 + t.horz1) - outer)
+                      / (8 * scale);
+    const I32 k_opposite = (12 * t.center + 4 * t.diag - 3 * outer)
+                         / (16 * scale);
+    const I32 k_row = (10 * t.center + 8 * t.horz1
+                       - 2 * (t.diag + t.horz2) + t.vert2) / (16 * scale);
+    const I32 k_column = (10 * t.center + 8 * t.vert1
+                          - 2 * (t.diag + t.vert2) + t.horz2) / (16 * scale);
+    I32 red;
+    I32 green;
+    I32 blue;
+    if ((row % 2) == 0) {
+        if ((col % 2) == 0) { // red
+            red = center;
+            green = k_green;
+            blue = k_opposite;
+        } else { // green in red-green row
+            red = k_row;
+            green = center;
+            blue = k_column;
+        }
+    } else {
+        if ((col % 2) == 0) { // green in green-blue row
+            red = k_column;
+            green = center;
+            blue = k_row;
+        } else { // blue
+            red = k_opposite;
+            green = k_green;
+            blue = center;
+        }
+    }
+    if (ccm != NULL) {
+        demosaic_correct_rgb(ccm, &red, &green, &blue);
+    }
+    output_pixel->red = DM_LIMIT(red, 0, max_val);
+    output_pixel->green = DM_LIMIT(green, 0, max_val);
+    output_pixel->blue = DM_LIMIT(blue, 0, max_val);
+    return DM_CLAMPED(red, max_val) + DM_CLAMPED(green, max_val)
+         + DM_CLAMPED(blue, max_val);
+}
+
+// apply the malvar kernels for each bayer color to its taps,
+// with the same weights and rounding as the get_* helpers.
+// Return the number of interpolated values clamped to [0, max_val].
+static inline I32 demosaic_taps_at_red(
+        const demosaic_taps * const t, const I32 max_val,
+        demosaic_pix_rgb16 * const output_pixel)
+{
+    const I32 outer = t->vert2 + t->horz2;
+    const I32 green = (4 * t->center + 2 * (t->vert1 + t->horz1) - outer) / 8;
+    const I32 blue = (12 * t->center + 4 * t->diag - 3 * outer) / 16;
+    output_pixel->red = t->center;
+    output_pixel->green = DM_LIMIT(green, 0, max_val);
+    output_pixel->blue = DM_LIMIT(blue, 0, max_val);
+    return DM_CLAMPED(green, max_val) + DM_CLAMPED(blue, max_val);
+}
+
+// green in red-green row
+static inline I32 demosaic_taps_at_green_rg(
+        const demosaic_taps * const t, const I32 max_val,
+        demosaic_pix_rgb16 * const output_pixel)
+{
+    const I32 red = (10 * t->center + 8 * t->horz1
+                     - 2 * (t->diag + t->horz2) + t->vert2) / 16;
+    const I32 blue = (10 * t->center + 8 * t->vert1
+                      - 2 * (t->diag + t->vert2) + t->horz2) / 16;
+    output_pixel->red = DM_LIMIT(red, 0, max_val);
+    output_pixel->green = t->center;
+    output_pixel->blue = DM_LIMIT(blue, 0, max_val);
+    return DM_CLAMPED(red, max_val) + DM_CLAMPED(blue, max_val);
+}
 
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            output_row[col].red = DM_LIMIT(red, 0, max_val);
-
-            output_row[col].green = GET_PIX(bayer,ncol,row,col);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            output_row[col].blue = DM_LIMIT(blue, 0, max_val);
+// green in green-blue row
+static inline I32 demosaic_taps_at_green_gb(
+        const demosaic_taps * const t, const I32 max_val,
+        demosaic_pix_rgb16 * const output_pixel)
+{
+    const I32 red = (10 * t->center + 8 * t->vert1
+                     - 2 * (t->diag + t->vert2) + t->horz2) / 16;
+    const I32 blue = (10 * t->center + 8 * t->horz1
+                      - 2 * (t->diag + t->horz2) + t->vert2) / 16;
+    output_pixel->red = DM_LIMIT(red, 0, max_val);
+    output_pixel->green = t->center;
+    output_pixel->blue = DM_LIMIT(blue, 0, max_val);
+    return DM_CLAMPED(red, max_val) + DM_CLAMPED(blue, max_val);
+}
 
-            ++col;
+static inline I32 demosaic_taps_at_blue(
+        const demosaic_taps * const t, const I32 max_val,
+        demosaic_pix_rgb16 * const output_pixel)
+{
+    const I32 outer = t->vert2 + t->horz2;
+    const I32 red = (12 * t->center + 4 * t->diag - 3 * outer) / 16;
+    const I32 green = (4 * t->center + 2 * (t->vert1 + t->horz1) - outer) / 8;
+    output_pixel->red = DM_LIMIT(red, 0, max_val);
+    output_pixel->green = DM_LIMIT(green, 0, max_val);
+    output_pixel->blue = t->center;
+    return DM_CLAMPED(red, max_val) + DM_CLAMPED(green, max_val);
+}
+
+// apply the malvar kernels for the bayer color at (row, col), in pattern
+// coordinates, returning the number of values clamped
+static inline I32 demosaic_interpolate_taps(
+        const demosaic_taps * const t,
+        const I32 row, const I32 col, const I32 max_val,
+        demosaic_pix_rgb16 * const output_pixel)
+{
+    if ((row % 2) == 0) {
+        if ((col % 2) == 0) {
+            return demosaic_taps_at_red(t, max_val, output_pixel);
+        } else {
+            return demosaic_taps_at_green_rg(t, max_val, output_pixel);
         }
-        // at right edge, use safe helpers
-        get_rgb8_at_red8(bayer, args, row, ncol-2, &(output_row[ncol-2]));
-        get_rgb8_at_green_rg8(bayer, args, row, ncol-1, &(output_row[ncol-1]));
-    } else { // green-blue row
-        // at left edge, use safe helpers
-        get_rgb8_at_green_gb8(bayer, args, row, 0, &(output_row[0]));
-        get_rgb8_at_blue8(bayer, args, row, 1, &(output_row[1]));
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            output_row[col].red = DM_LIMIT(red, 0, max_val);
-
-            output_row[col].green = GET_PIX(bayer,ncol,row,col);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            output_row[col].blue = DM_LIMIT(blue, 0, max_val);
+    } else {
+        if ((col % 2) == 0) {
+            return demosaic_taps_at_green_gb(t, max_val, output_pixel);
+        } else {
+            return demosaic_taps_at_blue(t, max_val, output_pixel);
+        }
+    }
+}
 
+// demosaic columns [col_begin, col_end) of a row of corrected pixels from
+// line pointers, as the span kernels, to rgb16 pixels at output index 0.
+// The corrected span kernels store them as their output type.
+DEMOSAIC_PRIVATE void demosaic_cal_span16(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        const I32 col_begin,
+        const I32 col_end,
+        demosaic_pix_rgb16 output[])
+{
+    const I32 ncol = args->n_cols;
+    const I32 max_val = args->max_val;
+    const I32 pattern_row = row + DM_ROW_OFFSET(args);
+    const I32 col_off = DM_COL_OFFSET(args);
+    demosaic_cal_weights weights;
+    const demosaic_cal_weights * const cal =
+            demosaic_corrected_weights_init(args, &weights);
+    demosaic_taps taps;
+    I32 col = col_begin;
+#ifdef DM_INSTRUMENT
+    const I32 edge_row = (row < 2 || row >= args->n_rows - 2);
+    demosaic_pix_rgb16 px;
+    I32 clamps = 0;
+#endif
+
+    while (col < col_end) {
+        I32 begin = col;
+        // within 2 of the left or right edge, mirror
+        const I32 edge = (col < 2 || col >= ncol - 2);
+        I32 end = (col_end < ncol - 2) ? col_end : ncol - 2;
+        if (edge) {
+            end = (col < 2 && col_end > 2) ? 2 : col_end;
+        }
+#ifdef DM_INSTRUMENT
+        const demosaic_stage stage = edge_row ? DEMOSAIC_STAGE_EDGE_ROWS
+                : (edge ? DEMOSAIC_STAGE_EDGE_COLS : DEMOSAIC_STAGE_INTERIOR);
+#endif
+        DM_STAGE_BEGIN(stage);
+#ifdef DM_SIMD
+        if (!edge && (demosaic_vector_engine != NULL)) {
+            col = demosaic_vector_engine->cal_lines16(lines, args, row, col,
+                    end, &output[col - col_begin]);
+        }
+#endif
+        const I32 scalar_begin = col;
+        while (col < end) {
+            if (edge) {
+                demosaic_load_taps16_safe(lines, ncol, col, &taps);
+            } else {
+                demosaic_load_taps16(lines, col, &taps);
+            }
+            DM_COUNT(clamps, demosaic_cal_interpolate_taps(&taps, cal,
+                    args->ccm, pattern_row, col + col_off, max_val,
+                    &output[col - col_begin]));
             ++col;
+        }
+        DM_STAGE_END(stage, col - begin);
+#ifdef DM_INSTRUMENT
+        // recount the columns of the vector kernels, after timing
+        while (begin < scalar_begin) {
+            demosaic_load_taps16(lines, begin, &taps);
+            clamps += demosaic_cal_interpolate_taps(&taps, cal, args->ccm,
+                    pattern_row, begin + col_off, max_val, &px);
+            ++begin;
+        }
+#else
+        (void) scalar_begin;
+#endif
+        DM_STAGE_CLAMPS(stage, clamps);
+#ifdef DM_INSTRUMENT
+        clamps = 0;
+#endif
+    }
+}
 
-            // blue pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            output_row[col].red = DM_LIMIT(red, 0, max_val);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            output_row[col].green = DM_LIMIT(green, 0, max_val);
-
-            output_row[col].blue = GET_PIX(bayer,ncol,row,col);
+DEMOSAIC_PRIVATE void demosaic_cal_span8(
+        const U8 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        const I32 col_begin,
+        const I32 col_end,
+        demosaic_pix_rgb16 output[])
+{
+    const I32 ncol = args->n_cols;
+    const I32 max_val = args->max_val;
+    const I32 pattern_row = row + DM_ROW_OFFSET(args);
+    const I32 col_off = DM_COL_OFFSET(args);
+    demosaic_cal_weights weights;
+    const demosaic_cal_weights * const cal =
+            demosaic_corrected_weights_init(args, &weights);
+    demosaic_taps taps;
+    I32 col = col_begin;
+#ifdef DM_INSTRUMENT
+    const I32 edge_row = (row < 2 || row >= args->n_rows - 2);
+    demosaic_pix_rgb16 px;
+    I32 clamps = 0;
+#endif
+
+    while (col < col_end) {
+        I32 begin = col;
+        // within 2 of the left or right edge, mirror
+        const I32 edge = (col < 2 || col >= ncol - 2);
+        I32 end = (col_end < ncol - 2) ? col_end : ncol - 2;
+        if (edge) {
+            end = (col < 2 && col_end > 2) ? 2 : col_end;
+        }
+#ifdef DM_INSTRUMENT
+        const demosaic_stage stage = edge_row ? DEMOSAIC_STAGE_EDGE_ROWS
+                : (edge ? DEMOSAIC_STAGE_EDGE_COLS : DEMOSAIC_STAGE_INTERIOR);
+#endif
+        DM_STAGE_BEGIN(stage);
+#ifdef DM_SIMD
+        if (!edge && (demosaic_vector_engine != NULL)) {
+            col = demosaic_vector_engine->cal_lines8(lines, args, row, col,
+                    end, &output[col - col_begin]);
+        }
+#endif
+        const I32 scalar_begin = col;
+        while (col < end) {
+            if (edge) {
+                demosaic_load_taps8_safe(lines, ncol, col, &taps);
+            } else {
+                demosaic_load_taps8(lines, col, &taps);
+            }
+            DM_COUNT(clamps, demosaic_cal_interpolate_taps(&taps, cal,
+                    args->ccm, pattern_row, col + col_off, max_val,
+                    &output[col - col_begin]));
             ++col;
         }
-        // at right edge, use safe helpers
-        get_rgb8_at_green_gb8(bayer, args, row, ncol-2, &(output_row[ncol-2]));
-        get_rgb8_at_blue8(bayer, args, row, ncol-1, &(output_row[ncol-1]));
+        DM_STAGE_END(stage, col - begin);
+#ifdef DM_INSTRUMENT
+        // recount the columns of the vector kernels, after timing
+        while (begin < scalar_begin) {
+            demosaic_load_taps8(lines, begin, &taps);
+            clamps += demosaic_cal_interpolate_taps(&taps, cal, args->ccm,
+                    pattern_row, begin + col_off, max_val, &px);
+            ++begin;
+        }
+#else
+        (void) scalar_begin;
+#endif
+        DM_STAGE_CLAMPS(stage, clamps);
+#ifdef DM_INSTRUMENT
+        clamps = 0;
+#endif
     }
 }
 
-// demosaic 8 bit bayer row to 8 bit rgb
-void demosaic_malvar_rgb8(
-        const U8 * const bayer,
+// span kernels, demosaicing columns [col_begin, col_end) of a row from
+// line pointers, generated by demosaic_span_template.h for each output type
+
+// pixels per chunk of corrected and tone mapped spans
+#define DM_SPAN_CHUNK 64
+
+#define DM_SPAN_NAME rgb16
+#define DM_SPAN_BITS 16
+#define DM_SPAN_SHIFTED 0
+#define DM_SPAN_MONO 0
+#define DM_SPAN_OUT_PARAMS demosaic_pix_rgb16 output[]
+#define DM_SPAN_OUT_ARGS output
+#define DM_SPAN_STORE(i, px) (output[i] = (px))
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_rgb16(lines, args, row, (col), (end), \
+            &output[i])
+#include "demosaic_span_template.h"
+
+#define DM_SPAN_NAME rgb8
+#define DM_SPAN_BITS 8
+#define DM_SPAN_SHIFTED 0
+#define DM_SPAN_MONO 0
+#define DM_SPAN_OUT_PARAMS demosaic_pix_rgb8 output[]
+#define DM_SPAN_OUT_ARGS output
+#define DM_SPAN_STORE(i, px) \
+    (output[i].red = (px).red, output[i].green = (px).green, \
+     output[i].blue = (px).blue)
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_rgb8(lines, args, row, (col), (end), \
+            &output[i])
+#include "demosaic_span_template.h"
+
+#define DM_SPAN_NAME rgb16to8
+#define DM_SPAN_BITS 16
+#define DM_SPAN_SHIFTED 1
+#define DM_SPAN_MONO 0
+#define DM_SPAN_OUT_PARAMS demosaic_pix_rgb8 output[]
+#define DM_SPAN_OUT_ARGS output
+#define DM_SPAN_STORE(i, px) \
+    (output[i].red = (px).red >> rshift, \
+     output[i].green = (px).green >> rshift, \
+     output[i].blue = (px).blue >> rshift)
+#define DM_SPAN_STORE_LUT(i, px) \
+    (output[i].red = DM_LUT(lut, (px).red, max_val), \
+     output[i].green = DM_LUT(lut, (px).green, max_val), \
+     output[i].blue = DM_LUT(lut, (px).blue, max_val))
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_rgb16to8(lines, args, row, (col), (end), \
+            &output[i])
+#include "demosaic_span_template.h"
+
+#define DM_SPAN_NAME mono16
+#define DM_SPAN_BITS 16
+#define DM_SPAN_SHIFTED 0
+#define DM_SPAN_MONO 1
+#define DM_SPAN_OUT_PARAMS U16 output[]
+#define DM_SPAN_OUT_ARGS output
+#define DM_SPAN_STORE(i, px) \
+    (output[i] = DM_LUMA(*coefs_normed, (px).red, (px).green, (px).blue))
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_mono16(lines, args, coefs_normed, row, \
+            (col), (end), &output[i])
+#include "demosaic_span_template.h"
+
+#define DM_SPAN_NAME mono8
+#define DM_SPAN_BITS 8
+#define DM_SPAN_SHIFTED 0
+#define DM_SPAN_MONO 1
+#define DM_SPAN_OUT_PARAMS U8 output[]
+#define DM_SPAN_OUT_ARGS output
+#define DM_SPAN_STORE(i, px) \
+    (output[i] = DM_LUMA(*coefs_normed, (px).red, (px).green, (px).blue))
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_mono8(lines, args, coefs_normed, row, \
+            (col), (end), &output[i])
+#include "demosaic_span_template.h"
+
+#define DM_SPAN_NAME mono16to8
+#define DM_SPAN_BITS 16
+#define DM_SPAN_SHIFTED 1
+#define DM_SPAN_MONO 1
+#define DM_SPAN_OUT_PARAMS U8 output[]
+#define DM_SPAN_OUT_ARGS output
+#define DM_SPAN_STORE(i, px) \
+    (output[i] = DM_LUMA(*coefs_normed, (px).red >> rshift, \
+                         (px).green >> rshift, (px).blue >> rshift))
+#define DM_SPAN_STORE_LUT(i, px) \
+    (output[i] = DM_LUMA(*coefs_normed, DM_LUT(lut, (px).red, max_val), \
+                         DM_LUT(lut, (px).green, max_val), \
+                         DM_LUT(lut, (px).blue, max_val)))
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_mono16to8(lines, args, coefs_normed, row, \
+            (col), (end), &output[i])
+#include "demosaic_span_template.h"
+
+#define DM_SPAN_NAME planar16
+#define DM_SPAN_BITS 16
+#define DM_SPAN_SHIFTED 0
+#define DM_SPAN_MONO 0
+#define DM_SPAN_OUT_PARAMS U16 red_out[], U16 green_out[], U16 blue_out[]
+#define DM_SPAN_OUT_ARGS red_out, green_out, blue_out
+#define DM_SPAN_STORE(i, px) \
+    (red_out[i] = (px).red, green_out[i] = (px).green, \
+     blue_out[i] = (px).blue)
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_planar16(lines, args, row, (col), (end), \
+            &red_out[i], &green_out[i], &blue_out[i])
+#include "demosaic_span_template.h"
+
+#define DM_SPAN_NAME planar8
+#define DM_SPAN_BITS 8
+#define DM_SPAN_SHIFTED 0
+#define DM_SPAN_MONO 0
+#define DM_SPAN_OUT_PARAMS U8 red_out[], U8 green_out[], U8 blue_out[]
+#define DM_SPAN_OUT_ARGS red_out, green_out, blue_out
+#define DM_SPAN_STORE(i, px) \
+    (red_out[i] = (px).red, green_out[i] = (px).green, \
+     blue_out[i] = (px).blue)
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_planar8(lines, args, row, (col), (end), \
+            &red_out[i], &green_out[i], &blue_out[i])
+#include "demosaic_span_template.h"
+
+#define DM_SPAN_NAME planar16to8
+#define DM_SPAN_BITS 16
+#define DM_SPAN_SHIFTED 1
+#define DM_SPAN_MONO 0
+#define DM_SPAN_OUT_PARAMS U8 red_out[], U8 green_out[], U8 blue_out[]
+#define DM_SPAN_OUT_ARGS red_out, green_out, blue_out
+#define DM_SPAN_STORE(i, px) \
+    (red_out[i] = (px).red >> rshift, green_out[i] = (px).green >> rshift, \
+     blue_out[i] = (px).blue >> rshift)
+#define DM_SPAN_STORE_LUT(i, px) \
+    (red_out[i] = DM_LUT(lut, (px).red, max_val), \
+     green_out[i] = DM_LUT(lut, (px).green, max_val), \
+     blue_out[i] = DM_LUT(lut, (px).blue, max_val))
+#define DM_SPAN_SIMD(col, end, i) \
+    demosaic_vector_engine->lines_planar16to8(lines, args, row, (col), \
+            (end), &red_out[i], &green_out[i], &blue_out[i])
+#include "demosaic_span_template.h"
+
+// assert luma coefficients are in [0,1], and normalize them to sum below 1
+DEMOSAIC_PRIVATE void demosaic_normalize_coefs_f64(
         const demosaic_args * const args,
-        demosaic_pix_rgb8 * output)
+        demosaic_luma_coefs * const coefs_normed)
+{
+    // assert coefficients are in [0,1]
+    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.red && args->coefs.red <= 1,
+            args->coefs.red);
+    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.green && args->coefs.green <= 1,
+            args->coefs.green);
+    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.blue && args->coefs.blue <= 1,
+            args->coefs.blue);
+
+    // normalize coefficients
+    F64 coef_sum = args->coefs.red + args->coefs.green + args->coefs.blue
+            + 0.000001;
+    coefs_normed->red = args->coefs.red / coef_sum;
+    coefs_normed->green = args->coefs.green / coef_sum;
+    coefs_normed->blue = args->coefs.blue / coef_sum;
+    coef_sum = coefs_normed->red + coefs_normed->green + coefs_normed->blue;
+    DEMOSAIC_ASSERT_DBL_1(coef_sum < 1.0, coef_sum);
+}
+
+// convert normalized luma coefficients to fixed-point weights.
+// Red and blue are rounded down and green gets the remainder of the
+// rounded sum, so no weight is negative, and they sum to at most 1.0.
+// Each weight is within 1 of the scaled coefficient, and the sum within
+// 0.5, so luma is within 1 + 2.5 * max_val / (1 << DM_LUMA_BITS)
+// of the F64 luma, i.e. 1 for 12-bit input.
+DEMOSAIC_PRIVATE void demosaic_luma_to_fixed(
+        const demosaic_luma_coefs * const coefs_normed,
+        demosaic_luma_fixed * const weights)
+{
+    const F64 one = (F64) (1 << DM_LUMA_BITS);
+    const F64 coef_sum =
+            coefs_normed->red + coefs_normed->green + coefs_normed->blue;
+    const I32 total = (I32) (coef_sum * one + 0.5);
+    weights->red = (I32) (coefs_normed->red * one);
+    weights->blue = (I32) (coefs_normed->blue * one);
+    weights->green = total - weights->red - weights->blue;
+}
+
+// the luma weights used by the mono functions, from args
+DEMOSAIC_PRIVATE void demosaic_normalize_coefs(
+        const demosaic_args * const args,
+        demosaic_luma_weights * const weights)
+{
+#ifdef DM_FIXED_LUMA
+    demosaic_luma_coefs coefs_normed;
+    demosaic_normalize_coefs_f64(args, &coefs_normed);
+    demosaic_luma_to_fixed(&coefs_normed, weights);
+#else
+    demosaic_normalize_coefs_f64(args, weights);
+#endif
+}
+
+// demosaic a 16 bit row to 16 bit rgb and 16 bit mono from line pointers,
+// computing each pixel's kernels once for both outputs
+DEMOSAIC_PRIVATE void demosaic_malvar_lines_rgb16_mono16(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        demosaic_pix_rgb16 output_rgb_row[],
+        U16 output_mono_row[])
+{
+    const I32 ncol = args->n_cols;
+    const I32 max_val = args->max_val;
+    const I32 row_off = DM_ROW_OFFSET(args);
+    const I32 col_off = DM_COL_OFFSET(args);
+    const I32 corrected = DM_CORRECTED(args);
+    demosaic_cal_weights weights;
+    const demosaic_cal_weights * const cal =
+            demosaic_corrected_weights_init(args, &weights);
+    demosaic_taps taps;
+    demosaic_pix_rgb16 * rgb;
+    I32 col = 0;
+
+    while (col < ncol) {
+        // mirror columns within 2 of the edges
+        if (col < 2 || col >= ncol - 2) {
+            demosaic_load_taps16_safe(lines, ncol, col, &taps);
+        } else {
+            demosaic_load_taps16(lines, col, &taps);
+        }
+        rgb = &output_rgb_row[col];
+        if (corrected) {
+            demosaic_cal_interpolate_taps(&taps, cal, args->ccm,
+                    row + row_off, col + col_off, max_val, rgb);
+        } else {
+            demosaic_interpolate_taps(&taps, row + row_off, col + col_off,
+                    max_val, rgb);
+        }
+        output_mono_row[col] = DM_LUMA(*coefs_normed,
+                rgb->red, rgb->green, rgb->blue);
+        ++col;
+#ifdef DM_SIMD
+        const demosaic_engine_fns * const engine = demosaic_vector_engine;
+        if (col == 2 && corrected && engine != NULL) {
+            // vectorized corrected interior, then its luma
+            const I32 end = engine->cal_lines16(lines, args, row, col,
+                    ncol - 2, &output_rgb_row[col]);
+            while (col < end) {
+                rgb = &output_rgb_row[col];
+                output_mono_row[col] = DM_LUMA(*coefs_normed,
+                        rgb->red, rgb->green, rgb->blue);
+                ++col;
+            }
+        } else if (col == 2 && engine != NULL) {
+            // vectorized interior, the loop finishes any remainder
+            col = engine->lines_rgb16_mono16(lines, args, coefs_normed,
+                    row, col, output_rgb_row, output_mono_row);
+        }
+#endif
+    }
+}
+
+#ifdef DM_REFERENCE
+// demosaic 16 bit bayer to 16 bit rgb, without optimizations
+DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb16_unoptimized(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb16 output_row[])
 {
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
     DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
-    // assert max val is 255 or less
-    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
 
-    for (I32 row = 0; row < args->n_rows; row++) {
-        demosaic_malvar_row_rgb8(bayer, args, row,
-                &output[row * args->n_cols]);
+    const I32 n_cols = args->n_cols;
+    I32 col = 0;
+
+    while (col < n_cols) {
+        get_rgb16_at16(bayer, args, row, col, &(output_row[col]));
+        ++col;
     }
 }
 
-
-// demosaic 16 bit bayer to 8 bit rgb
-// If the row is at the top or bottom, use the unoptimized function,
-// which ensures that sampling past the image edges does not occur.
-// Otherwise, use safe functions at left and right edges, and unsafe macros
-// in image interior, where edge testing is known to be unnecessary.
-// This vastly improves performance.
-void demosaic_malvar_row_rgb16to8(
-        const U16 * const bayer,
+// demosaic 8 bit bayer to 8 bit rgb, without optimizations
+DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb8_unoptimized(
+        const U8 * const bayer,
         const demosaic_args * const args,
         const I32 row,
         demosaic_pix_rgb8 output_row[])
 {
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
     DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
 
-    // if this row is one of the two top or bottom rows, use safe functions
-    if (row < 2 || row >= args->n_rows - 2 ) {
-        demosaic_malvar_row_rgb16to8_unoptimized(bayer, args, row, output_row);
-        return;
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    const I32 n_cols = args->n_cols;
+    I32 col = 0;
+
+    while (col < n_cols) {
+        get_rgb8_at8(bayer, args, row, col, &(output_row[col]));
+        ++col;
     }
-    // else middle row, can be optimized
+}
 
+// demosaic 16 bit bayer to 8 bit rgb, without optimizations
+DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb16to8_unoptimized(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[])
+{
     // assert pointers not null
-    DEMOSAIC_ASSERT(output_row != NULL);
     DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
@@ -1143,204 +2275,285 @@ void demosaic_malvar_row_rgb16to8(
     // assert shift is not negative
     DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
 
-    // assert max val can be shifted to 8 bits
-    DEMOSAIC_ASSERT_2((args->max_val >> args->rshift) <= U8_MAX,
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
             args->max_val, args->rshift);
 
-    const I32 ncol = args->n_cols;
-    I32 red = 0;
-    I32 green = 0;
-    I32 blue = 0;
-    const U16 max_val = args->max_val;
-    const I32 rshift = args->rshift;
-    const U8 max_val_rshift = max_val >> rshift;
-
-    if ((row % 2) == 0) { // red-green row
-        // at left edge, use safe helpers
-        get_rgb8_at_red16(bayer, args, row, 0, &(output_row[0]));
-        get_rgb8_at_green_rg16(bayer, args, row, 1, &(output_row[1]));
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // comments on the right indicate sampling kernels. See Malvar paper.
-
-            // red pixel
-            output_row[col].red = GET_PIX(bayer,ncol,row,col) >> rshift;
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            output_row[col].green = (green >= max_val) ? max_val_rshift :
-                                    (green <= 0) ? 0 :
-                                            (green >> rshift);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            output_row[col].blue = (blue >= max_val) ? max_val_rshift :
-                                    (blue <= 0) ? 0 :
-                                            (blue >> rshift);
-            ++col;
+    const I32 n_cols = args->n_cols;
+    I32 col = 0;
 
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            output_row[col].red = (red >= max_val) ? max_val_rshift :
-                                    (red <= 0) ? 0 :
-                                            (red >> rshift);
-
-            output_row[col].green = GET_PIX(bayer,ncol,row,col) >> rshift;
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            output_row[col].blue = (blue >= max_val) ? max_val_rshift :
-                                    (blue <= 0) ? 0 :
-                                            (blue >> rshift);
-            ++col;
-        }
-        // at right edge, use safe helpers
-        get_rgb8_at_red16(bayer, args, row, ncol-2, &(output_row[ncol-2]));
-        get_rgb8_at_green_rg16(bayer, args, row, ncol-1, &(output_row[ncol-1]));
-    } else { // green-blue row
-        // at left edge, use safe helpers
-        get_rgb8_at_green_gb16(bayer, args, row, 0, &(output_row[0]));
-        get_rgb8_at_blue16(bayer, args, row, 1, &(output_row[1]));
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            output_row[col].red = (red >= max_val) ? max_val_rshift:
-                                    (red <= 0) ? 0 :
-                                            (red >> rshift);
-
-            output_row[col].green = GET_PIX(bayer,ncol,row,col) >> rshift;
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            output_row[col].blue = (blue >= max_val) ? max_val_rshift :
-                                    (blue <= 0) ? 0 :
-                                            (blue >> rshift);
-            ++col;
+    while (col < n_cols) {
+        get_rgb8_at16(bayer, args, row, col, &(output_row[col]));
+        ++col;
+    }
+}
+#endif // DM_REFERENCE
+
+// output stores
+
+// which output a band of a parallel demosaic, a packed image or a
+// streamed image is demosaiced to
+typedef enum {
+    DEMOSAIC_BAND_RGB16,
+    DEMOSAIC_BAND_RGB8,
+    DEMOSAIC_BAND_RGB16TO8,
+    DEMOSAIC_BAND_MONO16,
+    DEMOSAIC_BAND_MONO8,
+    DEMOSAIC_BAND_MONO16TO8
+} demosaic_band_kind;
+
+// bytes of a bayer pixel read by a kind of band
+DEMOSAIC_PRIVATE I32 demosaic_band_bayer_size(const demosaic_band_kind kind)
+{
+    return (kind == DEMOSAIC_BAND_RGB8 || kind == DEMOSAIC_BAND_MONO8)
+            ? (I32) sizeof(U8) : (I32) sizeof(U16);
+}
+
+// bytes of an output pixel of a kind of band
+DEMOSAIC_PRIVATE I32 demosaic_band_output_size(const demosaic_band_kind kind)
+{
+    I32 size = (I32) sizeof(U8);
+    if (kind == DEMOSAIC_BAND_RGB16) {
+        size = (I32) sizeof(demosaic_pix_rgb16);
+    } else if (kind == DEMOSAIC_BAND_RGB8 || kind == DEMOSAIC_BAND_RGB16TO8) {
+        size = (I32) sizeof(demosaic_pix_rgb8);
+    } else if (kind == DEMOSAIC_BAND_MONO16) {
+        size = (I32) sizeof(U16);
+    }
+    return size;
+}
 
-            // blue pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            output_row[col].red = (red >= max_val) ? max_val_rshift :
-                                    (red <= 0) ? 0 :
-                                            (red >> rshift);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            output_row[col].green = (green >= max_val) ? max_val_rshift :
-                                    (green <= 0) ? 0 :
-                                            (green >> rshift);
-
-            output_row[col].blue = GET_PIX(bayer,ncol,row,col) >> rshift;
+// bytes between prefetches of a bayer row
+#define DM_CACHE_LINE 64
 
-            ++col;
+#if defined(__GNUC__)
+#define DM_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#else
+#define DM_PREFETCH(p) ((void) (p))
+#endif
+
+// pixels demosaiced into a chunk on the stack, so in cache, before they are
+// streamed to the output; a whole number of cache lines of every output type
+#define DM_STREAM_CHUNK 256
+
+// bytes per non-temporal store
+#define DM_STREAM_BYTES 16
+
+// copy bytes to dst, bypassing the cache with non-temporal stores where
+// dst is aligned, or with ordinary stores without the intrinsics
+DEMOSAIC_PRIVATE void demosaic_stream_bytes(
+        U8 * const dst,
+        const U8 * const src,
+        const I32 n_bytes)
+{
+#ifdef DM_ENGINE_X86
+    const I32 misaligned = (I32) ((size_t) dst % DM_STREAM_BYTES);
+    const I32 head = (misaligned == 0) ? 0
+            : DM_LIMIT(DM_STREAM_BYTES - misaligned, 0, n_bytes);
+    I32 i = head;
+
+    memcpy(dst, src, (size_t) head);
+    while (i + DM_STREAM_BYTES <= n_bytes) {
+        _mm_stream_si128((__m128i *) &dst[i],
+                _mm_loadu_si128((const __m128i *) &src[i]));
+        i += DM_STREAM_BYTES;
+    }
+    memcpy(&dst[i], &src[i], (size_t) (n_bytes - i));
+#else
+    memcpy(dst, src, (size_t) n_bytes);
+#endif
+}
+
+// order streamed stores before any later store, e.g. a flag handing the
+// output to another thread
+DEMOSAIC_PRIVATE void demosaic_stream_fence(void)
+{
+#ifdef DM_ENGINE_X86
+    _mm_sfence();
+#endif
+}
+
+// demosaic columns [col_begin, col_end) of a row of a kind through its span
+// kernel, from lines16 or lines8 by the kind's bayer size, to output, the
+// pixel of col_begin
+DEMOSAIC_PRIVATE void demosaic_band_span(
+        const demosaic_band_kind kind,
+        const U16 * const lines16[5],
+        const U8 * const lines8[5],
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        const I32 col_begin,
+        const I32 col_end,
+        void * const output)
+{
+    switch (kind) {
+    case DEMOSAIC_BAND_RGB16:
+        demosaic_malvar_span_rgb16(lines16, args, row, col_begin, col_end,
+                (demosaic_pix_rgb16 *) output);
+        break;
+    case DEMOSAIC_BAND_RGB8:
+        demosaic_malvar_span_rgb8(lines8, args, row, col_begin, col_end,
+                (demosaic_pix_rgb8 *) output);
+        break;
+    case DEMOSAIC_BAND_RGB16TO8:
+        demosaic_malvar_span_rgb16to8(lines16, args, row, col_begin, col_end,
+                (demosaic_pix_rgb8 *) output);
+        break;
+    case DEMOSAIC_BAND_MONO16:
+        demosaic_malvar_span_mono16(lines16, args, coefs_normed, row,
+                col_begin, col_end, (U16 *) output);
+        break;
+    case DEMOSAIC_BAND_MONO8:
+        demosaic_malvar_span_mono8(lines8, args, coefs_normed, row,
+                col_begin, col_end, (U8 *) output);
+        break;
+    case DEMOSAIC_BAND_MONO16TO8:
+        demosaic_malvar_span_mono16to8(lines16, args, coefs_normed, row,
+                col_begin, col_end, (U8 *) output);
+        break;
+    default:
+        DEMOSAIC_ASSERT_1(0, kind);
+        break;
+    }
+}
+
+// demosaic columns [col_begin, col_end) of a row of a kind, chunk by chunk,
+// streaming each chunk to output, the pixel of col_begin. Prefetches the
+// same columns of the bayer line the next row reads first.
+DEMOSAIC_PRIVATE void demosaic_streamed_span(
+        const demosaic_band_kind kind,
+        const void * const bayer,
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        const I32 col_begin,
+        const I32 col_end,
+        U8 * const output)
+{
+    const I32 bayer_size = demosaic_band_bayer_size(kind);
+    const I32 output_size = demosaic_band_output_size(kind);
+    const U8 * const next = (row + 3 < args->n_rows)
+            ? &((const U8 *) bayer)[(row + 3) * args->n_cols * bayer_size]
+            : NULL;
+    const U16 * lines16[5];
+    const U8 * lines8[5];
+    demosaic_pix_rgb16 chunk[DM_STREAM_CHUNK];
+    I32 col = col_begin;
+
+    if (bayer_size == (I32) sizeof(U8)) {
+        demosaic_bayer_lines8((const U8 *) bayer, args, row, lines8);
+    } else {
+        demosaic_bayer_lines16((const U16 *) bayer, args, row, lines16);
+    }
+    while (col < col_end) {
+        const I32 end = (col_end - col < DM_STREAM_CHUNK)
+                ? col_end : col + DM_STREAM_CHUNK;
+        if (next != NULL) {
+            for (I32 i = col * bayer_size; i < end * bayer_size;
+                    i += DM_CACHE_LINE) {
+                DM_PREFETCH(&next[i]);
+            }
         }
-        // at right edge, use safe helpers
-        get_rgb8_at_green_gb16(bayer, args, row, ncol-2, &(output_row[ncol-2]));
-        get_rgb8_at_blue16(bayer, args, row, ncol-1, &(output_row[ncol-1]));
+        demosaic_band_span(kind, lines16, lines8, args, coefs_normed, row,
+                col, end, chunk);
+        demosaic_stream_bytes(&output[(col - col_begin) * output_size],
+                (const U8 *) chunk, (end - col) * output_size);
+        col = end;
     }
 }
 
-// demosaic 16 bit bayer to 8 bit rgb
-void demosaic_malvar_rgb16to8(
+// demosaic a row of rgb16 through the span kernel, with arguments already checked
+DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb16_fast(
         const U16 * const bayer,
         const demosaic_args * const args,
-        demosaic_pix_rgb8 * output)
+        const I32 row,
+        demosaic_pix_rgb16 output_row[])
+{
+    const U16 * lines[5];
+
+    demosaic_bayer_lines16(bayer, args, row, lines);
+    demosaic_malvar_span_rgb16(lines, args, row, 0, args->n_cols,
+            output_row);
+}
+
+// Demosaic 16 bit bayer row to 16 bit rgb row
+// All rows use the span kernel. Lines above the top or below the bottom
+// of the image are mirrored, as are columns past the left and right edges,
+// and the image interior is sampled without edge testing.
+// This vastly improves performance.
+void demosaic_malvar_row_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb16 output_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(output_row != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    demosaic_malvar_row_rgb16_fast(bayer, args, row, output_row);
+}
+
+// demosaic 16 bit bayer row to 16 bit rgb row
+void demosaic_malvar_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb16 * output)
 {
     DEMOSAIC_ASSERT(args != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
+    DM_STAGE_BEGIN(DEMOSAIC_STAGE_IMAGE);
+
     for (I32 row = 0; row < args->n_rows; row++) {
-        demosaic_malvar_row_rgb16to8(bayer, args, row,
+        demosaic_malvar_row_rgb16(bayer, args, row,
                 &output[row * args->n_cols]);
     }
+    DM_STAGE_END(DEMOSAIC_STAGE_IMAGE, args->n_rows * args->n_cols);
 }
 
-// demosaic 16 bit bayer to 16 bit mono, without optimizations
-DEMOSAIC_PRIVATE void demosaic_malvar_row_mono16_unoptimized(
-        const U16 * const bayer,
+// demosaic a row of rgb8 through the span kernel, with arguments already checked
+DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb8_fast(
+        const U8 * const bayer,
         const demosaic_args * const args,
         const I32 row,
-        U16 output_row[])
+        demosaic_pix_rgb8 output_row[])
+{
+    const U8 * lines[5];
+
+    demosaic_bayer_lines8(bayer, args, row, lines);
+    demosaic_malvar_span_rgb8(lines, args, row, 0, args->n_cols,
+            output_row);
+}
+
+// demosaic 8 bit bayer to 8 bit rgb
+// All rows use the span kernel. Lines above the top or below the bottom
+// of the image are mirrored, as are columns past the left and right edges,
+// and the image interior is sampled without edge testing.
+// This vastly improves performance.
+void demosaic_malvar_row_rgb8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[])
 {
-    // assert pointers not null
-    DEMOSAIC_ASSERT(bayer != NULL);
     DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
     DEMOSAIC_ASSERT(output_row != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
@@ -1348,742 +2561,3379 @@ DEMOSAIC_PRIVATE void demosaic_malvar_row_mono16_unoptimized(
     // assert row is in image
     DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
 
-    // assert coefficients are in [0,1]
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.red && args->coefs.red <= 1,
-            args->coefs.red);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.green && args->coefs.green <= 1,
-            args->coefs.green);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.blue && args->coefs.blue <= 1,
-            args->coefs.blue);
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    demosaic_malvar_row_rgb8_fast(bayer, args, row, output_row);
+}
+
+// demosaic 8 bit bayer row to 8 bit rgb
+void demosaic_malvar_rgb8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    DM_STAGE_BEGIN(DEMOSAIC_STAGE_IMAGE);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_malvar_row_rgb8(bayer, args, row,
+                &output[row * args->n_cols]);
+    }
+    DM_STAGE_END(DEMOSAIC_STAGE_IMAGE, args->n_rows * args->n_cols);
+}
+
+
+// demosaic a row of rgb16to8 through the span kernel, with arguments already checked
+DEMOSAIC_PRIVATE void demosaic_malvar_row_rgb16to8_fast(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[])
+{
+    const U16 * lines[5];
+
+    demosaic_bayer_lines16(bayer, args, row, lines);
+    demosaic_malvar_span_rgb16to8(lines, args, row, 0, args->n_cols,
+            output_row);
+}
+
+// demosaic 16 bit bayer to 8 bit rgb
+// All rows use the span kernel. Lines above the top or below the bottom
+// of the image are mirrored, as are columns past the left and right edges,
+// and the image interior is sampled without edge testing.
+// This vastly improves performance.
+void demosaic_malvar_row_rgb16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(output_row != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    demosaic_malvar_row_rgb16to8_fast(bayer, args, row, output_row);
+}
+
+// demosaic 16 bit bayer to 8 bit rgb
+void demosaic_malvar_rgb16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    DM_STAGE_BEGIN(DEMOSAIC_STAGE_IMAGE);
+
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_malvar_row_rgb16to8(bayer, args, row,
+                &output[row * args->n_cols]);
+    }
+    DM_STAGE_END(DEMOSAIC_STAGE_IMAGE, args->n_rows * args->n_cols);
+}
+
+#ifdef DM_REFERENCE
+// demosaic 16 bit bayer to 16 bit mono, without optimizations
+DEMOSAIC_PRIVATE void demosaic_malvar_row_mono16_unoptimized(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const I32 ncol = args->n_cols;
+    I32 col = 0;
+    demosaic_pix_rgb16 rgb = {0,0,0};
+
+    while (col < ncol) {
+        get_rgb16_at16(bayer, args, row, col, &rgb);
+        output_row[col] = DM_LUMA(coefs_normed, rgb.red, rgb.green, rgb.blue);
+        ++col;
+    }
+}
+
+// demosaic 8 bit bayer to 8 bit mono, without optimizations
+DEMOSAIC_PRIVATE void demosaic_malvar_row_mono8_unoptimized(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const I32 ncol = args->n_cols;
+    I32 col = 0;
+    demosaic_pix_rgb8 rgb = {0,0,0};
+
+    while (col < ncol) {
+        get_rgb8_at8(bayer, args, row, col, &rgb);
+        output_row[col] = DM_LUMA(coefs_normed, rgb.red, rgb.green, rgb.blue);
+        ++col;
+    }
+}
+
+// demosaic 16 bit bayer to 8 bit mono, without optimizations
+DEMOSAIC_PRIVATE void demosaic_malvar_row_mono16to8_unoptimized(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    const I32 ncol = args->n_cols;
+    I32 col = 0;
+    demosaic_pix_rgb8 rgb = {0,0,0};
+
+    while (col < ncol) {
+        get_rgb8_at16(bayer, args, row, col, &rgb);
+        output_row[col] = DM_LUMA(coefs_normed, rgb.red, rgb.green, rgb.blue);
+        ++col;
+    }
+}
+#endif // DM_REFERENCE
+
+// demosaic a row of mono16 through the span kernel, with arguments already checked
+DEMOSAIC_PRIVATE void demosaic_malvar_row_mono16_fast(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        U16 output_row[])
+{
+    const U16 * lines[5];
+
+    demosaic_bayer_lines16(bayer, args, row, lines);
+    demosaic_malvar_span_mono16(lines, args, coefs_normed, row, 0,
+            args->n_cols, output_row);
+}
+
+// demosaic 16 bit bayer to 16 bit monchromatic
+// All rows use the span kernel. Lines above the top or below the bottom
+// of the image are mirrored, as are columns past the left and right edges,
+// and the image interior is sampled without edge testing.
+// This vastly improves performance.
+void demosaic_malvar_row_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 output_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(output_row != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    demosaic_malvar_row_mono16_fast(bayer, args, &coefs_normed,
+            row, output_row);
+}
+
+// demosaic 16 bit bayer row to 16 bit mono
+void demosaic_malvar_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        U16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    DM_STAGE_BEGIN(DEMOSAIC_STAGE_IMAGE);
+
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_malvar_row_mono16(bayer, args, row,
+                &output[row * args->n_cols]);
+    }
+    DM_STAGE_END(DEMOSAIC_STAGE_IMAGE, args->n_rows * args->n_cols);
+}
+
+// demosaic a row of mono8 through the span kernel, with arguments already checked
+DEMOSAIC_PRIVATE void demosaic_malvar_row_mono8_fast(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        U8 output_row[])
+{
+    const U8 * lines[5];
+
+    demosaic_bayer_lines8(bayer, args, row, lines);
+    demosaic_malvar_span_mono8(lines, args, coefs_normed, row, 0,
+            args->n_cols, output_row);
+}
+
+// demosaic 8 bit bayer to 8 bit monchromatic
+// All rows use the span kernel. Lines above the top or below the bottom
+// of the image are mirrored, as are columns past the left and right edges,
+// and the image interior is sampled without edge testing.
+// This vastly improves performance.
+void demosaic_malvar_row_mono8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 output_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(output_row != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    demosaic_malvar_row_mono8_fast(bayer, args, &coefs_normed,
+            row, output_row);
+}
+
+void demosaic_malvar_mono8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    DM_STAGE_BEGIN(DEMOSAIC_STAGE_IMAGE);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_malvar_row_mono8(bayer, args, row,
+                &output[row * args->n_cols]);
+    }
+    DM_STAGE_END(DEMOSAIC_STAGE_IMAGE, args->n_rows * args->n_cols);
+}
+
+// demosaic a row of mono16to8 through the span kernel, with arguments already checked
+DEMOSAIC_PRIVATE void demosaic_malvar_row_mono16to8_fast(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        U8 output_row[])
+{
+    const U16 * lines[5];
+
+    demosaic_bayer_lines16(bayer, args, row, lines);
+    demosaic_malvar_span_mono16to8(lines, args, coefs_normed, row, 0,
+            args->n_cols, output_row);
+}
+
+// demosaic 16 bit bayer to 8 bit monchromatic
+// All rows use the span kernel. Lines above the top or below the bottom
+// of the image are mirrored, as are columns past the left and right edges,
+// and the image interior is sampled without edge testing.
+// This vastly improves performance.
+void demosaic_malvar_row_mono16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 output_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(output_row != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    demosaic_malvar_row_mono16to8_fast(bayer, args, &coefs_normed,
+            row, output_row);
+}
+
+// demosaic 16 bit bayer row to 8 bit mono
+void demosaic_malvar_mono16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    DM_STAGE_BEGIN(DEMOSAIC_STAGE_IMAGE);
+
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_malvar_row_mono16to8(bayer, args, row,
+                &output[row * args->n_cols]);
+    }
+    DM_STAGE_END(DEMOSAIC_STAGE_IMAGE, args->n_rows * args->n_cols);
+}
+
+// tiles
+
+// assert a region is a non-empty rectangle within the image
+DEMOSAIC_PRIVATE void demosaic_assert_region(
+        const demosaic_args * const args,
+        const demosaic_rect * const region)
+{
+    DEMOSAIC_ASSERT_2(0 <= region->row && region->row < args->n_rows,
+            region->row, args->n_rows);
+    DEMOSAIC_ASSERT_2(0 <= region->col && region->col < args->n_cols,
+            region->col, args->n_cols);
+    DEMOSAIC_ASSERT_2(0 < region->n_rows
+            && region->n_rows <= args->n_rows - region->row,
+            region->n_rows, region->row);
+    DEMOSAIC_ASSERT_2(0 < region->n_cols
+            && region->n_cols <= args->n_cols - region->col,
+            region->n_cols, region->col);
+}
+
+// demosaic a region of a kind one tile at a time, with the kind's
+// arguments already checked
+DEMOSAIC_PRIVATE void demosaic_malvar_tiled(
+        const demosaic_band_kind kind,
+        const void * const bayer,
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        U8 * const output)
+{
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert tiles are not empty
+    DEMOSAIC_ASSERT_1(tile_rows >= 1, tile_rows);
+    DEMOSAIC_ASSERT_1(tile_cols >= 1, tile_cols);
+
+    demosaic_rect whole = {0, 0, args->n_rows, args->n_cols};
+    const demosaic_rect * const rect = (region != NULL) ? region : &whole;
+    demosaic_assert_region(args, rect);
+
+    const I32 output_size = demosaic_band_output_size(kind);
+    const U16 * lines16[5];
+    const U8 * lines8[5];
+
+    // tile ends are clipped to the region without adding past it,
+    // so no tile size overflows
+    I32 row_end;
+    for (I32 tile_row = 0; tile_row < rect->n_rows; tile_row = row_end) {
+        row_end = (tile_rows < rect->n_rows - tile_row)
+                ? tile_row + tile_rows : rect->n_rows;
+        I32 col_end;
+        for (I32 tile_col = 0; tile_col < rect->n_cols; tile_col = col_end) {
+            col_end = (tile_cols < rect->n_cols - tile_col)
+                    ? tile_col + tile_cols : rect->n_cols;
+
+            // the tile's 2 pixel apron is read from the bayer image,
+            // and only mirrored at the image edges
+            for (I32 row = tile_row; row < row_end; row++) {
+                if (demosaic_band_bayer_size(kind) == (I32) sizeof(U8)) {
+                    demosaic_bayer_lines8((const U8 *) bayer, args,
+                            rect->row + row, lines8);
+                } else {
+                    demosaic_bayer_lines16((const U16 *) bayer, args,
+                            rect->row + row, lines16);
+                }
+                demosaic_band_span(kind, lines16, lines8, args, coefs_normed,
+                        rect->row + row, rect->col + tile_col,
+                        rect->col + col_end, &output[(row * rect->n_cols
+                        + tile_col) * output_size]);
+            }
+        }
+    }
+}
+
+void demosaic_malvar_rgb16_tiled(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        demosaic_pix_rgb16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    demosaic_malvar_tiled(DEMOSAIC_BAND_RGB16, bayer, args, NULL, region,
+            tile_rows, tile_cols, (U8 *) output);
+}
+
+void demosaic_malvar_rgb8_tiled(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    demosaic_malvar_tiled(DEMOSAIC_BAND_RGB8, bayer, args, NULL, region,
+            tile_rows, tile_cols, (U8 *) output);
+}
+
+void demosaic_malvar_rgb16to8_tiled(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    demosaic_malvar_tiled(DEMOSAIC_BAND_RGB16TO8, bayer, args, NULL, region,
+            tile_rows, tile_cols, (U8 *) output);
+}
+
+void demosaic_malvar_mono16_tiled(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        U16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    demosaic_malvar_tiled(DEMOSAIC_BAND_MONO16, bayer, args, &coefs_normed,
+            region, tile_rows, tile_cols, (U8 *) output);
+}
+
+void demosaic_malvar_mono8_tiled(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    demosaic_malvar_tiled(DEMOSAIC_BAND_MONO8, bayer, args, &coefs_normed,
+            region, tile_rows, tile_cols, output);
+}
+
+void demosaic_malvar_mono16to8_tiled(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        const I32 tile_rows,
+        const I32 tile_cols,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    demosaic_malvar_tiled(DEMOSAIC_BAND_MONO16TO8, bayer, args,
+            &coefs_normed, region, tile_rows, tile_cols, output);
+}
+
+// regions
+
+void demosaic_malvar_region_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        demosaic_pix_rgb16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(region != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_region(args, region);
+
+    const U16 * lines[5];
+    for (I32 row = 0; row < region->n_rows; row++) {
+        demosaic_bayer_lines16(bayer, args, region->row + row, lines);
+        demosaic_malvar_span_rgb16(lines, args, region->row + row,
+                region->col, region->col + region->n_cols,
+                &output[row * region->n_cols]);
+    }
+}
+
+void demosaic_malvar_region_rgb8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(region != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_region(args, region);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    const U8 * lines[5];
+    for (I32 row = 0; row < region->n_rows; row++) {
+        demosaic_bayer_lines8(bayer, args, region->row + row, lines);
+        demosaic_malvar_span_rgb8(lines, args, region->row + row,
+                region->col, region->col + region->n_cols,
+                &output[row * region->n_cols]);
+    }
+}
+
+void demosaic_malvar_region_rgb16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(region != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_region(args, region);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    const U16 * lines[5];
+    for (I32 row = 0; row < region->n_rows; row++) {
+        demosaic_bayer_lines16(bayer, args, region->row + row, lines);
+        demosaic_malvar_span_rgb16to8(lines, args, region->row + row,
+                region->col, region->col + region->n_cols,
+                &output[row * region->n_cols]);
+    }
+}
+
+void demosaic_malvar_region_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        U16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(region != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_region(args, region);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const U16 * lines[5];
+    for (I32 row = 0; row < region->n_rows; row++) {
+        demosaic_bayer_lines16(bayer, args, region->row + row, lines);
+        demosaic_malvar_span_mono16(lines, args, &coefs_normed,
+                region->row + row, region->col, region->col + region->n_cols,
+                &output[row * region->n_cols]);
+    }
+}
+
+void demosaic_malvar_region_mono8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(region != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_region(args, region);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const U8 * lines[5];
+    for (I32 row = 0; row < region->n_rows; row++) {
+        demosaic_bayer_lines8(bayer, args, region->row + row, lines);
+        demosaic_malvar_span_mono8(lines, args, &coefs_normed,
+                region->row + row, region->col, region->col + region->n_cols,
+                &output[row * region->n_cols]);
+    }
+}
+
+void demosaic_malvar_region_mono16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect * const region,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(region != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_region(args, region);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    const U16 * lines[5];
+    for (I32 row = 0; row < region->n_rows; row++) {
+        demosaic_bayer_lines16(bayer, args, region->row + row, lines);
+        demosaic_malvar_span_mono16to8(lines, args, &coefs_normed,
+                region->row + row, region->col, region->col + region->n_cols,
+                &output[row * region->n_cols]);
+    }
+}
+
+// dirty rectangles
+
+void demosaic_dirty_affected(
+        const demosaic_args * const args,
+        const demosaic_rect * const dirty,
+        demosaic_rect * const affected)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(dirty != NULL);
+    DEMOSAIC_ASSERT(affected != NULL);
+    demosaic_assert_region(args, dirty);
+
+    const I32 row = DM_LIMIT(dirty->row - DEMOSAIC_KERNEL_RADIUS,
+            0, args->n_rows);
+    const I32 col = DM_LIMIT(dirty->col - DEMOSAIC_KERNEL_RADIUS,
+            0, args->n_cols);
+    const I32 row_end = DM_LIMIT(dirty->row + dirty->n_rows
+            + DEMOSAIC_KERNEL_RADIUS, 0, args->n_rows);
+    const I32 col_end = DM_LIMIT(dirty->col + dirty->n_cols
+            + DEMOSAIC_KERNEL_RADIUS, 0, args->n_cols);
+    affected->row = row;
+    affected->col = col;
+    affected->n_rows = row_end - row;
+    affected->n_cols = col_end - col;
+}
+
+// assert a list of dirty rectangles is within the image
+DEMOSAIC_PRIVATE void demosaic_assert_dirty(
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty)
+{
+    DEMOSAIC_ASSERT(dirty != NULL);
+    DEMOSAIC_ASSERT_1(n_dirty >= 0, n_dirty);
+    for (I32 i = 0; i < n_dirty; i++) {
+        demosaic_assert_region(args, &dirty[i]);
+    }
+}
+
+void demosaic_malvar_rgb16_dirty(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        demosaic_pix_rgb16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_dirty(args, dirty, n_dirty);
+
+    const U16 * lines[5];
+    for (I32 i = 0; i < n_dirty; i++) {
+        demosaic_rect rect;
+        demosaic_dirty_affected(args, &dirty[i], &rect);
+        for (I32 row = rect.row; row < rect.row + rect.n_rows; row++) {
+            demosaic_bayer_lines16(bayer, args, row, lines);
+            demosaic_malvar_span_rgb16(lines, args, row,
+                    rect.col, rect.col + rect.n_cols,
+                    &output[row * args->n_cols + rect.col]);
+        }
+    }
+}
+
+void demosaic_malvar_rgb8_dirty(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_dirty(args, dirty, n_dirty);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    const U8 * lines[5];
+    for (I32 i = 0; i < n_dirty; i++) {
+        demosaic_rect rect;
+        demosaic_dirty_affected(args, &dirty[i], &rect);
+        for (I32 row = rect.row; row < rect.row + rect.n_rows; row++) {
+            demosaic_bayer_lines8(bayer, args, row, lines);
+            demosaic_malvar_span_rgb8(lines, args, row,
+                    rect.col, rect.col + rect.n_cols,
+                    &output[row * args->n_cols + rect.col]);
+        }
+    }
+}
+
+void demosaic_malvar_rgb16to8_dirty(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_dirty(args, dirty, n_dirty);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    const U16 * lines[5];
+    for (I32 i = 0; i < n_dirty; i++) {
+        demosaic_rect rect;
+        demosaic_dirty_affected(args, &dirty[i], &rect);
+        for (I32 row = rect.row; row < rect.row + rect.n_rows; row++) {
+            demosaic_bayer_lines16(bayer, args, row, lines);
+            demosaic_malvar_span_rgb16to8(lines, args, row,
+                    rect.col, rect.col + rect.n_cols,
+                    &output[row * args->n_cols + rect.col]);
+        }
+    }
+}
+
+void demosaic_malvar_mono16_dirty(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        U16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_dirty(args, dirty, n_dirty);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const U16 * lines[5];
+    for (I32 i = 0; i < n_dirty; i++) {
+        demosaic_rect rect;
+        demosaic_dirty_affected(args, &dirty[i], &rect);
+        for (I32 row = rect.row; row < rect.row + rect.n_rows; row++) {
+            demosaic_bayer_lines16(bayer, args, row, lines);
+            demosaic_malvar_span_mono16(lines, args, &coefs_normed, row,
+                    rect.col, rect.col + rect.n_cols,
+                    &output[row * args->n_cols + rect.col]);
+        }
+    }
+}
+
+void demosaic_malvar_mono8_dirty(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_dirty(args, dirty, n_dirty);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const U8 * lines[5];
+    for (I32 i = 0; i < n_dirty; i++) {
+        demosaic_rect rect;
+        demosaic_dirty_affected(args, &dirty[i], &rect);
+        for (I32 row = rect.row; row < rect.row + rect.n_rows; row++) {
+            demosaic_bayer_lines8(bayer, args, row, lines);
+            demosaic_malvar_span_mono8(lines, args, &coefs_normed, row,
+                    rect.col, rect.col + rect.n_cols,
+                    &output[row * args->n_cols + rect.col]);
+        }
+    }
+}
+
+void demosaic_malvar_mono16to8_dirty(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_rect dirty[],
+        const I32 n_dirty,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_dirty(args, dirty, n_dirty);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const U16 * lines[5];
+    for (I32 i = 0; i < n_dirty; i++) {
+        demosaic_rect rect;
+        demosaic_dirty_affected(args, &dirty[i], &rect);
+        for (I32 row = rect.row; row < rect.row + rect.n_rows; row++) {
+            demosaic_bayer_lines16(bayer, args, row, lines);
+            demosaic_malvar_span_mono16to8(lines, args, &coefs_normed, row,
+                    rect.col, rect.col + rect.n_cols,
+                    &output[row * args->n_cols + rect.col]);
+        }
+    }
+}
+
+// pitched
+
+// assert pitches fit a row of the image, and keep rows aligned
+DEMOSAIC_PRIVATE void demosaic_assert_pitch(
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        const I32 input_size,
+        const I32 output_size,
+        const I32 output_align)
+{
+    DEMOSAIC_ASSERT(pitch != NULL);
+    DEMOSAIC_ASSERT_2(pitch->input >= args->n_cols * input_size,
+            pitch->input, args->n_cols);
+    DEMOSAIC_ASSERT_1((pitch->input % input_size) == 0, pitch->input);
+    DEMOSAIC_ASSERT_2(pitch->output >= args->n_cols * output_size,
+            pitch->output, args->n_cols);
+    DEMOSAIC_ASSERT_1((pitch->output % output_align) == 0, pitch->output);
+}
+
+void demosaic_malvar_rgb16_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        demosaic_pix_rgb16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_pitch(args, pitch, sizeof(U16), sizeof(demosaic_pix_rgb16),
+            sizeof(U16));
+
+    U8 * const base = (U8 *) output;
+    const U16 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_bayer_lines16_pitched(bayer, args, pitch->input, row,
+                lines);
+        demosaic_malvar_span_rgb16(lines, args, row, 0,
+                args->n_cols, (demosaic_pix_rgb16 *) &base[row * pitch->output]);
+    }
+}
+
+void demosaic_malvar_rgb8_pitched(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_pitch(args, pitch, sizeof(U8), sizeof(demosaic_pix_rgb8),
+            sizeof(U8));
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    U8 * const base = (U8 *) output;
+    const U8 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_bayer_lines8_pitched(bayer, args, pitch->input, row,
+                lines);
+        demosaic_malvar_span_rgb8(lines, args, row, 0,
+                args->n_cols, (demosaic_pix_rgb8 *) &base[row * pitch->output]);
+    }
+}
+
+void demosaic_malvar_rgb16to8_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_pitch(args, pitch, sizeof(U16), sizeof(demosaic_pix_rgb8),
+            sizeof(U8));
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    U8 * const base = (U8 *) output;
+    const U16 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_bayer_lines16_pitched(bayer, args, pitch->input, row,
+                lines);
+        demosaic_malvar_span_rgb16to8(lines, args, row, 0,
+                args->n_cols, (demosaic_pix_rgb8 *) &base[row * pitch->output]);
+    }
+}
+
+void demosaic_malvar_mono16_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        U16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_pitch(args, pitch, sizeof(U16), sizeof(U16),
+            sizeof(U16));
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    U8 * const base = (U8 *) output;
+    const U16 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_bayer_lines16_pitched(bayer, args, pitch->input, row,
+                lines);
+        demosaic_malvar_span_mono16(lines, args, &coefs_normed, row, 0,
+                args->n_cols, (U16 *) &base[row * pitch->output]);
+    }
+}
+
+void demosaic_malvar_mono8_pitched(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_pitch(args, pitch, sizeof(U8), sizeof(U8),
+            sizeof(U8));
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    U8 * const base = (U8 *) output;
+    const U8 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_bayer_lines8_pitched(bayer, args, pitch->input, row,
+                lines);
+        demosaic_malvar_span_mono8(lines, args, &coefs_normed, row, 0,
+                args->n_cols, (U8 *) &base[row * pitch->output]);
+    }
+}
+
+void demosaic_malvar_mono16to8_pitched(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_pitch * const pitch,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_pitch(args, pitch, sizeof(U16), sizeof(U8),
+            sizeof(U8));
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    U8 * const base = (U8 *) output;
+    const U16 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_bayer_lines16_pitched(bayer, args, pitch->input, row,
+                lines);
+        demosaic_malvar_span_mono16to8(lines, args, &coefs_normed, row, 0,
+                args->n_cols, (U8 *) &base[row * pitch->output]);
+    }
+}
+
+// planar
+
+void demosaic_malvar_row_rgb16_planar(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 red_row[],
+        U16 green_row[],
+        U16 blue_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(red_row != NULL);
+    DEMOSAIC_ASSERT(green_row != NULL);
+    DEMOSAIC_ASSERT(blue_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    const U16 * lines[5];
+    demosaic_bayer_lines16(bayer, args, row, lines);
+    demosaic_malvar_span_planar16(lines, args, row, 0, args->n_cols,
+            red_row, green_row, blue_row);
+}
+
+void demosaic_malvar_rgb16_planar(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_planes16 * const planes)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(planes != NULL);
+    DEMOSAIC_ASSERT(planes->red != NULL);
+    DEMOSAIC_ASSERT(planes->green != NULL);
+    DEMOSAIC_ASSERT(planes->blue != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert plane rows do not overlap
+    DEMOSAIC_ASSERT_2(planes->stride >= args->n_cols,
+            planes->stride, args->n_cols);
+
+    const U16 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        const I32 offset = row * planes->stride;
+        demosaic_bayer_lines16(bayer, args, row, lines);
+        demosaic_malvar_span_planar16(lines, args, row, 0, args->n_cols,
+                &planes->red[offset], &planes->green[offset],
+                &planes->blue[offset]);
+    }
+}
+
+void demosaic_malvar_row_rgb8_planar(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 red_row[],
+        U8 green_row[],
+        U8 blue_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(red_row != NULL);
+    DEMOSAIC_ASSERT(green_row != NULL);
+    DEMOSAIC_ASSERT(blue_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    const U8 * lines[5];
+    demosaic_bayer_lines8(bayer, args, row, lines);
+    demosaic_malvar_span_planar8(lines, args, row, 0, args->n_cols,
+            red_row, green_row, blue_row);
+}
+
+void demosaic_malvar_rgb8_planar(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_planes8 * const planes)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(planes != NULL);
+    DEMOSAIC_ASSERT(planes->red != NULL);
+    DEMOSAIC_ASSERT(planes->green != NULL);
+    DEMOSAIC_ASSERT(planes->blue != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert plane rows do not overlap
+    DEMOSAIC_ASSERT_2(planes->stride >= args->n_cols,
+            planes->stride, args->n_cols);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    const U8 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        const I32 offset = row * planes->stride;
+        demosaic_bayer_lines8(bayer, args, row, lines);
+        demosaic_malvar_span_planar8(lines, args, row, 0, args->n_cols,
+                &planes->red[offset], &planes->green[offset],
+                &planes->blue[offset]);
+    }
+}
+
+void demosaic_malvar_row_rgb16to8_planar(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U8 red_row[],
+        U8 green_row[],
+        U8 blue_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(red_row != NULL);
+    DEMOSAIC_ASSERT(green_row != NULL);
+    DEMOSAIC_ASSERT(blue_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    const U16 * lines[5];
+    demosaic_bayer_lines16(bayer, args, row, lines);
+    demosaic_malvar_span_planar16to8(lines, args, row, 0, args->n_cols,
+            red_row, green_row, blue_row);
+}
+
+void demosaic_malvar_rgb16to8_planar(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_planes8 * const planes)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(planes != NULL);
+    DEMOSAIC_ASSERT(planes->red != NULL);
+    DEMOSAIC_ASSERT(planes->green != NULL);
+    DEMOSAIC_ASSERT(planes->blue != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert plane rows do not overlap
+    DEMOSAIC_ASSERT_2(planes->stride >= args->n_cols,
+            planes->stride, args->n_cols);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    const U16 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        const I32 offset = row * planes->stride;
+        demosaic_bayer_lines16(bayer, args, row, lines);
+        demosaic_malvar_span_planar16to8(lines, args, row, 0, args->n_cols,
+                &planes->red[offset], &planes->green[offset],
+                &planes->blue[offset]);
+    }
+}
+
+// yuv
+
+// pixels per chunk of rgb demosaiced for yuv outputs
+#define DM_YUV_CHUNK 64
+
+// fixed-point weights of red, green and blue, scaled by 1 << DM_LUMA_BITS,
+// of full range chroma without the offset of 128: cb is
+// (blue - luma) / (2 * (1 - blue coef)) and cr is
+// (red - luma) / (2 * (1 - red coef)), as JPEG
+typedef struct {
+    I32 cb[3];
+    I32 cr[3];
+} demosaic_chroma_weights;
+
+// round to the nearest integer, halves away from zero
+#define DM_ROUND_F64(x) \
+    (((x) >= 0) ? (I32) ((x) + 0.5) : -(I32) (0.5 - (x)))
+
+// chroma weights from normalized luma coefficients, which sum below 1,
+// so neither denominator is zero
+DEMOSAIC_PRIVATE void demosaic_chroma_weights_init(
+        const demosaic_luma_coefs * const coefs_normed,
+        demosaic_chroma_weights * const weights)
+{
+    const F64 one = (F64) (1 << DM_LUMA_BITS);
+    const F64 cb_scale = one * 0.5 / (1.0 - coefs_normed->blue);
+    const F64 cr_scale = one * 0.5 / (1.0 - coefs_normed->red);
+    weights->cb[0] = DM_ROUND_F64(-coefs_normed->red * cb_scale);
+    weights->cb[1] = DM_ROUND_F64(-coefs_normed->green * cb_scale);
+    weights->cb[2] = DM_ROUND_F64((1.0 - coefs_normed->blue) * cb_scale);
+    weights->cr[0] = DM_ROUND_F64((1.0 - coefs_normed->red) * cr_scale);
+    weights->cr[1] = DM_ROUND_F64(-coefs_normed->green * cr_scale);
+    weights->cr[2] = DM_ROUND_F64(-coefs_normed->blue * cr_scale);
+}
+
+// chroma of the sum of 1 << log2_n pixels, offset by 128 and rounded.
+// Weights of each chroma sum to at most 0.5 in magnitude, so the
+// biased sum is negative or over U8_MAX only by rounding of weights.
+#define DM_CHROMA(w, r, g, b, log2_n) \
+    (DM_LIMIT((w)[0] * (r) + (w)[1] * (g) + (w)[2] * (b) \
+              + (128 << (DM_LUMA_BITS + (log2_n))) \
+              + (1 << (DM_LUMA_BITS + (log2_n) - 1)), \
+              0, U8_MAX << (DM_LUMA_BITS + (log2_n))) \
+     >> (DM_LUMA_BITS + (log2_n)))
+
+// write luma of n pixels of top, and of bottom unless NULL, and chroma
+// of each 2x1 block of top, or 2x2 block of top and bottom. n is even.
+DEMOSAIC_PRIVATE void demosaic_yuv_chunk(
+        const demosaic_pix_rgb8 * const top,
+        const demosaic_pix_rgb8 * const bottom,
+        const I32 n,
+        const demosaic_luma_weights * const coefs_normed,
+        const demosaic_chroma_weights * const chroma,
+        U8 * const y_top,
+        U8 * const y_bottom,
+        U8 * const cb,
+        U8 * const cr)
+{
+    for (I32 i = 0; i < n; i += 2) {
+        I32 red = top[i].red + top[i + 1].red;
+        I32 green = top[i].green + top[i + 1].green;
+        I32 blue = top[i].blue + top[i + 1].blue;
+        y_top[i] = DM_LUMA(*coefs_normed,
+                top[i].red, top[i].green, top[i].blue);
+        y_top[i + 1] = DM_LUMA(*coefs_normed,
+                top[i + 1].red, top[i + 1].green, top[i + 1].blue);
+        if (bottom == NULL) {
+            cb[i >> 1] = DM_CHROMA(chroma->cb, red, green, blue, 1);
+            cr[i >> 1] = DM_CHROMA(chroma->cr, red, green, blue, 1);
+            continue;
+        }
+        red += bottom[i].red + bottom[i + 1].red;
+        green += bottom[i].green + bottom[i + 1].green;
+        blue += bottom[i].blue + bottom[i + 1].blue;
+        y_bottom[i] = DM_LUMA(*coefs_normed,
+                bottom[i].red, bottom[i].green, bottom[i].blue);
+        y_bottom[i + 1] = DM_LUMA(*coefs_normed,
+                bottom[i + 1].red, bottom[i + 1].green, bottom[i + 1].blue);
+        cb[i >> 1] = DM_CHROMA(chroma->cb, red, green, blue, 2);
+        cr[i >> 1] = DM_CHROMA(chroma->cr, red, green, blue, 2);
+    }
+}
+
+// assert yuv planes and format are valid for args
+DEMOSAIC_PRIVATE void demosaic_assert_yuv_planes(
+        const demosaic_args * const args,
+        const demosaic_yuv_format format,
+        const demosaic_planes_yuv8 * const planes)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(planes != NULL);
+    DEMOSAIC_ASSERT(planes->y != NULL);
+    DEMOSAIC_ASSERT(planes->cb != NULL);
+    DEMOSAIC_ASSERT(planes->cr != NULL);
+
+    // assert known chroma subsampling
+    DEMOSAIC_ASSERT_1(format == DEMOSAIC_YUV420 || format == DEMOSAIC_YUV422,
+            format);
+
+    // assert plane rows do not overlap
+    DEMOSAIC_ASSERT_2(planes->y_stride >= args->n_cols,
+            planes->y_stride, args->n_cols);
+    DEMOSAIC_ASSERT_2(planes->chroma_stride >= args->n_cols / 2,
+            planes->chroma_stride, args->n_cols);
+}
+
+void demosaic_malvar_yuv8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_yuv_format format,
+        const demosaic_planes_yuv8 * const planes)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    demosaic_assert_yuv_planes(args, format, planes);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    demosaic_luma_coefs coefs_f64;
+    demosaic_normalize_coefs_f64(args, &coefs_f64);
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+    demosaic_chroma_weights chroma;
+    demosaic_chroma_weights_init(&coefs_f64, &chroma);
+
+    const I32 rows_per_chroma = (format == DEMOSAIC_YUV420) ? 2 : 1;
+    const U8 * top_lines[5];
+    const U8 * bottom_lines[5];
+    demosaic_pix_rgb8 top[DM_YUV_CHUNK];
+    demosaic_pix_rgb8 bottom[DM_YUV_CHUNK];
+    for (I32 row = 0; row < args->n_rows; row += rows_per_chroma) {
+        const I32 y_offset = row * planes->y_stride;
+        const I32 chroma_offset =
+                (row / rows_per_chroma) * planes->chroma_stride;
+        demosaic_bayer_lines8(bayer, args, row, top_lines);
+        if (rows_per_chroma == 2) {
+            demosaic_bayer_lines8(bayer, args, row + 1, bottom_lines);
+        }
+        for (I32 col = 0; col < args->n_cols; col += DM_YUV_CHUNK) {
+            const I32 end = (args->n_cols - col < DM_YUV_CHUNK)
+                    ? args->n_cols : col + DM_YUV_CHUNK;
+            demosaic_malvar_span_rgb8(top_lines, args, row, col, end, top);
+            if (rows_per_chroma == 2) {
+                demosaic_malvar_span_rgb8(bottom_lines, args, row + 1,
+                        col, end, bottom);
+            }
+            demosaic_yuv_chunk(top, (rows_per_chroma == 2) ? bottom : NULL,
+                    end - col, &coefs_normed, &chroma,
+                    &planes->y[y_offset + col], (rows_per_chroma == 2)
+                    ? &planes->y[y_offset + planes->y_stride + col] : NULL,
+                    &planes->cb[chroma_offset + col / 2],
+                    &planes->cr[chroma_offset + col / 2]);
+        }
+    }
+}
+
+void demosaic_malvar_yuv16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_yuv_format format,
+        const demosaic_planes_yuv8 * const planes)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    demosaic_assert_yuv_planes(args, format, planes);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    demosaic_luma_coefs coefs_f64;
+    demosaic_normalize_coefs_f64(args, &coefs_f64);
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+    demosaic_chroma_weights chroma;
+    demosaic_chroma_weights_init(&coefs_f64, &chroma);
+
+    const I32 rows_per_chroma = (format == DEMOSAIC_YUV420) ? 2 : 1;
+    const U16 * top_lines[5];
+    const U16 * bottom_lines[5];
+    demosaic_pix_rgb8 top[DM_YUV_CHUNK];
+    demosaic_pix_rgb8 bottom[DM_YUV_CHUNK];
+    for (I32 row = 0; row < args->n_rows; row += rows_per_chroma) {
+        const I32 y_offset = row * planes->y_stride;
+        const I32 chroma_offset =
+                (row / rows_per_chroma) * planes->chroma_stride;
+        demosaic_bayer_lines16(bayer, args, row, top_lines);
+        if (rows_per_chroma == 2) {
+            demosaic_bayer_lines16(bayer, args, row + 1, bottom_lines);
+        }
+        for (I32 col = 0; col < args->n_cols; col += DM_YUV_CHUNK) {
+            const I32 end = (args->n_cols - col < DM_YUV_CHUNK)
+                    ? args->n_cols : col + DM_YUV_CHUNK;
+            demosaic_malvar_span_rgb16to8(top_lines, args, row, col, end,
+                    top);
+            if (rows_per_chroma == 2) {
+                demosaic_malvar_span_rgb16to8(bottom_lines, args, row + 1,
+                        col, end, bottom);
+            }
+            demosaic_yuv_chunk(top, (rows_per_chroma == 2) ? bottom : NULL,
+                    end - col, &coefs_normed, &chroma,
+                    &planes->y[y_offset + col], (rows_per_chroma == 2)
+                    ? &planes->y[y_offset + planes->y_stride + col] : NULL,
+                    &planes->cb[chroma_offset + col / 2],
+                    &planes->cr[chroma_offset + col / 2]);
+        }
+    }
+}
+
+// arguments
+
+void demosaic_args_init(
+        demosaic_args * const args,
+        const I32 n_rows,
+        const I32 n_cols,
+        const U16 max_val)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    memset(args, 0, sizeof(*args));
+    args->n_rows = n_rows;
+    args->n_cols = n_cols;
+    args->max_val = max_val;
+
+    // the smallest shift to 8 bits
+    while ((max_val >> args->rshift) > U8_MAX) {
+        args->rshift++;
+    }
+
+    // ccir 601 formula
+    args->coefs.red = 0.299;
+    args->coefs.green = 0.587;
+    args->coefs.blue = 0.114;
+
+    args->pattern = DEMOSAIC_RGGB;
+    args->calibration = NULL;
+    args->ccm = NULL;
+    args->lut = NULL;
+}
+
+// plans
+
+void demosaic_plan_init(
+        demosaic_plan * const plan,
+        const demosaic_args * const args)
+{
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    plan->args = *args;
+
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_normalize_coefs_f64(args, &plan->coefs_normed);
+    demosaic_luma_to_fixed(&plan->coefs_normed, &plan->luma_fixed);
+
+    plan->max_val_shifted = (args->rshift < 16) ?
+            (args->max_val >> args->rshift) : 0;
+
+    plan->store = DEMOSAIC_STORE_CACHED;
+}
+
+// the luma weights of a plan used by the mono functions
+#ifdef DM_FIXED_LUMA
+#define DM_PLAN_WEIGHTS(plan) (&(plan)->luma_fixed)
+#else
+#define DM_PLAN_WEIGHTS(plan) (&(plan)->coefs_normed)
+#endif
+
+// bayer rows of the next frame a serial batch prefetches, one per row of
+// the current frame, as it demosaics the last rows of the current frame.
+// The first rows of a frame read bayer rows 0 to 3, mirrored.
+#define DM_BATCH_PREFETCH_ROWS 4
+
+// demosaic rows [row_start, row_end) of a frame with a plan, without checks,
+// storing output as plan->store asks. If next is not NULL, prefetch the
+// first bayer rows of the next frame while demosaicing the last rows of
+// this one.
+DEMOSAIC_PRIVATE void demosaic_plan_rows(
+        const demosaic_band_kind kind,
+        const void * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row_start,
+        const I32 row_end,
+        void * const output,
+        const void * const next)
+{
+    const I32 n_rows = plan->args.n_rows;
+    const I32 n_cols = plan->args.n_cols;
+    const I32 row_bytes = n_cols * demosaic_band_bayer_size(kind);
+    const I32 output_bytes = n_cols * demosaic_band_output_size(kind);
+    const I32 n_prefetch = (n_rows < DM_BATCH_PREFETCH_ROWS)
+            ? n_rows : DM_BATCH_PREFETCH_ROWS;
+
+    // assert a supported store
+    DEMOSAIC_ASSERT_1((plan->store == DEMOSAIC_STORE_CACHED)
+            || (plan->store == DEMOSAIC_STORE_STREAMING), plan->store);
+
+    for (I32 row = row_start; row < row_end; row++) {
+        const I32 prefetch_row = row - (n_rows - n_prefetch);
+        if (next != NULL && prefetch_row >= 0) {
+            const U8 * const line =
+                    &((const U8 *) next)[prefetch_row * row_bytes];
+            for (I32 i = 0; i < row_bytes; i += DM_CACHE_LINE) {
+                DM_PREFETCH(&line[i]);
+            }
+        }
+        U8 * const output_row = &((U8 *) output)[row * output_bytes];
+        if (plan->store == DEMOSAIC_STORE_STREAMING) {
+            demosaic_streamed_span(kind, bayer, &plan->args,
+                    DM_PLAN_WEIGHTS(plan), row, 0, n_cols, output_row);
+            continue;
+        }
+        switch (kind) {
+        case DEMOSAIC_BAND_RGB16:
+            demosaic_malvar_row_rgb16_fast((const U16 *) bayer, &plan->args,
+                    row, (demosaic_pix_rgb16 *) output_row);
+            break;
+        case DEMOSAIC_BAND_RGB8:
+            demosaic_malvar_row_rgb8_fast((const U8 *) bayer, &plan->args,
+                    row, (demosaic_pix_rgb8 *) output_row);
+            break;
+        case DEMOSAIC_BAND_RGB16TO8:
+            demosaic_malvar_row_rgb16to8_fast((const U16 *) bayer,
+                    &plan->args, row, (demosaic_pix_rgb8 *) output_row);
+            break;
+        case DEMOSAIC_BAND_MONO16:
+            demosaic_malvar_row_mono16_fast((const U16 *) bayer, &plan->args,
+                    DM_PLAN_WEIGHTS(plan), row, (U16 *) output_row);
+            break;
+        case DEMOSAIC_BAND_MONO8:
+            demosaic_malvar_row_mono8_fast((const U8 *) bayer, &plan->args,
+                    DM_PLAN_WEIGHTS(plan), row, output_row);
+            break;
+        case DEMOSAIC_BAND_MONO16TO8:
+            demosaic_malvar_row_mono16to8_fast((const U16 *) bayer,
+                    &plan->args, DM_PLAN_WEIGHTS(plan), row, output_row);
+            break;
+        default:
+            DEMOSAIC_ASSERT_1(0, kind);
+            break;
+        }
+    }
+    if (plan->store == DEMOSAIC_STORE_STREAMING) {
+        demosaic_stream_fence();
+    }
+}
+
+// demosaic a row to 16-bit rgb with a plan, without checks
+DEMOSAIC_PRIVATE void demosaic_plan_row_rgb16(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb16 output_row[])
+{
+    demosaic_malvar_row_rgb16_fast(bayer, &plan->args, row,
+            output_row);
+}
+
+void demosaic_malvar_row_rgb16_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb16 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < plan->args.n_rows,
+            row, plan->args.n_rows);
+
+    demosaic_plan_row_rgb16(bayer, plan, row, output_row);
+}
+
+void demosaic_malvar_rgb16_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        demosaic_pix_rgb16 * output)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    demosaic_plan_rows(DEMOSAIC_BAND_RGB16, bayer, plan,
+            0, plan->args.n_rows, output, NULL);
+}
+
+// demosaic a row to 8-bit rgb with a plan, without checks
+DEMOSAIC_PRIVATE void demosaic_plan_row_rgb8(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[])
+{
+    demosaic_malvar_row_rgb8_fast(bayer, &plan->args, row,
+            output_row);
+}
+
+void demosaic_malvar_row_rgb8_plan(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < plan->args.n_rows,
+            row, plan->args.n_rows);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(plan->args.max_val <= U8_MAX, plan->args.max_val);
+
+    demosaic_plan_row_rgb8(bayer, plan, row, output_row);
+}
+
+void demosaic_malvar_rgb8_plan(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        demosaic_pix_rgb8 * output)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(plan->args.max_val <= U8_MAX, plan->args.max_val);
+
+    demosaic_plan_rows(DEMOSAIC_BAND_RGB8, bayer, plan,
+            0, plan->args.n_rows, output, NULL);
+}
+
+// demosaic a row to 8-bit rgb with a plan, without checks
+DEMOSAIC_PRIVATE void demosaic_plan_row_rgb16to8(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[])
+{
+    demosaic_malvar_row_rgb16to8_fast(bayer, &plan->args, row,
+            output_row);
+}
+
+void demosaic_malvar_row_rgb16to8_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        demosaic_pix_rgb8 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < plan->args.n_rows,
+            row, plan->args.n_rows);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(plan->args.lut != NULL
+            || plan->max_val_shifted <= U8_MAX,
+            plan->args.max_val, plan->args.rshift);
+
+    demosaic_plan_row_rgb16to8(bayer, plan, row, output_row);
+}
+
+void demosaic_malvar_rgb16to8_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        demosaic_pix_rgb8 * output)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(plan->args.lut != NULL
+            || plan->max_val_shifted <= U8_MAX,
+            plan->args.max_val, plan->args.rshift);
+
+    demosaic_plan_rows(DEMOSAIC_BAND_RGB16TO8, bayer, plan,
+            0, plan->args.n_rows, output, NULL);
+}
+
+// demosaic a row to 16-bit mono with a plan, without checks
+DEMOSAIC_PRIVATE void demosaic_plan_row_mono16(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U16 output_row[])
+{
+    demosaic_malvar_row_mono16_fast(bayer, &plan->args,
+            DM_PLAN_WEIGHTS(plan), row, output_row);
+}
+
+void demosaic_malvar_row_mono16_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U16 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < plan->args.n_rows,
+            row, plan->args.n_rows);
+
+    demosaic_plan_row_mono16(bayer, plan, row, output_row);
+}
+
+void demosaic_malvar_mono16_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        U16 * output)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    demosaic_plan_rows(DEMOSAIC_BAND_MONO16, bayer, plan,
+            0, plan->args.n_rows, output, NULL);
+}
+
+// demosaic a row to 8-bit mono with a plan, without checks
+DEMOSAIC_PRIVATE void demosaic_plan_row_mono8(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U8 output_row[])
+{
+    demosaic_malvar_row_mono8_fast(bayer, &plan->args,
+            DM_PLAN_WEIGHTS(plan), row, output_row);
+}
+
+void demosaic_malvar_row_mono8_plan(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U8 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < plan->args.n_rows,
+            row, plan->args.n_rows);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(plan->args.max_val <= U8_MAX, plan->args.max_val);
+
+    demosaic_plan_row_mono8(bayer, plan, row, output_row);
+}
+
+void demosaic_malvar_mono8_plan(
+        const U8 * const bayer,
+        const demosaic_plan * const plan,
+        U8 * output)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(plan->args.max_val <= U8_MAX, plan->args.max_val);
+
+    demosaic_plan_rows(DEMOSAIC_BAND_MONO8, bayer, plan,
+            0, plan->args.n_rows, output, NULL);
+}
+
+// demosaic a row to 8-bit mono with a plan, without checks
+DEMOSAIC_PRIVATE void demosaic_plan_row_mono16to8(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U8 output_row[])
+{
+    demosaic_malvar_row_mono16to8_fast(bayer, &plan->args,
+            DM_PLAN_WEIGHTS(plan), row, output_row);
+}
+
+void demosaic_malvar_row_mono16to8_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        const I32 row,
+        U8 output_row[])
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < plan->args.n_rows,
+            row, plan->args.n_rows);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(plan->args.lut != NULL
+            || plan->max_val_shifted <= U8_MAX,
+            plan->args.max_val, plan->args.rshift);
+
+    demosaic_plan_row_mono16to8(bayer, plan, row, output_row);
+}
+
+void demosaic_malvar_mono16to8_plan(
+        const U16 * const bayer,
+        const demosaic_plan * const plan,
+        U8 * output)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(plan->args.lut != NULL
+            || plan->max_val_shifted <= U8_MAX,
+            plan->args.max_val, plan->args.rshift);
+
+    demosaic_plan_rows(DEMOSAIC_BAND_MONO16TO8, bayer, plan,
+            0, plan->args.n_rows, output, NULL);
+}
+
+// fused rgb and mono
+
+void demosaic_malvar_row_rgb16_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb16 output_rgb_row[],
+        U16 output_mono_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_rgb_row != NULL);
+    DEMOSAIC_ASSERT(output_mono_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const U16 * lines[5];
+    demosaic_bayer_lines16(bayer, args, row, lines);
+    demosaic_malvar_lines_rgb16_mono16(lines, args, &coefs_normed, row,
+            output_rgb_row, output_mono_row);
+}
+
+void demosaic_malvar_rgb16_mono16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb16 * output_rgb,
+        U16 * output_mono)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_rgb != NULL);
+    DEMOSAIC_ASSERT(output_mono != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // normalize once for the whole image
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const U16 * lines[5];
+    for (I32 row = 0; row < args->n_rows; row++) {
+        demosaic_bayer_lines16(bayer, args, row, lines);
+        demosaic_malvar_lines_rgb16_mono16(lines, args, &coefs_normed, row,
+                &output_rgb[row * args->n_cols],
+                &output_mono[row * args->n_cols]);
+    }
+}
+
+// rows [row_start, row_end) of band index of n_bands of n_rows rows
+DEMOSAIC_PRIVATE void demosaic_band_rows(
+        const I32 n_rows,
+        const I32 n_bands,
+        const I32 index,
+        I32 * const row_start,
+        I32 * const row_end)
+{
+    // rows per band, rounded up, so the last bands may be short or empty
+    const I32 band_rows = (n_rows + n_bands - 1) / n_bands;
+    *row_start = index * band_rows;
+    *row_end = (*row_start + band_rows < n_rows) ?
+               (*row_start + band_rows) : n_rows;
+}
+
+// batches
+
+// context shared by all jobs of a parallel batch, one per band of a frame.
+// jobs only read it, so it may live on the caller's stack.
+typedef struct {
+    demosaic_band_kind kind;
+    const void * const * bayer;
+    const demosaic_plan * plan;
+    void * const * output;
+    I32 n_frames;
+    I32 n_bands;
+} demosaic_batch_job;
+
+// demosaic one band of one frame of a batch, called by a dispatcher
+DEMOSAIC_PRIVATE void demosaic_malvar_batch_band(
+        void * job_context,
+        I32 index)
+{
+    const demosaic_batch_job * const job =
+            (const demosaic_batch_job *) job_context;
+    DEMOSAIC_ASSERT(job != NULL);
+    DEMOSAIC_ASSERT_2(0 <= index && index < job->n_frames * job->n_bands,
+            index, job->n_frames * job->n_bands);
+
+    const I32 frame = index / job->n_bands;
+    I32 row_start;
+    I32 row_end;
+    demosaic_band_rows(job->plan->args.n_rows, job->n_bands,
+            index % job->n_bands, &row_start, &row_end);
+    demosaic_plan_rows(job->kind, job->bayer[frame], job->plan,
+            row_start, row_end, job->output[frame], NULL);
+}
+
+// demosaic a batch of frames with a plan, serially, prefetching each next
+// frame, or by the dispatcher, in jobs of one band of one frame
+DEMOSAIC_PRIVATE void demosaic_malvar_dispatch_batch(
+        const demosaic_band_kind kind,
+        const void * const * const bayer,
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        void * const * const output)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(plan != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert frame count is not negative
+    DEMOSAIC_ASSERT_1(n_frames >= 0, n_frames);
+
+    // assert frame pointers not null
+    for (I32 frame = 0; frame < n_frames; frame++) {
+        DEMOSAIC_ASSERT_1(bayer[frame] != NULL, frame);
+        DEMOSAIC_ASSERT_1(output[frame] != NULL, frame);
+    }
+
+    if (dispatcher == NULL) {
+        for (I32 frame = 0; frame < n_frames; frame++) {
+            demosaic_plan_rows(kind, bayer[frame], plan,
+                    0, plan->args.n_rows, output[frame],
+                    (frame + 1 < n_frames) ? bayer[frame + 1] : NULL);
+        }
+        return;
+    }
+
+    DEMOSAIC_ASSERT(dispatcher->dispatch != NULL);
+
+    // assert at least one band
+    DEMOSAIC_ASSERT_1(dispatcher->n_bands >= 1, dispatcher->n_bands);
+
+    // assert the jobs can be counted
+    DEMOSAIC_ASSERT_2(n_frames <= 0x7FFFFFFF / dispatcher->n_bands,
+            n_frames, dispatcher->n_bands);
+
+    if (n_frames == 0) {
+        return;
+    }
+
+    demosaic_batch_job job;
+    job.kind = kind;
+    job.bayer = bayer;
+    job.plan = plan;
+    job.output = output;
+    job.n_frames = n_frames;
+    job.n_bands = dispatcher->n_bands;
+
+    dispatcher->dispatch(dispatcher->pool_context, demosaic_malvar_batch_band,
+            &job, n_frames * dispatcher->n_bands);
+}
+
+// demosaic a batch of 16 bit bayer frames to 16 bit rgb
+void demosaic_malvar_rgb16_batch(
+        const U16 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        demosaic_pix_rgb16 * const output[])
+{
+    demosaic_malvar_dispatch_batch(DEMOSAIC_BAND_RGB16,
+            (const void * const *) bayer, plan, dispatcher, n_frames,
+            (void * const *) output);
+}
+
+// demosaic a batch of 8 bit bayer frames to 8 bit rgb
+void demosaic_malvar_rgb8_batch(
+        const U8 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        demosaic_pix_rgb8 * const output[])
+{
+    DEMOSAIC_ASSERT(plan != NULL);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(plan->args.max_val <= U8_MAX, plan->args.max_val);
+
+    demosaic_malvar_dispatch_batch(DEMOSAIC_BAND_RGB8,
+            (const void * const *) bayer, plan, dispatcher, n_frames,
+            (void * const *) output);
+}
+
+// demosaic a batch of 16 bit bayer frames to 8 bit rgb
+void demosaic_malvar_rgb16to8_batch(
+        const U16 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        demosaic_pix_rgb8 * const output[])
+{
+    DEMOSAIC_ASSERT(plan != NULL);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(plan->args.lut != NULL
+            || plan->max_val_shifted <= U8_MAX,
+            plan->args.max_val, plan->args.rshift);
+
+    demosaic_malvar_dispatch_batch(DEMOSAIC_BAND_RGB16TO8,
+            (const void * const *) bayer, plan, dispatcher, n_frames,
+            (void * const *) output);
+}
+
+// demosaic a batch of 16 bit bayer frames to 16 bit mono
+void demosaic_malvar_mono16_batch(
+        const U16 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        U16 * const output[])
+{
+    demosaic_malvar_dispatch_batch(DEMOSAIC_BAND_MONO16,
+            (const void * const *) bayer, plan, dispatcher, n_frames,
+            (void * const *) output);
+}
+
+// demosaic a batch of 8 bit bayer frames to 8 bit mono
+void demosaic_malvar_mono8_batch(
+        const U8 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        U8 * const output[])
+{
+    DEMOSAIC_ASSERT(plan != NULL);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(plan->args.max_val <= U8_MAX, plan->args.max_val);
+
+    demosaic_malvar_dispatch_batch(DEMOSAIC_BAND_MONO8,
+            (const void * const *) bayer, plan, dispatcher, n_frames,
+            (void * const *) output);
+}
+
+// demosaic a batch of 16 bit bayer frames to 8 bit mono
+void demosaic_malvar_mono16to8_batch(
+        const U16 * const bayer[],
+        const demosaic_plan * const plan,
+        const demosaic_dispatcher * const dispatcher,
+        const I32 n_frames,
+        U8 * const output[])
+{
+    DEMOSAIC_ASSERT(plan != NULL);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(plan->args.lut != NULL
+            || plan->max_val_shifted <= U8_MAX,
+            plan->args.max_val, plan->args.rshift);
+
+    demosaic_malvar_dispatch_batch(DEMOSAIC_BAND_MONO16TO8,
+            (const void * const *) bayer, plan, dispatcher, n_frames,
+            (void * const *) output);
+}
+
+// parallel bands
+
+// split an image into bands of rows, and have the dispatcher demosaic them,
+// as a batch of one frame, so arguments are checked once, not per row
+DEMOSAIC_PRIVATE void demosaic_malvar_dispatch_bands(
+        const demosaic_band_kind kind,
+        const void * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        void * const output)
+{
+    // assert pointers not null
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(dispatcher != NULL);
+    DEMOSAIC_ASSERT(dispatcher->dispatch != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // assert at least one band
+    DEMOSAIC_ASSERT_1(dispatcher->n_bands >= 1, dispatcher->n_bands);
+
+    // assert even rows and columns, at least 2x2, and coefficients in [0,1]
+    demosaic_plan plan;
+    demosaic_plan_init(&plan, args);
+
+    demosaic_malvar_dispatch_batch(kind, &bayer, &plan, dispatcher, 1,
+            &output);
+}
+
+// demosaic 16 bit bayer to 16 bit rgb, in parallel bands of rows
+void demosaic_malvar_rgb16_parallel(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        demosaic_pix_rgb16 * output)
+{
+    demosaic_malvar_dispatch_bands(DEMOSAIC_BAND_RGB16,
+            bayer, args, dispatcher, output);
+}
+
+// demosaic 8 bit bayer to 8 bit rgb, in parallel bands of rows
+void demosaic_malvar_rgb8_parallel(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    demosaic_malvar_dispatch_bands(DEMOSAIC_BAND_RGB8,
+            bayer, args, dispatcher, output);
+}
+
+// demosaic 16 bit bayer to 8 bit rgb, in parallel bands of rows
+void demosaic_malvar_rgb16to8_parallel(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    demosaic_malvar_dispatch_bands(DEMOSAIC_BAND_RGB16TO8,
+            bayer, args, dispatcher, output);
+}
+
+// demosaic 16 bit bayer to 16 bit mono, in parallel bands of rows
+void demosaic_malvar_mono16_parallel(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        U16 * output)
+{
+    demosaic_malvar_dispatch_bands(DEMOSAIC_BAND_MONO16,
+            bayer, args, dispatcher, output);
+}
+
+// demosaic 8 bit bayer to 8 bit mono, in parallel bands of rows
+void demosaic_malvar_mono8_parallel(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    demosaic_malvar_dispatch_bands(DEMOSAIC_BAND_MONO8,
+            bayer, args, dispatcher, output);
+}
+
+// demosaic 16 bit bayer to 8 bit mono, in parallel bands of rows
+void demosaic_malvar_mono16to8_parallel(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const demosaic_dispatcher * const dispatcher,
+        U8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    demosaic_malvar_dispatch_bands(DEMOSAIC_BAND_MONO16TO8,
+            bayer, args, dispatcher, output);
+}
+
+// scratch
+
+// widest images sized by the scratch functions, so that sizes of at most
+// 24 bytes a pixel fit an I32
+#define DM_SCRATCH_MAX_COLS 0x4000000
+
+// bytes rounded up to a multiple of DEMOSAIC_SCRATCH_ALIGN
+#define DM_SCRATCH_ROUND(n_bytes) ((((n_bytes) + DEMOSAIC_SCRATCH_ALIGN - 1) \
+        / DEMOSAIC_SCRATCH_ALIGN) * DEMOSAIC_SCRATCH_ALIGN)
+
+void demosaic_scratch_init(
+        demosaic_scratch * const scratch,
+        void * const base,
+        const I32 n_bytes)
+{
+    DEMOSAIC_ASSERT(scratch != NULL);
+    DEMOSAIC_ASSERT(base != NULL);
+
+    // assert base is aligned, so that every buffer taken is
+    DEMOSAIC_ASSERT(((size_t) base % DEMOSAIC_SCRATCH_ALIGN) == 0);
+
+    // assert size not negative, and small enough to round without overflow
+    DEMOSAIC_ASSERT_1(n_bytes >= 0
+            && n_bytes <= 0x7FFFFFFF - DEMOSAIC_SCRATCH_ALIGN, n_bytes);
+
+    scratch->base = (U8 *) base;
+    scratch->n_bytes = n_bytes;
+    scratch->n_used = 0;
+}
+
+void * demosaic_scratch_take(
+        demosaic_scratch * const scratch,
+        const I32 n_bytes)
+{
+    DEMOSAIC_ASSERT(scratch != NULL);
+    DEMOSAIC_ASSERT(scratch->base != NULL);
+
+    // assert size positive, and the rounded buffer fits in the arena
+    DEMOSAIC_ASSERT_2(n_bytes > 0
+            && n_bytes <= scratch->n_bytes - scratch->n_used,
+            n_bytes, scratch->n_used);
+    const I32 n_taken = DM_SCRATCH_ROUND(n_bytes);
+    DEMOSAIC_ASSERT_2(n_taken <= scratch->n_bytes - scratch->n_used,
+            n_taken, scratch->n_used);
+
+    U8 * const buffer = &scratch->base[scratch->n_used];
+    scratch->n_used += n_taken;
+    return buffer;
+}
+
+void demosaic_scratch_reset(
+        demosaic_scratch * const scratch)
+{
+    DEMOSAIC_ASSERT(scratch != NULL);
+
+    scratch->n_used = 0;
+}
+
+I32 demosaic_scratch_size(
+        const demosaic_args * const args,
+        const demosaic_mode mode)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+
+    // assert even rows and columns, at least 2x2, not too wide to size
+    demosaic_malvar_assert_proper_dimensions(args);
+    DEMOSAIC_ASSERT_1(args->n_cols <= DM_SCRATCH_MAX_COLS, args->n_cols);
+
+    // assert mode is valid
+    DEMOSAIC_ASSERT_1((mode >= DEMOSAIC_MODE_ROWS)
+            && (mode <= DEMOSAIC_MODE_YUV), mode);
+
+    I32 n_bytes = 0;
+    switch (mode) {
+    case DEMOSAIC_MODE_ROWS:
+    case DEMOSAIC_MODE_YUV:
+        break;
+    case DEMOSAIC_MODE_STREAM:
+    case DEMOSAIC_MODE_PACKED:
+        // the line_buffer
+        n_bytes = DM_SCRATCH_ROUND(DEMOSAIC_STREAM_LINES * args->n_cols
+                * (I32) sizeof(U16));
+        break;
+    default:
+        DEMOSAIC_ASSERT_1(0, mode);
+        break;
+    }
+    return n_bytes;
+}
+
+I32 demosaic_working_set_size(
+        const demosaic_args * const args,
+        const demosaic_mode mode)
+{
+    // asserts args and mode
+    const I32 n_scratch = demosaic_scratch_size(args, mode);
+
+    const I32 n_cols = args->n_cols;
+    const I32 line16 = n_cols * (I32) sizeof(U16);
+    const I32 row_rgb16 = n_cols * (I32) sizeof(demosaic_pix_rgb16);
+    // the rgb16 chunk of the corrected and tone mapped spans
+    const I32 chunk = DM_SPAN_CHUNK * (I32) sizeof(demosaic_pix_rgb16);
+
+    I32 n_bytes = 0;
+    switch (mode) {
+    case DEMOSAIC_MODE_ROWS:
+        // 5 16-bit bayer lines, and a fused rgb16 and mono16 row
+        n_bytes = 5 * line16 + row_rgb16 + line16 + chunk;
+        break;
+    case DEMOSAIC_MODE_STREAM:
+        // the ring, the pushed 16-bit line, and an rgb16 row
+        n_bytes = n_scratch + line16 + row_rgb16 + chunk;
+        break;
+    case DEMOSAIC_MODE_PACKED:
+        // the unpacked lines, the 5 RAW12 lines of a row call, an rgb16 row
+        n_bytes = n_scratch + 5 * (n_cols / 2) * 3 + row_rgb16 + chunk;
+        break;
+    case DEMOSAIC_MODE_YUV:
+        // 6 16-bit bayer lines and 2 y rows, cb and cr of 4:2:0,
+        // and the rgb8 chunks of both rows
+        n_bytes = 6 * line16 + 3 * n_cols
+                + 2 * DM_YUV_CHUNK * (I32) sizeof(demosaic_pix_rgb8) + chunk;
+        break;
+    default:
+        DEMOSAIC_ASSERT_1(0, mode);
+        break;
+    }
+    return n_bytes;
+}
+
+// streaming
+
+void demosaic_stream_init(
+        demosaic_stream * const stream,
+        const demosaic_args * const args,
+        U16 line_buffer[])
+{
+    DEMOSAIC_ASSERT(stream != NULL);
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(line_buffer != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    stream->args = *args;
+    stream->lines = line_buffer;
+    stream->n_lines_in = 0;
+    stream->n_rows_out = 0;
+}
+
+// point lines at the ring buffer lines of the next row to output,
+// mirroring rows beyond the top and bottom edges like get_pixel16_safe
+DEMOSAIC_PRIVATE void demosaic_stream_lines(
+        const demosaic_stream * const stream,
+        const U16 * lines[DEMOSAIC_STREAM_LINES])
+{
+    const I32 row = stream->n_rows_out;
+    const I32 n_rows = stream->args.n_rows;
+    const I32 n_cols = stream->args.n_cols;
+
+    for (I32 i = 0; i < DEMOSAIC_STREAM_LINES; i++) {
+        const I32 line = demosaic_mirror_index(row - 2 + i, n_rows);
+        // the mirrored line must still be in the ring
+        DEMOSAIC_ASSERT_2(line < stream->n_lines_in
+                && line >= stream->n_lines_in - DEMOSAIC_STREAM_LINES,
+                line, stream->n_lines_in);
+        lines[i] = &stream->lines[(line % DEMOSAIC_STREAM_LINES) * n_cols];
+    }
+}
+
+// demosaic the next row from the ring buffer
+DEMOSAIC_PRIVATE I32 demosaic_stream_emit_rgb16(
+        demosaic_stream * const stream,
+        demosaic_pix_rgb16 output_row[])
+{
+    const I32 row = stream->n_rows_out;
+    const U16 * lines[DEMOSAIC_STREAM_LINES];
+
+    demosaic_stream_lines(stream, lines);
+    demosaic_malvar_span_rgb16(lines, &stream->args, row, 0,
+            stream->args.n_cols, output_row);
+    stream->n_rows_out++;
+    return row;
+}
+
+I32 demosaic_malvar_stream_push_rgb16(
+        demosaic_stream * const stream,
+        const U16 line[],
+        demosaic_pix_rgb16 output_row[])
+{
+    DEMOSAIC_ASSERT(stream != NULL);
+    DEMOSAIC_ASSERT(stream->lines != NULL);
+    DEMOSAIC_ASSERT(line != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert the frame has room for another line
+    DEMOSAIC_ASSERT_2(stream->n_lines_in < stream->args.n_rows,
+            stream->n_lines_in, stream->args.n_rows);
+
+    const I32 n_cols = stream->args.n_cols;
+    memcpy(&stream->lines[(stream->n_lines_in % DEMOSAIC_STREAM_LINES) * n_cols],
+            line, n_cols * sizeof(U16));
+    stream->n_lines_in++;
+
+    // a row can be demosaiced once the line two below it has arrived
+    if (stream->n_lines_in - stream->n_rows_out > 2) {
+        return demosaic_stream_emit_rgb16(stream, output_row);
+    }
+    return -1;
+}
+
+I32 demosaic_malvar_stream_flush_rgb16(
+        demosaic_stream * const stream,
+        demosaic_pix_rgb16 output_row[])
+{
+    DEMOSAIC_ASSERT(stream != NULL);
+    DEMOSAIC_ASSERT(stream->lines != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert every line of the frame has been pushed
+    DEMOSAIC_ASSERT_2(stream->n_lines_in == stream->args.n_rows,
+            stream->n_lines_in, stream->args.n_rows);
+
+    if (stream->n_rows_out == stream->args.n_rows) {
+        return -1;
+    }
+    return demosaic_stream_emit_rgb16(stream, output_row);
+}
+
+// packed input
+
+// unpack a line of n_cols MIPI CSI-2 packed pixels. Each group of 4 (RAW10)
+// or 2 (RAW12) pixels holds their high 8 bits in a byte each, then their
+// low bits in one byte, first pixel in the least significant bits.
+DEMOSAIC_PRIVATE void demosaic_unpack_line(
+        const U8 * const packed,
+        const demosaic_packing packing,
+        const I32 n_cols,
+        U16 line[])
+{
+    I32 col = 0;
+#ifdef DM_SIMD
+    if ((demosaic_vector_engine != NULL)
+            && (demosaic_vector_engine->unpack_line != NULL)) {
+        col = demosaic_vector_engine->unpack_line(packed, packing, n_cols,
+                line);
+    }
+#endif
+    if (packing == DEMOSAIC_PACKED_RAW10) {
+        const U8 * in = &packed[(col / 4) * 5];
+        for (; col < n_cols; col += 4) {
+            const U16 low = in[4];
+            line[col] = (U16) ((in[0] << 2) | (low & 0x3));
+            line[col + 1] = (U16) ((in[1] << 2) | ((low >> 2) & 0x3));
+            line[col + 2] = (U16) ((in[2] << 2) | ((low >> 4) & 0x3));
+            line[col + 3] = (U16) ((in[3] << 2) | (low >> 6));
+            in += 5;
+        }
+    } else {
+        const U8 * in = &packed[(col / 2) * 3];
+        for (; col < n_cols; col += 2) {
+            const U16 low = in[2];
+            line[col] = (U16) ((in[0] << 4) | (low & 0xF));
+            line[col + 1] = (U16) ((in[1] << 4) | (low >> 4));
+            in += 3;
+        }
+    }
+}
+
+// asserts for a packing and the columns it packs
+DEMOSAIC_PRIVATE void demosaic_assert_packing(
+        const demosaic_packing packing,
+        const I32 n_cols)
+{
+    DEMOSAIC_ASSERT_1(packing == DEMOSAIC_PACKED_RAW10
+            || packing == DEMOSAIC_PACKED_RAW12, packing);
+
+    // assert RAW10 rows are whole groups of 4 pixels
+    DEMOSAIC_ASSERT_1(packing != DEMOSAIC_PACKED_RAW10 || (n_cols % 4) == 0,
+            n_cols);
+}
+
+// asserts for a packed image, and for args of a kind of output
+DEMOSAIC_PRIVATE void demosaic_assert_packed(
+        const demosaic_band_kind kind,
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args)
+{
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(bayer->data != NULL);
+    demosaic_assert_packing(bayer->packing, args->n_cols);
+
+    // assert rows do not overlap, i.e. are at least a packed line apart
+    DEMOSAIC_ASSERT_2(bayer->pitch
+            >= ((bayer->packing == DEMOSAIC_PACKED_RAW10)
+            ? ((args->n_cols / 4) * 5) : ((args->n_cols / 2) * 3)),
+            bayer->pitch, args->n_cols);
+
+    if (kind == DEMOSAIC_BAND_RGB16TO8 || kind == DEMOSAIC_BAND_MONO16TO8) {
+        // assert shift is not negative
+        DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+        // assert max val can be shifted to 8 bits, unless mapped by a lut
+        DEMOSAIC_ASSERT_2(args->lut != NULL
+                || (args->max_val >> args->rshift) <= U8_MAX,
+                args->max_val, args->rshift);
+    }
+}
+
+// demosaic a row of a kind of 16-bit input from unpacked lines,
+// with the luma weights of mono kinds
+DEMOSAIC_PRIVATE void demosaic_packed_span(
+        const demosaic_band_kind kind,
+        const U16 * lines[DEMOSAIC_STREAM_LINES],
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        void * const output_row)
+{
+    switch (kind) {
+    case DEMOSAIC_BAND_RGB16:
+        demosaic_malvar_span_rgb16(lines, args, row, 0, args->n_cols,
+                (demosaic_pix_rgb16 *) output_row);
+        break;
+    case DEMOSAIC_BAND_RGB16TO8:
+        demosaic_malvar_span_rgb16to8(lines, args, row, 0, args->n_cols,
+                (demosaic_pix_rgb8 *) output_row);
+        break;
+    case DEMOSAIC_BAND_MONO16:
+        demosaic_malvar_span_mono16(lines, args, coefs_normed, row, 0,
+                args->n_cols, (U16 *) output_row);
+        break;
+    case DEMOSAIC_BAND_MONO16TO8:
+        demosaic_malvar_span_mono16to8(lines, args, coefs_normed, row, 0,
+                args->n_cols, (U8 *) output_row);
+        break;
+    default:
+        DEMOSAIC_ASSERT_1(0, kind);
+        break;
+    }
+}
+
+// assert the coefficients of mono kinds are in [0,1], and normalize them.
+// rgb kinds do not use them.
+DEMOSAIC_PRIVATE void demosaic_packed_weights(
+        const demosaic_band_kind kind,
+        const demosaic_args * const args,
+        demosaic_luma_weights * const coefs_normed)
+{
+    memset(coefs_normed, 0, sizeof(*coefs_normed));
+    if (kind == DEMOSAIC_BAND_MONO16 || kind == DEMOSAIC_BAND_MONO16TO8) {
+        demosaic_normalize_coefs(args, coefs_normed);
+    }
+}
+
+// demosaic a row of a packed image, unpacking its 5 lines,
+// mirrored at the top and bottom edges, into line_buffer
+DEMOSAIC_PRIVATE void demosaic_malvar_row_packed(
+        const demosaic_band_kind kind,
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        void * const output_row)
+{
+    const U16 * lines[DEMOSAIC_STREAM_LINES];
+
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(line_buffer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+    demosaic_assert_packed(kind, bayer, args);
+
+    // assert row is in image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+
+    demosaic_luma_weights coefs_normed;
+    demosaic_packed_weights(kind, args, &coefs_normed);
+
+    for (I32 i = 0; i < DEMOSAIC_STREAM_LINES; i++) {
+        const I32 line = demosaic_mirror_index(row - 2 + i, args->n_rows);
+        demosaic_unpack_line(&bayer->data[line * bayer->pitch],
+                bayer->packing, args->n_cols, &line_buffer[i * args->n_cols]);
+        lines[i] = &line_buffer[i * args->n_cols];
+    }
+    demosaic_packed_span(kind, lines, args, &coefs_normed, row, output_row);
+}
+
+// demosaic a packed image, unpacking each line once into the ring of a
+// stream, so at most DEMOSAIC_STREAM_LINES lines are ever unpacked
+DEMOSAIC_PRIVATE void demosaic_malvar_packed(
+        const demosaic_band_kind kind,
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        void * const output,
+        const I32 output_size)
+{
+    demosaic_stream stream;
+    const U16 * lines[DEMOSAIC_STREAM_LINES];
+    U8 * const base = (U8 *) output;
+
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
+
+    // asserts line_buffer and dimensions
+    demosaic_stream_init(&stream, args, line_buffer);
+    demosaic_assert_packed(kind, bayer, args);
+
+    demosaic_luma_weights coefs_normed;
+    demosaic_packed_weights(kind, args, &coefs_normed);
+
+    const I32 n_rows = args->n_rows;
+    const I32 n_cols = args->n_cols;
+    const I32 row_bytes = n_cols * output_size;
+    while (stream.n_rows_out < n_rows) {
+        // a row can be demosaiced once the line two below it is unpacked
+        while (stream.n_lines_in < n_rows
+                && stream.n_lines_in - stream.n_rows_out <= 2) {
+            demosaic_unpack_line(&bayer->data[stream.n_lines_in * bayer->pitch],
+                    bayer->packing, n_cols, &line_buffer[
+                    (stream.n_lines_in % DEMOSAIC_STREAM_LINES) * n_cols]);
+            stream.n_lines_in++;
+        }
+        demosaic_stream_lines(&stream, lines);
+        demosaic_packed_span(kind, lines, args, &coefs_normed,
+                stream.n_rows_out, &base[stream.n_rows_out * row_bytes]);
+        stream.n_rows_out++;
+    }
+}
+
+void demosaic_malvar_row_rgb16_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        demosaic_pix_rgb16 output_row[])
+{
+    demosaic_malvar_row_packed(DEMOSAIC_BAND_RGB16, bayer, args, row,
+            line_buffer, output_row);
+}
+
+void demosaic_malvar_rgb16_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        demosaic_pix_rgb16 * output)
+{
+    demosaic_malvar_packed(DEMOSAIC_BAND_RGB16, bayer, args, line_buffer,
+            output, sizeof(demosaic_pix_rgb16));
+}
+
+void demosaic_malvar_row_rgb16to8_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        demosaic_pix_rgb8 output_row[])
+{
+    demosaic_malvar_row_packed(DEMOSAIC_BAND_RGB16TO8, bayer, args, row,
+            line_buffer, output_row);
+}
+
+void demosaic_malvar_rgb16to8_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        demosaic_pix_rgb8 * output)
+{
+    demosaic_malvar_packed(DEMOSAIC_BAND_RGB16TO8, bayer, args, line_buffer,
+            output, sizeof(demosaic_pix_rgb8));
+}
+
+void demosaic_malvar_row_mono16_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        U16 output_row[])
+{
+    demosaic_malvar_row_packed(DEMOSAIC_BAND_MONO16, bayer, args, row,
+            line_buffer, output_row);
+}
+
+void demosaic_malvar_mono16_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        U16 * output)
+{
+    demosaic_malvar_packed(DEMOSAIC_BAND_MONO16, bayer, args, line_buffer,
+            output, sizeof(U16));
+}
+
+void demosaic_malvar_row_mono16to8_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        U16 line_buffer[],
+        U8 output_row[])
+{
+    demosaic_malvar_row_packed(DEMOSAIC_BAND_MONO16TO8, bayer, args, row,
+            line_buffer, output_row);
+}
+
+void demosaic_malvar_mono16to8_packed(
+        const demosaic_packed * const bayer,
+        const demosaic_args * const args,
+        U16 line_buffer[],
+        U8 * output)
+{
+    demosaic_malvar_packed(DEMOSAIC_BAND_MONO16TO8, bayer, args, line_buffer,
+            output, sizeof(U8));
+}
+
+I32 demosaic_malvar_stream_push_packed_rgb16(
+        demosaic_stream * const stream,
+        const demosaic_packing packing,
+        const U8 line[],
+        demosaic_pix_rgb16 output_row[])
+{
+    DEMOSAIC_ASSERT(stream != NULL);
+    DEMOSAIC_ASSERT(stream->lines != NULL);
+    DEMOSAIC_ASSERT(line != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+    demosaic_assert_packing(packing, stream->args.n_cols);
+
+    // assert the frame has room for another line
+    DEMOSAIC_ASSERT_2(stream->n_lines_in < stream->args.n_rows,
+            stream->n_lines_in, stream->args.n_rows);
+
+    const I32 n_cols = stream->args.n_cols;
+    const I32 slot = stream->n_lines_in % DEMOSAIC_STREAM_LINES;
+    demosaic_unpack_line(line, packing, n_cols, &stream->lines[slot * n_cols]);
+    stream->n_lines_in++;
+
+    // a row can be demosaiced once the line two below it has arrived
+    if (stream->n_lines_in - stream->n_rows_out > 2) {
+        return demosaic_stream_emit_rgb16(stream, output_row);
+    }
+    return -1;
+}
+
+// subsampling
+
+// each 2x2 quad of a pair of bayer rows becomes one output pixel,
+// with red, the rounded average of the two greens, and blue,
+// wherever the pattern puts them in the quad
+
+// calibrate the red, top green, bottom green and blue of a quad,
+// if w is not NULL
+static inline void demosaic_subsample_calibrate(
+        const demosaic_cal_weights * const w,
+        const I32 row_off, const I32 max_val,
+        I32 quad[4])
+{
+    if (w != NULL) {
+        const I32 channels[4] = {
+            DEMOSAIC_CFA_RED,
+            row_off ? DEMOSAIC_CFA_GREEN_BLUE : DEMOSAIC_CFA_GREEN_RED,
+            row_off ? DEMOSAIC_CFA_GREEN_RED : DEMOSAIC_CFA_GREEN_BLUE,
+            DEMOSAIC_CFA_BLUE};
+        for (I32 k = 0; k < 4; k++) {
+            const I32 ch = channels[k];
+            const I32 val = (w->gain[ch] * quad[k] - w->offset[ch])
+                    / (1 << DEMOSAIC_GAIN_BITS);
+            quad[k] = DM_LIMIT(val, 0, max_val);
+        }
+    }
+}
+
+// red, the rounded average of the greens and blue of a calibrated quad,
+// color corrected and clamped to [0, max_val] if ccm is not NULL
+static inline void demosaic_subsample_rgb(
+        const demosaic_ccm * const ccm, const I32 max_val,
+        const I32 quad[4], I32 rgb[3])
+{
+    rgb[0] = quad[0];
+    rgb[1] = (quad[1] + quad[2] + 1) >> 1;
+    rgb[2] = quad[3];
+    if (ccm != NULL) {
+        demosaic_correct_rgb(ccm, &rgb[0], &rgb[1], &rgb[2]);
+        for (I32 k = 0; k < 3; k++) {
+            rgb[k] = DM_LIMIT(rgb[k], 0, max_val);
+        }
+    }
+}
+
+// subsampling spans, generated by demosaic_subsample_template.h for each
+// output type
+
+#define DM_SUBSAMPLE_NAME rgb16
+#define DM_SUBSAMPLE_BITS 16
+#define DM_SUBSAMPLE_MONO 0
+#define DM_SUBSAMPLE_OUT demosaic_pix_rgb16
+#define DM_SUBSAMPLE_STORE(i, rgb) \
+    (output[i].red = (rgb)[0], output[i].green = (rgb)[1], \
+     output[i].blue = (rgb)[2])
+#include "demosaic_subsample_template.h"
+
+#define DM_SUBSAMPLE_NAME rgb8
+#define DM_SUBSAMPLE_BITS 8
+#define DM_SUBSAMPLE_MONO 0
+#define DM_SUBSAMPLE_OUT demosaic_pix_rgb8
+#define DM_SUBSAMPLE_STORE(i, rgb) \
+    (output[i].red = (rgb)[0], output[i].green = (rgb)[1], \
+     output[i].blue = (rgb)[2])
+#include "demosaic_subsample_template.h"
+
+#define DM_SUBSAMPLE_NAME rgb16to8
+#define DM_SUBSAMPLE_BITS 16
+#define DM_SUBSAMPLE_MONO 0
+#define DM_SUBSAMPLE_OUT demosaic_pix_rgb8
+#define DM_SUBSAMPLE_STORE(i, rgb) \
+    (output[i].red = DM_TO8(args, (rgb)[0]), \
+     output[i].green = DM_TO8(args, (rgb)[1]), \
+     output[i].blue = DM_TO8(args, (rgb)[2]))
+#include "demosaic_subsample_template.h"
+
+#define DM_SUBSAMPLE_NAME mono16
+#define DM_SUBSAMPLE_BITS 16
+#define DM_SUBSAMPLE_MONO 1
+#define DM_SUBSAMPLE_OUT U16
+#define DM_SUBSAMPLE_STORE(i, rgb) \
+    (output[i] = DM_LUMA(*coefs_normed, (rgb)[0], (rgb)[1], (rgb)[2]))
+#include "demosaic_subsample_template.h"
+
+#define DM_SUBSAMPLE_NAME mono8
+#define DM_SUBSAMPLE_BITS 8
+#define DM_SUBSAMPLE_MONO 1
+#define DM_SUBSAMPLE_OUT U8
+#define DM_SUBSAMPLE_STORE(i, rgb) \
+    (output[i] = DM_LUMA(*coefs_normed, (rgb)[0], (rgb)[1], (rgb)[2]))
+#include "demosaic_subsample_template.h"
+
+#define DM_SUBSAMPLE_NAME mono16to8
+#define DM_SUBSAMPLE_BITS 16
+#define DM_SUBSAMPLE_MONO 1
+#define DM_SUBSAMPLE_OUT U8
+#define DM_SUBSAMPLE_STORE(i, rgb) \
+    (output[i] = DM_LUMA(*coefs_normed, DM_TO8(args, (rgb)[0]), \
+            DM_TO8(args, (rgb)[1]), DM_TO8(args, (rgb)[2])))
+#include "demosaic_subsample_template.h"
+
+void demosaic_subsample_row_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        const I32 row,
+        demosaic_pix_rgb16 output_row[])
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
+
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert row is in the half-resolution image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows / 2, row, args->n_rows);
+
+    const U16 * const top = &bayer[2 * row * args->n_cols];
+    demosaic_subsample_span_rgb16(top, &top[args->n_cols], args,
+            output_row);
+}
 
-    // normalize coefficients
-    demosaic_luma_coefs coefs_normed;
-    F64 coef_sum = args->coefs.red + args->coefs.green + args->coefs.blue
-            + 0.000001;
-    coefs_normed.red = args->coefs.red / coef_sum;
-    coefs_normed.green = args->coefs.green / coef_sum;
-    coefs_normed.blue = args->coefs.blue / coef_sum;
-    coef_sum = coefs_normed.red + coefs_normed.green + coefs_normed.blue;
-    DEMOSAIC_ASSERT_DBL_1(coef_sum < 1.0, coef_sum);
+void demosaic_subsample_rgb16(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb16 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
 
-    const I32 ncol = args->n_cols;
-    I32 col = 0;
-    demosaic_pix_rgb16 rgb = {0,0,0};
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
 
-    if ((row % 2) == 0) { // red-green row
-        while (col < ncol) {
-            get_rgb16_at_red16(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-            get_rgb16_at_green_rg16(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-        }
-    } else { // green-blue row
-        while (col < ncol) {
-            get_rgb16_at_green_gb16(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-            get_rgb16_at_blue16(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-        }
+    const I32 n_out = args->n_cols / 2;
+    for (I32 row = 0; row < args->n_rows / 2; row++) {
+        const U16 * const top = &bayer[2 * row * args->n_cols];
+        demosaic_subsample_span_rgb16(top, &top[args->n_cols], args,
+                &output[row * n_out]);
     }
 }
 
-// demosaic 8 bit bayer to 8 bit mono, without optimizations
-DEMOSAIC_PRIVATE void demosaic_malvar_row_mono8_unoptimized(
+void demosaic_subsample_row_rgb8(
         const U8 * const bayer,
         const demosaic_args * const args,
         const I32 row,
-        U8 output_row[])
+        demosaic_pix_rgb8 output_row[])
 {
-    // assert pointers not null
-    DEMOSAIC_ASSERT(bayer != NULL);
     DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
     DEMOSAIC_ASSERT(output_row != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+    // assert row is in the half-resolution image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows / 2, row, args->n_rows);
 
     // assert max val is 255 or less
     DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
 
-    // assert coefficients are in [0,1]
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.red && args->coefs.red <= 1,
-            args->coefs.red);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.green && args->coefs.green <= 1,
-            args->coefs.green);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.blue && args->coefs.blue <= 1,
-            args->coefs.blue);
+    const U8 * const top = &bayer[2 * row * args->n_cols];
+    demosaic_subsample_span_rgb8(top, &top[args->n_cols], args,
+            output_row);
+}
 
-    // normalize coefficients
-    demosaic_luma_coefs coefs_normed;
-    F64 coef_sum = args->coefs.red + args->coefs.green + args->coefs.blue
-            + 0.000001;
-    coefs_normed.red = args->coefs.red / coef_sum;
-    coefs_normed.green = args->coefs.green / coef_sum;
-    coefs_normed.blue = args->coefs.blue / coef_sum;
-    coef_sum = coefs_normed.red + coefs_normed.green + coefs_normed.blue;
-    DEMOSAIC_ASSERT_DBL_1(coef_sum < 1.0, coef_sum);
+void demosaic_subsample_rgb8(
+        const U8 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
 
-    const I32 ncol = args->n_cols;
-    I32 col = 0;
-    demosaic_pix_rgb8 rgb = {0,0,0};
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
 
-    if ((row % 2) == 0) { // red-green row
-        while (col < ncol) {
-            get_rgb8_at_red8(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-            get_rgb8_at_green_rg8(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-        }
-    } else { // green-blue row
-        while (col < ncol) {
-            get_rgb8_at_green_gb8(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-            get_rgb8_at_blue8(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-        }
+    // assert max val is 255 or less
+    DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
+
+    const I32 n_out = args->n_cols / 2;
+    for (I32 row = 0; row < args->n_rows / 2; row++) {
+        const U8 * const top = &bayer[2 * row * args->n_cols];
+        demosaic_subsample_span_rgb8(top, &top[args->n_cols], args,
+                &output[row * n_out]);
     }
 }
 
-// demosaic 16 bit bayer to 8 bit mono, without optimizations
-DEMOSAIC_PRIVATE void demosaic_malvar_row_mono16to8_unoptimized(
+void demosaic_subsample_row_rgb16to8(
         const U16 * const bayer,
         const demosaic_args * const args,
         const I32 row,
-        U8 output_row[])
+        demosaic_pix_rgb8 output_row[])
 {
-    // assert pointers not null
-    DEMOSAIC_ASSERT(bayer != NULL);
     DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
     DEMOSAIC_ASSERT(output_row != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
-    // assert even rows and columns, at least 2x2
-    demosaic_malvar_assert_proper_dimensions(args);
-
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
-
-    // assert coefficients are in [0,1]
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.red && args->coefs.red <= 1,
-            args->coefs.red);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.green && args->coefs.green <= 1,
-            args->coefs.green);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.blue && args->coefs.blue <= 1,
-            args->coefs.blue);
+    // assert row is in the half-resolution image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows / 2, row, args->n_rows);
 
     // assert shift is not negative
     DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
 
-    // assert max val can be shifted to 8 bits
-    DEMOSAIC_ASSERT_2((args->max_val >> args->rshift) <= U8_MAX,
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
             args->max_val, args->rshift);
 
-    // normalize coefficients
-    demosaic_luma_coefs coefs_normed;
-    F64 coef_sum = args->coefs.red + args->coefs.green + args->coefs.blue
-            + 0.000001;
-    coefs_normed.red = args->coefs.red / coef_sum;
-    coefs_normed.green = args->coefs.green / coef_sum;
-    coefs_normed.blue = args->coefs.blue / coef_sum;
-    coef_sum = coefs_normed.red + coefs_normed.green + coefs_normed.blue;
-    DEMOSAIC_ASSERT_DBL_1(coef_sum < 1.0, coef_sum);
+    const U16 * const top = &bayer[2 * row * args->n_cols];
+    demosaic_subsample_span_rgb16to8(top, &top[args->n_cols], args,
+            output_row);
+}
 
-    const I32 ncol = args->n_cols;
-    I32 col = 0;
-    demosaic_pix_rgb8 rgb = {0,0,0};
+void demosaic_subsample_rgb16to8(
+        const U16 * const bayer,
+        const demosaic_args * const args,
+        demosaic_pix_rgb8 * output)
+{
+    DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
 
-    if ((row % 2) == 0) { // red-green row
-        while (col < ncol) {
-            get_rgb8_at_red16(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-            get_rgb8_at_green_rg16(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-        }
-    } else { // green-blue row
-        while (col < ncol) {
-            get_rgb8_at_green_gb16(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-            get_rgb8_at_blue16(bayer, args, row, col, &rgb);
-            output_row[col] = coefs_normed.red * rgb.red
-                              + coefs_normed.green * rgb.green
-                              + coefs_normed.blue * rgb.blue
-                              + 0.5;
-            ++col;
-        }
+    // assert even rows and columns, at least 2x2
+    demosaic_malvar_assert_proper_dimensions(args);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    const I32 n_out = args->n_cols / 2;
+    for (I32 row = 0; row < args->n_rows / 2; row++) {
+        const U16 * const top = &bayer[2 * row * args->n_cols];
+        demosaic_subsample_span_rgb16to8(top, &top[args->n_cols], args,
+                &output[row * n_out]);
     }
 }
 
-// demosaic 16 bit bayer to 16 bit monchromatic
-// If the row is at the top or bottom, use the unoptimized function,
-// which ensures that sampling past the image edges does not occur.
-// Otherwise, use safe functions at left and right edges, and unsafe macros
-// in image interior, where edge testing is known to be unnecessary.
-// This vastly improves performance.
-void demosaic_malvar_row_mono16(
+void demosaic_subsample_row_mono16(
         const U16 * const bayer,
         const demosaic_args * const args,
         const I32 row,
         U16 output_row[])
 {
     DEMOSAIC_ASSERT(args != NULL);
-
-    // if this row is one of the two top or bottom rows, use safe functions
-    if (row < 2 || row >= args->n_rows - 2 ) {
-        demosaic_malvar_row_mono16_unoptimized(bayer, args, row, output_row);
-        return;
-    }
-    // else this is a middle row, can be optimized
-
-    // assert pointers not null
-    DEMOSAIC_ASSERT(output_row != NULL);
     DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
-
-    // assert coefficients are in [0,1]
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.red && args->coefs.red <= 1,
-            args->coefs.red);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.green && args->coefs.green <= 1,
-            args->coefs.green);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.blue && args->coefs.blue <= 1,
-            args->coefs.blue);
-
-    // normalize coefficients
-    demosaic_luma_coefs coefs_normed;
-    F64 coef_sum = args->coefs.red + args->coefs.green + args->coefs.blue
-            + 0.000001;
-    coefs_normed.red = args->coefs.red / coef_sum;
-    coefs_normed.green = args->coefs.green / coef_sum;
-    coefs_normed.blue = args->coefs.blue / coef_sum;
-    coef_sum = coefs_normed.red + coefs_normed.green + coefs_normed.blue;
-    DEMOSAIC_ASSERT_DBL_1(coef_sum < 1.0, coef_sum);
-
-    const I32 ncol = args->n_cols;
-    I32 red = 0;
-    I32 green = 0;
-    I32 blue = 0;
-    const U16 max_val = args->max_val;
-    demosaic_pix_rgb16 rgb = {0,0,0};
-
-    if ((row % 2) == 0) { // red-green row
-        // at left edge, use safe helpers
-        get_rgb16_at_red16(bayer, args, row, 0, &rgb);
-        output_row[0] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-        get_rgb16_at_green_rg16(bayer, args, row, 1, &rgb);
-        output_row[1] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // comments on the right indicate sampling kernels. See Malvar paper.
-
-            // red pixel
-            red = GET_PIX(bayer,ncol,row,col);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            green = DM_LIMIT(green, 0, max_val);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            blue = DM_LIMIT(blue, 0, max_val);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
+    // assert row is in the half-resolution image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows / 2, row, args->n_rows);
 
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            red = DM_LIMIT(red, 0, max_val);
-
-            green = GET_PIX(bayer,ncol,row,col);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            blue = DM_LIMIT(blue, 0, max_val);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-        }
-        // at right edge, use safe helpers
-        get_rgb16_at_red16(bayer, args, row, ncol-2, &rgb);
-        output_row[ncol - 2] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-        get_rgb16_at_green_rg16(bayer, args, row, ncol-1, &rgb);
-        output_row[ncol - 1] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-    } else { // green-blue row
-        // at left edge, use safe helpers
-        get_rgb16_at_green_gb16(bayer, args, row, 0, &rgb);
-        output_row[0] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-        get_rgb16_at_blue16(bayer, args, row, 1, &rgb);
-        output_row[1] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            red = DM_LIMIT(red, 0, max_val);
-
-            green = GET_PIX(bayer,ncol,row,col);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            blue = DM_LIMIT(blue, 0, max_val);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
 
-            // blue pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            red = DM_LIMIT(red, 0, max_val);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            green = DM_LIMIT(green, 0, max_val);
-
-            blue = GET_PIX(bayer,ncol,row,col);
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-        }
-        // at right edge, use safe helpers
-        get_rgb16_at_green_gb16(bayer, args, row, ncol - 2, &rgb);
-        output_row[ncol - 2] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-        get_rgb16_at_blue16(bayer, args, row, ncol - 1, &rgb);
-        output_row[ncol - 1] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-    }
+    const U16 * const top = &bayer[2 * row * args->n_cols];
+    demosaic_subsample_span_mono16(top, &top[args->n_cols], args,
+            &coefs_normed, output_row);
 }
 
-// demosaic 16 bit bayer row to 16 bit mono
-void demosaic_malvar_mono16(
+void demosaic_subsample_mono16(
         const U16 * const bayer,
         const demosaic_args * const args,
         U16 * output)
 {
     DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
-    for (I32 row = 0; row < args->n_rows; row++) {
-        demosaic_malvar_row_mono16(bayer, args, row,
-                &output[row * args->n_cols]);
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const I32 n_out = args->n_cols / 2;
+    for (I32 row = 0; row < args->n_rows / 2; row++) {
+        const U16 * const top = &bayer[2 * row * args->n_cols];
+        demosaic_subsample_span_mono16(top, &top[args->n_cols], args,
+                &coefs_normed, &output[row * n_out]);
     }
 }
 
-// demosaic 8 bit bayer to 8 bit monchromatic
-// If the row is at the top or bottom, use the unoptimized function,
-// which ensures that sampling past the image edges does not occur.
-// Otherwise, use safe functions at left and right edges, and unsafe macros
-// in image interior, where edge testing is known to be unnecessary.
-// This vastly improves performance.
-void demosaic_malvar_row_mono8(
+void demosaic_subsample_row_mono8(
         const U8 * const bayer,
         const demosaic_args * const args,
         const I32 row,
         U8 output_row[])
 {
     DEMOSAIC_ASSERT(args != NULL);
-
-    // if this row is one of the two top or bottom rows, use safe functions
-    if (row < 2 || row >= args->n_rows - 2 ) {
-        demosaic_malvar_row_mono8_unoptimized(bayer, args, row, output_row);
-        return;
-    }
-    // else this is a middle row, can be optimized
-
-    // assert pointers not null
-    DEMOSAIC_ASSERT(output_row != NULL);
     DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+    // assert row is in the half-resolution image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows / 2, row, args->n_rows);
 
     // assert max val is 255 or less
     DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
 
-    // assert coefficients are in [0,1]
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.red && args->coefs.red <= 1,
-            args->coefs.red);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.green && args->coefs.green <= 1,
-            args->coefs.green);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.blue && args->coefs.blue <= 1,
-            args->coefs.blue);
-
-    // normalize coefficients
-    demosaic_luma_coefs coefs_normed;
-    F64 coef_sum = args->coefs.red + args->coefs.green + args->coefs.blue
-            + 0.000001;
-    coefs_normed.red = args->coefs.red / coef_sum;
-    coefs_normed.green = args->coefs.green / coef_sum;
-    coefs_normed.blue = args->coefs.blue / coef_sum;
-    coef_sum = coefs_normed.red + coefs_normed.green + coefs_normed.blue;
-    DEMOSAIC_ASSERT_DBL_1(coef_sum < 1.0, coef_sum);
-
-    const I32 ncol = args->n_cols;
-    I32 red = 0;
-    I32 green = 0;
-    I32 blue = 0;
-    const U16 max_val = args->max_val;
-    demosaic_pix_rgb8 rgb = {0,0,0};
-
-    if ((row % 2) == 0) { // red-green row
-        // at left edge, use safe helpers
-        get_rgb8_at_red8(bayer, args, row, 0, &rgb);
-        output_row[0] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-        get_rgb8_at_green_rg8(bayer, args, row, 1, &rgb);
-        output_row[1] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // comments on the right indicate sampling kernels. See Malvar paper.
-
-            // red pixel
-            red = GET_PIX(bayer,ncol,row,col);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            green = DM_LIMIT(green, 0, max_val);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            blue = DM_LIMIT(blue, 0, max_val);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            red = DM_LIMIT(red, 0, max_val);
-
-            green = GET_PIX(bayer, ncol, row, col);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            blue = DM_LIMIT(blue, 0, max_val);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-        }
-        // at right edge, use safe helpers
-        get_rgb8_at_red8(bayer, args, row, ncol-2, &rgb);
-        output_row[ncol - 2] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-        get_rgb8_at_green_rg8(bayer, args, row, ncol-1, &rgb);
-        output_row[ncol - 1] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-    } else { // green-blue row
-        // at left edge, use safe helpers
-        get_rgb8_at_green_gb8(bayer, args, row, 0, &rgb);
-        output_row[0] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-        get_rgb8_at_blue8(bayer, args, row, 1, &rgb);
-        output_row[1] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            red = DM_LIMIT(red, 0, max_val);
-
-            green = GET_PIX(bayer,ncol,row,col);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            blue = DM_LIMIT(blue, 0, max_val);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
 
-            // blue pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            red = DM_LIMIT(red, 0, max_val);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            green = DM_LIMIT(green, 0, max_val);
-
-            blue = GET_PIX(bayer,ncol,row,col);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-        }
-        // at right edge, use safe helpers
-        get_rgb8_at_green_gb8(bayer, args, row, ncol - 2, &rgb);
-        output_row[ncol - 2] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-        get_rgb8_at_blue8(bayer, args, row, ncol - 1, &rgb);
-        output_row[ncol - 1] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-    }
+    const U8 * const top = &bayer[2 * row * args->n_cols];
+    demosaic_subsample_span_mono8(top, &top[args->n_cols], args,
+            &coefs_normed, output_row);
 }
 
-void demosaic_malvar_mono8(
+void demosaic_subsample_mono8(
         const U8 * const bayer,
         const demosaic_args * const args,
         U8 * output)
 {
     DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
@@ -2091,302 +5941,79 @@ void demosaic_malvar_mono8(
     // assert max val is 255 or less
     DEMOSAIC_ASSERT_1(args->max_val <= U8_MAX, args->max_val);
 
-    for (I32 row = 0; row < args->n_rows; row++) {
-        demosaic_malvar_row_mono8(bayer, args, row,
-                &output[row * args->n_cols]);
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    const I32 n_out = args->n_cols / 2;
+    for (I32 row = 0; row < args->n_rows / 2; row++) {
+        const U8 * const top = &bayer[2 * row * args->n_cols];
+        demosaic_subsample_span_mono8(top, &top[args->n_cols], args,
+                &coefs_normed, &output[row * n_out]);
     }
 }
 
-// demosaic 16 bit bayer to 8 bit monchromatic
-// If the row is at the top or bottom, use the unoptimized function,
-// which ensures that sampling past the image edges does not occur.
-// Otherwise, use safe functions at left and right edges, and unsafe macros
-// in image interior, where edge testing is known to be unnecessary.
-// This vastly improves performance.
-void demosaic_malvar_row_mono16to8(
+void demosaic_subsample_row_mono16to8(
         const U16 * const bayer,
         const demosaic_args * const args,
         const I32 row,
         U8 output_row[])
 {
     DEMOSAIC_ASSERT(args != NULL);
-
-    // if this row is one of the two top or bottom rows, use safe functions
-    if (row < 2 || row >= args->n_rows - 2 ) {
-        demosaic_malvar_row_mono16to8_unoptimized(
-                bayer, args, row, output_row);
-        return;
-    }
-    // else this is a middle row, can be optimized
-
-    // assert pointers not null
-    DEMOSAIC_ASSERT(output_row != NULL);
     DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output_row != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
-    // assert row is in image
-    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows, row, args->n_rows);
+    // assert row is in the half-resolution image
+    DEMOSAIC_ASSERT_2(0 <= row && row < args->n_rows / 2, row, args->n_rows);
 
-    // assert coefficients are in [0,1]
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.red && args->coefs.red <= 1,
-            args->coefs.red);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.green && args->coefs.green <= 1,
-            args->coefs.green);
-    DEMOSAIC_ASSERT_DBL_1(0 <= args->coefs.blue && args->coefs.blue <= 1,
-            args->coefs.blue);
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
 
     // assert shift is not negative
     DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
 
-    // assert max val can be shifted to 8 bits
-    DEMOSAIC_ASSERT_2((args->max_val >> args->rshift) <= U8_MAX,
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
             args->max_val, args->rshift);
 
-    // normalize coefficients
-    demosaic_luma_coefs coefs_normed;
-    F64 coef_sum = args->coefs.red + args->coefs.green + args->coefs.blue
-            + 0.000001;
-    coefs_normed.red = args->coefs.red / coef_sum;
-    coefs_normed.green = args->coefs.green / coef_sum;
-    coefs_normed.blue = args->coefs.blue / coef_sum;
-    coef_sum = coefs_normed.red + coefs_normed.green + coefs_normed.blue;
-    DEMOSAIC_ASSERT_DBL_1(coef_sum < 1.0, coef_sum);
-
-    const I32 ncol = args->n_cols;
-    I32 red = 0;
-    I32 green = 0;
-    I32 blue = 0;
-    const U16 max_val = args->max_val;
-    demosaic_pix_rgb8 rgb = {0,0,0};
-    const I32 rshift = args->rshift;
-    const U8 max_val_rshift = max_val >> rshift;
-
-
-    if ((row % 2) == 0) { // red-green row
-        // at left edge, use safe helpers
-        get_rgb8_at_red16(bayer, args, row, 0, &rgb);
-        output_row[0] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-        get_rgb8_at_green_rg16(bayer, args, row, 1, &rgb);
-        output_row[1] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // comments on the right indicate sampling kernels. See Malvar paper.
-
-            // red pixel
-            red = GET_PIX(bayer,ncol,row,col) >> rshift;
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            green = (green >= max_val) ? max_val_rshift :
-                    (green <= 0) ? 0 :
-                                   (green >> rshift);
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            blue = (blue >= max_val) ? max_val_rshift :
-                   (blue <= 0) ? 0 :
-                                 (blue >> rshift);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            red = (red >= max_val) ? max_val_rshift :
-                  (red <= 0) ? 0 :
-                               (red >> rshift);
-
-            green = GET_PIX(bayer,ncol,row,col) >> rshift;
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            blue = (blue >= max_val) ? max_val_rshift :
-                   (blue <= 0) ? 0 :
-                                 (blue >> rshift);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-        }
-        // at right edge, use safe helpers
-        get_rgb8_at_red16(bayer, args, row, ncol-2, &rgb);
-        output_row[ncol - 2] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-        get_rgb8_at_green_rg16(bayer, args, row, ncol-1, &rgb);
-        output_row[ncol - 1] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-    } else { // green-blue row
-        // at left edge, use safe helpers
-        get_rgb8_at_green_gb16(bayer, args, row, 0, &rgb);
-        output_row[0] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-        get_rgb8_at_blue16(bayer, args, row, 1, &rgb);
-        output_row[1] = coefs_normed.red * rgb.red
-                        + coefs_normed.green * rgb.green
-                        + coefs_normed.blue * rgb.blue
-                        + 0.5;
-
-        // In middle of the image, use macros. This prevents function call
-        // overhead and edge-checking, which greatly improves performance.
-        I32 col = 2;
-        while (col < ncol - 2) {
-            // green pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -2 + //      -2
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row-1, col+0) * +8 + // 1    10    1
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + //   -2  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * +1 + //      -2
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * +1 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +8 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -2)/16;
-            red = (red >= max_val) ? max_val_rshift :
-                  (red <= 0) ? 0 :
-                               (red >> rshift);
-
-            green = GET_PIX(bayer, ncol, row, col) >> rshift;
-
-            blue =  (GET_PIX(bayer, ncol, row-2, col+0) * +1 + //        1
-                     GET_PIX(bayer, ncol, row-1, col-1) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row-1, col+1) * -2 + // -2  8 10  8 -2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -2 + //    -2    -2
-                     GET_PIX(bayer, ncol, row+0, col-1) * +8 + //        1
-                     GET_PIX(bayer, ncol, row+0, col+0) *+10 +
-                     GET_PIX(bayer, ncol, row+0, col+1) * +8 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * -2 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * -2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * +1)/16;
-            blue = (blue >= max_val) ? max_val_rshift :
-                   (blue <= 0) ? 0 :
-                                 (blue >> rshift);
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-
-            // blue pixel
-            red =   (GET_PIX(bayer, ncol, row-2, col+0) * -3 + //      -3
-                     GET_PIX(bayer, ncol, row-1, col-1) * +4 + //    4    4
-                     GET_PIX(bayer, ncol, row-1, col+1) * +4 + // -3   12   -3
-                     GET_PIX(bayer, ncol, row+0, col-2) * -3 + //    4    4
-                     GET_PIX(bayer, ncol, row+0, col+0) *+12 + //      -3
-                     GET_PIX(bayer, ncol, row+0, col+2) * -3 +
-                     GET_PIX(bayer, ncol, row+1, col-1) * +4 +
-                     GET_PIX(bayer, ncol, row+1, col+1) * +4 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -3)/16;
-            red = (red >= max_val) ? max_val_rshift :
-                  (red <= 0) ? 0 :
-                               (red >> rshift);
-
-            green = (GET_PIX(bayer, ncol, row-2, col+0) * -1 + //      -1
-                     GET_PIX(bayer, ncol, row-1, col+0) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col-2) * -1 + // -1 2  4 2 -1
-                     GET_PIX(bayer, ncol, row+0, col-1) * +2 + //       2
-                     GET_PIX(bayer, ncol, row+0, col+0) * +4 + //      -1
-                     GET_PIX(bayer, ncol, row+0, col+1) * +2 +
-                     GET_PIX(bayer, ncol, row+0, col+2) * -1 +
-                     GET_PIX(bayer, ncol, row+1, col+0) * +2 +
-                     GET_PIX(bayer, ncol, row+2, col+0) * -1)/8;
-            green = (green >= max_val) ? max_val_rshift :
-                    (green <= 0) ? 0 :
-                                   (green >> rshift);
-
-            blue = GET_PIX(bayer, ncol, row, col) >> rshift;
-
-            output_row[col] = coefs_normed.red * red
-                            + coefs_normed.green * green
-                            + coefs_normed.blue * blue
-                            + 0.5;
-            ++col;
-        }
-        // at right edge, use safe helpers
-        get_rgb8_at_green_gb16(bayer, args, row, ncol - 2, &rgb);
-        output_row[ncol - 2] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-        get_rgb8_at_blue16(bayer, args, row, ncol - 1, &rgb);
-        output_row[ncol - 1] = coefs_normed.red * rgb.red
-                               + coefs_normed.green * rgb.green
-                               + coefs_normed.blue * rgb.blue
-                               + 0.5;
-    }
+    const U16 * const top = &bayer[2 * row * args->n_cols];
+    demosaic_subsample_span_mono16to8(top, &top[args->n_cols], args,
+            &coefs_normed, output_row);
 }
 
-// demosaic 16 bit bayer row to 8 bit mono
-void demosaic_malvar_mono16to8(
+void demosaic_subsample_mono16to8(
         const U16 * const bayer,
         const demosaic_args * const args,
         U8 * output)
 {
     DEMOSAIC_ASSERT(args != NULL);
+    DEMOSAIC_ASSERT(bayer != NULL);
+    DEMOSAIC_ASSERT(output != NULL);
 
     // assert even rows and columns, at least 2x2
     demosaic_malvar_assert_proper_dimensions(args);
 
-    for (I32 row = 0; row < args->n_rows; row++) {
-        demosaic_malvar_row_mono16to8(bayer, args, row,
-                &output[row * args->n_cols]);
+    // assert coefficients are in [0,1], and normalize them
+    demosaic_luma_weights coefs_normed;
+    demosaic_normalize_coefs(args, &coefs_normed);
+
+    // assert shift is not negative
+    DEMOSAIC_ASSERT_1(args->rshift >= 0, args->rshift);
+
+    // assert max val can be shifted to 8 bits, unless mapped by a lut
+    DEMOSAIC_ASSERT_2(args->lut != NULL
+            || (args->max_val >> args->rshift) <= U8_MAX,
+            args->max_val, args->rshift);
+
+    const I32 n_out = args->n_cols / 2;
+    for (I32 row = 0; row < args->n_rows / 2; row++) {
+        const U16 * const top = &bayer[2 * row * args->n_cols];
+        demosaic_subsample_span_mono16to8(top, &top[args->n_cols], args,
+                &coefs_normed, &output[row * n_out]);
     }
 }
-
@@ -0,0 +1,306 @@
+/***********************************************************************
+ * Copyright 2020 by the California Institute of Technology
+ * ALL RIGHTS RESERVED. United States Government Sponsorship acknowledged.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file        demosaic_file.c
+ * @date        2026-10-14
+ * @brief       Memory-mapped raw bayer files and demosaiced output files
+ *
+ * Optional, for POSIX hosts, e.g. ground-side reprocessing of archived
+ * frames. demosaic.c does not depend on it.
+ *
+ * Files are opened, mapped, and closed, so only the mapping is held.
+ * Misuse (bad layouts, frame indices) asserts, like demosaic.c;
+ * failures of the file system return a demosaic_file_status.
+ */
+
+// posix_madvise, ftruncate, sysconf, even with -std=c99
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <demosaic/demosaic_types_pub.h>
+#include <demosaic/demosaic_file_pub.h>
+#include <demosaic/demosaic_conf_private.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// unpadded bytes of a row of n_cols pixels of format
+DEMOSAIC_PRIVATE size_t demosaic_file_row_bytes(
+        demosaic_file_format format,
+        I32 n_cols)
+{
+    size_t n = (size_t) n_cols;
+    size_t row_bytes = 0U;
+    switch (format) {
+    case DEMOSAIC_FILE_U16:
+        row_bytes = 2U * n;
+        break;
+    case DEMOSAIC_FILE_U8:
+        row_bytes = n;
+        break;
+    case DEMOSAIC_FILE_RAW10:
+        row_bytes = (5U * n) / 4U;
+        break;
+    case DEMOSAIC_FILE_RAW12:
+        row_bytes = (3U * n) / 2U;
+        break;
+    default:
+        DEMOSAIC_ASSERT_1(0, format);
+        break;
+    }
+    return row_bytes;
+}
+
+// check a bayer layout, and resolve its zero pitches
+DEMOSAIC_PRIVATE void demosaic_file_resolve_layout(
+        const demosaic_file_layout * const layout,
+        demosaic_file_layout * const resolved)
+{
+    size_t row_bytes;
+
+    DEMOSAIC_ASSERT(layout != NULL);
+    DEMOSAIC_ASSERT(layout->n_rows > 0);
+    DEMOSAIC_ASSERT(layout->n_cols > 0);
+    DEMOSAIC_ASSERT((layout->n_rows & 0x1) == 0);
+    DEMOSAIC_ASSERT((layout->n_cols & 0x1) == 0);
+    DEMOSAIC_ASSERT((layout->format >= DEMOSAIC_FILE_U16)
+            && (layout->format <= DEMOSAIC_FILE_RAW12));
+    DEMOSAIC_ASSERT((layout->format != DEMOSAIC_FILE_RAW10)
+            || ((layout->n_cols & 0x3) == 0));
+    DEMOSAIC_ASSERT(layout->row_pitch >= 0);
+
+    *resolved = *layout;
+    row_bytes = demosaic_file_row_bytes(layout->format, layout->n_cols);
+    if (resolved->row_pitch == 0) {
+        resolved->row_pitch = (I32) row_bytes;
+    }
+    DEMOSAIC_ASSERT((size_t) resolved->row_pitch >= row_bytes);
+    if (resolved->frame_pitch == 0U) {
+        resolved->frame_pitch =
+                (size_t) resolved->n_rows * (size_t) resolved->row_pitch;
+    }
+    DEMOSAIC_ASSERT(resolved->frame_pitch
+            >= ((size_t) resolved->n_rows * (size_t) resolved->row_pitch));
+
+    // U16 frames are read in place, so must be aligned
+    // (mappings are page aligned)
+    if (layout->format == DEMOSAIC_FILE_U16) {
+        DEMOSAIC_ASSERT((resolved->header_bytes & 0x1U) == 0U);
+        DEMOSAIC_ASSERT((resolved->row_pitch & 0x1) == 0);
+        DEMOSAIC_ASSERT((resolved->frame_pitch & 0x1U) == 0U);
+    }
+}
+
+demosaic_file_status demosaic_file_map(
+        const char * const path,
+        const demosaic_file_layout * const layout,
+        demosaic_file * const file)
+{
+    demosaic_file_layout resolved;
+    demosaic_file_status status = DEMOSAIC_FILE_OK;
+    struct stat info;
+    size_t n_bytes = 0U;
+    size_t frame_bytes;
+    size_t n_frames = 0U;
+    void * data = MAP_FAILED;
+    int fd;
+
+    DEMOSAIC_ASSERT(path != NULL);
+    DEMOSAIC_ASSERT(file != NULL);
+    demosaic_file_resolve_layout(layout, &resolved);
+    memset(file, 0, sizeof(*file));
+
+    // the last frame need not hold the padding after its last row
+    frame_bytes = ((size_t) (resolved.n_rows - 1)
+            * (size_t) resolved.row_pitch)
+            + demosaic_file_row_bytes(resolved.format, resolved.n_cols);
+
+    fd = open(path, O_RDONLY);
+    if ((fd < 0) || (fstat(fd, &info) != 0)) {
+        status = DEMOSAIC_FILE_ERR_OPEN;
+    } else {
+        n_bytes = (size_t) info.st_size;
+        if ((n_bytes < resolved.header_bytes)
+                || ((n_bytes - resolved.header_bytes) < frame_bytes)) {
+            status = DEMOSAIC_FILE_ERR_SIZE;
+        } else {
+            n_frames = 1U + ((n_bytes - resolved.header_bytes - frame_bytes)
+                    / resolved.frame_pitch);
+            data = mmap(NULL, n_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                status = DEMOSAIC_FILE_ERR_MAP;
+            }
+        }
+    }
+    if (fd >= 0) {
+        (void) close(fd);
+    }
+
+    if (status == DEMOSAIC_FILE_OK) {
+        // frames are usually demosaiced in order
+        (void) posix_madvise(data, n_bytes, POSIX_MADV_SEQUENTIAL);
+        file->data = (U8 *) data;
+        file->n_bytes = n_bytes;
+        file->layout = resolved;
+        file->n_frames = (n_frames > 0x7FFFFFFFU)
+                ? 0x7FFFFFFF : (I32) n_frames;
+        file->writable = 0;
+    }
+    return status;
+}
+
+demosaic_file_status demosaic_file_create(
+        const char * const path,
+        size_t header_bytes,
+        size_t frame_bytes,
+        I32 n_frames,
+        demosaic_file * const file)
+{
+    demosaic_file_status status = DEMOSAIC_FILE_OK;
+    size_t n_bytes;
+    void * data = MAP_FAILED;
+    int fd;
+
+    DEMOSAIC_ASSERT(path != NULL);
+    DEMOSAIC_ASSERT(file != NULL);
+    DEMOSAIC_ASSERT(frame_bytes > 0U);
+    DEMOSAIC_ASSERT(n_frames > 0);
+    // assert the file size does not wrap
+    DEMOSAIC_ASSERT(frame_bytes
+            <= ((SIZE_MAX - header_bytes) / (size_t) n_frames));
+    memset(file, 0, sizeof(*file));
+
+    n_bytes = header_bytes + (frame_bytes * (size_t) n_frames);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        status = DEMOSAIC_FILE_ERR_OPEN;
+    } else if (((off_t) n_bytes < 0) || ((size_t) (off_t) n_bytes != n_bytes)) {
+        // too large for a 32-bit off_t, as ftruncate would report
+        errno = EFBIG;
+        status = DEMOSAIC_FILE_ERR_TRUNCATE;
+    } else if (ftruncate(fd, (off_t) n_bytes) != 0) {
+        status = DEMOSAIC_FILE_ERR_TRUNCATE;
+    } else {
+        data = mmap(NULL, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            status = DEMOSAIC_FILE_ERR_MAP;
+        }
+    }
+    if (fd >= 0) {
+        (void) close(fd);
+    }
+
+    if (status == DEMOSAIC_FILE_OK) {
+        file->data = (U8 *) data;
+        file->n_bytes = n_bytes;
+        file->layout.header_bytes = header_bytes;
+        file->layout.frame_pitch = frame_bytes;
+        file->n_frames = n_frames;
+        file->writable = 1;
+    }
+    return status;
+}
+
+demosaic_file_status demosaic_file_unmap(
+        demosaic_file * const file)
+{
+    demosaic_file_status status = DEMOSAIC_FILE_OK;
+
+    DEMOSAIC_ASSERT(file != NULL);
+    DEMOSAIC_ASSERT(file->data != NULL);
+
+    if ((file->writable != 0)
+            && (msync(file->data, file->n_bytes, MS_SYNC) != 0)) {
+        status = DEMOSAIC_FILE_ERR_SYNC;
+    }
+    if (munmap(file->data, file->n_bytes) != 0) {
+        status = DEMOSAIC_FILE_ERR_SYNC;
+    }
+    memset(file, 0, sizeof(*file));
+    return status;
+}
+
+// first byte of a frame of a mapped file
+DEMOSAIC_PRIVATE U8 * demosaic_file_frame(
+        const demosaic_file * const file,
+        I32 frame)
+{
+    DEMOSAIC_ASSERT(file != NULL);
+    DEMOSAIC_ASSERT(file->data != NULL);
+    DEMOSAIC_ASSERT((frame >= 0) && (frame < file->n_frames));
+    return &file->data[file->layout.header_bytes
+            + ((size_t) frame * file->layout.frame_pitch)];
+}
+
+const U16 * demosaic_file_bayer16(
+        const demosaic_file * const file,
+        I32 frame)
+{
+    const U8 * first;
+
+    DEMOSAIC_ASSERT(file != NULL);
+    DEMOSAIC_ASSERT(file->writable == 0);
+    DEMOSAIC_ASSERT(file->layout.format == DEMOSAIC_FILE_U16);
+    first = demosaic_file_frame(file, frame);
+    // even offsets from a page-aligned mapping, see resolve_layout
+    return (const U16 *) (const void *) first;
+}
+
+const U8 * demosaic_file_bayer8(
+        const demosaic_file * const file,
+        I32 frame)
+{
+    DEMOSAIC_ASSERT(file != NULL);
+    DEMOSAIC_ASSERT(file->writable == 0);
+    DEMOSAIC_ASSERT(file->layout.format != DEMOSAIC_FILE_U16);
+    return demosaic_file_frame(file, frame);
+}
+
+void * demosaic_file_output(
+        const demosaic_file * const file,
+        I32 frame)
+{
+    DEMOSAIC_ASSERT(file != NULL);
+    DEMOSAIC_ASSERT(file->writable != 0);
+    return demosaic_file_frame(file, frame);
+}
+
+void demosaic_file_prefetch(
+        const demosaic_file * const file,
+        I32 frame)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start;
+    size_t end;
+
+    DEMOSAIC_ASSERT(file != NULL);
+    DEMOSAIC_ASSERT(file->writable == 0);
+    start = (size_t) (demosaic_file_frame(file, frame) - file->data);
+    end = start + file->layout.frame_pitch;
+    if (end > file->n_bytes) {
+        end = file->n_bytes;
+    }
+    // posix_madvise takes a page-aligned address
+    start -= start % page;
+    (void) posix_madvise(&file->data[start], end - start,
+            POSIX_MADV_WILLNEED);
+}
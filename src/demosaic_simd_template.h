@@ -0,0 +1,1000 @@
+/***********************************************************************
+ * Copyright 2020 by the California Institute of Technology
+ * ALL RIGHTS RESERVED. United States Government Sponsorship acknowledged.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file        demosaic_simd_template.h
+ * @brief       Generator for the vector engines of demosaic.c
+ *
+ * Included by demosaic.c once per instruction set, with no include guard.
+ * Each inclusion defines the vectorized interiors of the span kernels,
+ * demosaic_simd_lines_<output>(), demosaic_simd_cal_lines16() and
+ * demosaic_simd_cal_lines8(), and their helpers, with _<DM_V_NAME> appended
+ * to every name so that engines can coexist, then demosaic_engine_<DM_V_NAME>,
+ * the table of the engine for demosaic_engine_init().
+ *
+ * Every function is compiled with DM_V_TARGET, so an engine may use
+ * instructions the compiler does not target by default. Its functions are
+ * only called through its table, once the host is known to support them.
+ *
+ * The includer defines, and this file undefines:
+ *   DM_V_NAME               engine name, i.e. avx2
+ *   DM_V_ENGINE             its demosaic_engine
+ *   DM_V_TARGET             attributes of every function, or nothing
+ *   DM_V_UNPACK             unpacker of packed lines for the engine, or NULL
+ *   dm_vec, DM_V_WIDTH, DM_V_<op>       operations on 32-bit signed lanes
+ *   dm_vec16, DM_V16_WIDTH, DM_V16_<op> operations on 16-bit signed lanes
+ */
+
+#define DM_V_CAT_(a, b) a ## _ ## b
+#define DM_V_CAT(a, b) DM_V_CAT_(a, b)
+#define DM_V_SUFFIX(name) DM_V_CAT(name, DM_V_NAME)
+
+// names of this engine
+#define demosaic_simd16_interpolate DM_V_SUFFIX(demosaic_simd16_interpolate)
+#define demosaic_simd16_kernel_sums DM_V_SUFFIX(demosaic_simd16_kernel_sums)
+#define demosaic_simd16_load_taps8 DM_V_SUFFIX(demosaic_simd16_load_taps8)
+#define demosaic_simd16_taps DM_V_SUFFIX(demosaic_simd16_taps)
+#define demosaic_simd_cal DM_V_SUFFIX(demosaic_simd_cal)
+#define demosaic_simd_cal_init DM_V_SUFFIX(demosaic_simd_cal_init)
+#define demosaic_simd_cal_interpolate DM_V_SUFFIX(demosaic_simd_cal_interpolate)
+#define demosaic_simd_cal_lines16 DM_V_SUFFIX(demosaic_simd_cal_lines16)
+#define demosaic_simd_cal_lines8 DM_V_SUFFIX(demosaic_simd_cal_lines8)
+#define demosaic_simd_calibrate_taps DM_V_SUFFIX(demosaic_simd_calibrate_taps)
+#define demosaic_simd_ccm DM_V_SUFFIX(demosaic_simd_ccm)
+#define demosaic_simd_ccm_init DM_V_SUFFIX(demosaic_simd_ccm_init)
+#define demosaic_simd_interpolate DM_V_SUFFIX(demosaic_simd_interpolate)
+#define demosaic_simd_kernel_sums DM_V_SUFFIX(demosaic_simd_kernel_sums)
+#define demosaic_simd_lines_mono16 DM_V_SUFFIX(demosaic_simd_lines_mono16)
+#define demosaic_simd_lines_mono16to8 DM_V_SUFFIX(demosaic_simd_lines_mono16to8)
+#define demosaic_simd_lines_mono8 DM_V_SUFFIX(demosaic_simd_lines_mono8)
+#define demosaic_simd_lines_planar16 DM_V_SUFFIX(demosaic_simd_lines_planar16)
+#define demosaic_simd_lines_planar16to8 \
+        DM_V_SUFFIX(demosaic_simd_lines_planar16to8)
+#define demosaic_simd_lines_planar8 DM_V_SUFFIX(demosaic_simd_lines_planar8)
+#define demosaic_simd_lines_rgb16 DM_V_SUFFIX(demosaic_simd_lines_rgb16)
+#define demosaic_simd_lines_rgb16_mono16 \
+        DM_V_SUFFIX(demosaic_simd_lines_rgb16_mono16)
+#define demosaic_simd_lines_rgb16to8 DM_V_SUFFIX(demosaic_simd_lines_rgb16to8)
+#define demosaic_simd_lines_rgb8 DM_V_SUFFIX(demosaic_simd_lines_rgb8)
+#define demosaic_simd_load_taps16 DM_V_SUFFIX(demosaic_simd_load_taps16)
+#define demosaic_simd_load_taps8 DM_V_SUFFIX(demosaic_simd_load_taps8)
+#define demosaic_simd_taps DM_V_SUFFIX(demosaic_simd_taps)
+
+// sums of the bayer pixels sampled by the malvar kernels,
+// for DM_V_WIDTH consecutive pixels, relative to (row, col)
+typedef struct {
+    dm_vec center; // (0, 0)
+    dm_vec vert1;  // (-1, 0) + (+1, 0)
+    dm_vec horz1;  // (0, -1) + (0, +1)
+    dm_vec vert2;  // (-2, 0) + (+2, 0)
+    dm_vec horz2;  // (0, -2) + (0, +2)
+    dm_vec diag;   // (-1, -1) + (-1, +1) + (+1, -1) + (+1, +1)
+} demosaic_simd_taps;
+
+// load taps from lines, the five bayer rows from row-2 to row+2
+DM_V_INLINE void demosaic_simd_load_taps16(
+        const U16 * const lines[5], const I32 col,
+        demosaic_simd_taps * const taps)
+{
+    taps->center = DM_V_LOAD16(&lines[2][col]);
+    taps->vert1 = DM_V_ADD(DM_V_LOAD16(&lines[1][col]),
+                           DM_V_LOAD16(&lines[3][col]));
+    taps->horz1 = DM_V_ADD(DM_V_LOAD16(&lines[2][col - 1]),
+                           DM_V_LOAD16(&lines[2][col + 1]));
+    taps->vert2 = DM_V_ADD(DM_V_LOAD16(&lines[0][col]),
+                           DM_V_LOAD16(&lines[4][col]));
+    taps->horz2 = DM_V_ADD(DM_V_LOAD16(&lines[2][col - 2]),
+                           DM_V_LOAD16(&lines[2][col + 2]));
+    taps->diag = DM_V_ADD(
+            DM_V_ADD(DM_V_LOAD16(&lines[1][col - 1]),
+                     DM_V_LOAD16(&lines[1][col + 1])),
+            DM_V_ADD(DM_V_LOAD16(&lines[3][col - 1]),
+                     DM_V_LOAD16(&lines[3][col + 1])));
+}
+
+DM_V_INLINE void demosaic_simd_load_taps8(
+        const U8 * const lines[5], const I32 col,
+        demosaic_simd_taps * const taps)
+{
+    taps->center = DM_V_LOAD8(&lines[2][col]);
+    taps->vert1 = DM_V_ADD(DM_V_LOAD8(&lines[1][col]),
+                           DM_V_LOAD8(&lines[3][col]));
+    taps->horz1 = DM_V_ADD(DM_V_LOAD8(&lines[2][col - 1]),
+                           DM_V_LOAD8(&lines[2][col + 1]));
+    taps->vert2 = DM_V_ADD(DM_V_LOAD8(&lines[0][col]),
+                           DM_V_LOAD8(&lines[4][col]));
+    taps->horz2 = DM_V_ADD(DM_V_LOAD8(&lines[2][col - 2]),
+                           DM_V_LOAD8(&lines[2][col + 2]));
+    taps->diag = DM_V_ADD(
+            DM_V_ADD(DM_V_LOAD8(&lines[1][col - 1]),
+                     DM_V_LOAD8(&lines[1][col + 1])),
+            DM_V_ADD(DM_V_LOAD8(&lines[3][col - 1]),
+                     DM_V_LOAD8(&lines[3][col + 1])));
+}
+
+// per-lane gains and offsets of a calibration, for the taps of each lane
+typedef struct {
+    dm_vec gain_same;     // center, vert2 and horz2, the lane's channel
+    dm_vec gain_in_row;   // horz1
+    dm_vec gain_in_col;   // vert1
+    dm_vec gain_opposite; // diag
+    dm_vec offset_same;   // gain * black of one pixel of each
+    dm_vec offset_in_row;
+    dm_vec offset_in_col;
+    dm_vec offset_opposite;
+} demosaic_simd_cal;
+
+// fill cal from the calibration of args, with unity gains if it has none,
+// for vectors starting at col of row
+static inline DM_V_TARGET void demosaic_simd_cal_init(
+        const demosaic_args * const args, const I32 row, const I32 col,
+        demosaic_simd_cal * const cal)
+{
+    demosaic_cal_weights weights;
+    const demosaic_cal_weights * const w =
+            demosaic_corrected_weights_init(args, &weights);
+    I32 gain[4][DM_V_WIDTH];
+    I32 offset[4][DM_V_WIDTH];
+    for (I32 i = 0; i < DM_V_WIDTH; i++) {
+        const I32 same = 2 * ((row + DM_ROW_OFFSET(args)) % 2)
+                       + ((col + DM_COL_OFFSET(args) + i) % 2);
+        for (I32 tap = 0; tap < 4; tap++) {
+            // same, in row, in column and opposite channels
+            const I32 ch = same ^ tap;
+            gain[tap][i] = w->gain[ch];
+            offset[tap][i] = w->offset[ch];
+        }
+    }
+    cal->gain_same = DM_V_LOAD32(gain[0]);
+    cal->gain_in_row = DM_V_LOAD32(gain[1]);
+    cal->gain_in_col = DM_V_LOAD32(gain[2]);
+    cal->gain_opposite = DM_V_LOAD32(gain[3]);
+    cal->offset_same = DM_V_LOAD32(offset[0]);
+    cal->offset_in_row = DM_V_LOAD32(offset[1]);
+    cal->offset_in_col = DM_V_LOAD32(offset[2]);
+    cal->offset_opposite = DM_V_LOAD32(offset[3]);
+}
+
+// calibrate taps, as demosaic_calibrate_taps for each lane
+DM_V_INLINE void demosaic_simd_calibrate_taps(
+        const demosaic_simd_cal * const cal,
+        demosaic_simd_taps * const t)
+{
+    const dm_vec same2 = DM_V_SLL(cal->offset_same, 1);
+    t->center = DM_V_SUB(DM_V_MUL(cal->gain_same, t->center),
+                         cal->offset_same);
+    t->vert2 = DM_V_SUB(DM_V_MUL(cal->gain_same, t->vert2), same2);
+    t->horz2 = DM_V_SUB(DM_V_MUL(cal->gain_same, t->horz2), same2);
+    t->horz1 = DM_V_SUB(DM_V_MUL(cal->gain_in_row, t->horz1),
+                        DM_V_SLL(cal->offset_in_row, 1));
+    t->vert1 = DM_V_SUB(DM_V_MUL(cal->gain_in_col, t->vert1),
+                        DM_V_SLL(cal->offset_in_col, 1));
+    t->diag = DM_V_SUB(DM_V_MUL(cal->gain_opposite, t->diag),
+                       DM_V_SLL(cal->offset_opposite, 2));
+}
+
+// color correction matrix coefficients, in every lane
+typedef struct {
+    dm_vec coef[3][3];
+} demosaic_simd_ccm;
+
+// fill ccm from the color correction matrix of args.
+// returns ccm, or NULL if args has no matrix.
+static inline DM_V_TARGET const demosaic_simd_ccm * demosaic_simd_ccm_init(
+        const demosaic_args * const args,
+        demosaic_simd_ccm * const ccm)
+{
+    if (args->ccm == NULL) {
+        return NULL;
+    }
+    for (I32 i = 0; i < 3; i++) {
+        for (I32 j = 0; j < 3; j++) {
+            ccm->coef[i][j] = DM_V_SET1(args->ccm->coef[i][j]);
+        }
+    }
+    return ccm;
+}
+
+// arithmetic shift right by n, rounding toward zero as integer division
+#define DM_V_DIV_POW2(a, n) DM_V_SRA(DM_V_ADD((a), DM_V_SELECT( \
+    DM_V_SRA((a), 31), DM_V_SET1((1 << (n)) - 1), DM_V_SET1(0))), (n))
+
+// sums of the four malvar kernels of every lane, before division
+DM_V_INLINE void demosaic_simd_kernel_sums(
+        const demosaic_simd_taps * const t,
+        dm_vec * const green, dm_vec * const opposite,
+        dm_vec * const in_row, dm_vec * const in_column)
+{
+    const dm_vec c2 = DM_V_SLL(t->center, 1);
+    const dm_vec c8 = DM_V_SLL(t->center, 3);
+
+    // green at red or blue
+    //  4 * center + 2 * (vert1 + horz1) - (vert2 + horz2), over 8
+    *green = DM_V_SUB(
+            DM_V_ADD(DM_V_SLL(t->center, 2),
+                     DM_V_SLL(DM_V_ADD(t->vert1, t->horz1), 1)),
+            DM_V_ADD(t->vert2, t->horz2));
+
+    // red at blue or blue at red
+    //  12 * center + 4 * diag - 3 * (vert2 + horz2), over 16
+    const dm_vec outer = DM_V_ADD(t->vert2, t->horz2);
+    *opposite = DM_V_SUB(
+            DM_V_ADD(DM_V_ADD(c8, DM_V_SLL(t->center, 2)),
+                     DM_V_SLL(t->diag, 2)),
+            DM_V_ADD(DM_V_SLL(outer, 1), outer));
+
+    // red or blue at green, from the same row
+    //  10 * center + 8 * horz1 - 2 * (diag + horz2) + vert2, over 16
+    *in_row = DM_V_ADD(
+            DM_V_SUB(DM_V_ADD(DM_V_ADD(c8, c2), DM_V_SLL(t->horz1, 3)),
+                     DM_V_SLL(DM_V_ADD(t->diag, t->horz2), 1)),
+            t->vert2);
+
+    // red or blue at green, from the same column
+    //  10 * center + 8 * vert1 - 2 * (diag + vert2) + horz2, over 16
+    *in_column = DM_V_ADD(
+            DM_V_SUB(DM_V_ADD(DM_V_ADD(c8, c2), DM_V_SLL(t->vert1, 3)),
+                     DM_V_SLL(DM_V_ADD(t->diag, t->vert2), 1)),
+            t->horz2);
+}
+
+// Apply the four malvar kernels to every lane, clamp to [0, max_val],
+// then select per lane by bayer color.
+// green_blue_row and odd_first are the parities, in pattern coordinates,
+// of the row and of the first lane's column.
+// Raw bayer values are passed through unclamped, as in the scalar kernels.
+// Division by 8 or 16 is an arithmetic shift: results only differ for
+// negative sums, which clamp to 0 either way.
+DM_V_INLINE void demosaic_simd_interpolate(
+        const demosaic_simd_taps * const t,
+        const I32 green_blue_row,
+        const I32 odd_first,
+        const dm_vec max_val,
+        dm_vec * const red, dm_vec * const green, dm_vec * const blue)
+{
+    const dm_vec zero = DM_V_SET1(0);
+    // lanes at even pattern columns
+    const dm_vec even = odd_first ? DM_V_ODD_LANES() : DM_V_EVEN_LANES();
+    dm_vec k_green;
+    dm_vec k_opposite;
+    dm_vec k_row;
+    dm_vec k_column;
+
+    demosaic_simd_kernel_sums(t, &k_green, &k_opposite, &k_row, &k_column);
+    k_green = DM_V_MIN(DM_V_MAX(DM_V_SRA(k_green, 3), zero), max_val);
+    k_opposite = DM_V_MIN(DM_V_MAX(DM_V_SRA(k_opposite, 4), zero), max_val);
+    k_row = DM_V_MIN(DM_V_MAX(DM_V_SRA(k_row, 4), zero), max_val);
+    k_column = DM_V_MIN(DM_V_MAX(DM_V_SRA(k_column, 4), zero), max_val);
+
+    if (green_blue_row) { // even lanes green, odd lanes blue
+        *red = DM_V_SELECT(even, k_column, k_opposite);
+        *green = DM_V_SELECT(even, t->center, k_green);
+        *blue = DM_V_SELECT(even, k_row, t->center);
+    } else { // even lanes red, odd lanes green
+        *red = DM_V_SELECT(even, t->center, k_row);
+        *green = DM_V_SELECT(even, k_green, t->center);
+        *blue = DM_V_SELECT(even, k_opposite, k_column);
+    }
+}
+
+// sums of the bayer pixels sampled by the malvar kernels, for
+// DM_V16_WIDTH consecutive pixels of an 8-bit image
+typedef struct {
+    dm_vec16 center;
+    dm_vec16 vert1;
+    dm_vec16 horz1;
+    dm_vec16 vert2;
+    dm_vec16 horz2;
+    dm_vec16 diag;
+} demosaic_simd16_taps;
+
+DM_V_INLINE void demosaic_simd16_load_taps8(
+        const U8 * const lines[5], const I32 col,
+        demosaic_simd16_taps * const taps)
+{
+    taps->center = DM_V16_LOAD8(&lines[2][col]);
+    taps->vert1 = DM_V16_ADD(DM_V16_LOAD8(&lines[1][col]),
+                             DM_V16_LOAD8(&lines[3][col]));
+    taps->horz1 = DM_V16_ADD(DM_V16_LOAD8(&lines[2][col - 1]),
+                             DM_V16_LOAD8(&lines[2][col + 1]));
+    taps->vert2 = DM_V16_ADD(DM_V16_LOAD8(&lines[0][col]),
+                             DM_V16_LOAD8(&lines[4][col]));
+    taps->horz2 = DM_V16_ADD(DM_V16_LOAD8(&lines[2][col - 2]),
+                             DM_V16_LOAD8(&lines[2][col + 2]));
+    taps->diag = DM_V16_ADD(
+            DM_V16_ADD(DM_V16_LOAD8(&lines[1][col - 1]),
+                       DM_V16_LOAD8(&lines[1][col + 1])),
+            DM_V16_ADD(DM_V16_LOAD8(&lines[3][col - 1]),
+                       DM_V16_LOAD8(&lines[3][col + 1])));
+}
+
+// demosaic_simd_kernel_sums() in 16-bit lanes, in the same order.
+// No intermediate can overflow, for any 8-bit pixels, so for any max_val:
+// center is at most 255, vert1, horz1, vert2 and horz2 at most 510, and
+// diag at most 1020. Each kernel adds taps with positive weights, at most
+// 12 * 255 + 4 * 1020 = 10 * 255 + 8 * 510 + 510 = 7140, and subtracts
+// those with negative weights, at most 2 * (1020 + 510) = 3 * 1020 = 3060,
+// so every partial sum is in [-3060, 7140], within [-32768, 32767].
+DM_V_INLINE void demosaic_simd16_kernel_sums(
+        const demosaic_simd16_taps * const t,
+        dm_vec16 * const green, dm_vec16 * const opposite,
+        dm_vec16 * const in_row, dm_vec16 * const in_column)
+{
+    const dm_vec16 c2 = DM_V16_SLL(t->center, 1);
+    const dm_vec16 c8 = DM_V16_SLL(t->center, 3);
+    const dm_vec16 outer = DM_V16_ADD(t->vert2, t->horz2);
+
+    *green = DM_V16_SUB(
+            DM_V16_ADD(DM_V16_SLL(t->center, 2),
+                       DM_V16_SLL(DM_V16_ADD(t->vert1, t->horz1), 1)),
+            outer);
+    *opposite = DM_V16_SUB(
+            DM_V16_ADD(DM_V16_ADD(c8, DM_V16_SLL(t->center, 2)),
+                       DM_V16_SLL(t->diag, 2)),
+            DM_V16_ADD(DM_V16_SLL(outer, 1), outer));
+    *in_row = DM_V16_ADD(
+            DM_V16_SUB(DM_V16_ADD(DM_V16_ADD(c8, c2),
+                                  DM_V16_SLL(t->horz1, 3)),
+                       DM_V16_SLL(DM_V16_ADD(t->diag, t->horz2), 1)),
+            t->vert2);
+    *in_column = DM_V16_ADD(
+            DM_V16_SUB(DM_V16_ADD(DM_V16_ADD(c8, c2),
+                                  DM_V16_SLL(t->vert1, 3)),
+                       DM_V16_SLL(DM_V16_ADD(t->diag, t->vert2), 1)),
+            t->horz2);
+}
+
+// demosaic_simd_interpolate() in 16-bit lanes, for 8-bit images
+DM_V_INLINE void demosaic_simd16_interpolate(
+        const demosaic_simd16_taps * const t,
+        const I32 green_blue_row,
+        const I32 odd_first,
+        const dm_vec16 max_val,
+        dm_vec16 * const red, dm_vec16 * const green, dm_vec16 * const blue)
+{
+    const dm_vec16 zero = DM_V16_SET1(0);
+    // lanes at even pattern columns
+    const dm_vec16 even =
+            odd_first ? DM_V16_ODD_LANES() : DM_V16_EVEN_LANES();
+    dm_vec16 k_green;
+    dm_vec16 k_opposite;
+    dm_vec16 k_row;
+    dm_vec16 k_column;
+
+    demosaic_simd16_kernel_sums(t,
+            &k_green, &k_opposite, &k_row, &k_column);
+    k_green = DM_V16_MIN(DM_V16_MAX(DM_V16_SRA(k_green, 3), zero), max_val);
+    k_opposite =
+            DM_V16_MIN(DM_V16_MAX(DM_V16_SRA(k_opposite, 4), zero), max_val);
+    k_row = DM_V16_MIN(DM_V16_MAX(DM_V16_SRA(k_row, 4), zero), max_val);
+    k_column =
+            DM_V16_MIN(DM_V16_MAX(DM_V16_SRA(k_column, 4), zero), max_val);
+
+    if (green_blue_row) { // even lanes green, odd lanes blue
+        *red = DM_V16_SELECT(even, k_column, k_opposite);
+        *green = DM_V16_SELECT(even, t->center, k_green);
+        *blue = DM_V16_SELECT(even, k_row, t->center);
+    } else { // even lanes red, odd lanes green
+        *red = DM_V16_SELECT(even, t->center, k_row);
+        *green = DM_V16_SELECT(even, k_green, t->center);
+        *blue = DM_V16_SELECT(even, k_opposite, k_column);
+    }
+}
+
+// Vectorized demosaicing of the interior of a row, starting at col.
+// Stops before the last full vector that would pass col_end,
+// and returns the column at which the scalar loops should resume.
+// lines are the five bayer rows from row-2 to row+2, output is at col.
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_rgb16(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        demosaic_pix_rgb16 output[])
+{
+    const I32 first = col;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    while (col + DM_V_WIDTH <= col_end) {
+        demosaic_simd_load_taps16(lines, col, &taps);
+        demosaic_simd_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, red);
+        DM_V_STORE(green_buf, green);
+        DM_V_STORE(blue_buf, blue);
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            output[col - first + i].red = red_buf[i];
+            output[col - first + i].green = green_buf[i];
+            output[col - first + i].blue = blue_buf[i];
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+// rgb and mono from the same kernels, for the fused rgb + mono functions
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_rgb16_mono16(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        I32 col,
+        demosaic_pix_rgb16 output_rgb_row[],
+        U16 output_mono_row[])
+{
+    const I32 ncol = args->n_cols;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    while (col + DM_V_WIDTH <= ncol - 2) {
+        demosaic_simd_load_taps16(lines, col, &taps);
+        demosaic_simd_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, red);
+        DM_V_STORE(green_buf, green);
+        DM_V_STORE(blue_buf, blue);
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            output_rgb_row[col + i].red = red_buf[i];
+            output_rgb_row[col + i].green = green_buf[i];
+            output_rgb_row[col + i].blue = blue_buf[i];
+            output_mono_row[col + i] = DM_LUMA(*coefs_normed,
+                    red_buf[i], green_buf[i], blue_buf[i]);
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+// the 8-bit kernels, in 16-bit lanes, so twice as many pixels at a time
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_rgb8(
+        const U8 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        demosaic_pix_rgb8 output[])
+{
+    const I32 first = col;
+    const dm_vec16 max_val = DM_V16_SET1(args->max_val);
+    demosaic_simd16_taps taps;
+    dm_vec16 red;
+    dm_vec16 green;
+    dm_vec16 blue;
+    U8 red_buf[DM_V16_WIDTH];
+    U8 green_buf[DM_V16_WIDTH];
+    U8 blue_buf[DM_V16_WIDTH];
+
+    while (col + DM_V16_WIDTH <= col_end) {
+        demosaic_simd16_load_taps8(lines, col, &taps);
+        demosaic_simd16_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V16_STORE8(red_buf, red);
+        DM_V16_STORE8(green_buf, green);
+        DM_V16_STORE8(blue_buf, blue);
+        for (I32 i = 0; i < DM_V16_WIDTH; i++) {
+            output[col - first + i].red = red_buf[i];
+            output[col - first + i].green = green_buf[i];
+            output[col - first + i].blue = blue_buf[i];
+        }
+        col += DM_V16_WIDTH;
+    }
+    return col;
+}
+
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_rgb16to8(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        demosaic_pix_rgb8 output[])
+{
+    const I32 first = col;
+    const I32 rshift = args->rshift;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    while (col + DM_V_WIDTH <= col_end) {
+        demosaic_simd_load_taps16(lines, col, &taps);
+        demosaic_simd_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, DM_V_SRL_VAR(red, rshift));
+        DM_V_STORE(green_buf, DM_V_SRL_VAR(green, rshift));
+        DM_V_STORE(blue_buf, DM_V_SRL_VAR(blue, rshift));
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            output[col - first + i].red = red_buf[i];
+            output[col - first + i].green = green_buf[i];
+            output[col - first + i].blue = blue_buf[i];
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+// mono variants vectorize the kernels, and apply the luma coefficients
+// per pixel in F64 in the same order as the scalar kernels
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_mono16(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        U16 output[])
+{
+    const I32 first = col;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    while (col + DM_V_WIDTH <= col_end) {
+        demosaic_simd_load_taps16(lines, col, &taps);
+        demosaic_simd_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, red);
+        DM_V_STORE(green_buf, green);
+        DM_V_STORE(blue_buf, blue);
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            output[col - first + i] = DM_LUMA(*coefs_normed,
+                    red_buf[i], green_buf[i], blue_buf[i]);
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_mono8(
+        const U8 * const lines[5],
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        U8 output[])
+{
+    const I32 first = col;
+    const dm_vec16 max_val = DM_V16_SET1(args->max_val);
+    demosaic_simd16_taps taps;
+    dm_vec16 red;
+    dm_vec16 green;
+    dm_vec16 blue;
+    U8 red_buf[DM_V16_WIDTH];
+    U8 green_buf[DM_V16_WIDTH];
+    U8 blue_buf[DM_V16_WIDTH];
+
+    while (col + DM_V16_WIDTH <= col_end) {
+        demosaic_simd16_load_taps8(lines, col, &taps);
+        demosaic_simd16_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V16_STORE8(red_buf, red);
+        DM_V16_STORE8(green_buf, green);
+        DM_V16_STORE8(blue_buf, blue);
+        for (I32 i = 0; i < DM_V16_WIDTH; i++) {
+            output[col - first + i] = DM_LUMA(*coefs_normed,
+                    red_buf[i], green_buf[i], blue_buf[i]);
+        }
+        col += DM_V16_WIDTH;
+    }
+    return col;
+}
+
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_mono16to8(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const demosaic_luma_weights * const coefs_normed,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        U8 output[])
+{
+    const I32 first = col;
+    const I32 rshift = args->rshift;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    while (col + DM_V_WIDTH <= col_end) {
+        demosaic_simd_load_taps16(lines, col, &taps);
+        demosaic_simd_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, DM_V_SRL_VAR(red, rshift));
+        DM_V_STORE(green_buf, DM_V_SRL_VAR(green, rshift));
+        DM_V_STORE(blue_buf, DM_V_SRL_VAR(blue, rshift));
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            output[col - first + i] = DM_LUMA(*coefs_normed,
+                    red_buf[i], green_buf[i], blue_buf[i]);
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+// planar variants write each channel to its own plane
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_planar16(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        U16 red_out[],
+        U16 green_out[],
+        U16 blue_out[])
+{
+    const I32 first = col;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    while (col + DM_V_WIDTH <= col_end) {
+        demosaic_simd_load_taps16(lines, col, &taps);
+        demosaic_simd_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, red);
+        DM_V_STORE(green_buf, green);
+        DM_V_STORE(blue_buf, blue);
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            red_out[col - first + i] = red_buf[i];
+            green_out[col - first + i] = green_buf[i];
+            blue_out[col - first + i] = blue_buf[i];
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_planar8(
+        const U8 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        U8 red_out[],
+        U8 green_out[],
+        U8 blue_out[])
+{
+    const I32 first = col;
+    const dm_vec16 max_val = DM_V16_SET1(args->max_val);
+    demosaic_simd16_taps taps;
+    dm_vec16 red;
+    dm_vec16 green;
+    dm_vec16 blue;
+
+    while (col + DM_V16_WIDTH <= col_end) {
+        demosaic_simd16_load_taps8(lines, col, &taps);
+        demosaic_simd16_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V16_STORE8(&red_out[col - first], red);
+        DM_V16_STORE8(&green_out[col - first], green);
+        DM_V16_STORE8(&blue_out[col - first], blue);
+        col += DM_V16_WIDTH;
+    }
+    return col;
+}
+
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_lines_planar16to8(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        U8 red_out[],
+        U8 green_out[],
+        U8 blue_out[])
+{
+    const I32 first = col;
+    const I32 rshift = args->rshift;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    while (col + DM_V_WIDTH <= col_end) {
+        demosaic_simd_load_taps16(lines, col, &taps);
+        demosaic_simd_interpolate(&taps, (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, DM_V_SRL_VAR(red, rshift));
+        DM_V_STORE(green_buf, DM_V_SRL_VAR(green, rshift));
+        DM_V_STORE(blue_buf, DM_V_SRL_VAR(blue, rshift));
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            red_out[col - first + i] = red_buf[i];
+            green_out[col - first + i] = green_buf[i];
+            blue_out[col - first + i] = blue_buf[i];
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+
+// demosaic_simd_interpolate() of taps calibrated by cal, then corrected by
+// ccm if it is not NULL.
+// Without a matrix, calibrated sums are clamped to max_val scaled by the
+// gains, and then shifted by DEMOSAIC_GAIN_BITS, the same as shifting and
+// then clamping. Products of the matrix with negative kernel outputs need
+// not clamp to 0, so with one, division rounds toward zero as the scalar
+// kernels.
+DEMOSAIC_PRIVATE DM_V_TARGET void demosaic_simd_cal_interpolate(
+        const demosaic_simd_taps * const raw,
+        const demosaic_simd_cal * const cal,
+        const demosaic_simd_ccm * const ccm,
+        const I32 green_blue_row,
+        const I32 odd_first,
+        const dm_vec max_val,
+        dm_vec * const red, dm_vec * const green, dm_vec * const blue)
+{
+    const dm_vec zero = DM_V_SET1(0);
+    demosaic_simd_taps t = *raw;
+    demosaic_simd_calibrate_taps(cal, &t);
+
+    if (ccm == NULL) {
+        const dm_vec scaled_max = DM_V_ADD(
+                DM_V_SLL(max_val, DEMOSAIC_GAIN_BITS),
+                DM_V_SET1((1 << DEMOSAIC_GAIN_BITS) - 1));
+        demosaic_simd_interpolate(&t, green_blue_row, odd_first, scaled_max,
+                red, green, blue);
+        // the lanes' own channels are unclamped until here
+        *red = DM_V_SRA(*red, DEMOSAIC_GAIN_BITS);
+        *green = DM_V_SRA(*green, DEMOSAIC_GAIN_BITS);
+        *blue = DM_V_SRA(*blue, DEMOSAIC_GAIN_BITS);
+    } else {
+        // lanes at even pattern columns
+        const dm_vec even = odd_first ? DM_V_ODD_LANES() : DM_V_EVEN_LANES();
+        const dm_vec center = DM_V_DIV_POW2(t.center, DEMOSAIC_GAIN_BITS);
+        const dm_vec half = DM_V_SET1(1 << (DEMOSAIC_CCM_BITS - 1));
+        dm_vec k_green;
+        dm_vec k_opposite;
+        dm_vec k_row;
+        dm_vec k_column;
+        dm_vec in[3];
+
+        demosaic_simd_kernel_sums(&t, &k_green, &k_opposite, &k_row,
+                &k_column);
+        k_green = DM_V_DIV_POW2(k_green, 3 + DEMOSAIC_GAIN_BITS);
+        k_opposite = DM_V_DIV_POW2(k_opposite, 4 + DEMOSAIC_GAIN_BITS);
+        k_row = DM_V_DIV_POW2(k_row, 4 + DEMOSAIC_GAIN_BITS);
+        k_column = DM_V_DIV_POW2(k_column, 4 + DEMOSAIC_GAIN_BITS);
+        if (green_blue_row) { // even lanes green, odd lanes blue
+            in[0] = DM_V_SELECT(even, k_column, k_opposite);
+            in[1] = DM_V_SELECT(even, center, k_green);
+            in[2] = DM_V_SELECT(even, k_row, center);
+        } else { // even lanes red, odd lanes green
+            in[0] = DM_V_SELECT(even, center, k_row);
+            in[1] = DM_V_SELECT(even, k_green, center);
+            in[2] = DM_V_SELECT(even, k_opposite, k_column);
+        }
+        // as demosaic_correct_rgb()
+        dm_vec * const out[3] = {red, green, blue};
+        for (I32 i = 0; i < 3; i++) {
+            *out[i] = DM_V_SRA(DM_V_ADD(DM_V_ADD(
+                    DM_V_ADD(DM_V_MUL(ccm->coef[i][0], in[0]),
+                             DM_V_MUL(ccm->coef[i][1], in[1])),
+                    DM_V_MUL(ccm->coef[i][2], in[2])), half),
+                    DEMOSAIC_CCM_BITS);
+        }
+    }
+    *red = DM_V_MIN(DM_V_MAX(*red, zero), max_val);
+    *green = DM_V_MIN(DM_V_MAX(*green, zero), max_val);
+    *blue = DM_V_MIN(DM_V_MAX(*blue, zero), max_val);
+}
+
+// Vectorized demosaicing of the interior of a row of calibrated or color
+// corrected pixels, as demosaic_simd_lines_rgb16(). Output is always rgb16,
+// for the corrected span kernels to store as their output type.
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_cal_lines16(
+        const U16 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        demosaic_pix_rgb16 output[])
+{
+    const I32 first = col;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_cal cal;
+    demosaic_simd_ccm ccm_weights;
+    const demosaic_simd_ccm * const ccm =
+            demosaic_simd_ccm_init(args, &ccm_weights);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    demosaic_simd_cal_init(args, row, col, &cal);
+    while (col + DM_V_WIDTH <= col_end) {
+        demosaic_simd_load_taps16(lines, col, &taps);
+        demosaic_simd_cal_interpolate(&taps, &cal, ccm,
+                (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, red);
+        DM_V_STORE(green_buf, green);
+        DM_V_STORE(blue_buf, blue);
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            output[col - first + i].red = red_buf[i];
+            output[col - first + i].green = green_buf[i];
+            output[col - first + i].blue = blue_buf[i];
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+DEMOSAIC_PRIVATE DM_V_TARGET I32 demosaic_simd_cal_lines8(
+        const U8 * const lines[5],
+        const demosaic_args * const args,
+        const I32 row,
+        I32 col,
+        const I32 col_end,
+        demosaic_pix_rgb16 output[])
+{
+    const I32 first = col;
+    const dm_vec max_val = DM_V_SET1(args->max_val);
+    demosaic_simd_cal cal;
+    demosaic_simd_ccm ccm_weights;
+    const demosaic_simd_ccm * const ccm =
+            demosaic_simd_ccm_init(args, &ccm_weights);
+    demosaic_simd_taps taps;
+    dm_vec red;
+    dm_vec green;
+    dm_vec blue;
+    I32 red_buf[DM_V_WIDTH];
+    I32 green_buf[DM_V_WIDTH];
+    I32 blue_buf[DM_V_WIDTH];
+
+    demosaic_simd_cal_init(args, row, col, &cal);
+    while (col + DM_V_WIDTH <= col_end) {
+        demosaic_simd_load_taps8(lines, col, &taps);
+        demosaic_simd_cal_interpolate(&taps, &cal, ccm,
+                (row + DM_ROW_OFFSET(args)) % 2,
+                (col + DM_COL_OFFSET(args)) % 2, max_val, &red, &green, &blue);
+        DM_V_STORE(red_buf, red);
+        DM_V_STORE(green_buf, green);
+        DM_V_STORE(blue_buf, blue);
+        for (I32 i = 0; i < DM_V_WIDTH; i++) {
+            output[col - first + i].red = red_buf[i];
+            output[col - first + i].green = green_buf[i];
+            output[col - first + i].blue = blue_buf[i];
+        }
+        col += DM_V_WIDTH;
+    }
+    return col;
+}
+
+// the table of this engine, for demosaic_engine_init()
+static const demosaic_engine_fns DM_V_CAT(demosaic_engine, DM_V_NAME) = {
+    DM_V_ENGINE,
+    demosaic_simd_lines_rgb16,
+    demosaic_simd_lines_rgb16_mono16,
+    demosaic_simd_lines_rgb8,
+    demosaic_simd_lines_rgb16to8,
+    demosaic_simd_lines_mono16,
+    demosaic_simd_lines_mono8,
+    demosaic_simd_lines_mono16to8,
+    demosaic_simd_lines_planar16,
+    demosaic_simd_lines_planar8,
+    demosaic_simd_lines_planar16to8,
+    demosaic_simd_cal_lines16,
+    demosaic_simd_cal_lines8,
+    DM_V_UNPACK
+};
+
+#undef demosaic_simd16_interpolate
+#undef demosaic_simd16_kernel_sums
+#undef demosaic_simd16_load_taps8
+#undef demosaic_simd16_taps
+#undef demosaic_simd_cal
+#undef demosaic_simd_cal_init
+#undef demosaic_simd_cal_interpolate
+#undef demosaic_simd_cal_lines16
+#undef demosaic_simd_cal_lines8
+#undef demosaic_simd_calibrate_taps
+#undef demosaic_simd_ccm
+#undef demosaic_simd_ccm_init
+#undef demosaic_simd_interpolate
+#undef demosaic_simd_kernel_sums
+#undef demosaic_simd_lines_mono16
+#undef demosaic_simd_lines_mono16to8
+#undef demosaic_simd_lines_mono8
+#undef demosaic_simd_lines_planar16
+#undef demosaic_simd_lines_planar16to8
+#undef demosaic_simd_lines_planar8
+#undef demosaic_simd_lines_rgb16
+#undef demosaic_simd_lines_rgb16_mono16
+#undef demosaic_simd_lines_rgb16to8
+#undef demosaic_simd_lines_rgb8
+#undef demosaic_simd_load_taps16
+#undef demosaic_simd_load_taps8
+#undef demosaic_simd_taps
+#undef DM_V_CAT_
+#undef DM_V_CAT
+#undef DM_V_SUFFIX
+#undef DM_V_NAME
+#undef DM_V_ENGINE
+#undef DM_V_TARGET
+#undef DM_V_UNPACK
+#undef dm_vec
+#undef dm_vec16
+#undef DM_V16_ADD
+#undef DM_V16_EVEN_LANES
+#undef DM_V16_LOAD8
+#undef DM_V16_MAX
+#undef DM_V16_MIN
+#undef DM_V16_ODD_LANES
+#undef DM_V16_SELECT
+#undef DM_V16_SET1
+#undef DM_V16_SLL
+#undef DM_V16_SRA
+#undef DM_V16_STORE8
+#undef DM_V16_SUB
+#undef DM_V16_WIDTH
+#undef DM_V_ADD
+#undef DM_V_DIV_POW2
+#undef DM_V_EVEN_LANES
+#undef DM_V_LOAD16
+#undef DM_V_LOAD32
+#undef DM_V_LOAD8
+#undef DM_V_MAX
+#undef DM_V_MIN
+#undef DM_V_MUL
+#undef DM_V_ODD_LANES
+#undef DM_V_SELECT
+#undef DM_V_SET1
+#undef DM_V_SLL
+#undef DM_V_SRA
+#undef DM_V_SRL_VAR
+#undef DM_V_STORE
+#undef DM_V_SUB
+#undef DM_V_WIDTH
@@ -0,0 +1,371 @@
+/***********************************************************************
+ * Copyright 2020 by the California Institute of Technology
+ * ALL RIGHTS RESERVED. United States Government Sponsorship acknowledged.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file        demosaic_span_template.h
+ * @brief       Generator for the malvar span kernels of demosaic.c
+ *
+ * Included by demosaic.c once per output type, with no include guard.
+ * Each inclusion defines demosaic_malvar_span_<DM_SPAN_NAME>(), which
+ * demosaics columns [col_begin, col_end) of a row from line pointers into
+ * output index 0 to col_end - col_begin - 1. Columns within 2 of the image
+ * edges are mirrored. Elsewhere, including at the ends of the span,
+ * neighbors are sampled from the bayer lines.
+ *
+ * The kernel body is inlined once for the common sensor depths, with
+ * max_val and rshift as constants, so the compiler can fold the clamps
+ * and shifts, and once with both read from args.
+ * demosaic_malvar_span_cal_<DM_SPAN_NAME>() demosaics calibrated or color
+ * corrected pixels in chunks, through demosaic_cal_span16() or
+ * demosaic_cal_span8(), so that the raw kernels are unchanged.
+ * Shifted spans also define demosaic_malvar_span_lut_<DM_SPAN_NAME>(),
+ * which maps chunks of demosaic_malvar_span_rgb16() through the tone curve
+ * of args, if it has one, in place of the shift.
+ *
+ * The includer defines, and this file undefines:
+ *   DM_SPAN_NAME            output type, i.e. rgb16, names the functions
+ *   DM_SPAN_BITS            16 or 8, bits of the bayer input
+ *   DM_SPAN_SHIFTED         1 if outputs are shifted right by rshift, else 0
+ *   DM_SPAN_MONO            1 if outputs are luma, taking coefs_normed, else 0
+ *   DM_SPAN_OUT_PARAMS      declarations of the output parameters
+ *   DM_SPAN_OUT_ARGS        names of the output parameters
+ *   DM_SPAN_STORE(i, px)    store rgb16 pixel px at output index i
+ *   DM_SPAN_SIMD(col, end, i)  vectorize [col, end) to output index i
+ *                           with demosaic_vector_engine, if not NULL,
+ *                           returning the column at which to resume
+ *   DM_SPAN_STORE_LUT(i, px)  if shifted, store rgb16 pixel px at output
+ *                           index i through lut, limited to max_val
+ */
+
+#define DM_SPAN_CAT_(a, b) a ## b
+#define DM_SPAN_CAT(a, b) DM_SPAN_CAT_(a, b)
+#define DM_SPAN_FN DM_SPAN_CAT(demosaic_malvar_span_, DM_SPAN_NAME)
+#define DM_SPAN_KERNEL DM_SPAN_CAT(demosaic_span_kernel_, DM_SPAN_NAME)
+#define DM_SPAN_CAL_FN DM_SPAN_CAT(demosaic_malvar_span_cal_, DM_SPAN_NAME)
+#define DM_SPAN_LUT_FN DM_SPAN_CAT(demosaic_malvar_span_lut_, DM_SPAN_NAME)
+
+#if DM_SPAN_BITS == 16
+#define DM_SPAN_IN U16
+#define DM_SPAN_LOAD demosaic_load_taps16
+#define DM_SPAN_LOAD_SAFE demosaic_load_taps16_safe
+#define DM_SPAN_CAL demosaic_cal_span16
+#else
+#define DM_SPAN_IN U8
+#define DM_SPAN_LOAD demosaic_load_taps8
+#define DM_SPAN_LOAD_SAFE demosaic_load_taps8_safe
+#define DM_SPAN_CAL demosaic_cal_span8
+#endif
+
+#if DM_SPAN_MONO
+#define DM_SPAN_WEIGHTS_PARAM \
+        const demosaic_luma_weights * const coefs_normed,
+#define DM_SPAN_WEIGHTS_ARG coefs_normed,
+#else
+#define DM_SPAN_WEIGHTS_PARAM
+#define DM_SPAN_WEIGHTS_ARG
+#endif
+
+// demosaic pairs of interior columns from col while col + 1 < end, with
+// at_even and at_odd, the kernels of the even and odd pattern columns.
+#ifdef DM_RUNNING_SUMS
+// Rather than loading the taps of each pixel, keep a window of the
+// center line at col - 2 to col + 1, and of the vertical sums of lines 1
+// and 3 at col - 1 and col, sliding it two columns per pair. Each pair
+// then loads 10 pixels rather than 22, and the diagonal and horizontal
+// taps are sums of the window, as loaded, so output is identical.
+#define DM_SPAN_PAIRS(at_even, at_odd) \
+    if (col + 1 < end) { \
+        const DM_SPAN_IN * const l0 = lines[0]; \
+        const DM_SPAN_IN * const l1 = lines[1]; \
+        const DM_SPAN_IN * const l2 = lines[2]; \
+        const DM_SPAN_IN * const l3 = lines[3]; \
+        const DM_SPAN_IN * const l4 = lines[4]; \
+        I32 center_m2 = l2[col - 2]; \
+        I32 center_m1 = l2[col - 1]; \
+        I32 center_0 = l2[col]; \
+        I32 center_p1 = l2[col + 1]; \
+        I32 vert_m1 = l1[col - 1] + l3[col - 1]; \
+        I32 vert_0 = l1[col] + l3[col]; \
+        while (col + 1 < end) { \
+            const I32 center_p2 = l2[col + 2]; \
+            const I32 center_p3 = l2[col + 3]; \
+            const I32 vert_p1 = l1[col + 1] + l3[col + 1]; \
+            const I32 vert_p2 = l1[col + 2] + l3[col + 2]; \
+            taps.center = center_0; \
+            taps.vert1 = vert_0; \
+            taps.horz1 = center_m1 + center_p1; \
+            taps.vert2 = l0[col] + l4[col]; \
+            taps.horz2 = center_m2 + center_p2; \
+            taps.diag = vert_m1 + vert_p1; \
+            DM_COUNT(clamps, at_even(&taps, max_val, &px)); \
+            DM_SPAN_STORE(col - col_begin, px); \
+            taps.center = center_p1; \
+            taps.vert1 = vert_p1; \
+            taps.horz1 = center_0 + center_p2; \
+            taps.vert2 = l0[col + 1] + l4[col + 1]; \
+            taps.horz2 = center_m1 + center_p3; \
+            taps.diag = vert_0 + vert_p2; \
+            DM_COUNT(clamps, at_odd(&taps, max_val, &px)); \
+            DM_SPAN_STORE(col + 1 - col_begin, px); \
+            center_m2 = center_0; \
+            center_m1 = center_p1; \
+            center_0 = center_p2; \
+            center_p1 = center_p3; \
+            vert_m1 = vert_p1; \
+            vert_0 = vert_p2; \
+            col += 2; \
+        } \
+    }
+#else
+#define DM_SPAN_PAIRS(at_even, at_odd) \
+    while (col + 1 < end) { \
+        DM_SPAN_LOAD(lines, col, &taps); \
+        DM_COUNT(clamps, at_even(&taps, max_val, &px)); \
+        DM_SPAN_STORE(col - col_begin, px); \
+        DM_SPAN_LOAD(lines, col + 1, &taps); \
+        DM_COUNT(clamps, at_odd(&taps, max_val, &px)); \
+        DM_SPAN_STORE(col + 1 - col_begin, px); \
+        col += 2; \
+    }
+#endif
+
+static inline void DM_SPAN_KERNEL(
+        const DM_SPAN_IN * const lines[5],
+        const demosaic_args * const args,
+        DM_SPAN_WEIGHTS_PARAM
+        const I32 row,
+        const I32 col_begin,
+        const I32 col_end,
+        DM_SPAN_OUT_PARAMS,
+        const I32 max_val,
+        const I32 rshift)
+{
+    const I32 ncol = args->n_cols;
+    const I32 pattern_row = row + DM_ROW_OFFSET(args);
+    const I32 col_off = DM_COL_OFFSET(args);
+    demosaic_taps taps;
+    demosaic_pix_rgb16 px;
+    I32 col = col_begin;
+#ifdef DM_INSTRUMENT
+    // the top and bottom two rows are one stage, with mirrored lines
+    const I32 edge_row = (row < 2 || row >= args->n_rows - 2);
+    const demosaic_stage edge_stage =
+            edge_row ? DEMOSAIC_STAGE_EDGE_ROWS : DEMOSAIC_STAGE_EDGE_COLS;
+    const demosaic_stage interior_stage =
+            edge_row ? DEMOSAIC_STAGE_EDGE_ROWS : DEMOSAIC_STAGE_INTERIOR;
+    I32 clamps = 0;
+#endif
+
+    (void) rshift;
+    while (col < col_end) {
+        I32 begin = col;
+
+        // within 2 of the left or right edge, mirror
+        if (col < 2 || col >= ncol - 2) {
+            const I32 end = (col < 2 && col_end > 2) ? 2 : col_end;
+            DM_STAGE_BEGIN(edge_stage);
+            while (col < end) {
+                DM_SPAN_LOAD_SAFE(lines, ncol, col, &taps);
+                DM_COUNT(clamps, demosaic_interpolate_taps(&taps, pattern_row,
+                        col + col_off, max_val, &px));
+                DM_SPAN_STORE(col - col_begin, px);
+                ++col;
+            }
+            DM_STAGE_END(edge_stage, col - begin);
+            DM_STAGE_CLAMPS(edge_stage, clamps);
+#ifdef DM_INSTRUMENT
+            clamps = 0;
+#endif
+            continue;
+        }
+
+        // interior, up to the right edge or end of span
+        const I32 end = (col_end < ncol - 2) ? col_end : ncol - 2;
+        DM_STAGE_BEGIN(interior_stage);
+#ifdef DM_SIMD
+        if (demosaic_vector_engine != NULL) {
+            col = DM_SPAN_SIMD(col, end, col - col_begin);
+        }
+#endif
+        const I32 scalar_begin = col;
+        // align to an even column of the pattern
+        if (col < end && ((col + col_off) % 2) != 0) {
+            DM_SPAN_LOAD(lines, col, &taps);
+            DM_COUNT(clamps, demosaic_interpolate_taps(&taps, pattern_row,
+                    col + col_off, max_val, &px));
+            DM_SPAN_STORE(col - col_begin, px);
+            ++col;
+        }
+        // pixel pairs, with only the kernels each color needs
+        if ((pattern_row % 2) == 0) { // red-green row
+            DM_SPAN_PAIRS(demosaic_taps_at_red, demosaic_taps_at_green_rg);
+        } else { // green-blue row
+            DM_SPAN_PAIRS(demosaic_taps_at_green_gb, demosaic_taps_at_blue);
+        }
+        if (col < end) {
+            DM_SPAN_LOAD(lines, col, &taps);
+            DM_COUNT(clamps, demosaic_interpolate_taps(&taps, pattern_row,
+                    col + col_off, max_val, &px));
+            DM_SPAN_STORE(col - col_begin, px);
+            ++col;
+        }
+        DM_STAGE_END(interior_stage, col - begin);
+#ifdef DM_INSTRUMENT
+        // the vector kernels do not count clamps, so recount their
+        // columns, after timing
+        while (begin < scalar_begin) {
+            DM_SPAN_LOAD(lines, begin, &taps);
+            clamps += demosaic_interpolate_taps(&taps, pattern_row,
+                    begin + col_off, max_val, &px);
+            ++begin;
+        }
+#else
+        (void) scalar_begin;
+#endif
+        DM_STAGE_CLAMPS(interior_stage, clamps);
+#ifdef DM_INSTRUMENT
+        clamps = 0;
+#endif
+    }
+}
+
+// the span with corrected pixels, demosaiced in chunks of rgb16 pixels
+// by demosaic_cal_span16() or demosaic_cal_span8()
+DEMOSAIC_PRIVATE void DM_SPAN_CAL_FN(
+        const DM_SPAN_IN * const lines[5],
+        const demosaic_args * const args,
+        DM_SPAN_WEIGHTS_PARAM
+        const I32 row,
+        const I32 col_begin,
+        const I32 col_end,
+        DM_SPAN_OUT_PARAMS)
+{
+    const I32 rshift = args->rshift;
+    demosaic_pix_rgb16 chunk[DM_SPAN_CHUNK];
+    I32 col = col_begin;
+
+    (void) rshift;
+    while (col < col_end) {
+        const I32 end = (col_end - col < DM_SPAN_CHUNK)
+                ? col_end : col + DM_SPAN_CHUNK;
+        DM_SPAN_CAL(lines, args, row, col, end, chunk);
+        for (I32 i = 0; i < end - col; i++) {
+            DM_SPAN_STORE(col - col_begin + i, chunk[i]);
+        }
+        col = end;
+    }
+}
+
+#if DM_SPAN_SHIFTED
+// the span through the tone curve of args, from chunks of rgb16 pixels
+// demosaiced by demosaic_malvar_span_rgb16()
+DEMOSAIC_PRIVATE void DM_SPAN_LUT_FN(
+        const DM_SPAN_IN * const lines[5],
+        const demosaic_args * const args,
+        DM_SPAN_WEIGHTS_PARAM
+        const I32 row,
+        const I32 col_begin,
+        const I32 col_end,
+        DM_SPAN_OUT_PARAMS)
+{
+    const U8 * const lut = args->lut;
+    const I32 max_val = args->max_val;
+    demosaic_pix_rgb16 chunk[DM_SPAN_CHUNK];
+    I32 col = col_begin;
+
+    while (col < col_end) {
+        const I32 end = (col_end - col < DM_SPAN_CHUNK)
+                ? col_end : col + DM_SPAN_CHUNK;
+        demosaic_malvar_span_rgb16(lines, args, row, col, end, chunk);
+        for (I32 i = 0; i < end - col; i++) {
+            DM_SPAN_STORE_LUT(col - col_begin + i, chunk[i]);
+        }
+        col = end;
+    }
+}
+#endif
+
+DEMOSAIC_PRIVATE void DM_SPAN_FN(
+        const DM_SPAN_IN * const lines[5],
+        const demosaic_args * const args,
+        DM_SPAN_WEIGHTS_PARAM
+        const I32 row,
+        const I32 col_begin,
+        const I32 col_end,
+        DM_SPAN_OUT_PARAMS)
+{
+    const I32 max_val = args->max_val;
+    const I32 rshift = args->rshift;
+
+#if DM_SPAN_SHIFTED
+    if (args->lut != NULL) {
+        DM_SPAN_LUT_FN(lines, args, DM_SPAN_WEIGHTS_ARG row, col_begin,
+                col_end, DM_SPAN_OUT_ARGS);
+        return;
+    }
+#endif
+    if (DM_CORRECTED(args)) {
+        DM_SPAN_CAL_FN(lines, args, DM_SPAN_WEIGHTS_ARG row, col_begin,
+                col_end, DM_SPAN_OUT_ARGS);
+        return;
+    }
+    // specialize for common sensor depths, shifted to 8 bits if shifting
+#if DM_SPAN_BITS == 16
+    if (max_val == 0x0FFF && (!DM_SPAN_SHIFTED || rshift == 4)) {
+        DM_SPAN_KERNEL(lines, args, DM_SPAN_WEIGHTS_ARG row, col_begin,
+                col_end, DM_SPAN_OUT_ARGS, 0x0FFF, 4);
+    } else if (max_val == 0x03FF && (!DM_SPAN_SHIFTED || rshift == 2)) {
+        DM_SPAN_KERNEL(lines, args, DM_SPAN_WEIGHTS_ARG row, col_begin,
+                col_end, DM_SPAN_OUT_ARGS, 0x03FF, 2);
+    } else if (max_val == 0x3FFF && (!DM_SPAN_SHIFTED || rshift == 6)) {
+        DM_SPAN_KERNEL(lines, args, DM_SPAN_WEIGHTS_ARG row, col_begin,
+                col_end, DM_SPAN_OUT_ARGS, 0x3FFF, 6);
+    } else {
+        DM_SPAN_KERNEL(lines, args, DM_SPAN_WEIGHTS_ARG row, col_begin,
+                col_end, DM_SPAN_OUT_ARGS, max_val, rshift);
+    }
+#else
+    if (max_val == U8_MAX) {
+        DM_SPAN_KERNEL(lines, args, DM_SPAN_WEIGHTS_ARG row, col_begin,
+                col_end, DM_SPAN_OUT_ARGS, U8_MAX, 0);
+    } else {
+        DM_SPAN_KERNEL(lines, args, DM_SPAN_WEIGHTS_ARG row, col_begin,
+                col_end, DM_SPAN_OUT_ARGS, max_val, rshift);
+    }
+#endif
+}
+
+#undef DM_SPAN_CAT_
+#undef DM_SPAN_CAT
+#undef DM_SPAN_FN
+#undef DM_SPAN_KERNEL
+#undef DM_SPAN_CAL_FN
+#undef DM_SPAN_LUT_FN
+#undef DM_SPAN_IN
+#undef DM_SPAN_LOAD
+#undef DM_SPAN_LOAD_SAFE
+#undef DM_SPAN_CAL
+#undef DM_SPAN_PAIRS
+#undef DM_SPAN_WEIGHTS_PARAM
+#undef DM_SPAN_WEIGHTS_ARG
+#undef DM_SPAN_NAME
+#undef DM_SPAN_BITS
+#undef DM_SPAN_SHIFTED
+#undef DM_SPAN_MONO
+#undef DM_SPAN_OUT_PARAMS
+#undef DM_SPAN_OUT_ARGS
+#undef DM_SPAN_STORE
+#undef DM_SPAN_STORE_LUT
+#undef DM_SPAN_SIMD
@@ -0,0 +1,93 @@
+/***********************************************************************
+ * Copyright 2020 by the California Institute of Technology
+ * ALL RIGHTS RESERVED. United States Government Sponsorship acknowledged.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file        demosaic_subsample_template.h
+ * @brief       Generator for the subsampling spans of demosaic.c
+ *
+ * Included by demosaic.c once per output type, with no include guard.
+ * Each inclusion defines demosaic_subsample_span_<DM_SUBSAMPLE_NAME>(),
+ * which subsamples each 2x2 quad of a pair of bayer rows, top and bottom,
+ * into one output pixel, calibrated and color corrected as args asks.
+ *
+ * The includer defines, and this file undefines:
+ *   DM_SUBSAMPLE_NAME          output type, i.e. rgb16, names the function
+ *   DM_SUBSAMPLE_BITS          16 or 8, bits of the bayer input
+ *   DM_SUBSAMPLE_MONO          1 if outputs are luma, taking coefs_normed,
+ *                              else 0
+ *   DM_SUBSAMPLE_OUT           type of an output pixel
+ *   DM_SUBSAMPLE_STORE(i, rgb) store the I32 red, green and blue of rgb
+ *                              at output index i
+ */
+
+#define DM_SUBSAMPLE_CAT_(a, b) a ## b
+#define DM_SUBSAMPLE_CAT(a, b) DM_SUBSAMPLE_CAT_(a, b)
+#define DM_SUBSAMPLE_FN \
+    DM_SUBSAMPLE_CAT(demosaic_subsample_span_, DM_SUBSAMPLE_NAME)
+
+#if DM_SUBSAMPLE_BITS == 16
+#define DM_SUBSAMPLE_IN U16
+#else
+#define DM_SUBSAMPLE_IN U8
+#endif
+
+#if DM_SUBSAMPLE_MONO
+#define DM_SUBSAMPLE_WEIGHTS_PARAM \
+    const demosaic_luma_weights * const coefs_normed,
+#else
+#define DM_SUBSAMPLE_WEIGHTS_PARAM
+#endif
+
+DEMOSAIC_PRIVATE void DM_SUBSAMPLE_FN(
+        const DM_SUBSAMPLE_IN * const top,
+        const DM_SUBSAMPLE_IN * const bottom,
+        const demosaic_args * const args,
+        DM_SUBSAMPLE_WEIGHTS_PARAM
+        DM_SUBSAMPLE_OUT output[])
+{
+    const I32 row_off = DM_ROW_OFFSET(args);
+    const I32 col_off = DM_COL_OFFSET(args);
+    const DM_SUBSAMPLE_IN * const reds = &(row_off ? bottom : top)[col_off];
+    const DM_SUBSAMPLE_IN * const blues =
+            &(row_off ? top : bottom)[1 - col_off];
+    // greens are on the diagonal of the quad if row and column offsets differ
+    const I32 green_off = (row_off + col_off) % 2;
+    const DM_SUBSAMPLE_IN * const greens_top = &top[1 - green_off];
+    const DM_SUBSAMPLE_IN * const greens_bottom = &bottom[green_off];
+    const I32 n_out = args->n_cols / 2;
+    const I32 max_val = args->max_val;
+    demosaic_cal_weights weights;
+    const demosaic_cal_weights * const cal =
+            demosaic_cal_weights_init(args, &weights);
+    for (I32 i = 0; i < n_out; i++) {
+        I32 quad[4] = {reds[2 * i], greens_top[2 * i], greens_bottom[2 * i],
+                blues[2 * i]};
+        I32 rgb[3];
+        demosaic_subsample_calibrate(cal, row_off, max_val, quad);
+        demosaic_subsample_rgb(args->ccm, max_val, quad, rgb);
+        DM_SUBSAMPLE_STORE(i, rgb);
+    }
+}
+
+#undef DM_SUBSAMPLE_CAT_
+#undef DM_SUBSAMPLE_CAT
+#undef DM_SUBSAMPLE_FN
+#undef DM_SUBSAMPLE_IN
+#undef DM_SUBSAMPLE_WEIGHTS_PARAM
+#undef DM_SUBSAMPLE_NAME
+#undef DM_SUBSAMPLE_BITS
+#undef DM_SUBSAMPLE_MONO
+#undef DM_SUBSAMPLE_OUT
+#undef DM_SUBSAMPLE_STORE
@@ -4,8 +4,13 @@
 
 #include "gtest/gtest.h"
 #include <time.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
 
 #include <demosaic/demosaic_pub.h>
+#include <demosaic/demosaic_file_pub.h>
+#include <demosaic/demosaic_conf_private.h>
 
 extern "C"
 {
@@ -49,18 +54,56 @@ extern void demosaic_malvar_row_mono16to8_unoptimized(
         U8 output_row[]);
 } // extern C
 
-#define ABS(x) ( (x < 0) ? -(x) : (x) )
+// tallies of the instrumentation hooks of demosaic_test_private.h, by stage
+struct stage_tally {
+    int n_begin;
+    int n_end;
+    long n_pixels;
+    long n_clamped;
+    clock_t start;
+    clock_t ticks;
+    bool open;
+};
+stage_tally stage_tallies[4];
+int stage_overlaps = 0;
+
+extern "C" void demosaic_test_stage_begin(int stage)
+{
+    // stages other than the image may not overlap
+    for (int other = DEMOSAIC_STAGE_EDGE_ROWS; other < 4; other++) {
+        if (stage != DEMOSAIC_STAGE_IMAGE && stage_tallies[other].open) {
+            stage_overlaps++;
+        }
+    }
+    stage_tallies[stage].n_begin++;
+    stage_tallies[stage].open = true;
+    stage_tallies[stage].start = clock();
+}
+
+extern "C" void demosaic_test_stage_end(int stage, int n_pixels)
+{
+    stage_tallies[stage].ticks += clock() - stage_tallies[stage].start;
+    stage_tallies[stage].n_end++;
+    stage_tallies[stage].n_pixels += n_pixels;
+    stage_tallies[stage].open = false;
+}
 
-double time_rgb_unoptimized = 0;
-double time_rgb_optimized = 0;
-double time_mono_unoptimized = 0;
-double time_mono_optimized = 0;
+extern "C" void demosaic_test_stage_clamps(int stage, int n_clamped)
+{
+    stage_tallies[stage].n_clamped += n_clamped;
+}
+
+void reset_stage_tallies(void)
+{
+    memset(stage_tallies, 0, sizeof(stage_tallies));
+    stage_overlaps = 0;
+}
+
+#define ABS(x) ( (x < 0) ? -(x) : (x) )
 
 // whether to print image buffers
 bool print_images = true;
 
-int performance_iters = 5;
-
 demosaic_pix_rgb16 * image_truth16;
 demosaic_pix_rgb8 * image_truth8;
 U16 * bayer16;
@@ -224,33 +267,22 @@ void do_demosaicing(
     demosaic_args args8 = *args;
     args8.max_val = 0xFF;
 
-    clock_t t;
-
-    t = clock();
     demosaic_malvar_rgb16(bayer16, args, image_out_rgb16);
-    t = clock() - t;
-    time_rgb_optimized += ((double)t)/CLOCKS_PER_SEC;
 
     demosaic_malvar_rgb8(bayer8, &args8, image_out_rgb8);
 
     demosaic_malvar_rgb16to8(bayer16, args, image_out_rgb8from16);
 
-    t = clock();
     demosaic_malvar_mono16(bayer16, args, image_out_mono16);
-    t = clock() - t;
-    time_mono_optimized += ((double) t) / CLOCKS_PER_SEC;
 
     demosaic_malvar_mono8(bayer8, &args8, image_out_mono8);
 
     demosaic_malvar_mono16to8(bayer16, args, image_out_mono8from16);
 
-    t = clock();
     for (int row = 0; row < args->n_rows; row++) {
         demosaic_malvar_row_rgb16_unoptimized(bayer16, args, row,
                 &image_out_rgb16_unopt[row * args->n_cols]);
     }
-    t = clock() - t;
-    time_rgb_unoptimized += ((double)t)/CLOCKS_PER_SEC;
 
     for (int row = 0; row < args->n_rows; row++) {
         demosaic_malvar_row_rgb8_unoptimized(bayer8, &args8, row,
@@ -263,13 +295,10 @@ void do_demosaicing(
     }
 
 
-    t = clock();
     for (int row = 0; row < args->n_rows; row++) {
         demosaic_malvar_row_mono16_unoptimized(bayer16, args, row,
                 &image_out_mono16_unopt[row * args->n_cols]);
     }
-    t = clock() - t;
-    time_mono_unoptimized += ((double) t) / CLOCKS_PER_SEC;
 
     for (int row = 0; row < args->n_rows; row++) {
         demosaic_malvar_row_mono8_unoptimized(bayer8, &args8, row,
@@ -515,6 +544,9 @@ void do_demosaicing(
     }
 }
 
+void check_optimized_matches_unoptimized(
+        demosaic_args * args);
+
 // test optimized and unoptimized functions returned same values,
 // and that values are less thatn error bound
 void check_demosaicing_error(
@@ -779,10 +811,16 @@ void check_demosaicing_error(
             max_error, max_error_row, max_error_col);
     EXPECT_LE(rms_error, rms_error_bound/16.0);
 
+    check_optimized_matches_unoptimized(args);
+}
 
+// test optimized and unoptimized functions returned same values
+void check_optimized_matches_unoptimized(
+        demosaic_args * args) {
 
+    int n_rows = args->n_rows;
+    int n_cols = args->n_cols;
 
-    // check optimized and unoptimized return the same values
     for (int row = 0; row < n_rows; row++) {
         for (int col = 0; col < n_cols; col++) {
             if ((image_out_rgb16_unopt[row * n_cols + col].red !=
@@ -896,11 +934,8 @@ TEST(DemosaicTest, SingleColors) {
     alloc_global_bufs(n_rows, n_cols);
 
     demosaic_args args;
-    args.n_rows = n_rows;
-    args.n_cols = n_cols;
-    args.max_val = max_val;
+    demosaic_args_init(&args, n_rows, n_cols, max_val);
     args.rshift = 4;
-    args.coefs = {0.299, 0.587, 0.114};    // ccir 601 formula
 
     printf("\nall black image\n");
     test_demosaicing_single_color(0,0,0, &args);
@@ -942,11 +977,8 @@ TEST(DemosaicTest, Random) {
     alloc_global_bufs(n_rows, n_cols);
 
     demosaic_args args;
-    args.n_rows = n_rows;
-    args.n_cols = n_cols;
-    args.max_val = max_val;
+    demosaic_args_init(&args, n_rows, n_cols, max_val);
     args.rshift = 4;
-    args.coefs = {0.299, 0.587, 0.114};     // ccir 601 formula
 
     test_demosaicing_random_image(&args);
 
@@ -954,257 +986,2538 @@ TEST(DemosaicTest, Random) {
 
 }
 
-TEST(DemosaicTest, Performance) {
-    int n_rows = 960;
-    int n_cols = 960;
-    int n_pix = n_rows*n_cols;
+// vectorized interiors process several pixels at a time, and leave
+// a remainder to the scalar loops that depends on the image width
+TEST(DemosaicTest, InteriorWidths) {
+    int n_rows = 8;
     unsigned int max_val = 0x0FFF;
+    bool print_images_prev = print_images;
+    print_images = false;
 
-    alloc_global_bufs(n_rows, n_cols);
+    for (int n_cols = 4; n_cols <= 40; n_cols += 2) {
+        alloc_global_bufs(n_rows, n_cols);
 
-    demosaic_args args;
-    args.n_rows = n_rows;
-    args.n_cols = n_cols;
-    args.max_val = max_val;
-    args.rshift = 4;
-    args.coefs = {0.299, 0.587, 0.114}; // ccir 601 formula
-
-    time_rgb_unoptimized = 0;
-    time_rgb_optimized = 0;
-    time_mono_unoptimized = 0;
-    time_mono_optimized = 0;
-    for (int i = 0; i < performance_iters; i++) {
-        test_demosaicing_random_image(&args);
-    }
-    time_rgb_unoptimized = time_rgb_unoptimized/performance_iters;
-    time_rgb_optimized = time_rgb_optimized/performance_iters;
-    time_mono_unoptimized = time_mono_unoptimized/performance_iters;
-    time_mono_optimized = time_mono_optimized/performance_iters;
-
-    printf("average times: rgb unopt: %f s, rgb opt: %f s, %f x speedup. "
-            "mono unopt: %f s, mono opt: %f s, %f x speedup.\n",
-            time_rgb_unoptimized, time_rgb_optimized,
-            time_rgb_unoptimized/time_rgb_optimized,
-            time_mono_unoptimized, time_mono_optimized,
-            time_mono_unoptimized/ time_mono_optimized);
+        demosaic_args args;
+        demosaic_args_init(&args, n_rows, n_cols, max_val);
+        args.rshift = 4;
 
-    free_global_bufs();
+        make_random_input(&args);
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+
+        free_global_bufs();
+    }
+
+    print_images = print_images_prev;
 }
 
+// images with only border rows, or few interior rows, for every pattern,
+// so top and bottom rows through the span kernels match the reference
+TEST(DemosaicTest, BorderRows) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    demosaic_pattern patterns[] = {
+            DEMOSAIC_RGGB, DEMOSAIC_GRBG, DEMOSAIC_GBRG, DEMOSAIC_BGGR};
+    for (int n_rows = 2; n_rows <= 6; n_rows += 2) {
+        for (int n_cols = 2; n_cols <= 26; n_cols += 6) {
+            alloc_global_bufs(n_rows, n_cols);
+            for (int p = 0; p < 4; p++) {
+                demosaic_args args;
+                demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+                args.pattern = patterns[p];
+
+                make_random_input(&args);
+                do_demosaicing(&args);
+                check_optimized_matches_unoptimized(&args);
+            }
+            free_global_bufs();
+        }
+    }
 
-TEST(DemosaicTest, Image) {
+    print_images = print_images_prev;
+}
 
-    int n_cols = 0;
-    int n_rows = 0;
-    uint32_t* frog_image = NULL;
+// run jobs one after another on the calling thread
+void serial_dispatch(void * pool_context, demosaic_job_fn job,
+        void * job_context, I32 n_jobs)
+{
+    int * n_calls = (int *) pool_context;
+    for (I32 i = 0; i < n_jobs; i++) {
+        job(job_context, i);
+        (*n_calls)++;
+    }
+}
 
+// run each job on its own thread
+void thread_dispatch(void * pool_context, demosaic_job_fn job,
+        void * job_context, I32 n_jobs)
+{
+    (void) pool_context;
+    std::vector<std::thread> threads;
+    for (I32 i = 0; i < n_jobs; i++) {
+        threads.push_back(std::thread(job, job_context, i));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
 
-    frog_image = (uint32_t*) ReadImage(&n_cols, &n_rows,
-            "../test/frog.bmp", IMAGEIO_U8 | IMAGEIO_RGBA);
+// parallel bands must match the serial whole-image functions
+void check_parallel_matches_serial(
+        demosaic_args * args,
+        demosaic_dispatcher * dispatcher)
+{
+    int n_pix = args->n_rows * args->n_cols;
+    demosaic_args args8 = *args;
+    args8.max_val = 0xFF;
 
-    ASSERT_TRUE(frog_image != NULL);
+    std::vector<demosaic_pix_rgb16> rgb16(n_pix);
+    std::vector<demosaic_pix_rgb8> rgb8(n_pix);
+    std::vector<demosaic_pix_rgb8> rgb8from16(n_pix);
+    std::vector<U16> mono16(n_pix);
+    std::vector<U8> mono8(n_pix);
+    std::vector<U8> mono8from16(n_pix);
+
+    demosaic_malvar_rgb16_parallel(bayer16, args, dispatcher, &rgb16[0]);
+    demosaic_malvar_rgb8_parallel(bayer8, &args8, dispatcher, &rgb8[0]);
+    demosaic_malvar_rgb16to8_parallel(bayer16, args, dispatcher,
+            &rgb8from16[0]);
+    demosaic_malvar_mono16_parallel(bayer16, args, dispatcher, &mono16[0]);
+    demosaic_malvar_mono8_parallel(bayer8, &args8, dispatcher, &mono8[0]);
+    demosaic_malvar_mono16to8_parallel(bayer16, args, dispatcher,
+            &mono8from16[0]);
+
+    EXPECT_EQ(0, memcmp(&rgb16[0], image_out_rgb16,
+            n_pix * sizeof(demosaic_pix_rgb16)));
+    EXPECT_EQ(0, memcmp(&rgb8[0], image_out_rgb8,
+            n_pix * sizeof(demosaic_pix_rgb8)));
+    EXPECT_EQ(0, memcmp(&rgb8from16[0], image_out_rgb8from16,
+            n_pix * sizeof(demosaic_pix_rgb8)));
+    EXPECT_EQ(0, memcmp(&mono16[0], image_out_mono16, n_pix * sizeof(U16)));
+    EXPECT_EQ(0, memcmp(&mono8[0], image_out_mono8, n_pix * sizeof(U8)));
+    EXPECT_EQ(0, memcmp(&mono8from16[0], image_out_mono8from16,
+            n_pix * sizeof(U8)));
+}
 
-    printf("width = %d, height = %d\n", n_cols, n_rows);
+TEST(DemosaicTest, Parallel) {
+    int n_rows = 480;
+    int n_cols = 480;
+    unsigned int max_val = 0x0FFF;
+    bool print_images_prev = print_images;
+    print_images = false;
 
     alloc_global_bufs(n_rows, n_cols);
 
-    demosaic_pix_rgb8 * image_mosaic = (demosaic_pix_rgb8*) malloc(
-            n_rows * n_cols * sizeof(demosaic_pix_rgb8));
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, max_val);
+    args.rshift = 4;
 
-    // make inputs
+    make_random_input(&args);
+    do_demosaicing(&args);
 
-    for (int row = 0; row < n_rows; row++) {
-        for (int col = 0; col < n_cols; col++) {
-            U8* u8p = (U8*)(&frog_image[row*n_cols+col]);
-            U8 red = u8p[0];
-            U8 green = u8p[1];
-            U8 blue = u8p[2];
-            image_truth16[(row * n_cols) + col].red = (U16)red << 4;
-            image_truth16[(row * n_cols) + col].green = (U16)green << 4;
-            image_truth16[(row * n_cols) + col].blue = (U16)blue << 4;
-            image_truth8[(row * n_cols) + col].red = red;
-            image_truth8[(row * n_cols) + col].green = green;
-            image_truth8[(row * n_cols) + col].blue = blue;
-            image_mosaic[(row * n_cols) + col].red = 0;
-            image_mosaic[(row * n_cols) + col].green = 0;
-            image_mosaic[(row * n_cols) + col].blue = 0;
-            if (row % 2 == 0 && col % 2 == 0) {
-                bayer16[(row * n_cols) + col] = (U16)red << 4;
-                bayer8[(row * n_cols) + col] = red;
-                image_mosaic[(row * n_cols) + col].red = red;
-            } else if (row % 2 == 1 && col % 2 == 1) {
-                bayer16[(row * n_cols) + col] = (U16)blue << 4;
-                bayer8[(row * n_cols) + col] = blue;
-                image_mosaic[(row * n_cols) + col].blue = blue;
-            } else {
-                bayer16[(row * n_cols) + col] = (U16)green << 4;
-                bayer8[(row * n_cols) + col] = green;
-                image_mosaic[(row * n_cols) + col].green = green;
-            }
-        }
+    // bands that divide the rows evenly, unevenly,
+    // one row each, and more bands than rows
+    int band_counts[] = {1, 2, 7, 480, 500};
+    for (int n_bands : band_counts) {
+        int n_calls = 0;
+        demosaic_dispatcher serial = {serial_dispatch, &n_calls, n_bands};
+        check_parallel_matches_serial(&args, &serial);
+        EXPECT_EQ(n_calls, 6 * n_bands);
     }
 
-    int ret;
-    ret = WriteImage(image_truth8,n_cols,n_rows, "frog_check.bmp",
-            IMAGEIO_U8 | IMAGEIO_RGB, 85);
-    ASSERT_EQ(ret, 1);
-    ret = WriteImage(image_mosaic,n_cols,n_rows, "frog_mosaic_rgb.bmp",
-            IMAGEIO_U8 | IMAGEIO_RGB, 85);
-    ASSERT_EQ(ret, 1);
-    ret = WriteImage(bayer8,n_cols,n_rows, "frog_mosaic_gray.bmp",
-            IMAGEIO_U8 | IMAGEIO_GRAYSCALE, 85);
-    ASSERT_EQ(ret, 1);
+    demosaic_dispatcher threaded = {thread_dispatch, NULL, 4};
+    check_parallel_matches_serial(&args, &threaded);
 
-    demosaic_args args;
-    args.n_rows = n_rows;
-    args.n_cols = n_cols;
-    args.max_val = 0xFFF;
-    args.rshift = 4;
-    args.coefs = {0.299, 0.587, 0.114}; // ccir 601 formula
+    free_global_bufs();
+    print_images = print_images_prev;
+}
 
+// batches of frames must match the plan function of each frame
+void check_batch_matches_plan(
+        const demosaic_plan * plan,
+        const demosaic_plan * plan8,
+        const std::vector<std::vector<U16> > & frames16,
+        const std::vector<std::vector<U8> > & frames8,
+        const demosaic_dispatcher * dispatcher)
+{
+    int n_frames = (int) frames16.size();
+    int n_pix = plan->args.n_rows * plan->args.n_cols;
+    std::vector<const U16 *> in16(n_frames);
+    std::vector<const U8 *> in8(n_frames);
+    std::vector<std::vector<demosaic_pix_rgb16> > rgb16(n_frames,
+            std::vector<demosaic_pix_rgb16>(n_pix));
+    std::vector<std::vector<demosaic_pix_rgb8> > rgb8(n_frames,
+            std::vector<demosaic_pix_rgb8>(n_pix));
+    std::vector<std::vector<demosaic_pix_rgb8> > rgb8from16(n_frames,
+            std::vector<demosaic_pix_rgb8>(n_pix));
+    std::vector<std::vector<U16> > mono16(n_frames, std::vector<U16>(n_pix));
+    std::vector<std::vector<U8> > mono8(n_frames, std::vector<U8>(n_pix));
+    std::vector<std::vector<U8> > mono8from16(n_frames,
+            std::vector<U8>(n_pix));
+    std::vector<demosaic_pix_rgb16 *> out_rgb16(n_frames);
+    std::vector<demosaic_pix_rgb8 *> out_rgb8(n_frames);
+    std::vector<demosaic_pix_rgb8 *> out_rgb8from16(n_frames);
+    std::vector<U16 *> out_mono16(n_frames);
+    std::vector<U8 *> out_mono8(n_frames);
+    std::vector<U8 *> out_mono8from16(n_frames);
+    for (int i = 0; i < n_frames; i++) {
+        in16[i] = &frames16[i][0];
+        in8[i] = &frames8[i][0];
+        out_rgb16[i] = &rgb16[i][0];
+        out_rgb8[i] = &rgb8[i][0];
+        out_rgb8from16[i] = &rgb8from16[i][0];
+        out_mono16[i] = &mono16[i][0];
+        out_mono8[i] = &mono8[i][0];
+        out_mono8from16[i] = &mono8from16[i][0];
+    }
 
-    do_demosaicing(&args);
+    demosaic_malvar_rgb16_batch(&in16[0], plan, dispatcher, n_frames,
+            &out_rgb16[0]);
+    demosaic_malvar_rgb8_batch(&in8[0], plan8, dispatcher, n_frames,
+            &out_rgb8[0]);
+    demosaic_malvar_rgb16to8_batch(&in16[0], plan, dispatcher, n_frames,
+            &out_rgb8from16[0]);
+    demosaic_malvar_mono16_batch(&in16[0], plan, dispatcher, n_frames,
+            &out_mono16[0]);
+    demosaic_malvar_mono8_batch(&in8[0], plan8, dispatcher, n_frames,
+            &out_mono8[0]);
+    demosaic_malvar_mono16to8_batch(&in16[0], plan, dispatcher, n_frames,
+            &out_mono8from16[0]);
+
+    std::vector<demosaic_pix_rgb16> expect_rgb16(n_pix);
+    std::vector<demosaic_pix_rgb8> expect_rgb8(n_pix);
+    std::vector<U16> expect_mono16(n_pix);
+    std::vector<U8> expect_mono8(n_pix);
+    for (int i = 0; i < n_frames; i++) {
+        demosaic_malvar_rgb16_plan(in16[i], plan, &expect_rgb16[0]);
+        EXPECT_EQ(0, memcmp(&expect_rgb16[0], &rgb16[i][0],
+                n_pix * sizeof(demosaic_pix_rgb16)));
+        demosaic_malvar_rgb8_plan(in8[i], plan8, &expect_rgb8[0]);
+        EXPECT_EQ(0, memcmp(&expect_rgb8[0], &rgb8[i][0],
+                n_pix * sizeof(demosaic_pix_rgb8)));
+        demosaic_malvar_rgb16to8_plan(in16[i], plan, &expect_rgb8[0]);
+        EXPECT_EQ(0, memcmp(&expect_rgb8[0], &rgb8from16[i][0],
+                n_pix * sizeof(demosaic_pix_rgb8)));
+        demosaic_malvar_mono16_plan(in16[i], plan, &expect_mono16[0]);
+        EXPECT_EQ(0, memcmp(&expect_mono16[0], &mono16[i][0],
+                n_pix * sizeof(U16)));
+        demosaic_malvar_mono8_plan(in8[i], plan8, &expect_mono8[0]);
+        EXPECT_EQ(0, memcmp(&expect_mono8[0], &mono8[i][0],
+                n_pix * sizeof(U8)));
+        demosaic_malvar_mono16to8_plan(in16[i], plan, &expect_mono8[0]);
+        EXPECT_EQ(0, memcmp(&expect_mono8[0], &mono8from16[i][0],
+                n_pix * sizeof(U8)));
+    }
+}
 
-    // frog image has some test patterns meant to generate artifacts
-    check_demosaicing_error(&args, 1000);
+TEST(DemosaicTest, Batch) {
+    int n_rows = 68;
+    int n_cols = 90;
+    int n_pix = n_rows * n_cols;
+    int n_frames = 5;
+    bool print_images_prev = print_images;
+    print_images = false;
 
-    ret = WriteImage(image_out_rgb8,n_cols,n_rows, "frog_demosaic_rgb.bmp",
-            IMAGEIO_U8 | IMAGEIO_RGB, 85);
-    ASSERT_EQ(ret, 1);
-    ret = WriteImage(image_out_mono8,n_cols,n_rows, "frog_demosaic_gray.bmp",
-            IMAGEIO_U8 | IMAGEIO_GRAYSCALE, 85);
-    ASSERT_EQ(ret, 1);
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+    args.pattern = DEMOSAIC_GBRG;
+    demosaic_args args8 = args;
+    args8.max_val = 0xFF;
+    demosaic_plan plan;
+    demosaic_plan plan8;
+    demosaic_plan_init(&plan, &args);
+    demosaic_plan_init(&plan8, &args8);
+
+    // a burst of different frames with the same arguments
+    std::vector<std::vector<U16> > frames16;
+    std::vector<std::vector<U8> > frames8;
+    for (int i = 0; i < n_frames; i++) {
+        make_random_input(&args);
+        frames16.push_back(std::vector<U16>(bayer16, bayer16 + n_pix));
+        frames8.push_back(std::vector<U8>(bayer8, bayer8 + n_pix));
+    }
 
+    // serial with prefetch, one job per frame, bands of each frame,
+    // and frames and bands on threads
+    check_batch_matches_plan(&plan, &plan8, frames16, frames8, NULL);
+    int band_counts[] = {1, 3, 100};
+    for (int n_bands : band_counts) {
+        int n_calls = 0;
+        demosaic_dispatcher serial = {serial_dispatch, &n_calls, n_bands};
+        check_batch_matches_plan(&plan, &plan8, frames16, frames8, &serial);
+        EXPECT_EQ(n_calls, 6 * n_frames * n_bands);
+    }
+    demosaic_dispatcher threaded = {thread_dispatch, NULL, 2};
+    check_batch_matches_plan(&plan, &plan8, frames16, frames8, &threaded);
 
-    free(frog_image);
-    free(image_mosaic);
+    // an empty batch runs no jobs
+    int n_calls = 0;
+    demosaic_dispatcher serial = {serial_dispatch, &n_calls, 2};
+    const U16 * no_frames[1] = {NULL};
+    demosaic_pix_rgb16 * no_outputs[1] = {NULL};
+    demosaic_malvar_rgb16_batch(no_frames, &plan, &serial, 0, no_outputs);
+    EXPECT_EQ(n_calls, 0);
 
     free_global_bufs();
+    print_images = print_images_prev;
+}
+
+// plan functions must match the functions that take args
+void check_plan_matches_args(demosaic_args * args)
+{
+    int n_rows = args->n_rows;
+    int n_cols = args->n_cols;
+    int n_pix = n_rows * n_cols;
+    demosaic_args args8 = *args;
+    args8.max_val = 0xFF;
+    demosaic_plan plan;
+    demosaic_plan plan8;
+    demosaic_plan_init(&plan, args);
+    demosaic_plan_init(&plan8, &args8);
+
+    std::vector<demosaic_pix_rgb16> rgb16(n_pix);
+    std::vector<demosaic_pix_rgb8> rgb8(n_pix);
+    std::vector<demosaic_pix_rgb8> rgb8from16(n_pix);
+    std::vector<U16> mono16(n_pix);
+    std::vector<U8> mono8(n_pix);
+    std::vector<U8> mono8from16(n_pix);
+
+    for (int by_row = 0; by_row < 2; by_row++) {
+        if (by_row) {
+            for (int row = 0; row < n_rows; row++) {
+                int i = row * n_cols;
+                demosaic_malvar_row_rgb16_plan(bayer16, &plan, row, &rgb16[i]);
+                demosaic_malvar_row_rgb8_plan(bayer8, &plan8, row, &rgb8[i]);
+                demosaic_malvar_row_rgb16to8_plan(bayer16, &plan, row,
+                        &rgb8from16[i]);
+                demosaic_malvar_row_mono16_plan(bayer16, &plan, row,
+                        &mono16[i]);
+                demosaic_malvar_row_mono8_plan(bayer8, &plan8, row,
+                        &mono8[i]);
+                demosaic_malvar_row_mono16to8_plan(bayer16, &plan, row,
+                        &mono8from16[i]);
+            }
+        } else {
+            demosaic_malvar_rgb16_plan(bayer16, &plan, &rgb16[0]);
+            demosaic_malvar_rgb8_plan(bayer8, &plan8, &rgb8[0]);
+            demosaic_malvar_rgb16to8_plan(bayer16, &plan, &rgb8from16[0]);
+            demosaic_malvar_mono16_plan(bayer16, &plan, &mono16[0]);
+            demosaic_malvar_mono8_plan(bayer8, &plan8, &mono8[0]);
+            demosaic_malvar_mono16to8_plan(bayer16, &plan, &mono8from16[0]);
+        }
 
+        EXPECT_EQ(0, memcmp(&rgb16[0], image_out_rgb16,
+                n_pix * sizeof(demosaic_pix_rgb16)));
+        EXPECT_EQ(0, memcmp(&rgb8[0], image_out_rgb8,
+                n_pix * sizeof(demosaic_pix_rgb8)));
+        EXPECT_EQ(0, memcmp(&rgb8from16[0], image_out_rgb8from16,
+                n_pix * sizeof(demosaic_pix_rgb8)));
+        EXPECT_EQ(0, memcmp(&mono16[0], image_out_mono16,
+                n_pix * sizeof(U16)));
+        EXPECT_EQ(0, memcmp(&mono8[0], image_out_mono8, n_pix * sizeof(U8)));
+        EXPECT_EQ(0, memcmp(&mono8from16[0], image_out_mono8from16,
+                n_pix * sizeof(U8)));
+    }
 }
 
-TEST(DemosaicTest, Misc) {
-    // adding two maxed uints to a larger signed int should not overflow
-    U16 buf[] = {65535,65534};
+TEST(DemosaicTest, Plan) {
+    bool print_images_prev = print_images;
+    print_images = false;
 
-    I32 ans = buf[0] + buf[1];
-    EXPECT_EQ(ans, 131069);
+    int dims[][2] = {{2, 2}, {4, 6}, {6, 34}, {480, 480}};
+    for (int i = 0; i < 4; i++) {
+        alloc_global_bufs(dims[i][0], dims[i][1]);
 
+        demosaic_args args;
+        demosaic_args_init(&args, dims[i][0], dims[i][1], 0x0FFF);
 
-}
+        make_random_input(&args);
+        do_demosaicing(&args);
+        check_plan_matches_args(&args);
 
-TEST(DemosaicDeathTest, Asserts) {
+        free_global_bufs();
+    }
+    print_images = print_images_prev;
+}
 
-    if (getenv("DEMOSAIC_DISABLE_DEATH_TESTS")) {
-        printf("disabling death tests... they don't play well with valgrind.\n");
-        return;
-    } else {
-        printf("death tests enabled.\n");
+// compare a region of a whole image to a compact output
+template <typename T>
+void expect_region_matches(const T * output, const T * image,
+        int n_cols, const demosaic_rect & region, const char * name)
+{
+    for (int row = 0; row < region.n_rows; row++) {
+        EXPECT_EQ(0, memcmp(&output[row * region.n_cols],
+                &image[(region.row + row) * n_cols + region.col],
+                region.n_cols * sizeof(T)))
+                << name << " row " << row << " of region at "
+                << region.row << ", " << region.col;
     }
+}
 
-    int n_rows = 480;
-    int n_cols = 480;
-    int n_pix = n_rows*n_cols;
-    unsigned int max_val = 0x0FFF;
+// tiled output must match the whole image, cropped to the region
+void check_tiled_matches_image(demosaic_args * args,
+        const demosaic_rect * region, int tile_rows, int tile_cols)
+{
+    demosaic_rect whole = {0, 0, args->n_rows, args->n_cols};
+    const demosaic_rect & rect = region ? *region : whole;
+    int n_pix = rect.n_rows * rect.n_cols;
+    demosaic_args args8 = *args;
+    args8.max_val = 0xFF;
+    std::vector<demosaic_pix_rgb16> rgb16(n_pix);
+    std::vector<demosaic_pix_rgb8> rgb8(n_pix);
+    std::vector<demosaic_pix_rgb8> rgb8from16(n_pix);
+    std::vector<U16> mono16(n_pix);
+    std::vector<U8> mono8(n_pix);
+    std::vector<U8> mono8from16(n_pix);
+
+    demosaic_malvar_rgb16_tiled(bayer16, args, region, tile_rows, tile_cols,
+            &rgb16[0]);
+    demosaic_malvar_rgb8_tiled(bayer8, &args8, region, tile_rows, tile_cols,
+            &rgb8[0]);
+    demosaic_malvar_rgb16to8_tiled(bayer16, args, region, tile_rows,
+            tile_cols, &rgb8from16[0]);
+    demosaic_malvar_mono16_tiled(bayer16, args, region, tile_rows,
+            tile_cols, &mono16[0]);
+    demosaic_malvar_mono8_tiled(bayer8, &args8, region, tile_rows,
+            tile_cols, &mono8[0]);
+    demosaic_malvar_mono16to8_tiled(bayer16, args, region, tile_rows,
+            tile_cols, &mono8from16[0]);
+
+    SCOPED_TRACE(testing::Message() << "tiles " << tile_rows << "x"
+            << tile_cols);
+    expect_region_matches(&rgb16[0], image_out_rgb16, args->n_cols, rect,
+            "rgb16");
+    expect_region_matches(&rgb8[0], image_out_rgb8, args->n_cols, rect,
+            "rgb8");
+    expect_region_matches(&rgb8from16[0], image_out_rgb8from16,
+            args->n_cols, rect, "rgb8from16");
+    expect_region_matches(&mono16[0], image_out_mono16, args->n_cols, rect,
+            "mono16");
+    expect_region_matches(&mono8[0], image_out_mono8, args->n_cols, rect,
+            "mono8");
+    expect_region_matches(&mono8from16[0], image_out_mono8from16,
+            args->n_cols, rect, "mono8from16");
+}
+
+TEST(DemosaicTest, Tiled) {
+    int n_rows = 96;
+    int n_cols = 130;
+    bool print_images_prev = print_images;
+    print_images = false;
 
     alloc_global_bufs(n_rows, n_cols);
-    free_global_bufs();
 
-    demosaic_pix_rgb16 image_truth16_loc = {0,0,0};
-    demosaic_pix_rgb8 image_truth8_loc = {0,0,0};
-    U16 bayer16_loc = 0;
-    U8  bayer8_loc = 0;
-    demosaic_pix_rgb16 image_out_rgb16_loc = {0,0,0};
-    demosaic_pix_rgb8  image_out_rgb8_loc = {0,0,0};
-    demosaic_pix_rgb8  image_out_rgb8from16_loc = {0,0,0};
-    U16 image_out_mono16_loc = 0;
-    U8  image_out_mono8_loc = 0;
-    U8  image_out_mono8from16_loc = 0;
-    demosaic_pix_rgb16 image_out_rgb16_unopt_loc = {0,0,0};
-    demosaic_pix_rgb8  image_out_rgb8_unopt_loc = {0,0,0};
-    demosaic_pix_rgb8  image_out_rgb8from16_unopt_loc = {0,0,0};
-    U16 image_out_mono16_unopt_loc = 0;
-    U8  image_out_mono8_unopt_loc = 0;
-    U8  image_out_mono8from16_unopt_loc = 0;
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
 
-    image_truth16 = &image_truth16_loc;
-    image_truth8 = &image_truth8_loc;
-    bayer16 = &bayer16_loc;
-    bayer8 = &bayer8_loc;
-    image_out_rgb16 = &image_out_rgb16_loc;
-    image_out_rgb8 = &image_out_rgb8_loc;
-    image_out_rgb8from16 = &image_out_rgb8from16_loc;
-    image_out_mono16 = &image_out_mono16_loc;
-    image_out_mono8 = &image_out_mono8_loc;
-    image_out_mono8from16 = &image_out_mono8from16_loc;
-    image_out_rgb16_unopt = &image_out_rgb16_unopt_loc;
-    image_out_rgb8_unopt = &image_out_rgb8_unopt_loc;
-    image_out_rgb8from16_unopt = &image_out_rgb8from16_unopt_loc;
-    image_out_mono16_unopt = &image_out_mono16_unopt_loc;
-    image_out_mono8_unopt = &image_out_mono8_unopt_loc;
-    image_out_mono8from16_unopt = &image_out_mono8from16_unopt_loc;
+    make_random_input(&args);
+    do_demosaicing(&args);
 
+    // tiles that divide the image evenly, unevenly, are narrower than
+    // the apron, are bigger than the image, and are as big as an I32
+    int tiles[][2] = {{1, 1}, {3, 5}, {8, 32}, {16, 17}, {96, 130},
+            {200, 200}, {INT32_MAX, INT32_MAX}, {7, INT32_MAX}};
+    for (int i = 0; i < 8; i++) {
+        check_tiled_matches_image(&args, NULL, tiles[i][0], tiles[i][1]);
+    }
 
-    demosaic_args args;
-    args.n_rows = n_rows;
-    args.n_cols = n_cols;
-    args.max_val = max_val;
-    args.rshift = 4;
-    args.coefs = {0.299, 0.587, 0.114};     // ccir 601 formula
-//    make_random_input(&args);
-    demosaic_args bad_args;
-    int row = 0;
+    // regions at each corner and edge, odd offsets and sizes, one pixel
+    demosaic_rect regions[] = {
+        {0, 0, 10, 12},
+        {0, 119, 7, 11},
+        {89, 0, 7, 9},
+        {85, 117, 11, 13},
+        {31, 47, 33, 65},
+        {1, 1, 94, 128},
+        {50, 60, 1, 1}};
+    for (const demosaic_rect & region : regions) {
+        check_tiled_matches_image(&args, &region, 8, 32);
+        check_tiled_matches_image(&args, &region, 3, 5);
+    }
 
-    ASSERT_DEATH(
-            demosaic_malvar_row_rgb16(NULL, &args, row,
-                    &image_out_rgb16[row * args.n_cols]),
-            "bayer");
+    free_global_bufs();
+    print_images = print_images_prev;
+}
 
-    ASSERT_DEATH(
-            demosaic_malvar_row_rgb16(bayer16, NULL, row,
-                    &image_out_rgb16[row * args.n_cols]),
-            "args");
+TEST(DemosaicTest, Region) {
+    int n_rows = 64;
+    int n_cols = 90;
+    bool print_images_prev = print_images;
+    print_images = false;
 
-    ASSERT_DEATH(
-            demosaic_malvar_row_rgb16(bayer16, &args, row,
-                    NULL),
-            "output_row");
+    alloc_global_bufs(n_rows, n_cols);
 
-    row = -1;
-    ASSERT_DEATH(
-            demosaic_malvar_row_rgb16(bayer16, &args, row,
-                    &image_out_rgb16[row * args.n_cols]),
-            "row");
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+    demosaic_args args8 = args;
+    args8.max_val = 0xFF;
 
-    row = n_rows;
-    ASSERT_DEATH(
-            demosaic_malvar_row_rgb16(bayer16, &args, row,
-                    &image_out_rgb16[row * args.n_cols]),
-            "row");
+    make_random_input(&args);
+    do_demosaicing(&args);
 
-    row = 0;
+    // regions at each corner and edge, in the interior, odd offsets and
+    // sizes, narrower than the kernels, and the whole image
+    demosaic_rect regions[] = {
+        {0, 0, 5, 7},
+        {0, 81, 4, 9},
+        {59, 0, 5, 3},
+        {61, 87, 3, 3},
+        {20, 30, 17, 41},
+        {1, 1, 62, 88},
+        {33, 44, 1, 1},
+        {10, 2, 2, 1},
+        {0, 0, 64, 90}};
+    for (const demosaic_rect & region : regions) {
+        int n_pix = region.n_rows * region.n_cols;
+        std::vector<demosaic_pix_rgb16> rgb16(n_pix);
+        std::vector<demosaic_pix_rgb8> rgb8(n_pix);
+        std::vector<demosaic_pix_rgb8> rgb8from16(n_pix);
+        std::vector<U16> mono16(n_pix);
+        std::vector<U8> mono8(n_pix);
+        std::vector<U8> mono8from16(n_pix);
+
+        demosaic_malvar_region_rgb16(bayer16, &args, &region, &rgb16[0]);
+        demosaic_malvar_region_rgb8(bayer8, &args8, &region, &rgb8[0]);
+        demosaic_malvar_region_rgb16to8(bayer16, &args, &region,
+                &rgb8from16[0]);
+        demosaic_malvar_region_mono16(bayer16, &args, &region, &mono16[0]);
+        demosaic_malvar_region_mono8(bayer8, &args8, &region, &mono8[0]);
+        demosaic_malvar_region_mono16to8(bayer16, &args, &region,
+                &mono8from16[0]);
+
+        expect_region_matches(&rgb16[0], image_out_rgb16, n_cols, region,
+                "rgb16");
+        expect_region_matches(&rgb8[0], image_out_rgb8, n_cols, region,
+                "rgb8");
+        expect_region_matches(&rgb8from16[0], image_out_rgb8from16, n_cols,
+                region, "rgb8from16");
+        expect_region_matches(&mono16[0], image_out_mono16, n_cols, region,
+                "mono16");
+        expect_region_matches(&mono8[0], image_out_mono8, n_cols, region,
+                "mono8");
+        expect_region_matches(&mono8from16[0], image_out_mono8from16, n_cols,
+                region, "mono8from16");
+    }
 
+    free_global_bufs();
+    print_images = print_images_prev;
+}
 
-    bad_args = args;
-    bad_args.n_rows = 0;
-    ASSERT_DEATH(
-            demosaic_malvar_row_rgb16(bayer16, &bad_args, row,
-                    &image_out_rgb16[row * args.n_cols]),
-            "n_rows");
+// re-demosaicing dirty rectangles into the old output must write exactly
+// the affected pixels, with the output of the changed whole image
+template <typename B, typename T, typename F>
+void check_dirty_matches_image(F dirty_fn, const B * bayer,
+        const demosaic_args * args, const std::vector<T> & old_image,
+        const T * new_image, const std::vector<char> & affected,
+        const demosaic_rect * dirty, int n_dirty, const char * name)
+{
+    int n_pix = args->n_rows * args->n_cols;
+    T sentinel;
+    memset(&sentinel, 0xA5, sizeof(T));
+    std::vector<T> output(old_image);
+    std::vector<T> expected(n_pix);
+    for (int i = 0; i < n_pix; i++) {
+        output[i] = affected[i] ? old_image[i] : sentinel;
+        expected[i] = affected[i] ? new_image[i] : sentinel;
+    }
+    dirty_fn(bayer, args, dirty, n_dirty, &output[0]);
+    EXPECT_EQ(0, memcmp(&output[0], &expected[0], n_pix * sizeof(T))) << name;
+}
 
-    bad_args = args;
-    bad_args.n_rows = 45;
-    ASSERT_DEATH(
-            demosaic_malvar_row_rgb16(bayer16, &bad_args, row,
-                    &image_out_rgb16[row * args.n_cols]),
-            "n_rows");
+TEST(DemosaicTest, Dirty) {
+    int n_rows = 40;
+    int n_cols = 54;
+    int n_pix = n_rows * n_cols;
+    bool print_images_prev = print_images;
+    print_images = false;
 
-    bad_args = args;
-    bad_args.n_cols = -1;
-    ASSERT_DEATH(
-            demosaic_malvar_row_rgb16(bayer16, &bad_args, row,
-                    &image_out_rgb16[row * args.n_cols]),
-            "n_cols");
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+    args.pattern = DEMOSAIC_BGGR;
+    demosaic_args args8 = args;
+    args8.max_val = 0xFF;
+
+    make_random_input(&args);
+    do_demosaicing(&args);
+    std::vector<demosaic_pix_rgb16> old_rgb16(image_out_rgb16,
+            image_out_rgb16 + n_pix);
+    std::vector<demosaic_pix_rgb8> old_rgb8(image_out_rgb8,
+            image_out_rgb8 + n_pix);
+    std::vector<demosaic_pix_rgb8> old_rgb8from16(image_out_rgb8from16,
+            image_out_rgb8from16 + n_pix);
+    std::vector<U16> old_mono16(image_out_mono16, image_out_mono16 + n_pix);
+    std::vector<U8> old_mono8(image_out_mono8, image_out_mono8 + n_pix);
+    std::vector<U8> old_mono8from16(image_out_mono8from16,
+            image_out_mono8from16 + n_pix);
+
+    // corners and edges, odd offsets and sizes, overlaps, a whole row
+    demosaic_rect dirty[] = {
+        {0, 0, 1, 1},
+        {37, 51, 3, 3},
+        {10, 11, 5, 7},
+        {12, 14, 3, 3},
+        {25, 0, 1, n_cols},
+        {1, 30, 2, 1}};
+    int n_dirty = sizeof(dirty) / sizeof(dirty[0]);
+
+    // grown by the kernel radius, clipped to the image
+    demosaic_rect rect;
+    demosaic_dirty_affected(&args, &dirty[0], &rect);
+    EXPECT_TRUE(rect.row == 0 && rect.col == 0
+            && rect.n_rows == 3 && rect.n_cols == 3);
+    demosaic_dirty_affected(&args, &dirty[1], &rect);
+    EXPECT_TRUE(rect.row == 35 && rect.col == 49
+            && rect.n_rows == 5 && rect.n_cols == 5);
+    demosaic_dirty_affected(&args, &dirty[2], &rect);
+    EXPECT_TRUE(rect.row == 8 && rect.col == 9
+            && rect.n_rows == 9 && rect.n_cols == 11);
+
+    std::vector<char> affected(n_pix, 0);
+    for (int i = 0; i < n_dirty; i++) {
+        demosaic_dirty_affected(&args, &dirty[i], &rect);
+        for (int row = rect.row; row < rect.row + rect.n_rows; row++) {
+            for (int col = rect.col; col < rect.col + rect.n_cols; col++) {
+                affected[row * n_cols + col] = 1;
+            }
+        }
+        for (int row = dirty[i].row; row < dirty[i].row + dirty[i].n_rows;
+                row++) {
+            for (int col = dirty[i].col;
+                    col < dirty[i].col + dirty[i].n_cols; col++) {
+                U16 val = rand() % args.max_val;
+                bayer16[row * n_cols + col] = val;
+                bayer8[row * n_cols + col] = val >> args.rshift;
+            }
+        }
+    }
+    do_demosaicing(&args);
+
+    check_dirty_matches_image(demosaic_malvar_rgb16_dirty, bayer16, &args,
+            old_rgb16, image_out_rgb16, affected, dirty, n_dirty, "rgb16");
+    check_dirty_matches_image(demosaic_malvar_rgb8_dirty, bayer8, &args8,
+            old_rgb8, image_out_rgb8, affected, dirty, n_dirty, "rgb8");
+    check_dirty_matches_image(demosaic_malvar_rgb16to8_dirty, bayer16, &args,
+            old_rgb8from16, image_out_rgb8from16, affected, dirty, n_dirty,
+            "rgb16to8");
+    check_dirty_matches_image(demosaic_malvar_mono16_dirty, bayer16, &args,
+            old_mono16, image_out_mono16, affected, dirty, n_dirty, "mono16");
+    check_dirty_matches_image(demosaic_malvar_mono8_dirty, bayer8, &args8,
+            old_mono8, image_out_mono8, affected, dirty, n_dirty, "mono8");
+    check_dirty_matches_image(demosaic_malvar_mono16to8_dirty, bayer16,
+            &args, old_mono8from16, image_out_mono8from16, affected, dirty,
+            n_dirty, "mono16to8");
+
+    // no rectangles, no writes
+    std::vector<demosaic_pix_rgb16> unchanged(old_rgb16);
+    demosaic_malvar_rgb16_dirty(bayer16, &args, dirty, 0, &unchanged[0]);
+    EXPECT_EQ(0, memcmp(&unchanged[0], &old_rgb16[0],
+            n_pix * sizeof(demosaic_pix_rgb16)));
+
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+// luma of an rgb pixel in F64, normalized as by the library
+double luma_f64(const demosaic_luma_coefs * coefs,
+        double red, double green, double blue)
+{
+    double coef_sum = coefs->red + coefs->green + coefs->blue + 0.000001;
+    return (coefs->red * red + coefs->green * green + coefs->blue * blue)
+            / coef_sum;
+}
+
+// mono output must be within the documented bound of the F64 luma of the
+// rgb output, and equal to it when luma is computed in F64
+void check_luma_error(demosaic_args * args)
+{
+    int n_pix = args->n_rows * args->n_cols;
+    std::vector<demosaic_pix_rgb16> rgb16(n_pix);
+    std::vector<demosaic_pix_rgb8> rgb8from16(n_pix);
+    std::vector<U16> mono16(n_pix);
+    std::vector<U8> mono8from16(n_pix);
+
+    demosaic_malvar_rgb16(bayer16, args, &rgb16[0]);
+    demosaic_malvar_mono16(bayer16, args, &mono16[0]);
+    demosaic_malvar_rgb16to8(bayer16, args, &rgb8from16[0]);
+    demosaic_malvar_mono16to8(bayer16, args, &mono8from16[0]);
+
+#if DEMOSAIC_FIXED_POINT_LUMA
+    double bound16 = 1 + 2.5 * args->max_val / 32768;
+    double bound8 = 1 + 2.5 * (args->max_val >> args->rshift) / 32768;
+#else
+    double bound16 = 0;
+    double bound8 = 0;
+#endif
+
+    double max_err16 = 0;
+    double max_err8 = 0;
+    for (int i = 0; i < n_pix; i++) {
+        U16 expected16 = luma_f64(&args->coefs,
+                rgb16[i].red, rgb16[i].green, rgb16[i].blue) + 0.5;
+        U8 expected8 = luma_f64(&args->coefs, rgb8from16[i].red,
+                rgb8from16[i].green, rgb8from16[i].blue) + 0.5;
+        max_err16 = std::max(max_err16,
+                (double) ABS((int) mono16[i] - (int) expected16));
+        max_err8 = std::max(max_err8,
+                (double) ABS((int) mono8from16[i] - (int) expected8));
+    }
+    EXPECT_LE(max_err16, bound16);
+    EXPECT_LE(max_err8, bound8);
+}
+
+TEST(DemosaicTest, FixedPointLuma) {
+    int n_rows = 64;
+    int n_cols = 64;
+    demosaic_luma_coefs coefs[] = {
+        {0.299, 0.587, 0.114},      // ccir 601
+        {0.2126, 0.7152, 0.0722},   // itu-r 709
+        {1, 1, 1},
+        {1, 0, 0},
+        {0, 1, 0},
+        {0, 0, 1},
+        {0.5, 0, 0.5}};
+    U16 max_vals[] = {0x00FF, 0x0FFF, 0xFFFF};
+    I32 rshifts[] = {0, 4, 8};
+
+    alloc_global_bufs(n_rows, n_cols);
+    for (int i = 0; i < 3; i++) {
+        for (demosaic_luma_coefs c : coefs) {
+            demosaic_args args;
+            demosaic_args_init(&args, n_rows, n_cols, max_vals[i]);
+            args.rshift = rshifts[i];
+            args.coefs = c;
+
+            make_random_input(&args);
+            check_luma_error(&args);
+        }
+    }
+    free_global_bufs();
+}
+
+TEST(DemosaicTest, FusedRgbMono) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int dims[][2] = {{2, 2}, {4, 6}, {6, 34}, {480, 480}};
+    for (int i = 0; i < 4; i++) {
+        int n_rows = dims[i][0];
+        int n_cols = dims[i][1];
+        int n_pix = n_rows * n_cols;
+        alloc_global_bufs(n_rows, n_cols);
+
+        demosaic_args args;
+        demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+
+        make_random_input(&args);
+        do_demosaicing(&args);
+
+        std::vector<demosaic_pix_rgb16> rgb16(n_pix);
+        std::vector<U16> mono16(n_pix);
+        demosaic_malvar_rgb16_mono16(bayer16, &args, &rgb16[0], &mono16[0]);
+        EXPECT_EQ(0, memcmp(&rgb16[0], image_out_rgb16,
+                n_pix * sizeof(demosaic_pix_rgb16)));
+        EXPECT_EQ(0, memcmp(&mono16[0], image_out_mono16,
+                n_pix * sizeof(U16)));
+
+        // row variant, in reverse order
+        std::fill(rgb16.begin(), rgb16.end(), demosaic_pix_rgb16{0, 0, 0});
+        std::fill(mono16.begin(), mono16.end(), 0);
+        for (int row = n_rows - 1; row >= 0; row--) {
+            demosaic_malvar_row_rgb16_mono16(bayer16, &args, row,
+                    &rgb16[row * n_cols], &mono16[row * n_cols]);
+        }
+        EXPECT_EQ(0, memcmp(&rgb16[0], image_out_rgb16,
+                n_pix * sizeof(demosaic_pix_rgb16)));
+        EXPECT_EQ(0, memcmp(&mono16[0], image_out_mono16,
+                n_pix * sizeof(U16)));
+
+        free_global_bufs();
+    }
+    print_images = print_images_prev;
+}
+
+// streaming a frame one line at a time must match demosaic_malvar_rgb16,
+// with rows output two lines after they are pushed
+void check_stream_matches_image(demosaic_args * args)
+{
+    int n_rows = args->n_rows;
+    int n_cols = args->n_cols;
+    std::vector<U16> line_buffer(DEMOSAIC_STREAM_LINES * n_cols);
+    std::vector<demosaic_pix_rgb16> output(n_rows * n_cols);
+    std::vector<demosaic_pix_rgb16> output_row(n_cols);
+    demosaic_stream stream;
+
+    // twice, to check that init restarts the stream
+    for (int frame = 0; frame < 2; frame++) {
+        demosaic_stream_init(&stream, args, &line_buffer[0]);
+        for (int line = 0; line < n_rows; line++) {
+            int row = demosaic_malvar_stream_push_rgb16(&stream,
+                    &bayer16[line * n_cols], &output_row[0]);
+            EXPECT_EQ(row, line >= 2 ? line - 2 : -1);
+            if (row >= 0) {
+                memcpy(&output[row * n_cols], &output_row[0],
+                        n_cols * sizeof(demosaic_pix_rgb16));
+            }
+        }
+        for (int i = 0; i < 3; i++) {
+            int row = demosaic_malvar_stream_flush_rgb16(&stream,
+                    &output_row[0]);
+            EXPECT_EQ(row, i < 2 ? n_rows - 2 + i : -1);
+            if (row >= 0) {
+                memcpy(&output[row * n_cols], &output_row[0],
+                        n_cols * sizeof(demosaic_pix_rgb16));
+            }
+        }
+        EXPECT_EQ(0, memcmp(&output[0], image_out_rgb16,
+                n_rows * n_cols * sizeof(demosaic_pix_rgb16)));
+    }
+}
+
+TEST(DemosaicTest, Streaming) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int dims[][2] = {{2, 2}, {2, 8}, {4, 4}, {6, 2}, {6, 10}, {480, 640}};
+    for (int i = 0; i < 6; i++) {
+        alloc_global_bufs(dims[i][0], dims[i][1]);
+
+        demosaic_args args;
+        demosaic_args_init(&args, dims[i][0], dims[i][1], 0x0FFF);
+
+        make_random_input(&args);
+        do_demosaicing(&args);
+        check_stream_matches_image(&args);
+
+        free_global_bufs();
+    }
+    print_images = print_images_prev;
+}
+
+// pack a 10 or 12-bit bayer image into MIPI CSI-2 RAW10 or RAW12 rows,
+// pitch bytes apart
+void pack_bayer(const U16 * bayer, int n_rows, int n_cols,
+        demosaic_packing packing, int pitch, U8 * packed)
+{
+    int group = (packing == DEMOSAIC_PACKED_RAW10) ? 4 : 2;
+    int low_bits = (packing == DEMOSAIC_PACKED_RAW10) ? 2 : 4;
+    for (int row = 0; row < n_rows; row++) {
+        U8 * out = &packed[row * pitch];
+        for (int col = 0; col < n_cols; col += group) {
+            U8 low = 0;
+            for (int i = 0; i < group; i++) {
+                U16 pix = bayer[row * n_cols + col + i];
+                *out++ = pix >> low_bits;
+                low |= (pix & ((1 << low_bits) - 1)) << (i * low_bits);
+            }
+            *out++ = low;
+        }
+    }
+}
+
+// packed rows, images and streams must match the unpacked images
+void check_packed_matches_image(demosaic_args * args,
+        demosaic_packing packing)
+{
+    int n_rows = args->n_rows;
+    int n_cols = args->n_cols;
+    int n_pix = n_rows * n_cols;
+    int row_bytes = (packing == DEMOSAIC_PACKED_RAW10)
+            ? n_cols / 4 * 5 : n_cols / 2 * 3;
+    std::vector<U8> data(n_rows * (row_bytes + 3));
+    demosaic_packed packed = {&data[0], packing, row_bytes + 3};
+    pack_bayer(bayer16, n_rows, n_cols, packing, packed.pitch, &data[0]);
+
+    std::vector<U16> line_buffer(DEMOSAIC_STREAM_LINES * n_cols);
+    std::vector<demosaic_pix_rgb16> rgb16(n_pix);
+    std::vector<demosaic_pix_rgb8> rgb8(n_pix);
+    std::vector<U16> mono16(n_pix);
+    std::vector<U8> mono8(n_pix);
+
+    demosaic_malvar_rgb16_packed(&packed, args, &line_buffer[0], &rgb16[0]);
+    demosaic_malvar_rgb16to8_packed(&packed, args, &line_buffer[0], &rgb8[0]);
+    demosaic_malvar_mono16_packed(&packed, args, &line_buffer[0], &mono16[0]);
+    demosaic_malvar_mono16to8_packed(&packed, args, &line_buffer[0],
+            &mono8[0]);
+    EXPECT_EQ(0, memcmp(&rgb16[0], image_out_rgb16,
+            n_pix * sizeof(demosaic_pix_rgb16)));
+    EXPECT_EQ(0, memcmp(&rgb8[0], image_out_rgb8from16,
+            n_pix * sizeof(demosaic_pix_rgb8)));
+    EXPECT_EQ(0, memcmp(&mono16[0], image_out_mono16, n_pix * sizeof(U16)));
+    EXPECT_EQ(0, memcmp(&mono8[0], image_out_mono8from16, n_pix));
+
+    memset(&rgb16[0], 0, n_pix * sizeof(demosaic_pix_rgb16));
+    memset(&rgb8[0], 0, n_pix * sizeof(demosaic_pix_rgb8));
+    memset(&mono16[0], 0, n_pix * sizeof(U16));
+    memset(&mono8[0], 0, n_pix);
+    for (int row = 0; row < n_rows; row++) {
+        demosaic_malvar_row_rgb16_packed(&packed, args, row, &line_buffer[0],
+                &rgb16[row * n_cols]);
+        demosaic_malvar_row_rgb16to8_packed(&packed, args, row,
+                &line_buffer[0], &rgb8[row * n_cols]);
+        demosaic_malvar_row_mono16_packed(&packed, args, row,
+                &line_buffer[0], &mono16[row * n_cols]);
+        demosaic_malvar_row_mono16to8_packed(&packed, args, row,
+                &line_buffer[0], &mono8[row * n_cols]);
+    }
+    EXPECT_EQ(0, memcmp(&rgb16[0], image_out_rgb16,
+            n_pix * sizeof(demosaic_pix_rgb16)));
+    EXPECT_EQ(0, memcmp(&rgb8[0], image_out_rgb8from16,
+            n_pix * sizeof(demosaic_pix_rgb8)));
+    EXPECT_EQ(0, memcmp(&mono16[0], image_out_mono16, n_pix * sizeof(U16)));
+    EXPECT_EQ(0, memcmp(&mono8[0], image_out_mono8from16, n_pix));
+
+    demosaic_stream stream;
+    demosaic_stream_init(&stream, args, &line_buffer[0]);
+    memset(&rgb16[0], 0, n_pix * sizeof(demosaic_pix_rgb16));
+    for (int line = 0; line < n_rows; line++) {
+        int row = demosaic_malvar_stream_push_packed_rgb16(&stream, packing,
+                &data[line * packed.pitch], &rgb16[(line >= 2 ? line - 2 : 0)
+                * n_cols]);
+        EXPECT_EQ(row, line >= 2 ? line - 2 : -1);
+    }
+    for (int row = n_rows - 2; row < n_rows; row++) {
+        EXPECT_EQ(row, demosaic_malvar_stream_flush_rgb16(&stream,
+                &rgb16[row * n_cols]));
+    }
+    EXPECT_EQ(0, memcmp(&rgb16[0], image_out_rgb16,
+            n_pix * sizeof(demosaic_pix_rgb16)));
+}
+
+TEST(DemosaicTest, Packed) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int dims[][2] = {{2, 4}, {4, 8}, {6, 12}, {34, 72}, {480, 640}};
+    for (int i = 0; i < 5; i++) {
+        for (int p = 0; p < 2; p++) {
+            demosaic_packing packing = (demosaic_packing) p;
+            alloc_global_bufs(dims[i][0], dims[i][1]);
+
+            demosaic_args args;
+            demosaic_args_init(&args, dims[i][0], dims[i][1],
+                    (packing == DEMOSAIC_PACKED_RAW10) ? 0x03FF : 0x0FFF);
+            args.rshift = (packing == DEMOSAIC_PACKED_RAW10) ? 2 : 4;
+            args.pattern = (demosaic_pattern) (i % 4);
+
+            make_random_input(&args);
+            do_demosaicing(&args);
+            check_packed_matches_image(&args, packing);
+
+            free_global_bufs();
+        }
+    }
+    print_images = print_images_prev;
+}
+
+// a stream ring and packed lines taken from one static pool, sized by
+// the scratch queries, must demosaic like the images
+TEST(DemosaicTest, Scratch) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int n_rows = 34;
+    int n_cols = 70;
+    int n_pix = n_rows * n_cols;
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+    args.pattern = DEMOSAIC_GRBG;
+
+    make_random_input(&args);
+    do_demosaicing(&args);
+
+    // 5 lines of 140 bytes, rounded up to 11 cache lines
+    EXPECT_EQ(0, demosaic_scratch_size(&args, DEMOSAIC_MODE_ROWS));
+    EXPECT_EQ(0, demosaic_scratch_size(&args, DEMOSAIC_MODE_YUV));
+    EXPECT_EQ(704, demosaic_scratch_size(&args, DEMOSAIC_MODE_STREAM));
+    EXPECT_EQ(704, demosaic_scratch_size(&args, DEMOSAIC_MODE_PACKED));
+    EXPECT_EQ(5 * 140 + 420 + 140 + 384,
+            demosaic_working_set_size(&args, DEMOSAIC_MODE_ROWS));
+    EXPECT_EQ(704 + 140 + 420 + 384,
+            demosaic_working_set_size(&args, DEMOSAIC_MODE_STREAM));
+    EXPECT_EQ(704 + 5 * 105 + 420 + 384,
+            demosaic_working_set_size(&args, DEMOSAIC_MODE_PACKED));
+    EXPECT_EQ(6 * 140 + 210 + 384 + 384,
+            demosaic_working_set_size(&args, DEMOSAIC_MODE_YUV));
+
+    static U8 pool[2 * 704] __attribute__((aligned(DEMOSAIC_SCRATCH_ALIGN)));
+    int n_bytes = demosaic_scratch_size(&args, DEMOSAIC_MODE_STREAM)
+            + demosaic_scratch_size(&args, DEMOSAIC_MODE_PACKED);
+    ASSERT_EQ((int) sizeof(pool), n_bytes);
+    demosaic_scratch scratch;
+    demosaic_scratch_init(&scratch, pool, n_bytes);
+    U16 * ring = (U16 *) demosaic_scratch_take(&scratch,
+            demosaic_scratch_size(&args, DEMOSAIC_MODE_STREAM));
+    // an unrounded size takes as much
+    U16 * lines = (U16 *) demosaic_scratch_take(&scratch,
+            DEMOSAIC_STREAM_LINES * n_cols * sizeof(U16));
+    EXPECT_EQ((U8 *) ring, &pool[0]);
+    EXPECT_EQ((U8 *) lines, &pool[704]);
+    EXPECT_EQ(n_bytes, scratch.n_used);
+
+    std::vector<demosaic_pix_rgb16> output(n_pix);
+    demosaic_stream stream;
+    demosaic_stream_init(&stream, &args, ring);
+    for (int line = 0; line < n_rows; line++) {
+        demosaic_malvar_stream_push_rgb16(&stream, &bayer16[line * n_cols],
+                &output[(line >= 2 ? line - 2 : 0) * n_cols]);
+    }
+    for (int row = n_rows - 2; row < n_rows; row++) {
+        demosaic_malvar_stream_flush_rgb16(&stream, &output[row * n_cols]);
+    }
+    EXPECT_EQ(0, memcmp(&output[0], image_out_rgb16,
+            n_pix * sizeof(demosaic_pix_rgb16)));
+
+    std::vector<U8> data(n_rows * n_cols / 2 * 3);
+    demosaic_packed packed = {&data[0], DEMOSAIC_PACKED_RAW12, n_cols / 2 * 3};
+    pack_bayer(bayer16, n_rows, n_cols, DEMOSAIC_PACKED_RAW12, packed.pitch,
+            &data[0]);
+    memset(&output[0], 0, n_pix * sizeof(demosaic_pix_rgb16));
+    demosaic_malvar_rgb16_packed(&packed, &args, lines, &output[0]);
+    EXPECT_EQ(0, memcmp(&output[0], image_out_rgb16,
+            n_pix * sizeof(demosaic_pix_rgb16)));
+
+    demosaic_scratch_reset(&scratch);
+    EXPECT_EQ(0, scratch.n_used);
+    EXPECT_EQ(&pool[0], (U8 *) demosaic_scratch_take(&scratch, 1));
+    EXPECT_EQ(DEMOSAIC_SCRATCH_ALIGN, scratch.n_used);
+
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+// planar output, with padded plane rows, must match the packed output
+template <typename T, typename P>
+void expect_planes_match(const T * red, const T * green, const T * blue,
+        int stride, const P * image, int n_rows, int n_cols)
+{
+    for (int row = 0; row < n_rows; row++) {
+        for (int col = 0; col < n_cols; col++) {
+            const P & pix = image[row * n_cols + col];
+            ASSERT_EQ(red[row * stride + col], pix.red);
+            ASSERT_EQ(green[row * stride + col], pix.green);
+            ASSERT_EQ(blue[row * stride + col], pix.blue);
+        }
+    }
+}
+
+// yuv output, with padded plane rows, must have the luma of the mono
+// output, and chroma within 1 of the F64 full range chroma of the rgb
+// output, averaged over each 2x1 or 2x2 block
+void expect_yuv_matches(const demosaic_args * args,
+        demosaic_yuv_format format, const demosaic_planes_yuv8 * planes,
+        const demosaic_pix_rgb8 * rgb, const U8 * mono)
+{
+    int n_rows = args->n_rows;
+    int n_cols = args->n_cols;
+    double sum = args->coefs.red + args->coefs.green + args->coefs.blue
+            + 0.000001;
+    double kr = args->coefs.red / sum;
+    double kg = args->coefs.green / sum;
+    double kb = args->coefs.blue / sum;
+    int block_rows = (format == DEMOSAIC_YUV420) ? 2 : 1;
+    for (int row = 0; row < n_rows; row++) {
+        ASSERT_EQ(0, memcmp(&planes->y[row * planes->y_stride],
+                &mono[row * n_cols], n_cols));
+    }
+    for (int row = 0; row < n_rows; row += block_rows) {
+        for (int col = 0; col < n_cols; col += 2) {
+            double r = 0, g = 0, b = 0;
+            for (int i = 0; i < block_rows; i++) {
+                for (int j = 0; j < 2; j++) {
+                    const demosaic_pix_rgb8 & pix =
+                            rgb[(row + i) * n_cols + col + j];
+                    r += pix.red;
+                    g += pix.green;
+                    b += pix.blue;
+                }
+            }
+            r /= 2 * block_rows;
+            g /= 2 * block_rows;
+            b /= 2 * block_rows;
+            double y = kr * r + kg * g + kb * b;
+            double cb = 128 + (b - y) / (2 * (1 - kb));
+            double cr = 128 + (r - y) / (2 * (1 - kr));
+            int offset = (row / block_rows) * planes->chroma_stride + col / 2;
+            ASSERT_NEAR(planes->cb[offset], cb, 1.0) << row << "," << col;
+            ASSERT_NEAR(planes->cr[offset], cr, 1.0) << row << "," << col;
+        }
+    }
+}
+
+void check_planar_matches_packed(demosaic_args * args)
+{
+    int n_rows = args->n_rows;
+    int n_cols = args->n_cols;
+    int stride = n_cols + 3;
+    int n_plane = n_rows * stride;
+    std::vector<U16> red16(n_plane), green16(n_plane), blue16(n_plane);
+    std::vector<U8> red8(n_plane), green8(n_plane), blue8(n_plane);
+    demosaic_planes16 planes16 = {&red16[0], &green16[0], &blue16[0], stride};
+    demosaic_planes8 planes8 = {&red8[0], &green8[0], &blue8[0], stride};
+
+    demosaic_malvar_rgb16_planar(bayer16, args, &planes16);
+    expect_planes_match(&red16[0], &green16[0], &blue16[0], stride,
+            image_out_rgb16, n_rows, n_cols);
+    demosaic_malvar_rgb16to8_planar(bayer16, args, &planes8);
+    expect_planes_match(&red8[0], &green8[0], &blue8[0], stride,
+            image_out_rgb8from16, n_rows, n_cols);
+    demosaic_malvar_rgb8_planar(bayer8, args, &planes8);
+    expect_planes_match(&red8[0], &green8[0], &blue8[0], stride,
+            image_out_rgb8, n_rows, n_cols);
+
+    // row variants, in reverse order
+    std::fill(red16.begin(), red16.end(), 0);
+    std::fill(red8.begin(), red8.end(), 0);
+    for (int row = n_rows - 1; row >= 0; row--) {
+        int offset = row * stride;
+        demosaic_malvar_row_rgb16_planar(bayer16, args, row,
+                &red16[offset], &green16[offset], &blue16[offset]);
+        demosaic_malvar_row_rgb8_planar(bayer8, args, row,
+                &red8[offset], &green8[offset], &blue8[offset]);
+    }
+    expect_planes_match(&red16[0], &green16[0], &blue16[0], stride,
+            image_out_rgb16, n_rows, n_cols);
+    expect_planes_match(&red8[0], &green8[0], &blue8[0], stride,
+            image_out_rgb8, n_rows, n_cols);
+    for (int row = 0; row < n_rows; row++) {
+        int offset = row * stride;
+        demosaic_malvar_row_rgb16to8_planar(bayer16, args, row,
+                &red8[offset], &green8[offset], &blue8[offset]);
+    }
+    expect_planes_match(&red8[0], &green8[0], &blue8[0], stride,
+            image_out_rgb8from16, n_rows, n_cols);
+}
+
+TEST(DemosaicTest, Planar) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int dims[][2] = {{2, 2}, {4, 6}, {6, 34}, {480, 640}};
+    for (int i = 0; i < 4; i++) {
+        alloc_global_bufs(dims[i][0], dims[i][1]);
+
+        demosaic_args args;
+        demosaic_args_init(&args, dims[i][0], dims[i][1], 0xFF);
+
+        make_random_input(&args);
+        do_demosaicing(&args);
+        check_planar_matches_packed(&args);
+
+        free_global_bufs();
+    }
+    print_images = print_images_prev;
+}
+
+// copy a packed image into rows pitch bytes apart, padding with junk
+template <typename T>
+std::vector<U8> pad_rows(const T * image, int n_rows, int n_cols, int pitch)
+{
+    std::vector<U8> padded(n_rows * pitch, 0xA5);
+    for (int row = 0; row < n_rows; row++) {
+        memcpy(&padded[row * pitch], &image[row * n_cols], n_cols * sizeof(T));
+    }
+    return padded;
+}
+
+// output rows pitch bytes apart must match the packed image
+template <typename T>
+void expect_pitched_matches(const std::vector<U8> & output, const T * image,
+        int n_rows, int n_cols, int pitch)
+{
+    for (int row = 0; row < n_rows; row++) {
+        EXPECT_EQ(0, memcmp(&output[row * pitch], &image[row * n_cols],
+                n_cols * sizeof(T))) << "row " << row;
+    }
+}
+
+void check_pitched_matches_image(demosaic_args * args)
+{
+    int n_rows = args->n_rows;
+    int n_cols = args->n_cols;
+
+    // pad rows to 64 bytes, plus an extra 64 bytes
+    demosaic_pitch pitch16;
+    demosaic_pitch pitch8;
+    pitch16.input = (n_cols * sizeof(U16) + 127) / 64 * 64;
+    pitch8.input = (n_cols * sizeof(U8) + 127) / 64 * 64;
+    std::vector<U8> in16 = pad_rows(bayer16, n_rows, n_cols, pitch16.input);
+    std::vector<U8> in8 = pad_rows(bayer8, n_rows, n_cols, pitch8.input);
+    const U16 * padded16 = (const U16 *) &in16[0];
+    const U8 * padded8 = &in8[0];
+
+    pitch16.output = (n_cols * sizeof(demosaic_pix_rgb16) + 127) / 64 * 64;
+    pitch8.output = (n_cols * sizeof(demosaic_pix_rgb8) + 127) / 64 * 64;
+    std::vector<U8> out16(n_rows * pitch16.output);
+    std::vector<U8> out8(n_rows * pitch8.output);
+    demosaic_malvar_rgb16_pitched(padded16, args, &pitch16,
+            (demosaic_pix_rgb16 *) &out16[0]);
+    expect_pitched_matches(out16, image_out_rgb16, n_rows, n_cols,
+            pitch16.output);
+    demosaic_malvar_rgb8_pitched(padded8, args, &pitch8,
+            (demosaic_pix_rgb8 *) &out8[0]);
+    expect_pitched_matches(out8, image_out_rgb8, n_rows, n_cols,
+            pitch8.output);
+    pitch16.output = pitch8.output;
+    demosaic_malvar_rgb16to8_pitched(padded16, args, &pitch16,
+            (demosaic_pix_rgb8 *) &out8[0]);
+    expect_pitched_matches(out8, image_out_rgb8from16, n_rows, n_cols,
+            pitch16.output);
+
+    // an odd number of bytes of padding for 8-bit mono
+    pitch16.output = n_cols * sizeof(U16) + 2;
+    pitch8.output = n_cols * sizeof(U8) + 3;
+    demosaic_malvar_mono16_pitched(padded16, args, &pitch16,
+            (U16 *) &out16[0]);
+    expect_pitched_matches(out16, image_out_mono16, n_rows, n_cols,
+            pitch16.output);
+    demosaic_malvar_mono8_pitched(padded8, args, &pitch8, &out8[0]);
+    expect_pitched_matches(out8, image_out_mono8, n_rows, n_cols,
+            pitch8.output);
+    pitch16.output = pitch8.output;
+    demosaic_malvar_mono16to8_pitched(padded16, args, &pitch16, &out8[0]);
+    expect_pitched_matches(out8, image_out_mono8from16, n_rows, n_cols,
+            pitch16.output);
+}
+
+TEST(DemosaicTest, Pitched) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int dims[][2] = {{2, 2}, {4, 6}, {6, 34}, {480, 638}};
+    for (int i = 0; i < 4; i++) {
+        alloc_global_bufs(dims[i][0], dims[i][1]);
+
+        demosaic_args args;
+        demosaic_args_init(&args, dims[i][0], dims[i][1], 0xFF);
+
+        make_random_input(&args);
+        do_demosaicing(&args);
+        check_pitched_matches_image(&args);
+
+        free_global_bufs();
+    }
+    print_images = print_images_prev;
+}
+
+// subsampled output must match each quad's red, rounded mean green, and blue,
+// and mono must be their luma
+template <typename T, typename P, typename M>
+void check_subsampled(const T * bayer, const demosaic_args * args, int rshift,
+        const P * rgb, const M * mono, double max_luma_err)
+{
+    int n_out_cols = args->n_cols / 2;
+    for (int row = 0; row < args->n_rows / 2; row++) {
+        for (int col = 0; col < n_out_cols; col++) {
+            const T * quad = &bayer[2 * row * args->n_cols + 2 * col];
+            int red = quad[0] >> rshift;
+            int green = ((quad[1] + quad[args->n_cols] + 1) >> 1) >> rshift;
+            int blue = quad[args->n_cols + 1] >> rshift;
+            const P & pix = rgb[row * n_out_cols + col];
+            ASSERT_EQ(pix.red, red);
+            ASSERT_EQ(pix.green, green);
+            ASSERT_EQ(pix.blue, blue);
+            M expected = luma_f64(&args->coefs, red, green, blue) + 0.5;
+            ASSERT_LE(ABS((int) mono[row * n_out_cols + col] - (int) expected),
+                    max_luma_err);
+        }
+    }
+}
+
+TEST(DemosaicTest, Subsample) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int dims[][2] = {{2, 2}, {4, 6}, {6, 34}, {480, 640}};
+    for (int i = 0; i < 4; i++) {
+        int n_rows = dims[i][0];
+        int n_cols = dims[i][1];
+        int n_out = (n_rows / 2) * (n_cols / 2);
+        alloc_global_bufs(n_rows, n_cols);
+
+        demosaic_args args;
+        demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+        demosaic_args args8 = args;
+        args8.max_val = 0xFF;
+        args8.rshift = 0;
+        make_random_input(&args);
+
+        // fixed-point luma is off by at most one at these depths
+        double max_luma_err = DEMOSAIC_FIXED_POINT_LUMA ? 1 : 0;
+
+        std::vector<demosaic_pix_rgb16> rgb16(n_out);
+        std::vector<demosaic_pix_rgb8> rgb8(n_out);
+        std::vector<U16> mono16(n_out);
+        std::vector<U8> mono8(n_out);
+        demosaic_subsample_rgb16(bayer16, &args, &rgb16[0]);
+        demosaic_subsample_mono16(bayer16, &args, &mono16[0]);
+        check_subsampled(bayer16, &args, 0, &rgb16[0], &mono16[0],
+                max_luma_err);
+        demosaic_subsample_rgb16to8(bayer16, &args, &rgb8[0]);
+        demosaic_subsample_mono16to8(bayer16, &args, &mono8[0]);
+        check_subsampled(bayer16, &args, 4, &rgb8[0], &mono8[0],
+                max_luma_err);
+        demosaic_subsample_rgb8(bayer8, &args8, &rgb8[0]);
+        demosaic_subsample_mono8(bayer8, &args8, &mono8[0]);
+        check_subsampled(bayer8, &args8, 0, &rgb8[0], &mono8[0],
+                max_luma_err);
+
+        // row variants must match the image variants
+        std::vector<demosaic_pix_rgb16> rgb16_row(n_cols / 2);
+        std::vector<demosaic_pix_rgb8> rgb8_row(n_cols / 2);
+        std::vector<U16> mono16_row(n_cols / 2);
+        std::vector<U8> mono8_row(n_cols / 2);
+        for (int row = 0; row < n_rows / 2; row++) {
+            int offset = row * (n_cols / 2);
+            demosaic_subsample_row_rgb8(bayer8, &args8, row, &rgb8_row[0]);
+            demosaic_subsample_row_mono8(bayer8, &args8, row, &mono8_row[0]);
+            EXPECT_EQ(0, memcmp(&rgb8_row[0], &rgb8[offset],
+                    rgb8_row.size() * sizeof(demosaic_pix_rgb8)));
+            EXPECT_EQ(0, memcmp(&mono8_row[0], &mono8[offset],
+                    mono8_row.size() * sizeof(U8)));
+            demosaic_subsample_row_rgb16(bayer16, &args, row, &rgb16_row[0]);
+            demosaic_subsample_row_mono16(bayer16, &args, row,
+                    &mono16_row[0]);
+            EXPECT_EQ(0, memcmp(&rgb16_row[0], &rgb16[offset],
+                    rgb16_row.size() * sizeof(demosaic_pix_rgb16)));
+            EXPECT_EQ(0, memcmp(&mono16_row[0], &mono16[offset],
+                    mono16_row.size() * sizeof(U16)));
+        }
+        demosaic_subsample_rgb16to8(bayer16, &args, &rgb8[0]);
+        demosaic_subsample_mono16to8(bayer16, &args, &mono8[0]);
+        for (int row = 0; row < n_rows / 2; row++) {
+            int offset = row * (n_cols / 2);
+            demosaic_subsample_row_rgb16to8(bayer16, &args, row,
+                    &rgb8_row[0]);
+            demosaic_subsample_row_mono16to8(bayer16, &args, row,
+                    &mono8_row[0]);
+            EXPECT_EQ(0, memcmp(&rgb8_row[0], &rgb8[offset],
+                    rgb8_row.size() * sizeof(demosaic_pix_rgb8)));
+            EXPECT_EQ(0, memcmp(&mono8_row[0], &mono8[offset],
+                    mono8_row.size() * sizeof(U8)));
+        }
+
+        free_global_bufs();
+    }
+    print_images = print_images_prev;
+}
+
+// every pattern must match its unoptimized reference, and a pattern is
+// an rggb image cropped by its row and column offsets, so away from the
+// crop edges its output must match the rggb output
+TEST(DemosaicTest, Patterns) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int n_rows = 64;
+    int n_cols = 70;
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+    make_random_input(&args);
+    do_demosaicing(&args);
+
+    std::vector<demosaic_pix_rgb16> rggb(image_out_rgb16,
+            image_out_rgb16 + n_rows * n_cols);
+    std::vector<U16> rggb_mono(image_out_mono16,
+            image_out_mono16 + n_rows * n_cols);
+
+    demosaic_pattern patterns[] = {
+            DEMOSAIC_GRBG, DEMOSAIC_GBRG, DEMOSAIC_BGGR};
+    for (int p = 0; p < 3; p++) {
+        demosaic_args pattern_args = args;
+        pattern_args.pattern = patterns[p];
+
+        // optimized against unoptimized, for all output types
+        do_demosaicing(&pattern_args);
+        check_optimized_matches_unoptimized(&pattern_args);
+
+        // crop the rggb image by the pattern's offsets
+        int row_off = patterns[p] >> 1;
+        int col_off = patterns[p] & 1;
+        demosaic_args crop_args = pattern_args;
+        crop_args.n_rows = n_rows - 2;
+        crop_args.n_cols = n_cols - 2;
+        std::vector<U16> crop(crop_args.n_rows * crop_args.n_cols);
+        for (int row = 0; row < crop_args.n_rows; row++) {
+            memcpy(&crop[row * crop_args.n_cols],
+                    &bayer16[(row + row_off) * n_cols + col_off],
+                    crop_args.n_cols * sizeof(U16));
+        }
+
+        int n_crop = crop_args.n_rows * crop_args.n_cols;
+        std::vector<demosaic_pix_rgb16> rgb(n_crop);
+        std::vector<demosaic_pix_rgb16> tiled(n_crop);
+        std::vector<U16> mono(n_crop);
+        demosaic_malvar_rgb16(&crop[0], &crop_args, &rgb[0]);
+        demosaic_malvar_rgb16_tiled(&crop[0], &crop_args, NULL, 16, 16,
+                &tiled[0]);
+        demosaic_malvar_mono16(&crop[0], &crop_args, &mono[0]);
+        EXPECT_EQ(0, memcmp(&rgb[0], &tiled[0],
+                n_crop * sizeof(demosaic_pix_rgb16)));
+        for (int row = 2; row < crop_args.n_rows - 2; row++) {
+            for (int col = 2; col < crop_args.n_cols - 2; col++) {
+                int i = row * crop_args.n_cols + col;
+                int j = (row + row_off) * n_cols + col + col_off;
+                ASSERT_EQ(rgb[i].red, rggb[j].red);
+                ASSERT_EQ(rgb[i].green, rggb[j].green);
+                ASSERT_EQ(rgb[i].blue, rggb[j].blue);
+                ASSERT_EQ(mono[i], rggb_mono[j]);
+            }
+        }
+
+        // subsampled quads take red, greens and blue from the pattern
+        std::vector<demosaic_pix_rgb16> half(n_crop / 4);
+        demosaic_subsample_rgb16(&crop[0], &crop_args, &half[0]);
+        for (int row = 0; row < crop_args.n_rows / 2; row++) {
+            for (int col = 0; col < crop_args.n_cols / 2; col++) {
+                const U16 * quad = &crop[2 * row * crop_args.n_cols + 2 * col];
+                int n = crop_args.n_cols;
+                int green_off = (row_off + col_off) % 2;
+                int green =
+                        (quad[1 - green_off] + quad[n + green_off] + 1) >> 1;
+                const demosaic_pix_rgb16 & pix =
+                        half[row * (crop_args.n_cols / 2) + col];
+                ASSERT_EQ(pix.red, quad[row_off * n + col_off]);
+                ASSERT_EQ(pix.green, green);
+                ASSERT_EQ(pix.blue, quad[(1 - row_off) * n + 1 - col_off]);
+            }
+        }
+    }
+
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+// the 8-bit kernels sum in 16 bits. Inputs of only 0 and max_val reach the
+// extremes of every malvar sum, which must match the reference for any
+// max_val, i.e. not overflow.
+TEST(DemosaicTest, ExtremeBayer8) {
+    int n_rows = 40;
+    int n_cols = 102;
+    int n_pix = n_rows * n_cols;
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    alloc_global_bufs(n_rows, n_cols);
+
+    // max_val is set per case below
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0xFF);
+
+    std::vector<demosaic_pix_rgb8> rgb(n_pix), rgb_ref(n_pix);
+    std::vector<U8> mono(n_pix), mono_ref(n_pix);
+    std::vector<U8> red(n_pix), green(n_pix), blue(n_pix);
+    demosaic_planes8 planes = {&red[0], &green[0], &blue[0], n_cols};
+
+    // all one value, one bayer color at max_val and the others at 0, and
+    // its inverse, one row or column parity at max_val, and random 0 or
+    // max_val
+    unsigned int max_vals[] = {0xFF, 0xF0, 0x80, 0x01};
+    for (unsigned int max_val : max_vals) {
+        args.max_val = max_val;
+        for (int input = 0; input < 14; input++) {
+            for (int row = 0; row < n_rows; row++) {
+                for (int col = 0; col < n_cols; col++) {
+                    int color = 2 * (row % 2) + (col % 2);
+                    bool high;
+                    if (input < 2) {
+                        high = input == 1;
+                    } else if (input < 10) {
+                        high = (color == (input - 2) % 4) == (input < 6);
+                    } else if (input < 12) {
+                        high = (row % 2) == (input % 2);
+                    } else if (input < 13) {
+                        high = (col % 2) == 1;
+                    } else {
+                        high = (rand() % 2) == 1;
+                    }
+                    bayer8[row * n_cols + col] = high ? max_val : 0;
+                }
+            }
+            for (int p = 0; p < 4; p++) {
+                args.pattern = (demosaic_pattern) p;
+                demosaic_malvar_rgb8(bayer8, &args, &rgb[0]);
+                demosaic_malvar_mono8(bayer8, &args, &mono[0]);
+                demosaic_malvar_rgb8_planar(bayer8, &args, &planes);
+                for (int row = 0; row < n_rows; row++) {
+                    demosaic_malvar_row_rgb8_unoptimized(bayer8, &args, row,
+                            &rgb_ref[row * n_cols]);
+                    demosaic_malvar_row_mono8_unoptimized(bayer8, &args, row,
+                            &mono_ref[row * n_cols]);
+                }
+                ASSERT_EQ(0, memcmp(&rgb_ref[0], &rgb[0],
+                        n_pix * sizeof(demosaic_pix_rgb8)))
+                        << input << " " << max_val << " " << p;
+                ASSERT_EQ(0, memcmp(&mono_ref[0], &mono[0], n_pix))
+                        << input << " " << max_val << " " << p;
+                expect_planes_match(&red[0], &green[0], &blue[0], n_cols,
+                        &rgb_ref[0], n_rows, n_cols);
+            }
+        }
+    }
+
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+// per-channel black levels and gains, applied to bayer pixels before the
+// kernels, for every pattern
+TEST(DemosaicTest, Calibration) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int n_rows = 34;
+    int n_cols = 70;
+    int n_pix = n_rows * n_cols;
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_calibration identity = {{0, 0, 0, 0}, {256, 256, 256, 256}};
+    demosaic_calibration cal = {{64, 100, 128, 200}, {512, 256, 384, 1024}};
+    demosaic_pattern patterns[] = {
+            DEMOSAIC_RGGB, DEMOSAIC_GRBG, DEMOSAIC_GBRG, DEMOSAIC_BGGR};
+    for (int p = 0; p < 4; p++) {
+        demosaic_args args;
+        demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+        args.pattern = patterns[p];
+        make_random_input(&args);
+        do_demosaicing(&args);
+        std::vector<demosaic_pix_rgb16> raw(image_out_rgb16,
+                image_out_rgb16 + n_pix);
+        std::vector<U16> raw_mono(image_out_mono16, image_out_mono16 + n_pix);
+
+        // unit gains and no black level change nothing
+        args.calibration = &identity;
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+        EXPECT_EQ(0, memcmp(&raw[0], image_out_rgb16,
+                n_pix * sizeof(demosaic_pix_rgb16)));
+        EXPECT_EQ(0, memcmp(&raw_mono[0], image_out_mono16,
+                n_pix * sizeof(U16)));
+
+        // optimized against unoptimized, for all output types, with gains
+        // large enough to clamp, and tiles against the image
+        args.calibration = &cal;
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+        demosaic_rect region = {3, 5, 20, 40};
+        check_tiled_matches_image(&args, NULL, 16, 16);
+        check_tiled_matches_image(&args, &region, 8, 12);
+
+        // a flat field, once calibrated, demosaics to a flat image
+        int values[4] = {2000, 3000, 3000, 1000};
+        int row_off = patterns[p] >> 1;
+        int col_off = patterns[p] & 1;
+        for (int row = 0; row < n_rows; row++) {
+            for (int col = 0; col < n_cols; col++) {
+                int ch = 2 * ((row + row_off) % 2) + ((col + col_off) % 2);
+                bayer16[row * n_cols + col] =
+                        cal.black[ch] + values[ch] * 256 / cal.gain[ch];
+            }
+        }
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+        for (int i = 0; i < n_pix; i++) {
+            ASSERT_EQ(image_out_rgb16[i].red, 2000);
+            ASSERT_EQ(image_out_rgb16[i].green, 3000);
+            ASSERT_EQ(image_out_rgb16[i].blue, 1000);
+            ASSERT_EQ(image_out_rgb8from16[i].red, 2000 >> 4);
+            ASSERT_EQ(image_out_rgb8from16[i].green, 3000 >> 4);
+            ASSERT_EQ(image_out_rgb8from16[i].blue, 1000 >> 4);
+        }
+        std::vector<demosaic_pix_rgb16> half(n_pix / 4);
+        demosaic_subsample_rgb16(bayer16, &args, &half[0]);
+        for (int i = 0; i < n_pix / 4; i++) {
+            ASSERT_EQ(half[i].red, 2000);
+            ASSERT_EQ(half[i].green, 3000);
+            ASSERT_EQ(half[i].blue, 1000);
+        }
+    }
+
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+// number of interpolated values at (row, col) of an rggb image that are
+// outside [0, max_val], from the malvar kernels. row and col at least 2
+// from the edges.
+int count_clamps_rggb(const U16 * bayer, int n_cols, int row, int col,
+        int max_val)
+{
+    auto pix = [&](int dr, int dc) {
+        return (int) bayer[(row + dr) * n_cols + col + dc];
+    };
+    auto clamped = [&](int x) { return (x < 0 || x > max_val) ? 1 : 0; };
+    int center = pix(0, 0);
+    int vert1 = pix(-1, 0) + pix(1, 0);
+    int horz1 = pix(0, -1) + pix(0, 1);
+    int vert2 = pix(-2, 0) + pix(2, 0);
+    int horz2 = pix(0, -2) + pix(0, 2);
+    int diag = pix(-1, -1) + pix(-1, 1) + pix(1, -1) + pix(1, 1);
+    if ((row % 2) == (col % 2)) { // red or blue
+        int green = (4 * center + 2 * (vert1 + horz1) - vert2 - horz2) / 8;
+        int opposite = (12 * center + 4 * diag - 3 * (vert2 + horz2)) / 16;
+        return clamped(green) + clamped(opposite);
+    }
+    int from_row = (10 * center + 8 * horz1 - 2 * (diag + horz2) + vert2) / 16;
+    int from_col = (10 * center + 8 * vert1 - 2 * (diag + vert2) + horz2) / 16;
+    return clamped(from_row) + clamped(from_col);
+}
+
+TEST(DemosaicTest, ColorCorrection) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int n_rows = 34;
+    int n_cols = 70;
+    int n_pix = n_rows * n_cols;
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_ccm identity = {{{1024, 0, 0}, {0, 1024, 0}, {0, 0, 1024}}};
+    demosaic_ccm ccm = {{{1600, -400, -176}, {-200, 1400, -176},
+            {-100, -300, 1424}}};
+    demosaic_calibration cal = {{64, 100, 128, 200}, {512, 256, 384, 1024}};
+    demosaic_pattern patterns[] = {
+            DEMOSAIC_RGGB, DEMOSAIC_GRBG, DEMOSAIC_GBRG, DEMOSAIC_BGGR};
+    for (int p = 0; p < 4; p++) {
+        demosaic_args args;
+        demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+        args.pattern = patterns[p];
+        make_random_input(&args);
+        do_demosaicing(&args);
+        std::vector<demosaic_pix_rgb16> raw(image_out_rgb16,
+                image_out_rgb16 + n_pix);
+        std::vector<U16> raw_mono(image_out_mono16, image_out_mono16 + n_pix);
+
+        // the identity matrix changes nothing
+        args.ccm = &identity;
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+        EXPECT_EQ(0, memcmp(&raw[0], image_out_rgb16,
+                n_pix * sizeof(demosaic_pix_rgb16)));
+        EXPECT_EQ(0, memcmp(&raw_mono[0], image_out_mono16,
+                n_pix * sizeof(U16)));
+
+        // optimized against unoptimized, for all output types, with
+        // negative coefficients applied to unclamped kernel outputs,
+        // with and without calibration, and tiles against the image
+        demosaic_rect region = {3, 5, 20, 40};
+        args.ccm = &ccm;
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+        check_tiled_matches_image(&args, NULL, 16, 16);
+        args.calibration = &cal;
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+        check_tiled_matches_image(&args, &region, 8, 12);
+        args.calibration = NULL;
+
+        // a flat field demosaics to its corrected color
+        int values[4] = {1000, 2000, 2000, 1500};
+        int row_off = patterns[p] >> 1;
+        int col_off = patterns[p] & 1;
+        for (int row = 0; row < n_rows; row++) {
+            for (int col = 0; col < n_cols; col++) {
+                int ch = 2 * ((row + row_off) % 2) + ((col + col_off) % 2);
+                bayer16[row * n_cols + col] = values[ch];
+            }
+        }
+        int rgb[3] = {values[0], values[1], values[3]};
+        int expected[3];
+        for (int i = 0; i < 3; i++) {
+            expected[i] = (ccm.coef[i][0] * rgb[0] + ccm.coef[i][1] * rgb[1]
+                           + ccm.coef[i][2] * rgb[2] + 512) / 1024;
+        }
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+        for (int i = 0; i < n_pix; i++) {
+            ASSERT_EQ(image_out_rgb16[i].red, expected[0]);
+            ASSERT_EQ(image_out_rgb16[i].green, expected[1]);
+            ASSERT_EQ(image_out_rgb16[i].blue, expected[2]);
+            ASSERT_EQ(image_out_rgb8from16[i].red, expected[0] >> 4);
+            ASSERT_EQ(image_out_rgb8from16[i].green, expected[1] >> 4);
+            ASSERT_EQ(image_out_rgb8from16[i].blue, expected[2] >> 4);
+        }
+        std::vector<demosaic_pix_rgb16> half(n_pix / 4);
+        demosaic_subsample_rgb16(bayer16, &args, &half[0]);
+        for (int i = 0; i < n_pix / 4; i++) {
+            ASSERT_EQ(half[i].red, expected[0]);
+            ASSERT_EQ(half[i].green, expected[1]);
+            ASSERT_EQ(half[i].blue, expected[2]);
+        }
+    }
+
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+TEST(DemosaicTest, ToneCurve) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int n_rows = 34;
+    int n_cols = 70;
+    int n_pix = n_rows * n_cols;
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+    args.pattern = DEMOSAIC_GRBG;
+    make_random_input(&args);
+    do_demosaicing(&args);
+    std::vector<demosaic_pix_rgb8> shifted(image_out_rgb8from16,
+            image_out_rgb8from16 + n_pix);
+    std::vector<U8> shifted_mono(image_out_mono8from16,
+            image_out_mono8from16 + n_pix);
+
+    // a lut of the shift matches it, and the shift is then unused
+    std::vector<U8> lut(args.max_val + 1);
+    for (int i = 0; i <= args.max_val; i++) {
+        lut[i] = i >> 4;
+    }
+    args.lut = &lut[0];
+    args.rshift = 0;
+    do_demosaicing(&args);
+    check_optimized_matches_unoptimized(&args);
+    EXPECT_EQ(0, memcmp(&shifted[0], image_out_rgb8from16,
+            n_pix * sizeof(demosaic_pix_rgb8)));
+    EXPECT_EQ(0, memcmp(&shifted_mono[0], image_out_mono8from16,
+            n_pix * sizeof(U8)));
+
+    // a gamma curve, against unoptimized, planar, tiled and subsampled
+    // outputs, with and without calibration and color correction
+    demosaic_calibration cal = {{64, 100, 128, 200}, {512, 256, 384, 1024}};
+    demosaic_ccm ccm = {{{1600, -400, -176}, {-200, 1400, -176},
+            {-100, -300, 1424}}};
+    for (int i = 0; i <= args.max_val; i++) {
+        lut[i] = (U8) (255.0 * pow(i / (double) args.max_val, 1 / 2.2) + 0.5);
+    }
+    for (int corrected = 0; corrected < 2; corrected++) {
+        args.calibration = corrected ? &cal : NULL;
+        args.ccm = corrected ? &ccm : NULL;
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+        std::vector<U8> red(n_pix), green(n_pix), blue(n_pix);
+        demosaic_planes8 planes = {&red[0], &green[0], &blue[0], n_cols};
+        demosaic_malvar_rgb16to8_planar(bayer16, &args, &planes);
+        expect_planes_match(&red[0], &green[0], &blue[0], n_cols,
+                image_out_rgb8from16, n_rows, n_cols);
+        demosaic_rect region = {3, 5, 20, 40};
+        check_tiled_matches_image(&args, NULL, 16, 16);
+        check_tiled_matches_image(&args, &region, 8, 12);
+        for (int i = 0; i < n_pix; i++) {
+            ASSERT_EQ(image_out_rgb8from16[i].red,
+                    lut[image_out_rgb16[i].red]);
+            ASSERT_EQ(image_out_rgb8from16[i].green,
+                    lut[image_out_rgb16[i].green]);
+            ASSERT_EQ(image_out_rgb8from16[i].blue,
+                    lut[image_out_rgb16[i].blue]);
+        }
+    }
+    args.calibration = NULL;
+    args.ccm = NULL;
+    std::vector<demosaic_pix_rgb16> half16(n_pix / 4);
+    std::vector<demosaic_pix_rgb8> half8(n_pix / 4);
+    demosaic_subsample_rgb16(bayer16, &args, &half16[0]);
+    demosaic_subsample_rgb16to8(bayer16, &args, &half8[0]);
+    for (int i = 0; i < n_pix / 4; i++) {
+        ASSERT_EQ(half8[i].red, lut[half16[i].red]);
+        ASSERT_EQ(half8[i].green, lut[half16[i].green]);
+        ASSERT_EQ(half8[i].blue, lut[half16[i].blue]);
+    }
+
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+TEST(DemosaicTest, Yuv) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    int n_rows = 34;
+    int n_cols = 150;
+    int n_pix = n_rows * n_cols;
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+    args.pattern = DEMOSAIC_BGGR;
+    make_random_input(&args);
+    demosaic_args args8 = args;
+    args8.max_val = 0xFF;
+
+    // padded planes, large enough for 4:2:2
+    int y_stride = n_cols + 3;
+    int chroma_stride = n_cols / 2 + 5;
+    std::vector<U8> y(n_rows * y_stride);
+    std::vector<U8> cb(n_rows * chroma_stride), cr(n_rows * chroma_stride);
+    demosaic_planes_yuv8 planes = {&y[0], &cb[0], &cr[0],
+            y_stride, chroma_stride};
+
+    // against rgb and mono outputs, also shifted or tone mapped and
+    // color corrected, and for other luma coefficients
+    demosaic_ccm ccm = {{{1600, -400, -176}, {-200, 1400, -176},
+            {-100, -300, 1424}}};
+    std::vector<U8> lut(args.max_val + 1);
+    for (int i = 0; i <= args.max_val; i++) {
+        lut[i] = (U8) (255.0 * pow(i / (double) args.max_val, 1 / 2.2) + 0.5);
+    }
+    for (int variant = 0; variant < 3; variant++) {
+        args.lut = (variant == 1) ? &lut[0] : NULL;
+        args.ccm = (variant == 1) ? &ccm : NULL;
+        if (variant == 2) {
+            args.coefs = {0.2126, 0.7152, 0.0722};  // rec 709 formula
+        }
+        args8 = args;
+        args8.max_val = 0xFF;
+        do_demosaicing(&args);
+        for (int f = 0; f < 2; f++) {
+            demosaic_yuv_format format = (demosaic_yuv_format) f;
+            demosaic_malvar_yuv8(bayer8, &args8, format, &planes);
+            expect_yuv_matches(&args8, format, &planes, image_out_rgb8,
+                    image_out_mono8);
+            demosaic_malvar_yuv16to8(bayer16, &args, format, &planes);
+            expect_yuv_matches(&args, format, &planes, image_out_rgb8from16,
+                    image_out_mono8from16);
+        }
+    }
+
+    // gray has neutral chroma, and chroma samples past the width of the
+    // image and the height of 4:2:0 are not written
+    for (int i = 0; i < n_pix; i++) {
+        bayer8[i] = 77;
+    }
+    std::fill(cb.begin(), cb.end(), 0);
+    std::fill(cr.begin(), cr.end(), 0);
+    demosaic_malvar_yuv8(bayer8, &args8, DEMOSAIC_YUV420, &planes);
+    for (int row = 0; row < n_rows; row++) {
+        for (int col = 0; col < chroma_stride; col++) {
+            bool inside = row < n_rows / 2 && col < n_cols / 2;
+            ASSERT_EQ(inside ? 128 : 0, cb[row * chroma_stride + col]);
+            ASSERT_EQ(inside ? 128 : 0, cr[row * chroma_stride + col]);
+        }
+        for (int col = 0; col < n_cols; col++) {
+            ASSERT_EQ(77, y[row * y_stride + col]);
+        }
+    }
+
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+// every engine the host supports must match the scalar reference, for
+// every output type and input path, with and without calibration and
+// color correction, at widths leaving vector remainders
+TEST(DemosaicTest, Engines) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    demosaic_engine initial = demosaic_engine_active();
+    EXPECT_NE(DEMOSAIC_ENGINE_AUTO, initial);
+    EXPECT_TRUE(demosaic_engine_supported(initial));
+    EXPECT_TRUE(demosaic_engine_supported(DEMOSAIC_ENGINE_AUTO));
+    EXPECT_TRUE(demosaic_engine_supported(DEMOSAIC_ENGINE_SCALAR));
+
+    // auto selects the widest, and never narrows the compiler's engine
+    demosaic_engine best = demosaic_engine_init(DEMOSAIC_ENGINE_AUTO);
+    EXPECT_EQ(best, demosaic_engine_active());
+    EXPECT_GE(best, initial);
+    for (int e = best + 1; e <= DEMOSAIC_ENGINE_NEON; e++) {
+        EXPECT_FALSE(demosaic_engine_supported((demosaic_engine) e));
+    }
+
+    demosaic_calibration cal = {{64, 100, 128, 200}, {512, 256, 384, 1024}};
+    demosaic_ccm ccm = {{{1600, -400, -176}, {-200, 1400, -176},
+            {-100, -300, 1424}}};
+    int dims[][2] = {{6, 34}, {8, 38}, {34, 70}};
+    for (int e = DEMOSAIC_ENGINE_SCALAR; e <= DEMOSAIC_ENGINE_NEON; e++) {
+        demosaic_engine engine = (demosaic_engine) e;
+        if (!demosaic_engine_supported(engine)) {
+            continue;
+        }
+        printf("engine %d\n", e);
+        EXPECT_EQ(engine, demosaic_engine_init(engine));
+        EXPECT_EQ(engine, demosaic_engine_active());
+
+        // 12-bit, and 8-bit for the 8-bit planar outputs
+        for (int i = 0; i < 6; i++) {
+            // raw, calibrated, then also color corrected
+            for (int c = 0; c < 3; c++) {
+                int n_rows = dims[i % 3][0];
+                int n_cols = dims[i % 3][1];
+                int n_pix = n_rows * n_cols;
+                alloc_global_bufs(n_rows, n_cols);
+
+                demosaic_args args;
+                demosaic_args_init(&args, n_rows, n_cols,
+                        (i < 3) ? 0x0FFF : 0xFF);
+                args.rshift = (i < 3) ? 4 : 0;
+                args.pattern = (demosaic_pattern) ((i + c) % 4);
+                args.calibration = (c > 0) ? &cal : NULL;
+                args.ccm = (c > 1) ? &ccm : NULL;
+
+                make_random_input(&args);
+                do_demosaicing(&args);
+                check_optimized_matches_unoptimized(&args);
+                if (args.max_val == 0xFF) {
+                    check_planar_matches_packed(&args);
+                }
+                check_packed_matches_image(&args, DEMOSAIC_PACKED_RAW12);
+
+                std::vector<demosaic_pix_rgb16> rgb16(n_pix);
+                std::vector<U16> mono16(n_pix);
+                demosaic_malvar_rgb16_mono16(bayer16, &args, &rgb16[0],
+                        &mono16[0]);
+                EXPECT_EQ(0, memcmp(&rgb16[0], image_out_rgb16,
+                        n_pix * sizeof(demosaic_pix_rgb16)));
+                EXPECT_EQ(0, memcmp(&mono16[0], image_out_mono16,
+                        n_pix * sizeof(U16)));
+
+                free_global_bufs();
+            }
+        }
+    }
+
+    EXPECT_EQ(initial, demosaic_engine_init(initial));
+    print_images = print_images_prev;
+}
+
+// fill the bayer images with 0, max_val, or uniform random values, so
+// kernels overshoot and clamp at both ends of the range
+void make_extreme_input(
+        demosaic_args * args)
+{
+    int n_pix = args->n_rows * args->n_cols;
+    for (int i = 0; i < n_pix; i++) {
+        int pick = rand() % 3;
+        U16 val = (pick == 0) ? 0 : (pick == 1) ? args->max_val
+                : rand() % (args->max_val + 1);
+        bayer16[i] = val;
+        bayer8[i] = val >> args->rshift;
+    }
+}
+
+// demosaic the whole image with each optimized function into the global
+// outputs, adding the seconds each took to seconds
+void do_optimized_demosaicing(
+        demosaic_args * args,
+        double seconds[6])
+{
+    demosaic_args args8 = *args;
+    args8.max_val = 0xFF;
+    clock_t t[7];
+
+    t[0] = clock();
+    demosaic_malvar_rgb16(bayer16, args, image_out_rgb16);
+    t[1] = clock();
+    demosaic_malvar_rgb8(bayer8, &args8, image_out_rgb8);
+    t[2] = clock();
+    demosaic_malvar_rgb16to8(bayer16, args, image_out_rgb8from16);
+    t[3] = clock();
+    demosaic_malvar_mono16(bayer16, args, image_out_mono16);
+    t[4] = clock();
+    demosaic_malvar_mono8(bayer8, &args8, image_out_mono8);
+    t[5] = clock();
+    demosaic_malvar_mono16to8(bayer16, args, image_out_mono8from16);
+    t[6] = clock();
+    for (int i = 0; i < 6; i++) {
+        seconds[i] += ((double) (t[i + 1] - t[i])) / CLOCKS_PER_SEC;
+    }
+}
+
+// every engine, through every whole-image path, must match the unoptimized
+// functions on minimal images, widths leaving every vector tail, each
+// pattern, extreme max_val and rshift, and a large frame, whose throughput
+// is recorded per engine, as test properties. Only builds with
+// DEMOSAIC_INSTRUMENT 0 time the kernels alone.
+TEST(DemosaicTest, EngineRegression) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    const char * engine_names[] = {"auto", "scalar", "sse2", "sse41", "avx2",
+            "neon"};
+    const char * output_names[] = {"rgb16", "rgb8", "rgb16to8", "mono16",
+            "mono8", "mono16to8"};
+    demosaic_engine initial = demosaic_engine_active();
+
+    // n_rows, n_cols, max_val, rshift
+    int cases[][4] = {
+        {2, 2, 0x0FFF, 4},
+        {4, 4, 0x0FFF, 4},
+        {2, 6, 0x03FF, 2},
+        {4, 10, 0x0FFF, 4},
+        {6, 14, 0x0FFF, 4},
+        {8, 18, 0x0FFF, 4},
+        {10, 22, 0xFFFF, 8},
+        {12, 26, 0xFFFF, 15},
+        {6, 30, 0x00FF, 0},
+        {8, 38, 0x0001, 0},
+        {14, 42, 0x3FFF, 6},
+        {1080, 1920, 0x0FFF, 4}};
+    int n_cases = sizeof(cases) / sizeof(cases[0]);
+    for (int k = 0; k < n_cases; k++) {
+        int n_rows = cases[k][0];
+        int n_cols = cases[k][1];
+        bool large = (n_rows * n_cols >= 1000000);
+        alloc_global_bufs(n_rows, n_cols);
+
+        demosaic_args args;
+        demosaic_args_init(&args, n_rows, n_cols, cases[k][2]);
+        args.rshift = cases[k][3];
+        args.pattern = (demosaic_pattern) (k % 4);
+
+        // the scalar kernels and the unoptimized references
+        demosaic_engine_init(DEMOSAIC_ENGINE_SCALAR);
+        make_extreme_input(&args);
+        do_demosaicing(&args);
+        check_optimized_matches_unoptimized(&args);
+
+        for (int e = DEMOSAIC_ENGINE_SCALAR; e <= DEMOSAIC_ENGINE_NEON; e++) {
+            demosaic_engine engine = (demosaic_engine) e;
+            if (!demosaic_engine_supported(engine)) {
+                continue;
+            }
+            SCOPED_TRACE(testing::Message() << engine_names[e] << " "
+                    << n_rows << "x" << n_cols << " max_val " << args.max_val
+                    << " rshift " << args.rshift);
+            demosaic_engine_init(engine);
+
+            double seconds[6] = {0};
+            int n_iters = large ? 3 : 1;
+            for (int i = 0; i < n_iters; i++) {
+                do_optimized_demosaicing(&args, seconds);
+            }
+            check_optimized_matches_unoptimized(&args);
+
+            check_tiled_matches_image(&args, NULL, 6, 10);
+            check_stream_matches_image(&args);
+            demosaic_dispatcher threaded = {thread_dispatch, NULL, 3};
+            check_parallel_matches_serial(&args, &threaded);
+            if (args.max_val <= 0x0FFF) {
+                check_packed_matches_image(&args, DEMOSAIC_PACKED_RAW12);
+            }
+            if (args.max_val <= 0x03FF && n_cols % 4 == 0) {
+                check_packed_matches_image(&args, DEMOSAIC_PACKED_RAW10);
+            }
+            if (args.max_val <= 0xFF) {
+                check_planar_matches_packed(&args);
+                check_pitched_matches_image(&args);
+            }
+
+            if (large) {
+                printf("%-6s %dx%d:", engine_names[e], n_rows, n_cols);
+                for (int i = 0; i < 6; i++) {
+                    int mpix_s = (int) (n_iters * (double) (n_rows * n_cols)
+                            / std::max(seconds[i], 1e-6) / 1e6);
+                    printf(" %s %d", output_names[i], mpix_s);
+                    RecordProperty(std::string(engine_names[e]) + "_"
+                            + output_names[i] + "_mpix_s", mpix_s);
+                }
+                printf(" Mpix/s\n");
+            }
+        }
+
+        free_global_bufs();
+    }
+
+    EXPECT_EQ(initial, demosaic_engine_init(initial));
+    print_images = print_images_prev;
+}
+
+// whole-image and batch output of a plan streamed past the cache must match
+// the cached output, into unaligned outputs and rows of partial chunks
+TEST(DemosaicTest, StreamingStores) {
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    demosaic_engine initial = demosaic_engine_active();
+
+    int dims[][2] = {{2, 2}, {6, 34}, {34, 262}, {480, 640}};
+    for (int e = DEMOSAIC_ENGINE_SCALAR; e <= DEMOSAIC_ENGINE_NEON; e++) {
+        if (!demosaic_engine_supported((demosaic_engine) e)) {
+            continue;
+        }
+        demosaic_engine_init((demosaic_engine) e);
+        for (int i = 0; i < 4; i++) {
+            int n_rows = dims[i][0];
+            int n_cols = dims[i][1];
+            int n_pix = n_rows * n_cols;
+            alloc_global_bufs(n_rows, n_cols);
+
+            demosaic_args args;
+            demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+            args.pattern = (demosaic_pattern) i;
+            demosaic_args args8 = args;
+            args8.max_val = 0xFF;
+
+            make_random_input(&args);
+            do_demosaicing(&args);
+
+            demosaic_plan plan;
+            demosaic_plan_init(&plan, &args);
+            EXPECT_EQ(DEMOSAIC_STORE_CACHED, plan.store);
+            plan.store = DEMOSAIC_STORE_STREAMING;
+            demosaic_plan plan8;
+            demosaic_plan_init(&plan8, &args8);
+            plan8.store = DEMOSAIC_STORE_STREAMING;
+
+            // 2 bytes past an aligned start, so every row starts unaligned
+            std::vector<U8> bytes(n_pix * sizeof(demosaic_pix_rgb16) + 64);
+            U8 * out = &bytes[(64 - (size_t) &bytes[0] % 64) % 64 + 2];
+
+            demosaic_malvar_rgb16_plan(bayer16, &plan,
+                    (demosaic_pix_rgb16 *) out);
+            EXPECT_EQ(0, memcmp(out, image_out_rgb16,
+                    n_pix * sizeof(demosaic_pix_rgb16)));
+            demosaic_malvar_rgb8_plan(bayer8, &plan8,
+                    (demosaic_pix_rgb8 *) out);
+            EXPECT_EQ(0, memcmp(out, image_out_rgb8,
+                    n_pix * sizeof(demosaic_pix_rgb8)));
+            demosaic_malvar_rgb16to8_plan(bayer16, &plan,
+                    (demosaic_pix_rgb8 *) out);
+            EXPECT_EQ(0, memcmp(out, image_out_rgb8from16,
+                    n_pix * sizeof(demosaic_pix_rgb8)));
+            demosaic_malvar_mono16_plan(bayer16, &plan, (U16 *) out);
+            EXPECT_EQ(0, memcmp(out, image_out_mono16, n_pix * sizeof(U16)));
+            demosaic_malvar_mono8_plan(bayer8, &plan8, out);
+            EXPECT_EQ(0, memcmp(out, image_out_mono8, n_pix));
+            demosaic_malvar_mono16to8_plan(bayer16, &plan, out);
+            EXPECT_EQ(0, memcmp(out, image_out_mono8from16, n_pix));
+
+            // serial and dispatched batches of two frames, in two outputs
+            std::vector<U8> bytes2(n_pix * sizeof(demosaic_pix_rgb16) + 64);
+            U8 * out2 = &bytes2[(64 - (size_t) &bytes2[0] % 64) % 64 + 6];
+            const U16 * in16[2] = {bayer16, bayer16};
+            demosaic_pix_rgb16 * out_rgb16[2] = {
+                (demosaic_pix_rgb16 *) out, (demosaic_pix_rgb16 *) out2};
+            U8 * out_mono8[2] = {out, out2};
+            int n_calls = 0;
+            demosaic_dispatcher dispatcher = {serial_dispatch, &n_calls, 3};
+            for (int d = 0; d < 2; d++) {
+                memset(out, 0, n_pix * sizeof(demosaic_pix_rgb16));
+                memset(out2, 0, n_pix * sizeof(demosaic_pix_rgb16));
+                demosaic_malvar_rgb16_batch(in16, &plan,
+                        (d == 0) ? NULL : &dispatcher, 2, out_rgb16);
+                for (int f = 0; f < 2; f++) {
+                    EXPECT_EQ(0, memcmp(out_rgb16[f], image_out_rgb16,
+                            n_pix * sizeof(demosaic_pix_rgb16)));
+                }
+                demosaic_malvar_mono16to8_batch(in16, &plan,
+                        (d == 0) ? NULL : &dispatcher, 2, out_mono8);
+                for (int f = 0; f < 2; f++) {
+                    EXPECT_EQ(0, memcmp(out_mono8[f], image_out_mono8from16,
+                            n_pix));
+                }
+            }
+            // 2 dispatched batches of 2 frames of 3 bands
+            EXPECT_EQ(12, n_calls);
+
+            free_global_bufs();
+        }
+    }
+
+    EXPECT_EQ(initial, demosaic_engine_init(initial));
+    print_images = print_images_prev;
+}
+
+// frames of mapped raw files, with a header and padded rows, must demosaic
+// like the buffers written to them, and output files must hold what was
+// demosaiced into their mapping
+TEST(DemosaicTest, FileMap) {
+    int n_rows = 34;
+    int n_cols = 70;
+    int n_pix = n_rows * n_cols;
+    int n_frames = 3;
+    int header_bytes = 10;
+    int row_pitch = n_cols * sizeof(U16) + 6;
+    bool print_images_prev = print_images;
+    print_images = false;
+
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+
+    // frames of random pixels, the last without padding after its last row
+    std::vector<U16> frames(n_frames * n_pix);
+    for (int i = 0; i < n_frames * n_pix; i++) {
+        frames[i] = rand() & args.max_val;
+    }
+    FILE * raw = fopen("file_map_bayer16.raw", "wb");
+    ASSERT_TRUE(raw != NULL);
+    std::vector<U8> header(header_bytes, 0xA5);
+    std::vector<U8> padding(row_pitch - n_cols * sizeof(U16), 0);
+    fwrite(&header[0], 1, header_bytes, raw);
+    for (int row = 0; row < n_frames * n_rows; row++) {
+        fwrite(&frames[row * n_cols], sizeof(U16), n_cols, raw);
+        if (row < n_frames * n_rows - 1) {
+            fwrite(&padding[0], 1, padding.size(), raw);
+        }
+    }
+    fclose(raw);
+
+    demosaic_file_layout layout;
+    layout.n_rows = n_rows;
+    layout.n_cols = n_cols;
+    layout.format = DEMOSAIC_FILE_U16;
+    layout.header_bytes = header_bytes;
+    layout.row_pitch = row_pitch;
+    layout.frame_pitch = 0;
+
+    demosaic_file in;
+    demosaic_file out;
+    ASSERT_EQ(DEMOSAIC_FILE_OK,
+            demosaic_file_map("file_map_bayer16.raw", &layout, &in));
+    ASSERT_EQ(n_frames, in.n_frames);
+    ASSERT_EQ(row_pitch, in.layout.row_pitch);
+    ASSERT_EQ((size_t) (n_rows * row_pitch), in.layout.frame_pitch);
+    ASSERT_EQ(DEMOSAIC_FILE_OK, demosaic_file_create("file_map_rgb8.raw",
+            0, n_pix * sizeof(demosaic_pix_rgb8), n_frames, &out));
+
+    demosaic_pitch pitch = {row_pitch,
+            (I32) (n_cols * sizeof(demosaic_pix_rgb8))};
+    std::vector<demosaic_pix_rgb8> expected(n_frames * n_pix);
+    for (int frame = 0; frame < n_frames; frame++) {
+        if (frame + 1 < n_frames) {
+            demosaic_file_prefetch(&in, frame + 1);
+        }
+        demosaic_malvar_rgb16to8(&frames[frame * n_pix], &args,
+                &expected[frame * n_pix]);
+        demosaic_malvar_rgb16to8_pitched(demosaic_file_bayer16(&in, frame),
+                &args, &pitch,
+                (demosaic_pix_rgb8 *) demosaic_file_output(&out, frame));
+    }
+    ASSERT_EQ(DEMOSAIC_FILE_OK, demosaic_file_unmap(&in));
+    ASSERT_TRUE(in.data == NULL);
+    ASSERT_EQ(DEMOSAIC_FILE_OK, demosaic_file_unmap(&out));
+
+    std::vector<demosaic_pix_rgb8> written(n_frames * n_pix);
+    FILE * rgb = fopen("file_map_rgb8.raw", "rb");
+    ASSERT_TRUE(rgb != NULL);
+    ASSERT_EQ((size_t) (n_frames * n_pix),
+            fread(&written[0], sizeof(demosaic_pix_rgb8), written.size(), rgb));
+    ASSERT_EQ(EOF, fgetc(rgb));
+    fclose(rgb);
+    ASSERT_EQ(0, memcmp(&expected[0], &written[0],
+            written.size() * sizeof(demosaic_pix_rgb8)));
+
+    // 8-bit frames, unpadded and adjacent, in the same file
+    layout.format = DEMOSAIC_FILE_U8;
+    layout.header_bytes = 0;
+    layout.row_pitch = 0;
+    ASSERT_EQ(DEMOSAIC_FILE_OK,
+            demosaic_file_map("file_map_bayer16.raw", &layout, &in));
+    ASSERT_EQ(n_cols, in.layout.row_pitch);
+    ASSERT_EQ((I32) ((header_bytes + n_frames * n_rows * row_pitch - 6)
+            / n_pix), in.n_frames);
+    ASSERT_EQ(in.data + n_pix, demosaic_file_bayer8(&in, 1));
+    ASSERT_EQ(DEMOSAIC_FILE_OK, demosaic_file_unmap(&in));
+
+    // failures of the file system
+    ASSERT_EQ(DEMOSAIC_FILE_ERR_OPEN,
+            demosaic_file_map("file_map_missing.raw", &layout, &in));
+    ASSERT_TRUE(in.data == NULL);
+    layout.n_rows = 4 * n_rows * n_frames;
+    ASSERT_EQ(DEMOSAIC_FILE_ERR_SIZE,
+            demosaic_file_map("file_map_bayer16.raw", &layout, &in));
+    ASSERT_TRUE(in.data == NULL);
+
+    remove("file_map_bayer16.raw");
+    remove("file_map_rgb8.raw");
+    free_global_bufs();
+    print_images = print_images_prev;
+}
+
+TEST(DemosaicTest, Instrumentation) {
+#if DEMOSAIC_INSTRUMENT != 0
+    int n_rows = 32;
+    int n_cols = 46;
+    int n_pix = n_rows * n_cols;
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0x0FFF);
+
+    // black and white speckle away from the edges, so that only interior
+    // pixels clamp
+    std::vector<U16> bayer(n_pix, 0);
+    srand(15);
+    for (int row = 4; row < n_rows - 4; row++) {
+        for (int col = 4; col < n_cols - 4; col++) {
+            bayer[row * n_cols + col] = (rand() % 3 == 0) ? args.max_val : 0;
+        }
+    }
+    long n_clamped = 0;
+    for (int row = 2; row < n_rows - 2; row++) {
+        for (int col = 2; col < n_cols - 2; col++) {
+            n_clamped += count_clamps_rggb(&bayer[0], n_cols, row, col,
+                    args.max_val);
+        }
+    }
+    ASSERT_GT(n_clamped, 0);
+
+    std::vector<demosaic_pix_rgb16> rgb(n_pix);
+    std::vector<U8> mono(n_pix);
+    for (int output = 0; output < 2; output++) {
+        reset_stage_tallies();
+        if (output == 0) {
+            demosaic_malvar_rgb16(&bayer[0], &args, &rgb[0]);
+        } else {
+            demosaic_malvar_mono16to8(&bayer[0], &args, &mono[0]);
+        }
+
+        for (int stage = 0; stage < 4; stage++) {
+            EXPECT_EQ(stage_tallies[stage].n_begin,
+                      stage_tallies[stage].n_end);
+            EXPECT_FALSE(stage_tallies[stage].open);
+        }
+        EXPECT_EQ(stage_overlaps, 0);
+        const stage_tally & image = stage_tallies[DEMOSAIC_STAGE_IMAGE];
+        const stage_tally & edge_rows = stage_tallies[DEMOSAIC_STAGE_EDGE_ROWS];
+        const stage_tally & edge_cols = stage_tallies[DEMOSAIC_STAGE_EDGE_COLS];
+        const stage_tally & interior = stage_tallies[DEMOSAIC_STAGE_INTERIOR];
+        EXPECT_EQ(image.n_end, 1);
+        EXPECT_EQ(image.n_pixels, n_pix);
+        // left edge, interior and right edge of each of the 4 rows
+        EXPECT_EQ(edge_rows.n_end, 4 * 3);
+        EXPECT_EQ(edge_rows.n_pixels, 4 * n_cols);
+        EXPECT_EQ(edge_rows.n_clamped, 0);
+        EXPECT_EQ(edge_cols.n_end, 2 * (n_rows - 4));
+        EXPECT_EQ(edge_cols.n_pixels, 4 * (n_rows - 4));
+        EXPECT_EQ(edge_cols.n_clamped, 0);
+        EXPECT_EQ(interior.n_end, n_rows - 4);
+        EXPECT_EQ(interior.n_pixels, (n_rows - 4) * (n_cols - 4));
+        EXPECT_EQ(interior.n_clamped, n_clamped);
+        EXPECT_GE(image.ticks, interior.ticks);
+    }
+
+    // region functions report the same stages, through the span kernels
+    reset_stage_tallies();
+    demosaic_rect region = {2, 2, n_rows - 4, n_cols - 4};
+    std::vector<demosaic_pix_rgb16> region_rgb(region.n_rows * region.n_cols);
+    demosaic_malvar_region_rgb16(&bayer[0], &args, &region, &region_rgb[0]);
+    EXPECT_EQ(stage_tallies[DEMOSAIC_STAGE_IMAGE].n_end, 0);
+    EXPECT_EQ(stage_tallies[DEMOSAIC_STAGE_EDGE_COLS].n_pixels, 0);
+    EXPECT_EQ(stage_tallies[DEMOSAIC_STAGE_INTERIOR].n_pixels,
+              region.n_rows * region.n_cols);
+    EXPECT_EQ(stage_tallies[DEMOSAIC_STAGE_INTERIOR].n_clamped, n_clamped);
+#else
+    printf("DEMOSAIC_INSTRUMENT is 0, hooks compile to nothing\n");
+#endif
+}
+
+TEST(DemosaicTest, Image) {
+
+    int n_cols = 0;
+    int n_rows = 0;
+    uint32_t* frog_image = NULL;
+
+
+    frog_image = (uint32_t*) ReadImage(&n_cols, &n_rows,
+            "../test/frog.bmp", IMAGEIO_U8 | IMAGEIO_RGBA);
+
+    ASSERT_TRUE(frog_image != NULL);
+
+    printf("width = %d, height = %d\n", n_cols, n_rows);
+
+    alloc_global_bufs(n_rows, n_cols);
+
+    demosaic_pix_rgb8 * image_mosaic = (demosaic_pix_rgb8*) malloc(
+            n_rows * n_cols * sizeof(demosaic_pix_rgb8));
+
+    // make inputs
+
+    for (int row = 0; row < n_rows; row++) {
+        for (int col = 0; col < n_cols; col++) {
+            U8* u8p = (U8*)(&frog_image[row*n_cols+col]);
+            U8 red = u8p[0];
+            U8 green = u8p[1];
+            U8 blue = u8p[2];
+            image_truth16[(row * n_cols) + col].red = (U16)red << 4;
+            image_truth16[(row * n_cols) + col].green = (U16)green << 4;
+            image_truth16[(row * n_cols) + col].blue = (U16)blue << 4;
+            image_truth8[(row * n_cols) + col].red = red;
+            image_truth8[(row * n_cols) + col].green = green;
+            image_truth8[(row * n_cols) + col].blue = blue;
+            image_mosaic[(row * n_cols) + col].red = 0;
+            image_mosaic[(row * n_cols) + col].green = 0;
+            image_mosaic[(row * n_cols) + col].blue = 0;
+            if (row % 2 == 0 && col % 2 == 0) {
+                bayer16[(row * n_cols) + col] = (U16)red << 4;
+                bayer8[(row * n_cols) + col] = red;
+                image_mosaic[(row * n_cols) + col].red = red;
+            } else if (row % 2 == 1 && col % 2 == 1) {
+                bayer16[(row * n_cols) + col] = (U16)blue << 4;
+                bayer8[(row * n_cols) + col] = blue;
+                image_mosaic[(row * n_cols) + col].blue = blue;
+            } else {
+                bayer16[(row * n_cols) + col] = (U16)green << 4;
+                bayer8[(row * n_cols) + col] = green;
+                image_mosaic[(row * n_cols) + col].green = green;
+            }
+        }
+    }
+
+    int ret;
+    ret = WriteImage(image_truth8,n_cols,n_rows, "frog_check.bmp",
+            IMAGEIO_U8 | IMAGEIO_RGB, 85);
+    ASSERT_EQ(ret, 1);
+    ret = WriteImage(image_mosaic,n_cols,n_rows, "frog_mosaic_rgb.bmp",
+            IMAGEIO_U8 | IMAGEIO_RGB, 85);
+    ASSERT_EQ(ret, 1);
+    ret = WriteImage(bayer8,n_cols,n_rows, "frog_mosaic_gray.bmp",
+            IMAGEIO_U8 | IMAGEIO_GRAYSCALE, 85);
+    ASSERT_EQ(ret, 1);
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, 0xFFF);
+
+
+    do_demosaicing(&args);
+
+    // frog image has some test patterns meant to generate artifacts
+    check_demosaicing_error(&args, 1000);
+
+    ret = WriteImage(image_out_rgb8,n_cols,n_rows, "frog_demosaic_rgb.bmp",
+            IMAGEIO_U8 | IMAGEIO_RGB, 85);
+    ASSERT_EQ(ret, 1);
+    ret = WriteImage(image_out_mono8,n_cols,n_rows, "frog_demosaic_gray.bmp",
+            IMAGEIO_U8 | IMAGEIO_GRAYSCALE, 85);
+    ASSERT_EQ(ret, 1);
+
+
+    free(frog_image);
+    free(image_mosaic);
+
+    free_global_bufs();
+
+}
+
+TEST(DemosaicTest, Misc) {
+    // adding two maxed uints to a larger signed int should not overflow
+    U16 buf[] = {65535,65534};
+
+    I32 ans = buf[0] + buf[1];
+    EXPECT_EQ(ans, 131069);
+
+
+}
+
+TEST(DemosaicDeathTest, Asserts) {
+
+    if (getenv("DEMOSAIC_DISABLE_DEATH_TESTS")) {
+        printf("disabling death tests... they don't play well with valgrind.\n");
+        return;
+    } else {
+        printf("death tests enabled.\n");
+    }
+
+    int n_rows = 480;
+    int n_cols = 480;
+    int n_pix = n_rows*n_cols;
+    unsigned int max_val = 0x0FFF;
+
+    alloc_global_bufs(n_rows, n_cols);
+    free_global_bufs();
+
+    demosaic_pix_rgb16 image_truth16_loc = {0,0,0};
+    demosaic_pix_rgb8 image_truth8_loc = {0,0,0};
+    U16 bayer16_loc = 0;
+    U8  bayer8_loc = 0;
+    demosaic_pix_rgb16 image_out_rgb16_loc = {0,0,0};
+    demosaic_pix_rgb8  image_out_rgb8_loc = {0,0,0};
+    demosaic_pix_rgb8  image_out_rgb8from16_loc = {0,0,0};
+    U16 image_out_mono16_loc = 0;
+    U8  image_out_mono8_loc = 0;
+    U8  image_out_mono8from16_loc = 0;
+    demosaic_pix_rgb16 image_out_rgb16_unopt_loc = {0,0,0};
+    demosaic_pix_rgb8  image_out_rgb8_unopt_loc = {0,0,0};
+    demosaic_pix_rgb8  image_out_rgb8from16_unopt_loc = {0,0,0};
+    U16 image_out_mono16_unopt_loc = 0;
+    U8  image_out_mono8_unopt_loc = 0;
+    U8  image_out_mono8from16_unopt_loc = 0;
+
+    image_truth16 = &image_truth16_loc;
+    image_truth8 = &image_truth8_loc;
+    bayer16 = &bayer16_loc;
+    bayer8 = &bayer8_loc;
+    image_out_rgb16 = &image_out_rgb16_loc;
+    image_out_rgb8 = &image_out_rgb8_loc;
+    image_out_rgb8from16 = &image_out_rgb8from16_loc;
+    image_out_mono16 = &image_out_mono16_loc;
+    image_out_mono8 = &image_out_mono8_loc;
+    image_out_mono8from16 = &image_out_mono8from16_loc;
+    image_out_rgb16_unopt = &image_out_rgb16_unopt_loc;
+    image_out_rgb8_unopt = &image_out_rgb8_unopt_loc;
+    image_out_rgb8from16_unopt = &image_out_rgb8from16_unopt_loc;
+    image_out_mono16_unopt = &image_out_mono16_unopt_loc;
+    image_out_mono8_unopt = &image_out_mono8_unopt_loc;
+    image_out_mono8from16_unopt = &image_out_mono8from16_unopt_loc;
+
+
+    demosaic_args args;
+    demosaic_args_init(&args, n_rows, n_cols, max_val);
+    args.rshift = 4;
+//    make_random_input(&args);
+    demosaic_args bad_args;
+    int row = 0;
+
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16(NULL, &args, row,
+                    &image_out_rgb16[row * args.n_cols]),
+            "bayer");
+
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16(bayer16, NULL, row,
+                    &image_out_rgb16[row * args.n_cols]),
+            "args");
+
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16(bayer16, &args, row,
+                    NULL),
+            "output_row");
+
+    row = -1;
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16(bayer16, &args, row,
+                    &image_out_rgb16[row * args.n_cols]),
+            "row");
+
+    row = n_rows;
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16(bayer16, &args, row,
+                    &image_out_rgb16[row * args.n_cols]),
+            "row");
+
+    row = 0;
+
+
+    bad_args = args;
+    bad_args.n_rows = 0;
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16(bayer16, &bad_args, row,
+                    &image_out_rgb16[row * args.n_cols]),
+            "n_rows");
+
+    bad_args = args;
+    bad_args.n_rows = 45;
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16(bayer16, &bad_args, row,
+                    &image_out_rgb16[row * args.n_cols]),
+            "n_rows");
+
+    bad_args = args;
+    bad_args.n_cols = -1;
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16(bayer16, &bad_args, row,
+                    &image_out_rgb16[row * args.n_cols]),
+            "n_cols");
 
     bad_args = args;
     bad_args.n_cols = 43;
@@ -1276,6 +3589,392 @@ TEST(DemosaicDeathTest, Asserts) {
                     &image_out_rgb8[row * args.n_cols]),
             "n_cols");
 
+    int n_calls = 0;
+    demosaic_dispatcher dispatcher = {serial_dispatch, &n_calls, 4};
+    demosaic_dispatcher bad_dispatcher;
+
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_parallel(bayer16, &args, NULL,
+                    image_out_rgb16),
+            "dispatcher");
+
+    bad_dispatcher = dispatcher;
+    bad_dispatcher.dispatch = NULL;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_parallel(bayer16, &args, &bad_dispatcher,
+                    image_out_rgb16),
+            "dispatch");
+
+    bad_dispatcher = dispatcher;
+    bad_dispatcher.n_bands = 0;
+    ASSERT_DEATH(
+            demosaic_malvar_mono16_parallel(bayer16, &args, &bad_dispatcher,
+                    image_out_mono16),
+            "n_bands");
+
+    demosaic_plan batch_plan;
+    demosaic_plan_init(&batch_plan, &args);
+    const U16 * batch_in[2] = {bayer16, NULL};
+    demosaic_pix_rgb16 * batch_out[2] = {image_out_rgb16, image_out_rgb16};
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_batch(batch_in, &batch_plan, NULL, 2,
+                    batch_out),
+            "bayer\\[frame\\]");
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_batch(batch_in, &batch_plan, &dispatcher,
+                    -1, batch_out),
+            "n_frames");
+    bad_dispatcher = dispatcher;
+    bad_dispatcher.n_bands = 0;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_batch(batch_in, &batch_plan,
+                    &bad_dispatcher, 1, batch_out),
+            "n_bands");
+
+    bad_args = args;
+    bad_args.max_val = 0x100;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb8_parallel(bayer8, &bad_args, &dispatcher,
+                    image_out_rgb8),
+            "max_val");
+
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16_mono16(bayer16, &args, row,
+                    image_out_rgb16, NULL),
+            "output_mono_row");
+    bad_args = args;
+    bad_args.coefs.green = 1.5;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_mono16(bayer16, &bad_args,
+                    image_out_rgb16, image_out_mono16),
+            "coefs.green");
+
+    demosaic_plan plan;
+    bad_args = args;
+    bad_args.n_cols = 5;
+    ASSERT_DEATH(demosaic_plan_init(&plan, &bad_args), "n_cols");
+    bad_args = args;
+    bad_args.rshift = -1;
+    ASSERT_DEATH(demosaic_plan_init(&plan, &bad_args), "rshift");
+    bad_args = args;
+    bad_args.coefs.blue = -0.1;
+    ASSERT_DEATH(demosaic_plan_init(&plan, &bad_args), "coefs.blue");
+
+    demosaic_plan_init(&plan, &args);
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16_plan(bayer16, &plan, args.n_rows,
+                    image_out_rgb16),
+            "row");
+    ASSERT_DEATH(
+            demosaic_malvar_mono16_plan(bayer16, NULL, image_out_mono16),
+            "plan");
+    ASSERT_DEATH(
+            demosaic_malvar_rgb8_plan(bayer8, &plan, image_out_rgb8),
+            "max_val");
+    bad_args = args;
+    bad_args.rshift = 2;
+    demosaic_plan_init(&plan, &bad_args);
+    ASSERT_DEATH(
+            demosaic_malvar_row_mono16to8_plan(bayer16, &plan, 0,
+                    image_out_mono8from16),
+            "max_val_shifted");
+
+    demosaic_rect region = {0, 0, args.n_rows, args.n_cols};
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_tiled(bayer16, &args, &region, 0, 32,
+                    image_out_rgb16),
+            "tile_rows");
+    region.col = 1;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_tiled(bayer16, &args, &region, 8, 32,
+                    image_out_rgb16),
+            "n_cols");
+    region.col = 0;
+    region.n_rows = 0;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_tiled(bayer16, &args, &region, 8, 32,
+                    image_out_rgb16),
+            "n_rows");
+    ASSERT_DEATH(
+            demosaic_malvar_mono8_tiled(bayer8, &args, NULL, 8, 32,
+                    image_out_mono8),
+            "max_val");
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16to8_tiled(bayer16, &args, NULL, 8, 0,
+                    image_out_rgb8from16),
+            "tile_cols");
+
+    region.n_rows = 8;
+    region.n_cols = 8;
+    ASSERT_DEATH(
+            demosaic_malvar_region_rgb8(bayer8, &args, &region,
+                    image_out_rgb8),
+            "max_val");
+    ASSERT_DEATH(
+            demosaic_malvar_region_mono16(bayer16, &args, NULL,
+                    image_out_mono16),
+            "region");
+    region.row = args.n_rows - 4;
+    ASSERT_DEATH(
+            demosaic_malvar_region_mono16to8(bayer16, &args, &region,
+                    image_out_mono8from16),
+            "n_rows");
+
+    demosaic_args stream_args = args;
+    stream_args.n_rows = 4;
+    stream_args.n_cols = 4;
+    U16 frame16[16] = {0};
+    U16 line_buffer[DEMOSAIC_STREAM_LINES * 4];
+    demosaic_pix_rgb16 stream_row[4];
+    demosaic_stream stream;
+    demosaic_stream_init(&stream, &stream_args, line_buffer);
+    ASSERT_DEATH(
+            demosaic_malvar_stream_flush_rgb16(&stream, stream_row),
+            "n_lines_in");
+    for (int line = 0; line < stream_args.n_rows; line++) {
+        demosaic_malvar_stream_push_rgb16(&stream,
+                &frame16[line * stream_args.n_cols], stream_row);
+    }
+    ASSERT_DEATH(
+            demosaic_malvar_stream_push_rgb16(&stream, frame16, stream_row),
+            "n_lines_in");
+    bad_args = stream_args;
+    bad_args.n_rows = 3;
+    ASSERT_DEATH(
+            demosaic_stream_init(&stream, &bad_args, line_buffer),
+            "n_rows");
+
+    demosaic_plan streamed_plan;
+    demosaic_plan_init(&streamed_plan, &args);
+    streamed_plan.store = (demosaic_store) 2;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_plan(bayer16, &streamed_plan,
+                    image_out_rgb16),
+            "store");
+    streamed_plan.store = DEMOSAIC_STORE_STREAMING;
+    ASSERT_DEATH(
+            demosaic_malvar_mono8_plan(bayer8, &streamed_plan,
+                    image_out_mono8),
+            "max_val");
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_plan(bayer16, &streamed_plan, NULL),
+            "output");
+
+    demosaic_rect dirty = {0, 0, 2, 2};
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_dirty(bayer16, &args, &dirty, -1,
+                    image_out_rgb16),
+            "n_dirty");
+    ASSERT_DEATH(
+            demosaic_malvar_mono8_dirty(bayer8, &args, NULL, 1,
+                    image_out_mono8),
+            "dirty");
+    dirty.n_cols = n_cols + 1;
+    ASSERT_DEATH(
+            demosaic_malvar_mono16_dirty(bayer16, &args, &dirty, 1,
+                    image_out_mono16),
+            "n_cols");
+
+    static U8 scratch_pool[2 * DEMOSAIC_SCRATCH_ALIGN]
+            __attribute__((aligned(DEMOSAIC_SCRATCH_ALIGN)));
+    demosaic_scratch scratch;
+    ASSERT_DEATH(
+            demosaic_scratch_init(&scratch, &scratch_pool[1], 8),
+            "base");
+    ASSERT_DEATH(
+            demosaic_scratch_init(&scratch, scratch_pool, -1),
+            "n_bytes");
+    demosaic_scratch_init(&scratch, scratch_pool, sizeof(scratch_pool) - 1);
+    demosaic_scratch_take(&scratch, 1);
+    ASSERT_DEATH(
+            demosaic_scratch_take(&scratch, DEMOSAIC_SCRATCH_ALIGN - 1),
+            "n_taken");
+    ASSERT_DEATH(
+            demosaic_scratch_take(&scratch, 0),
+            "n_bytes");
+    ASSERT_DEATH(
+            demosaic_scratch_size(&stream_args, (demosaic_mode) 4),
+            "mode");
+    ASSERT_DEATH(
+            demosaic_working_set_size(&bad_args, DEMOSAIC_MODE_ROWS),
+            "n_rows");
+
+    U16 plane16[16];
+    U8 plane8[16];
+    demosaic_planes16 planes16 = {plane16, plane16, plane16, 3};
+    demosaic_planes8 planes8 = {plane8, plane8, plane8, 4};
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_planar(frame16, &stream_args, &planes16),
+            "stride");
+    planes16.green = NULL;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_planar(frame16, &stream_args, &planes16),
+            "green");
+    ASSERT_DEATH(
+            demosaic_malvar_row_rgb16to8_planar(frame16, &stream_args, 4,
+                    plane8, plane8, plane8),
+            "n_rows");
+    bad_args = stream_args;
+    bad_args.max_val = 0x0FFF;
+    bad_args.rshift = 0;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16to8_planar(frame16, &bad_args, &planes8),
+            "max_val");
+
+    demosaic_pitch pitch = {4 * sizeof(U16), 4 * sizeof(U16)};
+    ASSERT_DEATH(
+            demosaic_malvar_mono16_pitched(frame16, &stream_args, NULL,
+                    plane16),
+            "pitch");
+    pitch.input = 3 * sizeof(U16);
+    ASSERT_DEATH(
+            demosaic_malvar_mono16_pitched(frame16, &stream_args, &pitch,
+                    plane16),
+            "input");
+    pitch.input = 4 * sizeof(U16) + 1;
+    ASSERT_DEATH(
+            demosaic_malvar_mono16_pitched(frame16, &stream_args, &pitch,
+                    plane16),
+            "input");
+    pitch.input = 4 * sizeof(U16);
+    pitch.output = 4 * sizeof(demosaic_pix_rgb16) + 1;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_pitched(frame16, &stream_args, &pitch,
+                    stream_row),
+            "output");
+
+    ASSERT_DEATH(
+            demosaic_subsample_row_rgb16(frame16, &stream_args, 2, stream_row),
+            "row");
+    ASSERT_DEATH(
+            demosaic_subsample_mono8(plane8, &bad_args, plane8),
+            "max_val");
+    bad_args = stream_args;
+    bad_args.n_cols = 3;
+    ASSERT_DEATH(
+            demosaic_subsample_rgb16to8(frame16, &bad_args,
+                    (demosaic_pix_rgb8 *) plane8),
+            "n_cols");
+
+    bad_args = args;
+    bad_args.pattern = (demosaic_pattern) 4;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16(bayer16, &bad_args, image_out_rgb16),
+            "pattern");
+
+    demosaic_calibration bad_cal = {{0, 0, 0, 0}, {256, 256, 256, 256}};
+    bad_args = args;
+    bad_args.calibration = &bad_cal;
+    bad_cal.black[DEMOSAIC_CFA_GREEN_BLUE] = 0x1000;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16(bayer16, &bad_args, image_out_rgb16),
+            "black");
+    bad_cal.black[DEMOSAIC_CFA_GREEN_BLUE] = 0;
+    bad_cal.gain[DEMOSAIC_CFA_BLUE] = 0x4000;
+    ASSERT_DEATH(
+            demosaic_malvar_mono16(bayer16, &bad_args, image_out_mono16),
+            "gain");
+
+    demosaic_ccm bad_ccm = {{{1024, 0, 0}, {0, 1024, 0}, {0, 0, 1024}}};
+    bad_args = args;
+    bad_args.ccm = &bad_ccm;
+    bad_ccm.coef[1][2] = -0x40000;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16(bayer16, &bad_args, image_out_rgb16),
+            "row_sum");
+    // within the limit for raw pixels, but not once calibrated by gains of 2
+    bad_ccm.coef[1][2] = 100000;
+    bad_cal.gain[DEMOSAIC_CFA_BLUE] = 512;
+    bad_args.calibration = &bad_cal;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16(bayer16, &bad_args, image_out_rgb16),
+            "row_sum");
+
+    std::vector<U8> y_plane(n_rows * n_cols);
+    std::vector<U8> c_plane(n_rows * n_cols / 2);
+    demosaic_planes_yuv8 yuv = {&y_plane[0], &c_plane[0], &c_plane[0],
+            n_cols, n_cols / 2};
+    ASSERT_DEATH(
+            demosaic_malvar_yuv16to8(bayer16, &args, (demosaic_yuv_format) 2,
+                    &yuv),
+            "format");
+    yuv.chroma_stride = n_cols / 2 - 1;
+    ASSERT_DEATH(
+            demosaic_malvar_yuv16to8(bayer16, &args, DEMOSAIC_YUV422, &yuv),
+            "chroma_stride");
+    yuv.chroma_stride = n_cols / 2;
+    yuv.cr = NULL;
+    ASSERT_DEATH(
+            demosaic_malvar_yuv16to8(bayer16, &args, DEMOSAIC_YUV420, &yuv),
+            "cr");
+    ASSERT_DEATH(
+            demosaic_malvar_yuv8(bayer8, &args, DEMOSAIC_YUV420, &yuv),
+            "cr");
+
+    demosaic_packed packed = {bayer8, DEMOSAIC_PACKED_RAW10, 3 * n_cols};
+    std::vector<U16> packed_lines(DEMOSAIC_STREAM_LINES * n_cols);
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_packed(&packed, &args, NULL,
+                    image_out_rgb16),
+            "line_buffer");
+    packed.packing = (demosaic_packing) 2;
+    ASSERT_DEATH(
+            demosaic_malvar_rgb16_packed(&packed, &args, &packed_lines[0],
+                    image_out_rgb16),
+            "packing");
+    packed.packing = DEMOSAIC_PACKED_RAW12;
+    packed.pitch = 3 * n_cols / 2 - 1;
+    ASSERT_DEATH(
+            demosaic_malvar_row_mono16_packed(&packed, &args, 0,
+                    &packed_lines[0], image_out_mono16),
+            "pitch");
+    packed.pitch = 3 * n_cols / 2;
+    ASSERT_DEATH(
+            demosaic_malvar_row_mono16_packed(&packed, &args, n_rows,
+                    &packed_lines[0], image_out_mono16),
+            "row");
+    packed.data = NULL;
+    ASSERT_DEATH(
+            demosaic_malvar_mono16to8_packed(&packed, &args, &packed_lines[0],
+                    image_out_mono8from16),
+            "data");
+
+    demosaic_file_layout file_layout = {2, 2, DEMOSAIC_FILE_U16, 0, 0, 0};
+    demosaic_file file;
+    ASSERT_EQ(DEMOSAIC_FILE_OK, demosaic_file_create("file_death.raw",
+            0, 8, 1, &file));
+    ASSERT_EQ(DEMOSAIC_FILE_OK, demosaic_file_unmap(&file));
+    ASSERT_EQ(DEMOSAIC_FILE_OK,
+            demosaic_file_map("file_death.raw", &file_layout, &file));
+    ASSERT_DEATH(demosaic_file_bayer16(&file, 2), "frame");
+    ASSERT_DEATH(demosaic_file_bayer8(&file, 0), "format");
+    ASSERT_DEATH(demosaic_file_output(&file, 0), "writable");
+    ASSERT_EQ(DEMOSAIC_FILE_OK, demosaic_file_unmap(&file));
+    ASSERT_DEATH(demosaic_file_create("file_death.raw", 8,
+            (SIZE_MAX - 8) / 3 + 1, 3, &file), "frame_bytes");
+    ASSERT_DEATH(demosaic_file_create("file_death.raw", SIZE_MAX, 1, 1,
+            &file), "frame_bytes");
+    file_layout.header_bytes = 1;
+    ASSERT_DEATH(demosaic_file_map("file_death.raw", &file_layout, &file),
+            "header_bytes");
+    file_layout.header_bytes = 0;
+    file_layout.row_pitch = 2;
+    ASSERT_DEATH(demosaic_file_map("file_death.raw", &file_layout, &file),
+            "row_pitch");
+    file_layout.row_pitch = 0;
+    file_layout.format = DEMOSAIC_FILE_RAW10;
+    ASSERT_DEATH(demosaic_file_map("file_death.raw", &file_layout, &file),
+            "n_cols");
+    remove("file_death.raw");
+
+    ASSERT_DEATH(demosaic_engine_init((demosaic_engine) 6), "engine");
+    ASSERT_DEATH(demosaic_engine_supported((demosaic_engine) -1), "engine");
+    for (int e = DEMOSAIC_ENGINE_SCALAR; e <= DEMOSAIC_ENGINE_NEON; e++) {
+        if (!demosaic_engine_supported((demosaic_engine) e)) {
+            ASSERT_DEATH(demosaic_engine_init((demosaic_engine) e), "engine");
+        }
+    }
+
     printf("death tests complete.\n");
 
 